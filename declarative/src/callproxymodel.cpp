@@ -44,6 +44,16 @@ void CallProxyModel::setGroupBy(GroupBy grouping)
     }
 }
 
+int CallProxyModel::queryPriority() const
+{
+    return m_source->queryPriority();
+}
+
+void CallProxyModel::setQueryPriority(int priority)
+{
+    m_source->setQueryPriority(priority);
+}
+
 void CallProxyModel::setSortRole(int role)
 {
     QSortFilterProxyModel::setSortRole(role);
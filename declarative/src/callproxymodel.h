@@ -47,6 +47,7 @@ class CallProxyModel : public QSortFilterProxyModel, public QDeclarativeParserSt
     Q_ENUMS(GroupBy)
 
     Q_PROPERTY(GroupBy groupBy READ groupBy WRITE setGroupBy NOTIFY groupByChanged)
+    Q_PROPERTY(int queryPriority READ queryPriority WRITE setQueryPriority)
     Q_INTERFACES(QDeclarativeParserStatus)
 public:
     enum EventRole {
@@ -125,6 +126,9 @@ public:
     GroupBy groupBy() const;
     void setGroupBy(GroupBy grouping);
 
+    int queryPriority() const;
+    void setQueryPriority(int priority);
+
 public Q_SLOTS:
     void getEvents();
     void setSortRole(int role);
@@ -53,6 +53,8 @@ public:
     bool useBackgroundThread() { return backgroundThread() != 0; }
     void setUseBackgroundThread(bool on);
 
+    Q_PROPERTY(int queryPriority READ queryPriority WRITE setQueryPriority)
+
     Q_PROPERTY(int groupId READ groupId WRITE setGroupId NOTIFY groupIdChanged)
     int groupId() const { return m_groupId; }
     void setGroupId(int groupId);
@@ -47,6 +47,8 @@ public:
     bool useBackgroundThread() { return backgroundThread() != 0; }
     void setUseBackgroundThread(bool on);
 
+    Q_PROPERTY(int queryPriority READ queryPriority WRITE setQueryPriority)
+
     /* Create an event for an outgoing plain text message, which will be
      * in the sending state. Returns the event ID, which should be passed
      * using the x-commhistory-event-id header in a Telepathy message to
@@ -36,5 +36,6 @@ Adaptor::Adaptor(QObject *parent)
     qDBusRegisterMetaType<QList<CommHistory::MessagePart> >();
     qDBusRegisterMetaType<CommHistory::Group>();
     qDBusRegisterMetaType<QList<CommHistory::Group> >();
-    setAutoRelaySignals(true);
+    // UpdatesEmitter emits our signals when it flushes its queue
+    setAutoRelaySignals(false);
 }
@@ -39,6 +39,9 @@ public:
     Adaptor(QObject *parent = 0);
 
 Q_SIGNALS:
+#ifndef Q_MOC_RUN
+public:
+#endif
     void eventsAdded(const QList<CommHistory::Event> &events);
 
     void eventsUpdated(const QList<CommHistory::Event> &events);
@@ -52,6 +55,18 @@ Q_SIGNALS:
     void groupsUpdatedFull(const QList<CommHistory::Group> &groups);
 
     void groupsDeleted(const QList<int> &groupIds);
+
+    /*!
+     * All changes of one coalescing window, see UpdatesEmitter. Sent
+     * before the per-type signals of the same window.
+     */
+    void updatesBatched(const QList<CommHistory::Event> &addedEvents,
+                        const QList<CommHistory::Event> &updatedEvents,
+                        const QList<int> &deletedEventIds,
+                        const QList<CommHistory::Group> &addedGroups,
+                        const QList<int> &updatedGroupIds,
+                        const QList<CommHistory::Group> &updatedGroups,
+                        const QList<int> &deletedGroupIds);
 };
 
 }
@@ -159,41 +159,39 @@ void CallModelPrivate::eventsReceivedSlot(int start, int end, QList<CommHistory:
     while (i.hasNext()) {
         Event event = i.next();
 
-        bool replaced = false;
-        QModelIndex index;
-        for (int row = 0; row < eventRootItem->childCount(); row++) {
-            if (belongToSameGroup(eventRootItem->eventAt(row), event)
-                || eventRootItem->eventAt(row).id() == event.id()) {
-                qDebug() << "replacing row" << row;
-                replaced = true;
-                index = q->createIndex(row, 0, eventRootItem->child(row));
-
-                eventRootItem->child(row)->setEvent(event);
-                QModelIndex bottom = q->createIndex(row,
-                                                    EventModel::NumberOfColumns - 1,
-                                                    eventRootItem->child(row));
-                emit q->dataChanged(index, bottom);
-                updatedGroups.remove(TrackerIOPrivate::makeCallGroupURI(event));
-
-                // if we had an audio and video call group for the same
-                // contact and the latest audio call gets upgraded (or
-                // vice versa), there may now be two rows for the same
-                // group, so we have to remove the other one.
-                for (int dupe = index.row() + 1; dupe < eventRootItem->childCount(); dupe++) {
-                    Event e = eventRootItem->eventAt(dupe);
-                    if (belongToSameGroup(e, event)) {
-                        qDebug() << Q_FUNC_INFO << "remove" << dupe << e.toString();
-                        emit q->beginRemoveRows(QModelIndex(), dupe, dupe);
-                        eventRootItem->removeAt(dupe);
-                        emit q->endRemoveRows();
-                        break;
-                    }
-                }
-                break;
-            }
-        }
+        // an upgraded call may move to another call group, so look for
+        // the event itself as well
+        EventTreeItem *item = findCallGroupItem(event);
+        int idRow = eventRootItem->findChild(event.id());
+        if (idRow != -1 && (!item || idRow < item->row()))
+            item = eventRootItem->child(idRow);
 
-        if (!replaced) {
+        if (item) {
+            int row = item->row();
+            qDebug() << "replacing row" << row;
+            QModelIndex index = q->createIndex(row, 0, item);
+
+            setCallGroupEvent(item, event);
+            QModelIndex bottom = q->createIndex(row,
+                                                EventModel::NumberOfColumns - 1,
+                                                item);
+            emit q->dataChanged(index, bottom);
+            updatedGroups.remove(TrackerIOPrivate::makeCallGroupURI(event));
+
+            // if we had an audio and video call group for the same
+            // contact and the latest audio call gets upgraded (or
+            // vice versa), there may now be two rows for the same
+            // group, so we have to remove the other one.
+            EventTreeItem *dupeItem = findCallGroupItem(event, item, row + 1);
+            if (dupeItem) {
+                int dupe = dupeItem->row();
+                qDebug() << Q_FUNC_INFO << "remove" << dupe << dupeItem->event().toString();
+                emit q->beginRemoveRows(QModelIndex(), dupe, dupe);
+                unindexCallGroupItem(dupeItem);
+                eventRootItem->removeAt(dupe);
+                emit q->endRemoveRows();
+            }
+        } else {
             // didn't find an old row to overwrite -> insert new row in the appropriate spot
             if (!event.contacts().isEmpty()) {
                 contactCache.insert(qMakePair(event.localUid(), event.remoteUid()), event.contacts());
@@ -206,7 +204,9 @@ void CallModelPrivate::eventsReceivedSlot(int start, int end, QList<CommHistory:
             }
 
             q->beginInsertRows(QModelIndex(), row, row);
-            eventRootItem->insertChildAt(row, new EventTreeItem(event, eventRootItem));
+            EventTreeItem *newItem = new EventTreeItem(event, eventRootItem);
+            eventRootItem->insertChildAt(row, newItem);
+            indexCallGroupItem(newItem);
             q->endInsertRows();
 
             updatedGroups.remove(TrackerIOPrivate::makeCallGroupURI(event));
@@ -217,14 +217,14 @@ void CallModelPrivate::eventsReceivedSlot(int start, int end, QList<CommHistory:
         qDebug() << Q_FUNC_INFO << "remaining call groups:" << updatedGroups;
         // no results for call group means it has been emptied, remove from list
         foreach (QString group, updatedGroups.values()) {
-            for (int row = 0; row < eventRootItem->childCount(); row++) {
-                if (TrackerIOPrivate::makeCallGroupURI(eventRootItem->eventAt(row)) == group) {
-                    qDebug() << Q_FUNC_INFO << "remove" << row << eventRootItem->eventAt(row).toString();
-                    emit q->beginRemoveRows(QModelIndex(), row, row);
-                    eventRootItem->removeAt(row);
-                    emit q->endRemoveRows();
-                    break;
-                }
+            EventTreeItem *item = findCallGroupItem(group);
+            if (item) {
+                int row = item->row();
+                qDebug() << Q_FUNC_INFO << "remove" << row << item->event().toString();
+                emit q->beginRemoveRows(QModelIndex(), row, row);
+                unindexCallGroupItem(item);
+                eventRootItem->removeAt(row);
+                emit q->endRemoveRows();
             }
         }
     }
@@ -245,7 +245,7 @@ void CallModelPrivate::modelUpdatedSlot( bool successful )
     }
 }
 
-bool CallModelPrivate::belongToSameGroup( const Event &e1, const Event &e2 )
+bool CallModelPrivate::belongToSameGroup( const Event &e1, const Event &e2 ) const
 {
     if (sortBy == CallModel::SortByContact
         && remoteAddressMatch(e1.remoteUid(), e2.remoteUid(), NormalizeFlagKeepDialString)
@@ -266,6 +266,95 @@ bool CallModelPrivate::belongToSameGroup( const Event &e1, const Event &e2 )
     return false;
 }
 
+bool CallModelPrivate::hasCallGroupIndex() const
+{
+    return isInTreeMode
+        && (sortBy == CallModel::SortByContact
+            || sortBy == CallModel::SortByContactAndType);
+}
+
+EventTreeItem *CallModelPrivate::findCallGroupItem(const Event &event,
+                                                   EventTreeItem *exclude,
+                                                   int minRow) const
+{
+    EventTreeItem *match = 0;
+    int matchRow = -1;
+
+    // with SortByContactAndType there is one item per call type, so a
+    // call group URI can have a few items
+    if (!hasCallGroupIndex()) {
+        for (int row = minRow; row < eventRootItem->childCount(); row++) {
+            EventTreeItem *item = eventRootItem->child(row);
+            if (item != exclude && belongToSameGroup(item->event(), event))
+                return item;
+        }
+        return 0;
+    }
+
+    QString key = TrackerIOPrivate::makeCallGroupURI(event);
+    QMultiHash<QString, EventTreeItem *>::const_iterator i = callGroupItems.constFind(key);
+    while (i != callGroupItems.constEnd() && i.key() == key) {
+        EventTreeItem *item = i.value();
+        ++i;
+        if (item == exclude)
+            continue;
+        int row = item->row();
+        if (row < minRow || (match && row > matchRow))
+            continue;
+        if (belongToSameGroup(item->event(), event)) {
+            match = item;
+            matchRow = row;
+        }
+    }
+
+    return match;
+}
+
+EventTreeItem *CallModelPrivate::findCallGroupItem(const QString &callGroupUri) const
+{
+    if (!hasCallGroupIndex()) {
+        for (int row = 0; row < eventRootItem->childCount(); row++) {
+            if (TrackerIOPrivate::makeCallGroupURI(eventRootItem->eventAt(row)) == callGroupUri)
+                return eventRootItem->child(row);
+        }
+        return 0;
+    }
+
+    EventTreeItem *match = 0;
+    foreach (EventTreeItem *item, callGroupItems.values(callGroupUri)) {
+        if (!match || item->row() < match->row())
+            match = item;
+    }
+
+    return match;
+}
+
+void CallModelPrivate::indexCallGroupItem(EventTreeItem *item)
+{
+    if (!hasCallGroupIndex())
+        return;
+
+    QString key = TrackerIOPrivate::makeCallGroupURI(item->event());
+    callGroupItems.insert(key, item);
+    callGroupKeys.insert(item, key);
+}
+
+void CallModelPrivate::unindexCallGroupItem(EventTreeItem *item)
+{
+    QHash<EventTreeItem *, QString>::iterator i = callGroupKeys.find(item);
+    if (i != callGroupKeys.end()) {
+        callGroupItems.remove(i.value(), item);
+        callGroupKeys.erase(i);
+    }
+}
+
+void CallModelPrivate::setCallGroupEvent(EventTreeItem *item, const Event &event)
+{
+    unindexCallGroupItem(item);
+    item->setEvent(event);
+    indexCallGroupItem(item);
+}
+
 int CallModelPrivate::calculateEventCount( EventTreeItem *item )
 {
     int count = -1;
@@ -375,27 +464,29 @@ bool CallModelPrivate::fillModel( int start, int end, QList<CommHistory::Event>
             case CallModel::SortByContactAndType:
             {
                 QList<EventTreeItem *> topLevelItems;
-                // get the first event and save it as top level item
-                Event event = events.first();
-                topLevelItems.append(new EventTreeItem(event));
-                if (!event.contacts().isEmpty())
-                    contactCache.insert(qMakePair(event.localUid(), event.remoteUid()), event.contacts());
-
-                for (int i = 1; i < events.count(); i++) {
-                    Event event = events.at(i);
+                // call group URI -> new top level items
+                QMultiHash<QString, EventTreeItem *> newGroups;
+
+                foreach (const Event &event, events) {
                     if (!event.contacts().isEmpty())
                         contactCache.insert(qMakePair(event.localUid(), event.remoteUid()), event.contacts());
 
+                    // ignore matching events because the already existing
+                    // entry has to be more recent
+                    QString key = TrackerIOPrivate::makeCallGroupURI(event);
                     bool found = false;
-                    for (int i = 0; i < topLevelItems.count() && !found; ++i) {
-                        // ignore matching events because the already existing
-                        // entry has to be more recent
-                        if (belongToSameGroup(topLevelItems.at(i)->event(), event))
+                    foreach (EventTreeItem *item, newGroups.values(key)) {
+                        if (belongToSameGroup(item->event(), event)) {
                             found = true;
+                            break;
+                        }
                     }
 
-                    if (!found)
-                        topLevelItems.append(new EventTreeItem(event));
+                    if (!found) {
+                        EventTreeItem *item = new EventTreeItem(event);
+                        topLevelItems.append(item);
+                        newGroups.insert(key, item);
+                    }
                 }
 
                 // save top level items into the model
@@ -403,6 +494,7 @@ bool CallModelPrivate::fillModel( int start, int end, QList<CommHistory::Event>
                 foreach ( EventTreeItem *item, topLevelItems )
                 {
                     eventRootItem->appendChild( item );
+                    indexCallGroupItem( item );
                 }
                 q->endInsertRows();
 
@@ -523,24 +615,17 @@ void CallModelPrivate::addToModel( Event &event )
         case CallModel::SortByContactAndType:
         {
             // find match, update count if needed, move to top
-            int matchingRow = -1;
-            for (int i = 0; i < eventRootItem->childCount(); i++) {
-                if (belongToSameGroup(eventRootItem->child(i)->event(), event)) {
-                    matchingRow = i;
-                    break;
-                }
-            }
-
-            if (matchingRow != -1) {
-                EventTreeItem *matchingItem = eventRootItem->child(matchingRow);
+            EventTreeItem *matchingItem = findCallGroupItem(event);
+            int matchingRow = matchingItem ? matchingItem->row() : -1;
 
+            if (matchingItem) {
                 if (matchingItem->event().direction() == event.direction()
                     && matchingItem->event().isMissedCall() == event.isMissedCall())
                     event.setEventCount(matchingItem->event().eventCount() + 1);
                 else
                     event.setEventCount(1);
 
-                matchingItem->setEvent(event);
+                setCallGroupEvent(matchingItem, event);
 
                 if (matchingRow == 0) {
                     // already at the top, update row
@@ -557,7 +642,9 @@ void CallModelPrivate::addToModel( Event &event )
                 // no match, insert new row at top
                 emit q->beginInsertRows(QModelIndex(), 0, 0);
                 event.setEventCount(1);
-                eventRootItem->prependChild(new EventTreeItem(event));
+                EventTreeItem *item = new EventTreeItem(event);
+                eventRootItem->prependChild(item);
+                indexCallGroupItem(item);
                 emit q->endInsertRows();
             }
 
@@ -697,18 +784,21 @@ QModelIndex CallModelPrivate::findEvent( int id ) const
         return EventModelPrivate::findEvent(id);
     }
 
-    for ( int row = 0; row < eventRootItem->childCount(); row++ )
+    // check top level items
+    int row = eventRootItem->findChild( id );
+    if ( row != -1 )
     {
-        // check top level item
-        if ( eventRootItem->child( row )->event().id() == id )
-        {
-            return q->createIndex( row, 0, eventRootItem->child( row ) );
-        }
-        // loop through all grouped events
-        EventTreeItem *currentGroup = eventRootItem->child( row );
-        for ( int column = 0; column < currentGroup->childCount(); column++ )
+        return q->createIndex( row, 0, eventRootItem->child( row ) );
+    }
+
+    // look through all grouped events
+    if ( eventRootItem->hasNestedChildren() )
+    {
+        for ( row = 0; row < eventRootItem->childCount(); row++ )
         {
-            if ( currentGroup->child( column )->event().id() == id )
+            EventTreeItem *currentGroup = eventRootItem->child( row );
+            int column = currentGroup->findChild( id );
+            if ( column != -1 )
             {
                 return q->createIndex( row, column, currentGroup->child( column ) );
             }
@@ -772,6 +862,7 @@ void CallModelPrivate::deleteFromModel( int id )
         if ( !isRegroupingNeeded )
         {
             q->beginRemoveRows( index.parent(), row, row );
+            unindexCallGroupItem( eventRootItem->child( row ) );
             eventRootItem->removeAt( row );
         }
         // otherwise delete the current and the following one
@@ -779,6 +870,8 @@ void CallModelPrivate::deleteFromModel( int id )
         else
         {
             q->beginRemoveRows( index.parent(), row, row + 1 );
+            unindexCallGroupItem( eventRootItem->child( row + 1 ) );
+            unindexCallGroupItem( eventRootItem->child( row ) );
             eventRootItem->removeAt( row + 1 );
             eventRootItem->removeAt( row );
             emit q->dataChanged( q->createIndex( row - 1, 0, eventRootItem->child( row - 1 ) ),
@@ -797,6 +890,13 @@ void CallModelPrivate::deleteFromModel( int id )
     }
 }
 
+void CallModelPrivate::clearEvents()
+{
+    callGroupItems.clear();
+    callGroupKeys.clear();
+    EventModelPrivate::clearEvents();
+}
+
 void CallModelPrivate::deleteCallGroup( const Event &event, bool typed )
 {
     qDebug() << Q_FUNC_INFO << event.id();
@@ -24,6 +24,8 @@
 #define COMMHISTORY_CALLMODEL_P_H
 
 #include <QList>
+#include <QHash>
+#include <QMultiHash>
 
 #include "callmodel.h"
 #include "eventmodel.h"
@@ -58,7 +60,7 @@ public:
 
     bool fillModel( int start, int end, QList<CommHistory::Event> events );
 
-    bool belongToSameGroup( const Event &e1, const Event &e2 );
+    bool belongToSameGroup( const Event &e1, const Event &e2 ) const;
 
     void addToModel( Event &event );
 
@@ -70,6 +72,46 @@ public:
 
     void deleteFromModel( int id );
 
+    void clearEvents();
+
+    /*!
+     * True if top level items are grouped by contact and indexed by
+     * call group URI.
+     */
+    bool hasCallGroupIndex() const;
+
+    /*!
+     * Find the top level item of the call group the event belongs to.
+     *
+     * \param event Event to match.
+     * \param exclude Item to skip, if any.
+     * \param minRow Lowest row to consider.
+     * \return matching item with the lowest row, or 0 if none.
+     */
+    EventTreeItem *findCallGroupItem(const Event &event,
+                                     EventTreeItem *exclude = 0,
+                                     int minRow = 0) const;
+
+    /*!
+     * Find the top level item with the lowest row in a call group.
+     */
+    EventTreeItem *findCallGroupItem(const QString &callGroupUri) const;
+
+    /*!
+     * Add top level item to the call group index.
+     */
+    void indexCallGroupItem(EventTreeItem *item);
+
+    /*!
+     * Remove top level item from the call group index.
+     */
+    void unindexCallGroupItem(EventTreeItem *item);
+
+    /*!
+     * Replace the event of a top level item and update its index entry.
+     */
+    void setCallGroupEvent(EventTreeItem *item, const Event &event);
+
     void deleteCallGroup( const Event &event, bool typed );
 
     /*!
@@ -96,6 +138,9 @@ public:
     bool hasBeenFetched;
     QSet<QString> countedUids;
     QSet<QString> updatedGroups;
+    // call group URI -> top level items, and the reverse for removal
+    QMultiHash<QString, EventTreeItem *> callGroupItems;
+    QHash<EventTreeItem *, QString> callGroupKeys;
 };
 
 }
@@ -25,13 +25,46 @@
 #include <QSparqlResult>
 #include <QSparqlError>
 #include <QTimer>
+#include <QStringList>
 
 #include "committingtransaction.h"
 #include "committingtransaction_p.h"
+#include "queryregistry.h"
+#include "sparqlbackend.h"
+#include "telemetry.h"
 
 namespace CommHistory
 {
 
+namespace {
+
+// SparqlBackend on a connection owned by the caller of run()
+class ConnectionBackend : public SparqlBackend
+{
+public:
+    ConnectionBackend(QSparqlConnection &connection) : m_connection(connection) {}
+
+    QSparqlResult* exec(const QSparqlQuery &query)
+    {
+        return m_connection.exec(query);
+    }
+
+    QSparqlResult* syncExec(const QSparqlQuery &query)
+    {
+        return m_connection.syncExec(query);
+    }
+
+    bool hasFeature(QSparqlConnection::Feature feature) const
+    {
+        return m_connection.hasFeature(feature);
+    }
+
+private:
+    QSparqlConnection &m_connection;
+};
+
+}
+
 void CommittingTransactionPrivate::DelayedSignal::addArgument(QGenericArgument &arg)
 {
     if (qstrlen(arg.name())) {
@@ -68,12 +101,20 @@ CommittingTransactionPrivate::~CommittingTransactionPrivate()
 
     qDeleteAll(pendingQueries);
     pendingQueries.clear();
+    qDeleteAll(unmergedQueries);
+    unmergedQueries.clear();
+
+    delete ownedConnection;
 }
 
 bool CommittingTransactionPrivate::runNextQuery()
 {
     qDebug() << Q_FUNC_INFO;
 
+    if (!commitTimer.isValid())
+        commitTimer.start();
+    ++executedQueries;
+
     PendingQuery *query = pendingQueries.first();
     query->result = connection->exec(query->query);
     if (query->result->hasError()) {
@@ -94,6 +135,85 @@ bool CommittingTransactionPrivate::isEmpty() const
     return pendingQueries.isEmpty();
 }
 
+bool CommittingTransactionPrivate::isMergeable() const
+{
+    if (started || aborted || noMerge || pendingQueries.isEmpty())
+        return false;
+
+    foreach (PendingQuery *query, pendingQueries) {
+        if (query->callback
+            || (query->query.type() != QSparqlQuery::InsertStatement
+                && query->query.type() != QSparqlQuery::DeleteStatement))
+            return false;
+    }
+
+    return true;
+}
+
+void CommittingTransactionPrivate::merge(const QList<CommittingTransaction *> &transactions)
+{
+    if (transactions.isEmpty())
+        return;
+
+    QStringList updates;
+    foreach (PendingQuery *query, pendingQueries)
+        updates << query->query.preparedQueryText();
+
+    foreach (CommittingTransaction *t, transactions) {
+        foreach (PendingQuery *query, t->d->pendingQueries)
+            updates << query->query.preparedQueryText();
+        mergedTransactions.append(t);
+    }
+
+    PendingQuery *merged = new PendingQuery;
+    merged->query = QSparqlQuery(updates.join(QLatin1String(" ")),
+                                 QSparqlQuery::InsertStatement);
+    merged->result = 0;
+    merged->callback = 0;
+
+    unmergedQueries = pendingQueries;
+    pendingQueries.clear();
+    pendingQueries.append(merged);
+}
+
+int CommittingTransactionPrivate::mergedCount() const
+{
+    return mergedTransactions.size();
+}
+
+void CommittingTransactionPrivate::splitMerged()
+{
+    if (unmergedQueries.isEmpty())
+        return;
+
+    qDeleteAll(pendingQueries);
+    pendingQueries = unmergedQueries;
+    unmergedQueries.clear();
+    noMerge = true;
+    error = false;
+
+    // still queued after us in TrackerIO, will run one by one
+    foreach (QPointer<CommittingTransaction> t, mergedTransactions) {
+        if (t)
+            t->d->noMerge = true;
+    }
+    mergedTransactions.clear();
+}
+
+void CommittingTransactionPrivate::markMergedFinished()
+{
+    qDeleteAll(unmergedQueries);
+    unmergedQueries.clear();
+
+    foreach (QPointer<CommittingTransaction> t, mergedTransactions) {
+        if (t) {
+            qDeleteAll(t->d->pendingQueries);
+            t->d->pendingQueries.clear();
+            t->d->started = true;
+        }
+    }
+}
+
 void CommittingTransactionPrivate::handleCallbacks(PendingQuery *query)
 {
     qDebug() << Q_FUNC_INFO;
@@ -154,11 +274,53 @@ void CommittingTransactionPrivate::finished()
         return;
     }
 
-    // all done
+    if (!mergedTransactions.isEmpty()) {
+        if (error && !aborted) {
+            // the combined update was rejected as a whole; retry
+            // separately to attribute the error
+            qWarning() << Q_FUNC_INFO << "merged update failed, running"
+                       << mergedTransactions.size() + 1 << "transactions separately";
+            splitMerged();
+            QTimer::singleShot(0, this, SLOT(runNextQuery()));
+            return;
+        }
+
+        // mark the merged transactions finished before anybody reacts
+        // to our finished() and looks at the queue
+        markMergedFinished();
+        QList<QPointer<CommittingTransaction> > merged = mergedTransactions;
+        mergedTransactions.clear();
+
+        QueryRegistry::instance()->invalidate();
+        addTelemetry();
+        sendSignals();
+        emit q->finished();
+
+        foreach (QPointer<CommittingTransaction> t, merged) {
+            if (t) {
+                t->d->error = error;
+                t->d->sendSignals();
+                emit t->finished();
+            }
+        }
+        return;
+    }
+
+    // all done; shared query results may predate the update
+    QueryRegistry::instance()->invalidate();
+    addTelemetry();
     sendSignals();
     emit q->finished();
 }
 
+void CommittingTransactionPrivate::addTelemetry()
+{
+    if (Telemetry::isEnabled() && commitTimer.isValid())
+        Telemetry::instance()->addTransaction(executedQueries,
+                                              commitTimer.nsecsElapsed() / 1000,
+                                              error);
+}
+
 CommittingTransaction::CommittingTransaction(QObject *parent) : QObject(parent),
         d(new CommittingTransactionPrivate(this))
 {
@@ -191,6 +353,16 @@ void CommittingTransaction::addSignal(bool onError,
 }
 
 bool CommittingTransaction::run(QSparqlConnection &connection, bool isBlocking)
+{
+    if (isRunning()) return true;
+
+    delete d->ownedConnection;
+    d->ownedConnection = new ConnectionBackend(connection);
+
+    return run(*d->ownedConnection, isBlocking);
+}
+
+bool CommittingTransaction::run(SparqlBackend &connection, bool isBlocking)
 {
     qDebug() << Q_FUNC_INFO;
 
@@ -34,6 +34,7 @@ class QSparqlQuery;
 namespace CommHistory {
 
 class CommittingTransactionPrivate;
+class SparqlBackend;
 
 class LIBCOMMHISTORY_EXPORT CommittingTransaction : public QObject
 {
@@ -59,7 +60,12 @@ public:
                    QGenericArgument arg1,
                    QGenericArgument arg2 = QGenericArgument());
 
+    /*!
+     * Execute the queries of the transaction on connection, which has to
+     * stay valid until finished() is emitted.
+     */
     bool run(QSparqlConnection &connection, bool isBlocking = false);
+    bool run(SparqlBackend &connection, bool isBlocking = false);
 
     bool isRunning() const;
     bool isFinished() const;
@@ -28,8 +28,9 @@
 #include <QPointer>
 #include <QWeakPointer>
 #include <QMetaType>
+#include <QTime>
+#include <QElapsedTimer>
 
-#include <QSparqlConnection>
 #include <QSparqlQuery>
 
 class QSparqlResult;
@@ -37,6 +38,7 @@ class QSparqlResult;
 namespace CommHistory {
 
 class CommittingTransaction;
+class SparqlBackend;
 
 class CommittingTransactionPrivate : public QObject
 {
@@ -53,10 +55,15 @@ public:
 
     CommittingTransactionPrivate(CommittingTransaction *parent) :
         q(parent),
+        connection(0),
+        ownedConnection(0),
         error(false),
         started(false),
-        aborted(false)
+        aborted(false),
+        noMerge(false),
+        executedQueries(0)
     {
+        commitTimer.invalidate();
     }
 
     ~CommittingTransactionPrivate();
@@ -68,11 +75,41 @@ public:
     void handleCallbacks(PendingQuery *query);
     void sendSignals();
 
+    /*!
+     * True if the transaction hasn't started and consists only of
+     * updates without callbacks, i.e. nothing needs to run between its
+     * queries and those of a neighbouring transaction.
+     */
+    bool isMergeable() const;
+
+    /*!
+     * Run the queries of this transaction and of the given following
+     * transactions as one update. On success the merged transactions
+     * finish right after this one, each with its own signals. If the
+     * update fails, nothing was applied and every transaction is run
+     * again separately so that the error reaches the right one.
+     */
+    void merge(const QList<CommittingTransaction *> &transactions);
+
+    int mergedCount() const;
+
+    /*!
+     * Undo merge(): restore the own queries and mark this and the
+     * merged transactions to run separately.
+     */
+    void splitMerged();
+
+    // time since TrackerIO::commit() queued the transaction
+    QTime queuedTime;
+
 private Q_SLOTS:
     bool runNextQuery();
     void finished();
 
 private:
+    void markMergedFinished();
+    void addTelemetry();
+
     // committing transactions
     // store model signals that should be emitted on transaction commit
     struct DelayedSignal {
@@ -90,12 +127,23 @@ private:
 
     QList<DelayedSignal> modelSignals;
 
-    QSparqlConnection *connection;
+    SparqlBackend *connection;
+    // wrapper created by run(QSparqlConnection&)
+    SparqlBackend *ownedConnection;
     QList<PendingQuery *> pendingQueries;
     bool error;
     bool started;
     bool aborted;
 
+    // original queries while a merged update runs in their place
+    QList<PendingQuery *> unmergedQueries;
+    QList<QPointer<CommittingTransaction> > mergedTransactions;
+    bool noMerge;
+
+    // for Telemetry, from the first update to finished()
+    QElapsedTimer commitTimer;
+    int executedQueries;
+
     friend class CommittingTransaction;
 };
 
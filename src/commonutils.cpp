@@ -21,8 +21,11 @@
 ******************************************************************************/
 
 #include <QString>
-#include <QRegExp>
+#include <QCoreApplication>
+#include <QThread>
 #include <QSettings>
+#include <QMutex>
+#include <QHash>
 
 #include "commonutils.h"
 #include "libcommhistoryexport.h"
@@ -31,37 +34,142 @@ namespace CommHistory {
 
 static const int DEFAULT_PHONE_NUMBER_MATCH_LENGTH = 7;
 static int numberMatchLength = 0;
+// uids kept by internUid(); more than a device has accounts and active
+// contacts, but a bound for processes walking the whole history
+static const int MAX_INTERNED_UIDS = 4096;
+
+struct UidPool {
+    QMutex mutex;
+    // uid -> interned again since the last sweep
+    QHash<QString, bool> uids;
+
+    void sweep();
+};
+Q_GLOBAL_STATIC(UidPool, uidPool)
+
+void UidPool::sweep()
+{
+    // drop uids not asked for since the last sweep; the strings handed
+    // out stay valid, they are only no longer shared with new ones
+    QMutableHashIterator<QString, bool> i(uids);
+    while (i.hasNext()) {
+        i.next();
+        if (i.value())
+            i.setValue(false);
+        else
+            i.remove();
+    }
+
+    // everything was in use, start over rather than grow
+    if (uids.size() >= MAX_INTERNED_UIDS)
+        uids.clear();
+}
+
+namespace {
+
+enum CharClass {
+    InvalidChar = 0,
+    DigitChar,       // 0-9 and other unicode digits
+    SymbolChar,      // # * +
+    PunctuationChar, // ( ) - . and space
+    DialStringChar   // X W P, starts the dial string
+};
+
+#define I InvalidChar
+#define D DigitChar
+#define S SymbolChar
+#define P PunctuationChar
+#define W DialStringChar
+
+// class of each ASCII character
+static const uchar asciiCharClass[128] = {
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  // 0x00
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  // 0x10
+    P, I, I, S, I, I, I, I, P, P, S, S, I, P, P, I,  // 0x20
+    D, D, D, D, D, D, D, D, D, D, I, I, I, I, I, I,  // 0x30
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  // 0x40
+    W, I, I, I, I, I, I, W, W, I, I, I, I, I, I, I,  // 0x50
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  // 0x60
+    W, I, I, I, I, I, I, W, W, I, I, I, I, I, I, I   // 0x70
+};
+
+#undef I
+#undef D
+#undef S
+#undef P
+#undef W
+
+inline CharClass charClass(QChar c)
+{
+    ushort u = c.unicode();
+    if (u < 128)
+        return CharClass(asciiCharClass[u]);
+    return c.isDigit() ? DigitChar : InvalidChar;
+}
+
+}
 
 LIBCOMMHISTORY_EXPORT QString normalizePhoneNumber(const QString &number,
                                                    PhoneNumberNormalizeFlags flags)
 {
-    QString result(number);
+    const QChar *begin = number.constData();
+    const QChar *end = begin + number.length();
 
-    QRegExp sipRegExp("^sips?:(.*)@");
-    if (sipRegExp.indexIn(number) != -1)
-        result = sipRegExp.cap(1);
+    // take the user part of sip:user@host and sips:user@host, up to
+    // the last @
+    if (number.startsWith(QLatin1String("sip:"))
+        || number.startsWith(QLatin1String("sips:"))) {
+        int prefix = number.at(3) == QLatin1Char(':') ? 4 : 5;
+        int at = number.lastIndexOf(QLatin1Char('@'));
+        if (at >= prefix) {
+            begin += prefix;
+            end = number.constData() + at;
+        }
+    }
 
     // artistic reinterpretation of Fremantle code...
 
-    if (flags & NormalizeFlagRemovePunctuation) {
-        result.remove(QRegExp("[()\\-\\. ]"));
-        // check for invalid characters
-        if (result.indexOf(QRegExp("[^\\d#\\*\\+XxWwPp]")) != -1) {
-            return QString();
-        }
-    } else {
-        if (result.indexOf(QRegExp("[^()\\-\\. \\d#\\*\\+XxWwPp]")) != -1) {
+    const bool removePunctuation = flags & NormalizeFlagRemovePunctuation;
+    const bool keepDialString = flags & NormalizeFlagKeepDialString;
+
+    QString result;
+    result.resize(end - begin);
+    QChar *out = result.data();
+    bool inDialString = false;
+    bool hasPlus = false;
+
+    // one pass: validate every character, drop punctuation and the
+    // dial string as requested
+    for (const QChar *c = begin; c != end; c++) {
+        switch (charClass(*c)) {
+        case InvalidChar:
             return QString();
+        case PunctuationChar:
+            if (removePunctuation)
+                continue;
+            break;
+        case DialStringChar:
+            if (!keepDialString)
+                inDialString = true;
+            break;
+        case SymbolChar:
+            if (*c == QLatin1Char('+') && !inDialString)
+                hasPlus = true;
+            break;
+        case DigitChar:
+            break;
         }
+
+        if (!inDialString)
+            *out++ = *c;
     }
 
-    if (!(flags & NormalizeFlagKeepDialString))
-        result.replace(QRegExp("[XxWwPp].*"), "");
+    result.truncate(out - result.constData());
 
     // can't have + with control codes
-    if ((result.indexOf(QLatin1String("*31#")) != -1 ||
-         result.indexOf(QLatin1String("#31#")) != -1) &&
-         result.indexOf('+') != -1) {
+    if (hasPlus &&
+        (result.indexOf(QLatin1String("*31#")) != -1 ||
+         result.indexOf(QLatin1String("#31#")) != -1)) {
         return QString();
     }
 
@@ -127,4 +235,32 @@ LIBCOMMHISTORY_EXPORT QString makeShortNumber(const QString &number,
     return shortNumber;
 }
 
+LIBCOMMHISTORY_EXPORT QString internUid(const QString &uid)
+{
+    if (uid.isEmpty())
+        return uid;
+
+    UidPool *pool = uidPool();
+    QMutexLocker locker(&pool->mutex);
+
+    QHash<QString, bool>::iterator i = pool->uids.find(uid);
+    if (i != pool->uids.end()) {
+        i.value() = true;
+        return i.key();
+    }
+
+    if (pool->uids.size() >= MAX_INTERNED_UIDS)
+        pool->sweep();
+
+    pool->uids.insert(uid, false);
+    return uid;
+}
+
+LIBCOMMHISTORY_EXPORT void moveToMainThread(QObject *object)
+{
+    QCoreApplication *app = QCoreApplication::instance();
+    if (app && object->thread() != app->thread())
+        object->moveToThread(app->thread());
+}
+
 };
@@ -25,6 +25,8 @@
 
 #include <QString>
 
+class QObject;
+
 // FIXME: keep this for now to avoid API break
 #define PHONE_NUMBER_MATCH_LENGTH 7
 
@@ -88,6 +90,32 @@ int phoneNumberMatchLength();
 QString makeShortNumber(const QString &number,
                         PhoneNumberNormalizeFlags flags = NormalizeFlagRemovePunctuation);
 
+/*!
+ * Returns a shared copy of a local or remote uid from a process-wide
+ * pool, so that repeated uids (account paths, frequent contacts) use the
+ * same string data. Interned uids with equal values have equal
+ * constData() pointers. The pool keeps at most a few thousand uids:
+ * when it is full, the uids not interned again since the previous sweep
+ * are dropped. Returned strings stay valid either way. QueryResult caches
+ * interned uids per query, so the pool lock is taken about once per
+ * distinct uid and query, not once per row.
+ *
+ * \param uid Local or remote uid.
+ * \return Interned uid with the same value.
+ */
+QString internUid(const QString &uid);
+
+/*!
+ * Moves a process-wide object of the library to the main thread. D-Bus
+ * signals and calls are delivered in the thread of the receiving
+ * object, so objects listening on the bus have to live there rather
+ * than in whichever thread created them first. Does nothing without a
+ * QCoreApplication.
+ *
+ * \param object Object without a parent.
+ */
+void moveToMainThread(QObject *object);
+
 }
 
 #endif /* COMMONUTILS_H */
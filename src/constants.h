@@ -29,6 +29,8 @@ namespace CommHistory {
 #define COMM_HISTORY_SERVICE_NAME  QLatin1String("com.nokia.commhistory")
 #define COMM_HISTORY_OBJECT_PATH   QLatin1String("/CommHistoryModel")
 
+#define COMM_HISTORY_TELEMETRY_PATH QLatin1String("/CommHistoryTelemetry")
+
 #define EVENTS_ADDED_SIGNAL        QLatin1String("eventsAdded")
 #define EVENTS_UPDATED_SIGNAL      QLatin1String("eventsUpdated")
 #define EVENT_DELETED_SIGNAL       QLatin1String("eventDeleted")
@@ -38,6 +40,8 @@ namespace CommHistory {
 #define GROUPS_UPDATED_FULL_SIGNAL QLatin1String("groupsUpdatedFull")
 #define GROUPS_DELETED_SIGNAL      QLatin1String("groupsDeleted")
 
+#define UPDATES_BATCHED_SIGNAL     QLatin1String("updatesBatched")
+
 } /* namespace CommHistory */
 
 #endif /* CONSTANTS_H */
@@ -20,6 +20,9 @@
 **
 ******************************************************************************/
 
+#include <QHash>
+#include <QMap>
+
 #include "contactgroup.h"
 #include "trackerio.h"
 #include "updatesemitter.h"
@@ -34,10 +37,38 @@ class ContactGroupPrivate {
 public:
     ContactGroupPrivate(ContactGroup *parent);
 
+    /*!
+     * Recompute all properties from the member groups.
+     */
     void update();
 
+    /*!
+     * Apply the changes of one member group to the properties.
+     * Falls back to update() when an extreme value can't be derived
+     * from the change alone.
+     */
+    void update(GroupObject *group);
+
+    // values of a member group as last seen by this contact group
+    struct Member {
+        Member() : totalMessages(0), unreadMessages(0), sentMessages(0) { }
+
+        QList<Event::Contact> contacts;
+        QDateTime startTime, endTime, lastModified;
+        int totalMessages, unreadMessages, sentMessages;
+    };
+
+    static Member memberValues(GroupObject *group);
+    void addContacts(const QList<Event::Contact> &contacts);
+    void removeContacts(const QList<Event::Contact> &contacts);
+    void setContacts();
+    void setLastEvent(GroupObject *group);
+
     ContactGroup *q_ptr;
     QList<GroupObject*> groups;
+    QHash<GroupObject*, Member> members;
+    // contact id -> name and number of member groups with the contact
+    QMap<int, QPair<QString, int> > contactRefs;
  
     QList<int> contactIds;
     QList<QString> contactNames;
@@ -78,7 +109,7 @@ void ContactGroup::addGroup(GroupObject *group)
         emit groupsChanged();
     }
 
-    d->update();
+    d->update(group);
 }
 
 bool ContactGroup::removeGroup(GroupObject *group)
@@ -96,52 +127,144 @@ void ContactGroup::updateGroup(GroupObject *group)
 {
     Q_D(ContactGroup);
 
-    Q_UNUSED(group);
-    d->update();
+    if (d->groups.contains(group))
+        d->update(group);
+    else
+        d->update();
+}
+
+ContactGroupPrivate::Member ContactGroupPrivate::memberValues(GroupObject *group)
+{
+    Member m;
+    m.contacts = group->contacts();
+    m.startTime = group->startTime();
+    m.endTime = group->endTime();
+    m.lastModified = group->lastModified();
+    m.totalMessages = group->totalMessages();
+    m.unreadMessages = group->unreadMessages();
+    m.sentMessages = group->sentMessages();
+    return m;
+}
+
+void ContactGroupPrivate::addContacts(const QList<Event::Contact> &contacts)
+{
+    foreach (const Event::Contact &contact, contacts) {
+        QPair<QString, int> &ref = contactRefs[contact.first];
+        ref.first = contact.second;
+        ref.second++;
+    }
+}
+
+void ContactGroupPrivate::removeContacts(const QList<Event::Contact> &contacts)
+{
+    foreach (const Event::Contact &contact, contacts) {
+        QMap<int, QPair<QString, int> >::iterator i = contactRefs.find(contact.first);
+        if (i != contactRefs.end() && --i.value().second <= 0)
+            contactRefs.erase(i);
+    }
+}
+
+void ContactGroupPrivate::setContacts()
+{
+    Q_Q(ContactGroup);
+
+    QList<int> uContactIds;
+    QList<QString> uContactNames;
+    uContactIds.reserve(contactRefs.size());
+    uContactNames.reserve(contactRefs.size());
+
+    QMap<int, QPair<QString, int> >::const_iterator i = contactRefs.constBegin();
+    for (; i != contactRefs.constEnd(); ++i) {
+        uContactIds.append(i.key());
+        uContactNames.append(i.value().first);
+    }
+
+    if (uContactIds != contactIds || uContactNames != contactNames) {
+        contactIds = uContactIds;
+        contactNames = uContactNames;
+        emit q->contactsChanged();
+    }
+}
+
+void ContactGroupPrivate::setLastEvent(GroupObject *uLastEventGroup)
+{
+    Q_Q(ContactGroup);
+
+    if (uLastEventGroup) {
+        bool changed = false;
+        if (uLastEventGroup != lastEventGroup) {
+            lastEventGroup = uLastEventGroup;
+            changed = true;
+        }
+
+        if (lastEventId != lastEventGroup->lastEventId() ||
+                lastMessageText != lastEventGroup->lastMessageText() ||
+                lastVCardFileName != lastEventGroup->lastVCardFileName() ||
+                lastVCardLabel != lastEventGroup->lastVCardLabel() ||
+                lastEventType != lastEventGroup->lastEventType() ||
+                lastEventStatus != lastEventGroup->lastEventStatus())
+            changed = true;
+
+        lastEventId = lastEventGroup->lastEventId();
+        lastMessageText = lastEventGroup->lastMessageText();
+        lastVCardFileName = lastEventGroup->lastVCardFileName();
+        lastVCardLabel = lastEventGroup->lastVCardLabel();
+        lastEventType = static_cast<int>(lastEventGroup->lastEventType());
+        lastEventStatus = static_cast<int>(lastEventGroup->lastEventStatus());
+
+        if (changed)
+            emit q->lastEventChanged();
+    } else if (lastEventId >= 0) {
+        lastEventGroup = 0;
+        lastEventId = -1;
+        lastMessageText.clear();
+        lastVCardFileName.clear();
+        lastVCardLabel.clear();
+        lastEventType = static_cast<int>(Event::UnknownType);
+        lastEventStatus = static_cast<int>(Event::UnknownStatus);
+        emit q->lastEventChanged();
+    }
 }
 
 void ContactGroupPrivate::update()
 {
     Q_Q(ContactGroup);
-    /* Iterate all groups to update properties. Unfortunately, we can't rely on just comparing
-       the changes to one group and have reliable data.
+    /* Iterate all groups to update properties. This is only needed when
+       a member is removed or an extreme value (times, last event) moved
+       away from the group holding it; other changes go through
+       update(GroupObject*).
      */
 
-    QMap<int,QString> contacts;
- 
+    members.clear();
+    contactRefs.clear();
+
     QDateTime uStartTime, uEndTime, uLastModified;
     int uTotalMessages = 0, uUnreadMessages = 0, uSentMessages = 0;
     GroupObject *uLastEventGroup = 0;
 
     foreach (GroupObject *group, groups) {
-        foreach (const Event::Contact &contact, group->contacts())
-            contacts[contact.first] = contact.second;
+        Member m = memberValues(group);
+        members.insert(group, m);
+        addContacts(m.contacts);
 
-        if (!uStartTime.isValid() || group->startTime() < uStartTime)
-            uStartTime = group->startTime();
+        if (!uStartTime.isValid() || m.startTime < uStartTime)
+            uStartTime = m.startTime;
 
-        if (!uEndTime.isValid() || group->endTime() > uEndTime)
-            uEndTime = group->endTime();
+        if (!uEndTime.isValid() || m.endTime > uEndTime)
+            uEndTime = m.endTime;
 
-        if (group->lastEventId() >= 0 && (!uLastEventGroup || group->endTime() > uLastEventGroup->endTime()))
+        if (group->lastEventId() >= 0 && (!uLastEventGroup || m.endTime > uLastEventGroup->endTime()))
             uLastEventGroup = group;
 
-        if (!uLastModified.isValid() || group->lastModified() > uLastModified)
-            uLastModified = group->lastModified();
+        if (!uLastModified.isValid() || m.lastModified > uLastModified)
+            uLastModified = m.lastModified;
 
-        uTotalMessages += group->totalMessages();
-        uUnreadMessages += group->unreadMessages();
-        uSentMessages += group->sentMessages();
+        uTotalMessages += m.totalMessages;
+        uUnreadMessages += m.unreadMessages;
+        uSentMessages += m.sentMessages;
     }
 
-    QList<int> uContactIds = contacts.keys();
-    QList<QString> uContactNames = contacts.values();
-
-    if (uContactIds != contactIds || uContactNames != contactNames) {
-        contactIds = uContactIds;
-        contactNames = uContactNames;
-        emit q->contactsChanged();
-    }
+    setContacts();
 
     if (uStartTime != startTime) {
         startTime = uStartTime;
@@ -173,39 +296,72 @@ void ContactGroupPrivate::update()
         emit q->sentMessagesChanged();
     }
 
-    if (uLastEventGroup) {
-        bool changed = false;
-        if (uLastEventGroup != lastEventGroup) {
-            lastEventGroup = uLastEventGroup;
-            changed = true;
-        }
+    setLastEvent(uLastEventGroup);
+}
 
-        if (lastEventId != lastEventGroup->lastEventId() ||
-                lastMessageText != lastEventGroup->lastMessageText() ||
-                lastVCardFileName != lastEventGroup->lastVCardFileName() ||
-                lastVCardLabel != lastEventGroup->lastVCardLabel() ||
-                lastEventType != lastEventGroup->lastEventType() ||
-                lastEventStatus != lastEventGroup->lastEventStatus())
-            changed = true;
+void ContactGroupPrivate::update(GroupObject *group)
+{
+    Q_Q(ContactGroup);
 
-        lastEventId = lastEventGroup->lastEventId();
-        lastMessageText = lastEventGroup->lastMessageText();
-        lastVCardFileName = lastEventGroup->lastVCardFileName();
-        lastVCardLabel = lastEventGroup->lastVCardLabel();
-        lastEventType = static_cast<int>(lastEventGroup->lastEventType());
-        lastEventStatus = static_cast<int>(lastEventGroup->lastEventStatus());
+    Member m = memberValues(group);
+    QHash<GroupObject*, Member>::iterator i = members.find(group);
+    bool isNew = (i == members.end());
+    Member old = isNew ? Member() : i.value();
+
+    // an extreme value held by this group got smaller, the new one may
+    // come from any member
+    if (!isNew
+        && ((old.startTime == startTime && m.startTime > startTime)
+            || (old.endTime == endTime && m.endTime < endTime)
+            || (old.lastModified == lastModified && m.lastModified < lastModified)
+            || (group == lastEventGroup
+                && (group->lastEventId() < 0 || m.endTime < old.endTime)))) {
+        update();
+        return;
+    }
 
-        if (changed)
-            emit q->lastEventChanged();
-    } else if (lastEventId >= 0) {
-        lastEventId = -1;
-        lastMessageText.clear();
-        lastVCardFileName.clear();
-        lastVCardLabel.clear();
-        lastEventType = static_cast<int>(Event::UnknownType);
-        lastEventStatus = static_cast<int>(Event::UnknownStatus);
-        emit q->lastEventChanged();
+    members.insert(group, m);
+
+    if (isNew || m.contacts != old.contacts) {
+        removeContacts(old.contacts);
+        addContacts(m.contacts);
+        setContacts();
+    }
+
+    if (!startTime.isValid() || m.startTime < startTime) {
+        startTime = m.startTime;
+        emit q->startTimeChanged();
     }
+
+    if (!endTime.isValid() || m.endTime > endTime) {
+        endTime = m.endTime;
+        emit q->endTimeChanged();
+    }
+
+    if (!lastModified.isValid() || m.lastModified > lastModified) {
+        lastModified = m.lastModified;
+        emit q->lastModifiedChanged();
+    }
+
+    if (m.totalMessages != old.totalMessages) {
+        totalMessages += m.totalMessages - old.totalMessages;
+        emit q->totalMessagesChanged();
+    }
+
+    if (m.unreadMessages != old.unreadMessages) {
+        unreadMessages += m.unreadMessages - old.unreadMessages;
+        emit q->unreadMessagesChanged();
+    }
+
+    if (m.sentMessages != old.sentMessages) {
+        sentMessages += m.sentMessages - old.sentMessages;
+        emit q->sentMessagesChanged();
+    }
+
+    if (group->lastEventId() >= 0
+        && (!lastEventGroup || group == lastEventGroup
+            || m.endTime > lastEventGroup->endTime()))
+        setLastEvent(group);
 }
 
 QList<int> ContactGroup::contactIds() const
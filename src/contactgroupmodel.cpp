@@ -29,6 +29,7 @@
 #include "contactgroupmodel_p.h"
 #include "groupmanager.h"
 #include "contactgroup.h"
+#include "telemetry.h"
 
 Q_DECLARE_METATYPE(QObjectList)
 
@@ -69,6 +70,7 @@ void ContactGroupModelPrivate::setManager(GroupManager *m)
             emit q->contactGroupRemoved(g);
         qDeleteAll(items);
         items.clear();
+        clearIndex();
     }
 
     manager = m;
@@ -81,16 +83,17 @@ void ContactGroupModelPrivate::setManager(GroupManager *m)
 
         // Create data without sorting
         foreach (GroupObject *group, manager->groups()) {
-            int index = indexForContacts(group->contactIds());
+            ContactGroup *item = itemForContacts(group->contactIds());
 
-            if (index < 0) {
-                ContactGroup *item = new ContactGroup(this);
-                index = items.size();
+            if (!item) {
+                item = new ContactGroup(this);
                 items.append(item);
             }
 
-            items[index]->addGroup(group);
-            emit q->contactGroupCreated(items[index]);
+            item->addGroup(group);
+            groupItems.insert(group, item);
+            updateItemKey(item);
+            emit q->contactGroupCreated(item);
         }
 
         qSort(items.begin(), items.end(), contactGroupSort);
@@ -102,32 +105,87 @@ void ContactGroupModelPrivate::setManager(GroupManager *m)
         emit q->modelReady(true);
 }
 
-int ContactGroupModelPrivate::indexForContacts(QList<int> contacts)
+QByteArray ContactGroupModelPrivate::contactsKey(QList<int> contacts)
+{
+    std::sort(contacts.begin(), contacts.end());
+
+    QByteArray key;
+    key.reserve(contacts.size() * sizeof(int));
+    for (int i = 0; i < contacts.size(); i++) {
+        if (i > 0 && contacts.at(i) == contacts.at(i - 1))
+            continue;
+        int id = contacts.at(i);
+        key.append(reinterpret_cast<const char *>(&id), sizeof(id));
+    }
+
+    return key;
+}
+
+ContactGroup *ContactGroupModelPrivate::itemForContacts(const QList<int> &contacts) const
 {
     if (contacts.isEmpty())
-        return -1;
+        return 0;
 
-    std::sort(contacts.begin(), contacts.end());
+    QByteArray key = contactsKey(contacts);
+    ContactGroup *item = 0;
+    int index = -1;
 
-    for (int i = 0; i < items.size(); i++) {
-        QList<int> ic = items[i]->contactIds();
-        std::sort(ic.begin(), ic.end());
+    QMultiHash<QByteArray, ContactGroup*>::const_iterator i = contactItems.constFind(key);
+    for (; i != contactItems.constEnd() && i.key() == key; ++i) {
+        if (!item) {
+            item = i.value();
+            continue;
+        }
 
-        if (contacts == ic)
-            return i;
+        // several items with the same contacts, use the topmost one
+        if (index < 0)
+            index = items.indexOf(item);
+        int candidate = items.indexOf(i.value());
+        if (candidate < index) {
+            item = i.value();
+            index = candidate;
+        }
     }
-    
-    return -1;
+
+    return item;
+}
+
+ContactGroup *ContactGroupModelPrivate::itemForObject(GroupObject *group) const
+{
+    return groupItems.value(group);
 }
 
-int ContactGroupModelPrivate::indexForObject(GroupObject *group)
+void ContactGroupModelPrivate::updateItemKey(ContactGroup *item)
 {
-    for (int i = 0; i < items.size(); i++) {
-        if (items[i]->groups().contains(group))
-            return i;
+    QByteArray key = contactsKey(item->contactIds());
+
+    QHash<ContactGroup*, QByteArray>::iterator i = itemKeys.find(item);
+    if (i != itemKeys.end()) {
+        if (i.value() == key)
+            return;
+        contactItems.remove(i.value(), item);
+        i.value() = key;
+    } else {
+        itemKeys.insert(item, key);
     }
 
-    return -1;
+    contactItems.insert(key, item);
+}
+
+void ContactGroupModelPrivate::removeItemKey(ContactGroup *item)
+{
+    QHash<ContactGroup*, QByteArray>::iterator i = itemKeys.find(item);
+    if (i != itemKeys.end()) {
+        contactItems.remove(i.value(), item);
+        itemKeys.erase(i);
+    }
+}
+
+void ContactGroupModelPrivate::clearIndex()
+{
+    contactItems.clear();
+    itemKeys.clear();
+    groupItems.clear();
 }
 
 void ContactGroupModelPrivate::groupAdded(GroupObject *group)
@@ -136,16 +194,18 @@ void ContactGroupModelPrivate::groupAdded(GroupObject *group)
 
     qDebug() << Q_FUNC_INFO << group->id() << group->contactIds();
 
-    int index = indexForContacts(group->contactIds());
+    ContactGroup *item = itemForContacts(group->contactIds());
 
-    if (index < 0) {
-        ContactGroup *item = new ContactGroup(this);
+    if (!item) {
+        item = new ContactGroup(this);
         item->addGroup(group);
+        groupItems.insert(group, item);
+        updateItemKey(item);
 
-        for (index = 0; index < items.size(); index++) {
-            if (contactGroupSort(item, items[index]))
-                break;
-        }
+        // items are sorted, insert after the ones that are at least as recent
+        QList<ContactGroup*>::iterator pos = qUpperBound(items.begin(), items.end(),
+                                                         item, contactGroupSort);
+        int index = pos - items.begin();
 
         q->beginInsertRows(QModelIndex(), index, index);
         items.insert(index, item);
@@ -155,10 +215,11 @@ void ContactGroupModelPrivate::groupAdded(GroupObject *group)
         return;
     }
 
-    ContactGroup *item = items[index];
     item->addGroup(group);
+    groupItems.insert(group, item);
+    updateItemKey(item);
 
-    itemDataChanged(index);
+    itemDataChanged(items.indexOf(item));
 }
 
 void ContactGroupModelPrivate::itemDataChanged(int index)
@@ -198,30 +259,31 @@ void ContactGroupModelPrivate::itemDataChanged(int index)
 
 void ContactGroupModelPrivate::groupUpdated(GroupObject *group)
 {
-    int oldIndex = indexForObject(group);
-    int newIndex;
-    
+    ContactGroup *oldItem = itemForObject(group);
+    ContactGroup *newItem;
+
     // If the group has any contact information, and there is more than one group in this contactgroup,
     // check for a new contactgroup. Otherwise, the current one is used.
-    if (!group->contactIds().isEmpty() && (oldIndex >= 0 && items[oldIndex]->groups().size() > 1))
-        newIndex = indexForContacts(group->contactIds());
+    if (!group->contactIds().isEmpty() && (oldItem && oldItem->groups().size() > 1))
+        newItem = itemForContacts(group->contactIds());
     else
-        newIndex = oldIndex;
+        newItem = oldItem;
 
-    qDebug() << Q_FUNC_INFO << group->id() << group->contactIds() << oldIndex << newIndex;
+    qDebug() << Q_FUNC_INFO << group->id() << group->contactIds() << oldItem << newItem;
 
-    if (oldIndex >= 0 && oldIndex != newIndex) {
+    if (oldItem && oldItem != newItem) {
         // Remove from old
         groupDeleted(group);
     }
 
-    if (newIndex < 0 || oldIndex != newIndex) {
+    if (!newItem || oldItem != newItem) {
         // Add to new, creating if necessary
         groupAdded(group);
     } else {
         // Update data
-        items[oldIndex]->updateGroup(group);
-        itemDataChanged(oldIndex);
+        oldItem->updateGroup(group);
+        updateItemKey(oldItem);
+        itemDataChanged(items.indexOf(oldItem));
     }
 }
 
@@ -231,13 +293,16 @@ void ContactGroupModelPrivate::groupDeleted(GroupObject *group)
 
     qDebug() << Q_FUNC_INFO << group->id() << group->contactIds();
 
-    int index = indexForObject(group);
-    if (index < 0)
+    ContactGroup *item = groupItems.take(group);
+    if (!item)
         return;
 
-    ContactGroup *item = items[index];
+    int index = items.indexOf(item);
+
     // Returns true when removing the last group
     if (item->removeGroup(group)) {
+        removeItemKey(item);
+
         emit q->beginRemoveRows(QModelIndex(), index, index);
         items.removeAt(index);
         emit q->endRemoveRows();
@@ -248,6 +313,7 @@ void ContactGroupModelPrivate::groupDeleted(GroupObject *group)
         return;
     }
 
+    updateItemKey(item);
     itemDataChanged(index);
 }
 
@@ -279,6 +345,9 @@ ContactGroupModel::ContactGroupModel(QObject *parent)
     roles[BaseRole + StartTime] = "startTime";
     roles[BaseRole + Groups] = "groups";
     setRoleNames(roles);
+
+    if (Telemetry::isEnabled())
+        Telemetry::instance()->watchModel(this);
 }
 
 ContactGroupModel::~ContactGroupModel()
@@ -27,6 +27,9 @@
 #include "contactgroupmodel.h"
 #include <QObject>
 #include <QDateTime>
+#include <QHash>
+#include <QMultiHash>
+#include <QByteArray>
 
 namespace CommHistory {
 
@@ -50,8 +53,13 @@ public:
 
     void setManager(GroupManager *manager);
 
-    int indexForContacts(QList<int> contacts);
-    int indexForObject(GroupObject *group);
+    ContactGroup *itemForContacts(const QList<int> &contacts) const;
+    ContactGroup *itemForObject(GroupObject *group) const;
+
+    /*!
+     * Canonical key for a set of contact ids: the sorted, unique ids.
+     */
+    static QByteArray contactsKey(QList<int> contacts);
 
 private slots:
     void groupAdded(GroupObject *group);
@@ -60,6 +68,14 @@ private slots:
 
 private:
     void itemDataChanged(int index);
+    void updateItemKey(ContactGroup *item);
+    void removeItemKey(ContactGroup *item);
+    void clearIndex();
+
+    // contacts key -> items, items with the same contacts are rare
+    QMultiHash<QByteArray, ContactGroup*> contactItems;
+    QHash<ContactGroup*, QByteArray> itemKeys;
+    QHash<GroupObject*, ContactGroup*> groupItems;
 };
 
 }
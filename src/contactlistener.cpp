@@ -22,6 +22,7 @@
 
 #include <QCoreApplication>
 #include <QDebug>
+#include <QMutex>
 
 #include <QContactManager>
 #include <QContactFetchRequest>
@@ -48,6 +49,8 @@ namespace {
     static const int CONTACT_REQUEST_THRESHOLD = 5000;
     static const int REQUEST_BATCH_SIZE = 10;
 
+    static const int MAX_CACHED_ADDRESS_KEYS = 10000;
+
     QContactFilter addContactFilter(const QContactFilter &existingFilter,
                                     const QContactFilter &newFilter)
     {
@@ -56,6 +59,36 @@ namespace {
 
         return existingFilter | newFilter;
     }
+
+    struct AddressKeyCache {
+        QMutex mutex;
+        QHash<QString, QString> keys;
+    };
+    Q_GLOBAL_STATIC(AddressKeyCache, addressKeyCache)
+
+    // Remote uids match if their keys are equal: the short number for
+    // phone numbers, the uid itself for anything else (see
+    // CommHistory::remoteAddressMatch()). Normalizing is expensive, so
+    // keys are cached.
+    QString addressKey(const QString &remoteUid)
+    {
+        AddressKeyCache *cache = addressKeyCache();
+        QMutexLocker locker(&cache->mutex);
+
+        QHash<QString, QString>::const_iterator i = cache->keys.constFind(remoteUid);
+        if (i != cache->keys.constEnd())
+            return i.value();
+
+        QString key = CommHistory::makeShortNumber(remoteUid);
+        if (key.isEmpty())
+            key = remoteUid;
+
+        if (cache->keys.size() >= MAX_CACHED_ADDRESS_KEYS)
+            cache->keys.clear();
+        cache->keys.insert(remoteUid, key);
+
+        return key;
+    }
 }
 
 ContactListener::ContactListener(QObject *parent)
@@ -154,8 +187,10 @@ void ContactListener::slotContactsRemoved(const QList<QContactLocalId> &contactI
 
     qDebug() << Q_FUNC_INFO << contactIds;
 
-    foreach (QContactLocalId localId, contactIds)
+    foreach (QContactLocalId localId, contactIds) {
+        uncacheContact(localId);
         emit contactRemoved(localId);
+    }
 }
 
 void ContactListener::slotStartContactRequest()
@@ -230,6 +265,7 @@ void ContactListener::slotResultsAvailable()
                 addresses += qMakePair(QString(), phoneNumber.number());
             }
 
+            cacheContact(contact.localId(), contact.displayLabel(), addresses);
             emit contactUpdated(contact.localId(), contact.displayLabel(), addresses);
         } // if
     }
@@ -244,12 +280,13 @@ bool ContactListener::addressMatchesList(const QString &localUid,
                                          const QList< QPair<QString,QString> > &contactAddresses)
 {
     bool found = false;
+    QString key = addressKey(remoteUid);
 
     QListIterator<QPair<QString,QString> > i(contactAddresses);
     while (i.hasNext()) {
         QPair<QString,QString> address = i.next();
         if ((address.first.isEmpty() || address.first == localUid)
-            && CommHistory::remoteAddressMatch(remoteUid, address.second)) {
+            && addressKey(address.second) == key) {
             found = true;
             break;
         }
@@ -258,6 +295,60 @@ bool ContactListener::addressMatchesList(const QString &localUid,
     return found;
 }
 
+QList<Event::Contact> ContactListener::cachedContacts(const QString &localUid,
+                                                      const QString &remoteUid) const
+{
+    QList<Event::Contact> contacts;
+
+    QList<QPair<QString, quint32> > candidates = m_AddressContacts.value(addressKey(remoteUid));
+    for (int i = 0; i < candidates.size(); i++) {
+        const QPair<QString, quint32> &candidate = candidates.at(i);
+        if (candidate.first.isEmpty() || candidate.first == localUid) {
+            Event::Contact contact(candidate.second, m_Contacts.value(candidate.second).name);
+            if (!contacts.contains(contact))
+                contacts << contact;
+        }
+    }
+
+    return contacts;
+}
+
+void ContactListener::cacheContact(quint32 localId,
+                                   const QString &contactName,
+                                   const QList< QPair<QString,QString> > &contactAddresses)
+{
+    uncacheContact(localId);
+
+    CachedContact contact;
+    contact.name = contactName;
+    contact.addresses = contactAddresses;
+    m_Contacts.insert(localId, contact);
+
+    foreach (const QPair<QString,QString> &address, contactAddresses)
+        m_AddressContacts[addressKey(address.second)] << qMakePair(address.first, localId);
+}
+
+void ContactListener::uncacheContact(quint32 localId)
+{
+    QHash<quint32, CachedContact>::iterator contact = m_Contacts.find(localId);
+    if (contact == m_Contacts.end())
+        return;
+
+    // only touch the entries of the contact's own addresses
+    foreach (const QPair<QString,QString> &address, contact.value().addresses) {
+        QHash<QString, QList<QPair<QString, quint32> > >::iterator i =
+            m_AddressContacts.find(addressKey(address.second));
+        if (i == m_AddressContacts.end())
+            continue;
+
+        i.value().removeAll(qMakePair(address.first, localId));
+        if (i.value().isEmpty())
+            m_AddressContacts.erase(i);
+    }
+
+    m_Contacts.erase(contact);
+}
+
 void ContactListener::resolveContact(const QString &localUid,
                                      const QString &remoteUid)
 {
@@ -29,8 +29,10 @@
 #include <QList>
 #include <QTimer>
 #include <QPointer>
+#include <QHash>
 
 #include "libcommhistoryexport.h"
+#include "event.h"
 
 // contacts
 #include <qcontact.h>
@@ -67,6 +69,14 @@ public:
     void resolveContact(const QString &localUid,
                         const QString &remoteUid);
 
+    /**
+     * Get contacts matching (localUid, remoteUid) from the contacts
+     * already fetched by resolveContact() or reported as changed,
+     * without querying the contact store.
+     */
+    QList<Event::Contact> cachedContacts(const QString &localUid,
+                                         const QString &remoteUid) const;
+
     /**
      * Get address book settings.
      */
@@ -93,6 +103,10 @@ private:
     void init();
     QContactFetchRequest *buildRequest(const QContactFilter &filter);
     void startRequestOrTimer();
+    void cacheContact(quint32 localId,
+                      const QString &contactName,
+                      const QList< QPair<QString,QString> > &contactAddresses);
+    void uncacheContact(quint32 localId);
 
 private:
     static QWeakPointer<ContactListener> m_Instance;
@@ -102,6 +116,15 @@ private:
     QList<QContactLocalId> m_PendingContactIds;
     QList<QPair<QString,QString> > m_PendingUnresolvedContacts;
     QPointer<QctSettings> m_Settings;
+
+    struct CachedContact {
+        QString name;
+        QList<QPair<QString,QString> > addresses;
+    };
+    // contact id -> name and addresses of fetched contacts
+    QHash<quint32, CachedContact> m_Contacts;
+    // short number or IM id -> (account path, contact id)
+    QHash<QString, QList<QPair<QString, quint32> > > m_AddressContacts;
 };
 
 }
@@ -63,6 +63,26 @@ ConversationModelPrivate::ConversationModelPrivate(EventModel *model)
     propertyMask -= unusedProperties;
 }
 
+void ConversationModelPrivate::setBatchedUpdates(bool enabled)
+{
+    if (batchedUpdates == enabled)
+        return;
+
+    // group changes arrive through updatesBatchedSlot() when batched
+    typedef bool (QDBusConnection::*ConnectFunc)(const QString &, const QString &,
+                                                 const QString &, const QString &,
+                                                 QObject *, const char *);
+    ConnectFunc legacy = enabled ? &QDBusConnection::disconnect : &QDBusConnection::connect;
+    QDBusConnection bus = QDBusConnection::sessionBus();
+
+    (bus.*legacy)(QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_UPDATED_FULL_SIGNAL,
+                  this, SLOT(groupsUpdatedFullSlot(const QList<CommHistory::Group> &)));
+    (bus.*legacy)(QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_DELETED_SIGNAL,
+                  this, SLOT(groupsDeletedSlot(const QList<int> &)));
+
+    EventModelPrivate::setBatchedUpdates(enabled);
+}
+
 void ConversationModelPrivate::groupsUpdatedFullSlot(const QList<CommHistory::Group> &groups)
 {
     qDebug() << Q_FUNC_INFO;
@@ -201,10 +221,15 @@ EventsQuery ConversationModelPrivate::buildQuery() const
 
     query.addPattern(QLatin1String("%1 nmo:isDraft \"false\"; nmo:isDeleted \"false\" .")).variable(Event::Id);
 
+    // bind group ids to keep the query shape stable between groups
     QStringList ids;
-    foreach (int id, filterGroupIds)
-        ids.append(QString(QLatin1String("<%1>")).arg(Group::idToUrl(id).toString()));
-    
+    int i = 0;
+    foreach (int id, filterGroupIds) {
+        QString name = QString(QLatin1String("group%1")).arg(i++);
+        ids.append(QLatin1String("?:") + name);
+        query.bindValue(name, Group::idToUrl(id));
+    }
+
     query.addPattern(QString(QLatin1String("FILTER(%2 IN (%1)) ."))
                      .arg(ids.join(QLatin1String(",")))).variable(Event::GroupId);
 
@@ -365,10 +390,11 @@ void ConversationModel::fetchMore(const QModelIndex &parent)
     Event &event = d->eventRootItem->eventAt(d->eventRootItem->childCount() - 1);
 
     query.addProjection(QLatin1String("tracker:id(%1)")).variable(Event::Id);
-    query.addPattern(QString(QLatin1String("FILTER (%3 < \"%1\"^^xsd:dateTime || (%3 = \"%1\"^^xsd:dateTime && tracker:id(%4) < %2))"))
-                     .arg(event.endTime().toUTC().toString(Qt::ISODate)).arg(d->lastEventTrackerId))
+    query.addPattern(QLatin1String("FILTER (%1 < ?:lastTime || (%1 = ?:lastTime && tracker:id(%2) < ?:lastId))"))
         .variable(Event::EndTime)
         .variable(Event::Id);
+    query.bindValue(QLatin1String("lastTime"), event.endTime().toUTC());
+    query.bindValue(QLatin1String("lastId"), d->lastEventTrackerId);
     query.addModifier(QLatin1String("LIMIT ") + QString::number(d->chunkSize));
 
     QString sparqlQuery = query.query();
@@ -45,12 +45,13 @@ public:
     bool fillModel(int start, int end, QList<CommHistory::Event> events);
     EventsQuery buildQuery() const;
     bool isModelReady() const;
+    void setBatchedUpdates(bool enabled);
 
 public Q_SLOTS:
-    void groupsUpdatedFullSlot(const QList<CommHistory::Group> &groups);
+    virtual void groupsUpdatedFullSlot(const QList<CommHistory::Group> &groups);
     virtual void modelUpdatedSlot(bool successful);
     void extraReceivedSlot(QList<CommHistory::Event> events, QVariantList extra);
-    void groupsDeletedSlot(const QList<int> &groupIds);
+    virtual void groupsDeletedSlot(const QList<int> &groupIds);
     void contactSettingsChangedSlot(const QHash<QString, QVariant> &changedSettings);
 
 public:
@@ -33,6 +33,31 @@
 
 namespace CommHistory {
 
+/*
+ * Rarely used message fields (MMS, vCard, encoding, headers). Empty for
+ * calls and most SMS/IM events, so EventPrivate only allocates the block
+ * when one of them gets a non-empty value, and detaching an event shares
+ * it instead of copying every field.
+ */
+class EventExtension : public QSharedData
+{
+public:
+    QString mmsId;
+    QString fromVCardFileName;
+    QString fromVCardLabel;
+    QString encoding;
+    QString charset;
+    QString language;
+
+    QString contentLocation;
+    QString subject;
+    QList<MessagePart> messageParts;
+    QStringList ccList;
+    QStringList bccList;
+
+    QHash<QString, QString> headers;
+};
+
 class EventPrivate : public QSharedData
 {
 public:
@@ -45,160 +70,279 @@ public:
         modifiedProperties += property;
     }
 
+    const EventExtension &extension() const;
+    EventExtension &writableExtension();
+
+    template<class T>
+    void setExtended(T EventExtension::*field, const T &value) {
+        // don't allocate the block just to store an empty value
+        if (!ext && value == T())
+            return;
+        writableExtension().*field = value;
+    }
+
     int id;
     Event::EventType type;
-    QDateTime startTime;
-    QDateTime endTime;
     Event::EventDirection direction;
-    bool isDraft;
-    bool isRead;
-    bool isMissedCall;
-    bool isEmergencyCall;
     Event::EventStatus status;
+    Event::EventReadStatus readStatus;
     int bytesReceived;
-
-    QString localUid;  /* telepathy account */
-    QString remoteUid;
-    QList<Event::Contact> contacts;
     int parentId;
-
-    QString freeText;
     int groupId;
-    QString messageToken;
-    QString mmsId;
-
-    QDateTime lastModified;
-
     int eventCount;
-    QString fromVCardFileName;
-    QString fromVCardLabel;
-    QString encoding;
-    QString charset;
-    QString language;
+    int validityPeriod;
+
+    bool isDraft;
+    bool isRead;
+    bool isMissedCall;
+    bool isEmergencyCall;
     bool deleted;
     bool reportDelivery;
     bool reportRead;
     bool reportReadRequested;
-    int validityPeriod;
+    bool isAction;
 
-    QString contentLocation;
-    QString subject;
-    QList<MessagePart> messageParts;
-    QStringList ccList;
-    QStringList bccList;
-    Event::EventReadStatus readStatus;
+    QDateTime startTime;
+    QDateTime endTime;
+    QDateTime lastModified;
 
-    bool isAction;
+    QString localUid;  /* telepathy account */
+    QString remoteUid;
+    QList<Event::Contact> contacts;
+    QString freeText;
+    QString messageToken;
 
-    QHash<QString, QString> headers;
+    QSharedDataPointer<EventExtension> ext;
 
     Event::PropertySet validProperties;
     Event::PropertySet modifiedProperties;
 };
 
+Q_GLOBAL_STATIC(EventExtension, emptyExtension)
+
+const EventExtension &EventPrivate::extension() const
+{
+    return ext ? *ext : *emptyExtension();
+}
+
+EventExtension &EventPrivate::writableExtension()
+{
+    if (!ext)
+        ext = new EventExtension;
+    return *ext;
+}
+
 }
 
 using namespace CommHistory;
 
 static Event::PropertySet setOfAllProperties;
 
+/*
+ * Compact wire format shared by D-Bus and QDataStream: a presence bitmap
+ * (bit n set = Event::Property n is valid) followed by the values of the
+ * present properties only, in Property order. Deprecated aliases
+ * (ContactId, ContactName, To) are folded into the properties that
+ * carry their data.
+ */
+
+// first qint32 of a compact stream; never a valid legacy event id
+static const qint32 COMPACT_STREAM_MARKER = -2;
+
+static quint64 propertyBit(Event::Property property)
+{
+    return Q_UINT64_C(1) << property;
+}
+
+static quint64 presenceMask(const Event &event)
+{
+    quint64 mask = propertyBit(Event::Id);
+    foreach (Event::Property p, event.validProperties()) {
+        switch (p) {
+        case Event::ContactId:
+        case Event::ContactName:
+            mask |= propertyBit(Event::Contacts);
+            break;
+        case Event::To:
+            mask |= propertyBit(Event::Headers);
+            break;
+        case Event::FromVCardFileName:
+        case Event::FromVCardLabel:
+            mask |= propertyBit(Event::FromVCardFileName);
+            break;
+        default:
+            mask |= propertyBit(p);
+        }
+    }
+    return mask;
+}
+
+static void writeCompact(QDataStream &stream, const Event &event, quint64 mask)
+{
+    for (int i = 0; i < Event::NumProperties; i++) {
+        if (!(mask & propertyBit((Event::Property)i)))
+            continue;
+
+        switch ((Event::Property)i) {
+        case Event::Id: stream << event.id(); break;
+        case Event::Type: stream << (int)event.type(); break;
+        case Event::StartTime: stream << event.startTime(); break;
+        case Event::EndTime: stream << event.endTime(); break;
+        case Event::Direction: stream << (int)event.direction(); break;
+        case Event::IsDraft: stream << event.isDraft(); break;
+        case Event::IsRead: stream << event.isRead(); break;
+        case Event::IsMissedCall: stream << event.isMissedCall(); break;
+        case Event::IsEmergencyCall: stream << event.isEmergencyCall(); break;
+        case Event::Status: stream << (int)event.status(); break;
+        case Event::BytesReceived: stream << event.bytesReceived(); break;
+        case Event::LocalUid: stream << event.localUid(); break;
+        case Event::RemoteUid: stream << event.remoteUid(); break;
+        case Event::ParentId: stream << event.parentId(); break;
+        case Event::Subject: stream << event.subject(); break;
+        case Event::FreeText: stream << event.freeText(); break;
+        case Event::GroupId: stream << event.groupId(); break;
+        case Event::MessageToken: stream << event.messageToken(); break;
+        case Event::LastModified: stream << event.lastModified(); break;
+        case Event::EventCount: stream << event.eventCount(); break;
+        case Event::FromVCardFileName:
+            stream << event.fromVCardFileName() << event.fromVCardLabel();
+            break;
+        case Event::Encoding: stream << event.encoding(); break;
+        case Event::CharacterSet: stream << event.characterSet(); break;
+        case Event::Language: stream << event.language(); break;
+        case Event::IsDeleted: stream << event.isDeleted(); break;
+        case Event::ReportDelivery: stream << event.reportDelivery(); break;
+        case Event::ValidityPeriod: stream << event.validityPeriod(); break;
+        case Event::ContentLocation: stream << event.contentLocation(); break;
+        case Event::MessageParts: stream << event.messageParts(); break;
+        case Event::Cc: stream << event.ccList(); break;
+        case Event::Bcc: stream << event.bccList(); break;
+        case Event::ReadStatus: stream << (int)event.readStatus(); break;
+        case Event::ReportRead: stream << event.reportRead(); break;
+        case Event::ReportReadRequested: stream << event.reportReadRequested(); break;
+        case Event::MmsId: stream << event.mmsId(); break;
+        case Event::Contacts: stream << event.contacts(); break;
+        case Event::IsAction: stream << event.isAction(); break;
+        case Event::Headers: stream << event.headers(); break;
+        default:
+            break;
+        }
+    }
+}
+
+template<class T>
+static T readValue(QDataStream &stream)
+{
+    T value;
+    stream >> value;
+    return value;
+}
+
+static void readCompact(QDataStream &stream, Event &event, quint64 mask)
+{
+    Event::PropertySet valid;
+
+    for (int i = 0; i < Event::NumProperties; i++) {
+        Event::Property p = (Event::Property)i;
+        if (!(mask & propertyBit(p)))
+            continue;
+        valid.insert(p);
+
+        switch (p) {
+        case Event::Id: event.setId(readValue<int>(stream)); break;
+        case Event::Type: event.setType((Event::EventType)readValue<int>(stream)); break;
+        case Event::StartTime: event.setStartTime(readValue<QDateTime>(stream)); break;
+        case Event::EndTime: event.setEndTime(readValue<QDateTime>(stream)); break;
+        case Event::Direction:
+            event.setDirection((Event::EventDirection)readValue<int>(stream));
+            break;
+        case Event::IsDraft: event.setIsDraft(readValue<bool>(stream)); break;
+        case Event::IsRead: event.setIsRead(readValue<bool>(stream)); break;
+        case Event::IsMissedCall: event.setIsMissedCall(readValue<bool>(stream)); break;
+        case Event::IsEmergencyCall: event.setIsEmergencyCall(readValue<bool>(stream)); break;
+        case Event::Status: event.setStatus((Event::EventStatus)readValue<int>(stream)); break;
+        case Event::BytesReceived: event.setBytesReceived(readValue<int>(stream)); break;
+        case Event::LocalUid: event.setLocalUid(readValue<QString>(stream)); break;
+        case Event::RemoteUid: event.setRemoteUid(readValue<QString>(stream)); break;
+        case Event::ParentId: event.setParentId(readValue<int>(stream)); break;
+        case Event::Subject: event.setSubject(readValue<QString>(stream)); break;
+        case Event::FreeText: event.setFreeText(readValue<QString>(stream)); break;
+        case Event::GroupId: event.setGroupId(readValue<int>(stream)); break;
+        case Event::MessageToken: event.setMessageToken(readValue<QString>(stream)); break;
+        case Event::LastModified: event.setLastModified(readValue<QDateTime>(stream)); break;
+        case Event::EventCount: event.setEventCount(readValue<int>(stream)); break;
+        case Event::FromVCardFileName: {
+            QString fileName, label;
+            stream >> fileName >> label;
+            event.setFromVCard(fileName, label);
+            valid.insert(Event::FromVCardLabel);
+            break;
+        }
+        case Event::Encoding: event.setEncoding(readValue<QString>(stream)); break;
+        case Event::CharacterSet: event.setCharacterSet(readValue<QString>(stream)); break;
+        case Event::Language: event.setLanguage(readValue<QString>(stream)); break;
+        case Event::IsDeleted: event.setDeleted(readValue<bool>(stream)); break;
+        case Event::ReportDelivery: event.setReportDelivery(readValue<bool>(stream)); break;
+        case Event::ValidityPeriod: event.setValidityPeriod(readValue<int>(stream)); break;
+        case Event::ContentLocation:
+            event.setContentLocation(readValue<QString>(stream));
+            break;
+        case Event::MessageParts:
+            event.setMessageParts(readValue<QList<MessagePart> >(stream));
+            break;
+        case Event::Cc: event.setCcList(readValue<QStringList>(stream)); break;
+        case Event::Bcc: event.setBccList(readValue<QStringList>(stream)); break;
+        case Event::ReadStatus:
+            event.setReadStatus((Event::EventReadStatus)readValue<int>(stream));
+            break;
+        case Event::ReportRead: event.setReportRead(readValue<bool>(stream)); break;
+        case Event::ReportReadRequested:
+            event.setReportReadRequested(readValue<bool>(stream));
+            break;
+        case Event::MmsId: event.setMmsId(readValue<QString>(stream)); break;
+        case Event::Contacts:
+            event.setContacts(readValue<QList<Event::Contact> >(stream));
+            break;
+        case Event::IsAction: event.setIsAction(readValue<bool>(stream)); break;
+        case Event::Headers:
+            event.setHeaders(readValue<QHash<QString, QString> >(stream));
+            break;
+        default:
+            break;
+        }
+    }
+
+    event.setValidProperties(valid);
+    event.resetModifiedProperties();
+}
+
 QDBusArgument &operator<<(QDBusArgument &argument, const Event &event)
 {
-    argument.beginStructure();
-    argument << event.id() << event.type() << event.startTime()
-             << event.endTime() << event.direction()  << event.isDraft()
-             << event.isRead() << event.isMissedCall()
-             << event.isEmergencyCall() << event.status()
-             << event.bytesReceived() << event.localUid()
-             << event.remoteUid() << event.contacts()
-             << event.parentId() << event.freeText() << event.groupId()
-             << event.messageToken() << event.mmsId() << event.lastModified()
-             << event.eventCount()
-             << event.fromVCardFileName() << event.fromVCardLabel()
-             << event.encoding() << event.characterSet() << event.language()
-             << event.isDeleted() << event.reportDelivery()
-             << event.contentLocation() << event.subject()
-             << event.messageParts() << event.ccList() << event.bccList()
-             << event.readStatus() << event.reportRead() << event.reportReadRequested()
-             << event.validityPeriod() << event.isAction() << event.headers();
-
-    // pass valid properties
-    argument.beginArray(qMetaTypeId<int>());
-    foreach (int e, event.validProperties())
-        argument << e;
-    argument.endArray();
+    quint64 mask = presenceMask(event);
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_7);
+    writeCompact(stream, event, mask);
 
+    argument.beginStructure();
+    argument << mask << data;
     argument.endStructure();
     return argument;
 }
 
 const QDBusArgument &operator>>(const QDBusArgument &argument, Event &event)
 {
-    EventPrivate p;
-    int type, direction, status, rstatus ;
+    quint64 mask;
+    QByteArray data;
     argument.beginStructure();
-    argument >> p.id >> type >> p.startTime >> p.endTime
-             >> direction  >> p.isDraft >>  p.isRead >> p.isMissedCall >> p.isEmergencyCall
-             >> status >> p.bytesReceived >> p.localUid >> p.remoteUid >> p.contacts
-             >> p.parentId >> p.freeText >> p.groupId
-             >> p.messageToken >> p.mmsId >>p.lastModified  >> p.eventCount
-             >> p.fromVCardFileName >> p.fromVCardLabel  >> p.encoding   >> p.charset >> p.language
-             >> p.deleted >> p.reportDelivery >> p.contentLocation >> p.subject
-             >> p.messageParts >> p.ccList >> p.bccList
-             >> rstatus >> p.reportRead >> p.reportReadRequested
-             >> p.validityPeriod >> p.isAction >> p.headers;
-
-    //read valid properties
-    argument.beginArray();
-    while (!argument.atEnd()) {
-        int vp;
-        argument >> vp;
-        p.validProperties.insert((Event::Property)vp);
-    }
-    argument.endArray();
+    argument >> mask >> data;
     argument.endStructure();
 
-    event.setId(p.id);
-    event.setType((Event::EventType)type);
-    event.setStartTime(p.startTime);
-    event.setEndTime(p.endTime);
-    event.setDirection((Event::EventDirection)direction);
-    event.setIsDraft( p.isDraft );
-    event.setIsRead(p.isRead);
-    event.setIsMissedCall( p.isMissedCall );
-    event.setIsEmergencyCall( p.isEmergencyCall );
-    event.setStatus((Event::EventStatus)status);
-    event.setBytesReceived(p.bytesReceived);
-    event.setLocalUid(p.localUid);
-    event.setRemoteUid(p.remoteUid);
-    event.setContacts(p.contacts);
-    event.setParentId(p.parentId);
-    event.setSubject(p.subject);
-    event.setFreeText(p.freeText);
-    event.setGroupId(p.groupId);
-    event.setMessageToken(p.messageToken);
-    event.setMmsId(p.mmsId);
-    event.setLastModified(p.lastModified);
-    event.setEventCount(p.eventCount);
-    event.setFromVCard( p.fromVCardFileName, p.fromVCardLabel );
-    event.setEncoding(p.encoding);
-    event.setCharacterSet(p.charset);
-    event.setLanguage(p.language);
-    event.setDeleted(p.deleted);
-    event.setReportDelivery(p.reportDelivery);
-    event.setValidityPeriod(p.validityPeriod);
-    event.setContentLocation(p.contentLocation);
-    event.setMessageParts(p.messageParts);
-    event.setCcList(p.ccList);
-    event.setBccList(p.bccList);
-    event.setReadStatus((Event::EventReadStatus)rstatus);
-    event.setReportRead(p.reportRead);
-    event.setReportReadRequested(p.reportReadRequested);
-    event.setIsAction(p.isAction);
-    event.setHeaders(p.headers);
-
-    event.setValidProperties(p.validProperties);
-    event.resetModifiedProperties();
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_4_7);
+    readCompact(stream, event, mask);
+    if (stream.status() != QDataStream::Ok)
+        qWarning() << Q_FUNC_INFO << "truncated event data, id" << event.id();
 
     return argument;
 }
@@ -223,38 +367,39 @@ const QDBusArgument &operator>>(const QDBusArgument &argument,
 
 QDataStream &operator<<(QDataStream &stream, const CommHistory::Event &event)
 {
-    stream << event.id() << event.type() << event.startTime()
-           << event.endTime() << event.direction()  << event.isDraft()
-           << event.isRead() << event.isMissedCall()
-           << event.isEmergencyCall() << event.status()
-           << event.bytesReceived() << event.localUid() << event.remoteUid()
-           << event.parentId() << event.freeText() << event.groupId()
-           << event.messageToken() << event.mmsId() << event.lastModified()
-           << event.fromVCardFileName() << event.fromVCardLabel()
-           << event.encoding() << event.characterSet() << event.language()
-           << event.isDeleted() << event.reportDelivery()
-           << event.contentLocation() << event.subject()
-           << event.messageParts() << event.ccList() << event.bccList()
-           << event.readStatus() << event.reportRead() << event.reportReadRequested()
-           << event.validityPeriod() << event.isAction() << event.headers();
+    quint64 mask = presenceMask(event);
+    stream << COMPACT_STREAM_MARKER << mask;
+    writeCompact(stream, event, mask);
 
     return stream;
 }
 
 QDataStream &operator>>(QDataStream &stream, CommHistory::Event &event)
 {
+    qint32 first;
+    stream >> first;
+    if (first == COMPACT_STREAM_MARKER) {
+        quint64 mask;
+        stream >> mask;
+        readCompact(stream, event, mask);
+        return stream;
+    }
+
+    // streams written before the compact format, e.g. old exports
     EventPrivate p;
+    EventExtension x;
     int type, direction, status, rstatus;
-    stream >> p.id >> type >> p.startTime >> p.endTime
+    p.id = first;
+    stream >> type >> p.startTime >> p.endTime
            >> direction  >> p.isDraft >>  p.isRead >> p.isMissedCall >> p.isEmergencyCall
            >> status >> p.bytesReceived >> p.localUid >> p.remoteUid
            >> p.parentId >> p.freeText >> p.groupId
-           >> p.messageToken >> p.mmsId >>p.lastModified
-           >> p.fromVCardFileName >> p.fromVCardLabel  >> p.encoding   >> p.charset >> p.language
-           >> p.deleted >> p.reportDelivery >> p.contentLocation >> p.subject
-           >> p.messageParts >> p.ccList >> p.bccList
+           >> p.messageToken >> x.mmsId >>p.lastModified
+           >> x.fromVCardFileName >> x.fromVCardLabel  >> x.encoding   >> x.charset >> x.language
+           >> p.deleted >> p.reportDelivery >> x.contentLocation >> x.subject
+           >> x.messageParts >> x.ccList >> x.bccList
            >> rstatus >> p.reportRead >> p.reportReadRequested
-           >> p.validityPeriod >> p.isAction >> p.headers;
+           >> p.validityPeriod >> p.isAction >> x.headers;
 
     event.setId(p.id);
     event.setType((Event::EventType)type);
@@ -270,28 +415,28 @@ QDataStream &operator>>(QDataStream &stream, CommHistory::Event &event)
     event.setLocalUid(p.localUid);
     event.setRemoteUid(p.remoteUid);
     event.setParentId(p.parentId);
-    event.setSubject(p.subject);
+    event.setSubject(x.subject);
     event.setFreeText(p.freeText);
     event.setGroupId(p.groupId);
     event.setMessageToken(p.messageToken);
-    event.setMmsId(p.mmsId);
+    event.setMmsId(x.mmsId);
     event.setLastModified(p.lastModified);
-    event.setFromVCard( p.fromVCardFileName, p.fromVCardLabel );
-    event.setEncoding(p.encoding);
-    event.setCharacterSet(p.charset);
-    event.setLanguage(p.language);
+    event.setFromVCard( x.fromVCardFileName, x.fromVCardLabel );
+    event.setEncoding(x.encoding);
+    event.setCharacterSet(x.charset);
+    event.setLanguage(x.language);
     event.setDeleted(p.deleted);
     event.setReportDelivery(p.reportDelivery);
     event.setValidityPeriod(p.validityPeriod);
-    event.setContentLocation(p.contentLocation);
-    event.setMessageParts(p.messageParts);
-    event.setCcList(p.ccList);
-    event.setBccList(p.bccList);
+    event.setContentLocation(x.contentLocation);
+    event.setMessageParts(x.messageParts);
+    event.setCcList(x.ccList);
+    event.setBccList(x.bccList);
     event.setReadStatus((Event::EventReadStatus)rstatus);
     event.setReportRead(p.reportRead);
     event.setReportReadRequested(p.reportReadRequested);
     event.setIsAction(p.isAction);
-    event.setHeaders(p.headers);
+    event.setHeaders(x.headers);
 
     event.resetModifiedProperties();
 
@@ -302,21 +447,21 @@ EventPrivate::EventPrivate()
         : id(-1)
         , type(Event::UnknownType)
         , direction(Event::UnknownDirection)
-        , isDraft( false )
-        , isRead(false)
-        , isMissedCall( false )
-        , isEmergencyCall( false )
         , status(Event::UnknownStatus)
+        , readStatus(Event::UnknownReadStatus)
         , bytesReceived(0)
         , parentId(-1)
         , groupId(-1)
         , eventCount(0)
+        , validityPeriod(0)
+        , isDraft( false )
+        , isRead(false)
+        , isMissedCall( false )
+        , isEmergencyCall( false )
         , deleted(false)
         , reportDelivery(false)
         , reportRead(false)
         , reportReadRequested(false)
-        , validityPeriod(0)
-        , readStatus(Event::UnknownReadStatus)
         , isAction(false)
 {
     lastModified = QDateTime::fromTime_t(0);
@@ -326,43 +471,32 @@ EventPrivate::EventPrivate(const EventPrivate &other)
         : QSharedData(other)
         , id(other.id)
         , type(other.type)
-        , startTime(other.startTime)
-        , endTime(other.endTime)
         , direction(other.direction)
-        , isDraft( other.isDraft )
-        , isRead(other.isRead)
-        , isMissedCall( other.isMissedCall )
-        , isEmergencyCall( other.isEmergencyCall )
         , status(other.status)
+        , readStatus(other.readStatus)
         , bytesReceived(other.bytesReceived)
-        , localUid(other.localUid)
-        , remoteUid(other.remoteUid)
-        , contacts(other.contacts)
         , parentId(other.parentId)
-        , freeText(other.freeText)
         , groupId(other.groupId)
-        , messageToken(other.messageToken)
-        , mmsId(other.mmsId)
-        , lastModified(other.lastModified)
         , eventCount( other.eventCount )
-        , fromVCardFileName( other.fromVCardFileName )
-        , fromVCardLabel( other.fromVCardLabel )
-        , encoding(other.encoding)
-        , charset(other.charset)
-        , language(other.language)
+        , validityPeriod(other.validityPeriod)
+        , isDraft( other.isDraft )
+        , isRead(other.isRead)
+        , isMissedCall( other.isMissedCall )
+        , isEmergencyCall( other.isEmergencyCall )
         , deleted(other.deleted)
         , reportDelivery(other.reportDelivery)
         , reportRead(other.reportRead)
         , reportReadRequested(other.reportReadRequested)
-        , validityPeriod(other.validityPeriod)
-        , contentLocation(other.contentLocation)
-        , subject(other.subject)
-        , messageParts(other.messageParts)
-        , ccList(other.ccList)
-        , bccList(other.bccList)
-        , readStatus(other.readStatus)
         , isAction(other.isAction)
-        , headers(other.headers)
+        , startTime(other.startTime)
+        , endTime(other.endTime)
+        , lastModified(other.lastModified)
+        , localUid(other.localUid)
+        , remoteUid(other.remoteUid)
+        , contacts(other.contacts)
+        , freeText(other.freeText)
+        , messageToken(other.messageToken)
+        , ext(other.ext)
         , validProperties(other.validProperties)
         , modifiedProperties(other.modifiedProperties)
 {
@@ -441,12 +575,13 @@ bool Event::operator==(const Event &other) const
             this->d->id                == other.id()                &&
             this->d->parentId          == other.parentId()          &&
             this->d->deleted           == other.isDeleted()         &&
-            this->d->fromVCardFileName == other.fromVCardFileName() &&
-            this->d->encoding          == other.encoding()          &&
-            this->d->charset           == other.characterSet()      &&
-            this->d->language          == other.language()          &&
             this->d->reportDelivery    == other.reportDelivery()    &&
-            this->d->messageParts      == other.messageParts());
+            (this->d->ext == other.d->ext ||
+             (fromVCardFileName()      == other.fromVCardFileName() &&
+              encoding()               == other.encoding()          &&
+              characterSet()           == other.characterSet()      &&
+              language()               == other.language()          &&
+              messageParts()           == other.messageParts())));
 }
 
 bool Event::operator!=(const Event &other) const
@@ -513,7 +648,7 @@ bool Event::isVideoCall() const
 {
     bool isVideo = false;
 
-    QString header = d->headers.value(VIDEO_CALL_HEADER).toLower();
+    QString header = d->extension().headers.value(VIDEO_CALL_HEADER).toLower();
     if (header == "true" || header == "1" || header == "yes")
         isVideo = true;
 
@@ -557,7 +692,7 @@ QList<Event::Contact> Event::contacts() const
 
 QString Event::subject() const
 {
-    return d->subject;
+    return d->extension().subject;
 }
 
 QString Event::freeText() const
@@ -577,7 +712,7 @@ QString Event::messageToken() const
 
 QString Event::mmsId() const
 {
-    return d->mmsId;
+    return d->extension().mmsId;
 }
 
 QDateTime Event::lastModified() const
@@ -592,22 +727,22 @@ int Event::eventCount() const
 
 QList<MessagePart> Event::messageParts() const
 {
-    return d->messageParts;
+    return d->extension().messageParts;
 }
 
 QStringList Event::toList() const
 {
-    return d->headers.value(MMS_TO_HEADER).split("\x1e", QString::SkipEmptyParts);
+    return d->extension().headers.value(MMS_TO_HEADER).split("\x1e", QString::SkipEmptyParts);
 }
 
 QStringList Event::ccList() const
 {
-    return d->ccList;
+    return d->extension().ccList;
 }
 
 QStringList Event::bccList() const
 {
-    return d->bccList;
+    return d->extension().bccList;
 }
 
 Event::EventReadStatus Event::readStatus() const
@@ -617,27 +752,27 @@ Event::EventReadStatus Event::readStatus() const
 
 QString Event::fromVCardFileName() const
 {
-    return d->fromVCardFileName;
+    return d->extension().fromVCardFileName;
 }
 
 QString Event::fromVCardLabel() const
 {
-    return d->fromVCardLabel;
+    return d->extension().fromVCardLabel;
 }
 
 QString Event::characterSet() const
 {
-    return d->charset;
+    return d->extension().charset;
 }
 
 QString Event::language() const
 {
-    return d->language;
+    return d->extension().language;
 }
 
 QString Event::encoding() const
 {
-    return d->encoding;
+    return d->extension().encoding;
 }
 
 bool Event::isDeleted() const
@@ -667,7 +802,7 @@ int Event::validityPeriod() const
 
 QString Event::contentLocation() const
 {
-    return d->contentLocation;
+    return d->extension().contentLocation;
 }
 
 bool Event::isAction() const
@@ -677,7 +812,7 @@ bool Event::isAction() const
 
 QHash<QString, QString> Event::headers() const
 {
-    return d->headers;
+    return d->extension().headers;
 }
 
 void Event::setValidProperties(const Event::PropertySet &properties)
@@ -758,9 +893,10 @@ void Event::setIsEmergencyCall( bool isEmergency )
 void Event::setIsVideoCall( bool isVideo )
 {
     if (!isVideo) {
-        d->headers.remove(VIDEO_CALL_HEADER);
+        if (d->ext)
+            d->writableExtension().headers.remove(VIDEO_CALL_HEADER);
     } else {
-        d->headers.insert(VIDEO_CALL_HEADER, "true");
+        d->writableExtension().headers.insert(VIDEO_CALL_HEADER, "true");
     }
     d->propertyChanged(Event::Headers);
 }
@@ -817,7 +953,7 @@ void Event::setContacts(const QList<Event::Contact> &contacts)
 
 void Event::setSubject(const QString &subject)
 {
-    d->subject = subject;
+    d->setExtended(&EventExtension::subject, subject);
     d->propertyChanged(Event::Subject);
 }
 
@@ -841,7 +977,7 @@ void Event::setMessageToken(const QString &messageToken)
 
 void Event::setMmsId(const QString &mmsId)
 {
-    d->mmsId = mmsId;
+    d->setExtended(&EventExtension::mmsId, mmsId);
     d->propertyChanged(Event::MmsId);
 }
 
@@ -859,27 +995,27 @@ void Event::setEventCount( int count )
 
 void Event::setFromVCard( const QString &filename, const QString &label )
 {
-    d->fromVCardFileName = filename;
-    d->fromVCardLabel = label.isEmpty() ? filename : label;
+    d->setExtended(&EventExtension::fromVCardFileName, filename);
+    d->setExtended(&EventExtension::fromVCardLabel, label.isEmpty() ? filename : label);
     d->propertyChanged(Event::FromVCardFileName);
     d->propertyChanged(Event::FromVCardLabel);
 }
 
 void Event::setEncoding(const QString& enc)
 {
-    d->encoding = enc;
+    d->setExtended(&EventExtension::encoding, enc);
     d->propertyChanged(Event::Encoding);
 }
 
 void Event::setCharacterSet(const QString& charset)
 {
-    d->charset = charset;
+    d->setExtended(&EventExtension::charset, charset);
     d->propertyChanged(Event::CharacterSet);
 }
 
 void Event::setLanguage(const QString &lang)
 {
-    d->language = lang;
+    d->setExtended(&EventExtension::language, lang);
     d->propertyChanged(Event::Language);
 }
 
@@ -903,41 +1039,42 @@ void Event::setValidityPeriod(int validity)
 
 void Event::setContentLocation(const QString &location)
 {
-    d->contentLocation = location;
+    d->setExtended(&EventExtension::contentLocation, location);
     d->propertyChanged(Event::ContentLocation);
 }
 
 void Event::setMessageParts(const QList<MessagePart> &parts)
 {
-    d->messageParts = parts;
+    d->setExtended(&EventExtension::messageParts, parts);
     d->propertyChanged(Event::MessageParts);
 }
 
 void Event::addMessagePart(const MessagePart &part)
 {
-    d->messageParts.append(part);
+    d->writableExtension().messageParts.append(part);
     d->propertyChanged(Event::MessageParts);
 }
 
 void Event::setToList(const QStringList &toList)
 {
     if (toList.isEmpty()) {
-        d->headers.remove(MMS_TO_HEADER);
+        if (d->ext)
+            d->writableExtension().headers.remove(MMS_TO_HEADER);
     } else {
-        d->headers.insert(MMS_TO_HEADER, toList.join("\x1e"));
+        d->writableExtension().headers.insert(MMS_TO_HEADER, toList.join("\x1e"));
     }
     d->propertyChanged(Event::Headers);
 }
 
 void Event::setCcList(const QStringList &ccList)
 {
-    d->ccList = ccList;
+    d->setExtended(&EventExtension::ccList, ccList);
     d->propertyChanged(Event::Cc);
 }
 
 void Event::setBccList(const QStringList &bccList)
 {
-    d->bccList = bccList;
+    d->setExtended(&EventExtension::bccList, bccList);
     d->propertyChanged(Event::Bcc);
 }
 
@@ -967,7 +1104,7 @@ void Event::setIsAction(bool isAction)
 
 void Event::setHeaders(const QHash<QString, QString> &headers)
 {
-    d->headers = headers;
+    d->setExtended(&EventExtension::headers, headers);
     d->propertyChanged(Event::Headers);
 }
 
@@ -986,9 +1123,9 @@ QString Event::toString() const
     }
 
     QString headers;
-    if (!d->headers.isEmpty()) {
+    if (!d->extension().headers.isEmpty()) {
         QStringList headerList;
-        QHashIterator<QString, QString> i(d->headers);
+        QHashIterator<QString, QString> i(d->extension().headers);
         while (i.hasNext()) {
             i.next();
             headerList.append(QString("%1=%2").arg(i.key()).arg(i.value()));
@@ -32,6 +32,7 @@
 #include "eventtreeitem.h"
 #include "queryrunner.h"
 #include "committingtransaction.h"
+#include "telemetry.h"
 
 using namespace CommHistory;
 
@@ -46,6 +47,9 @@ EventModel::EventModel(QObject *parent)
             this, SIGNAL(eventsCommitted(const QList<CommHistory::Event>&,bool)));
 
     setupRoles();
+
+    if (Telemetry::isEnabled())
+        Telemetry::instance()->watchModel(this);
 }
 
 EventModel::EventModel(EventModelPrivate &dd, QObject *parent)
@@ -56,6 +60,9 @@ EventModel::EventModel(EventModelPrivate &dd, QObject *parent)
             this, SIGNAL(eventsCommitted(const QList<CommHistory::Event>&,bool)));
 
     setupRoles();
+
+    if (Telemetry::isEnabled())
+        Telemetry::instance()->watchModel(this);
 }
 
 EventModel::~EventModel()
@@ -481,6 +488,18 @@ void EventModel::enableContactChanges(bool enabled)
     d->contactChangesEnabled = enabled;
 }
 
+void EventModel::setBatchedUpdates(bool enabled)
+{
+    Q_D(EventModel);
+    d->setBatchedUpdates(enabled);
+}
+
+bool EventModel::batchedUpdates() const
+{
+    Q_D(const EventModel);
+    return d->batchedUpdates;
+}
+
 bool EventModel::addEvent(Event &event, bool toModelOnly)
 {
     Q_D(EventModel);
@@ -557,23 +576,24 @@ bool EventModel::addEvents(QList<Event> &events, bool toModelOnly)
     }
     // otherwise execute proper db operations.
     else {
-        while (i.hasNext()) {
+        int first = 0;
+        while (first < events.size()) {
             d->tracker()->transaction(d->syncOnCommit);
 
-            while (added.size() < MAX_ADD_EVENTS_SIZE && i.hasNext()) {
-                Event &event = i.next();
-
-                if (!d->doAddEvent(event)) {
-                    d->tracker()->rollback();
-                    return false;
-                }
+            added = events.mid(first, MAX_ADD_EVENTS_SIZE);
+            if (!d->doAddEvents(added)) {
+                d->tracker()->rollback();
+                return false;
+            }
 
-                if (d->acceptsEvent(event)) {
-                    d->addToModel(event);
+            for (int j = 0; j < added.size(); j++) {
+                if (d->acceptsEvent(added[j])) {
+                    d->addToModel(added[j]);
                 }
-
-                added.append(event);
+                // propagate new ids back to the caller
+                events[first + j] = added[j];
             }
+            first += added.size();
 
             CommittingTransaction *t = d->commitTransaction(added);
             if (t)
@@ -958,6 +978,24 @@ QThread* EventModel::backgroundThread()
     return d->bgThread;
 }
 
+void EventModel::setQueryPriority(int priority)
+{
+    Q_D(EventModel);
+
+    d->queryPriority = priority;
+    if (d->queryRunner)
+        d->queryRunner->setPriority(priority);
+    if (d->partQueryRunner)
+        d->partQueryRunner->setPriority(priority);
+}
+
+int EventModel::queryPriority() const
+{
+    Q_D(const EventModel);
+
+    return d->queryPriority;
+}
+
 TrackerIO& EventModel::trackerIO()
 {
     Q_D(EventModel);
@@ -229,6 +229,16 @@ public:
      */
     void enableContactChanges(bool enabled);
 
+    /*!
+     * If enabled, the model applies the changes of each coalescing window
+     * of the sending process at once, when the window ends, instead of
+     * one D-Bus change signal at a time. Disabled by default.
+     *
+     * \param enabled If true, receive changes in batches.
+     */
+    void setBatchedUpdates(bool enabled);
+    bool batchedUpdates() const;
+
     /*!
      * Add a new event.
      *
@@ -357,6 +367,17 @@ public:
     void setBackgroundThread(QThread *thread);
     QThread* backgroundThread();
 
+    /*!
+     * Set the priority of this model's query result decoding. Result rows of
+     * all models are decoded on a shared worker pool; rows of a higher
+     * priority model are decoded first. Raise it for the model that is
+     * currently on screen. Default is 0.
+     *
+     * \param priority decoding priority
+    **/
+    void setQueryPriority(int priority);
+    int queryPriority() const;
+
     /*!
      * Return an instance of TrackerIO that can be used for low-level queries.
      * \return a TrackerIO
@@ -29,6 +29,7 @@
 #include "eventmodel.h"
 #include "eventmodel_p.h"
 #include "updatesemitter.h"
+#include "updatesreceiver.h"
 #include "event.h"
 #include "eventtreeitem.h"
 #include "constants.h"
@@ -55,10 +56,12 @@ EventModelPrivate::EventModelPrivate(EventModel *model)
         , threadCanFetchMore(false)
         , syncOnCommit(false)
         , contactChangesEnabled(false)
+        , batchedUpdates(false)
         , queryRunner(0)
         , partQueryRunner(0)
         , propertyMask(Event::allProperties())
         , bgThread(0)
+        , queryPriority(0)
         , m_pTracker(0)
 {
     q_ptr = model;
@@ -108,6 +111,8 @@ void EventModelPrivate::resetQueryRunners()
 
     queryRunner = new QueryRunner(tracker());
     partQueryRunner = new QueryRunner(tracker());
+    queryRunner->setPriority(queryPriority);
+    partQueryRunner->setPriority(queryPriority);
 
     connect(queryRunner, SIGNAL(eventsReceived(int, int, QList<CommHistory::Event>)),
             this, SLOT(eventsReceivedSlot(int, int, QList<CommHistory::Event>)));
@@ -154,13 +159,20 @@ QModelIndex EventModelPrivate::findEventRecursive(int id, EventTreeItem *parent)
 {
     Q_Q(const EventModel);
 
-    for (int row = 0; row < parent->childCount(); row++) {
-        if (parent->eventAt(row).id() == id) {
-            return q->createIndex(row, 0, parent->child(row));
-        } else if (parent->child(row)->childCount()) {
-            return findEventRecursive(id, parent->child(row));
+    int row = parent->findChild(id);
+    if (row != -1)
+        return q->createIndex(row, 0, parent->child(row));
+
+    if (parent->hasNestedChildren()) {
+        for (row = 0; row < parent->childCount(); row++) {
+            if (parent->child(row)->childCount()) {
+                QModelIndex index = findEventRecursive(id, parent->child(row));
+                if (index.isValid())
+                    return index;
+            }
         }
     }
+
     return QModelIndex();
 }
 
@@ -302,7 +314,7 @@ void EventModelPrivate::deleteFromModel(int id)
     }
 }
 
-bool EventModelPrivate::doAddEvent( Event &event )
+bool EventModelPrivate::checkNewEvent(const Event &event) const
 {
     if (event.type() == Event::UnknownType) {
         qWarning() << Q_FUNC_INFO << "Event type not set";
@@ -321,6 +333,15 @@ bool EventModelPrivate::doAddEvent( Event &event )
         }
     }
 
+    return true;
+}
+
+bool EventModelPrivate::doAddEvent( Event &event )
+{
+    if (!checkNewEvent(event)) {
+        return false;
+    }
+
     if (!tracker()->addEvent(event)) {
         return false;
     }
@@ -328,6 +349,21 @@ bool EventModelPrivate::doAddEvent( Event &event )
     return true;
 }
 
+bool EventModelPrivate::doAddEvents(QList<Event> &events)
+{
+    foreach (const Event &event, events) {
+        if (!checkNewEvent(event)) {
+            return false;
+        }
+    }
+
+    if (!tracker()->addEvents(events)) {
+        return false;
+    }
+
+    return true;
+}
+
 bool EventModelPrivate::doDeleteEvent(int id, Event &event)
 {
     QModelIndex index = findEvent(id);
@@ -471,6 +507,84 @@ void EventModelPrivate::eventDeletedSlot(int id)
     deleteFromModel(id);
 }
 
+void EventModelPrivate::groupsUpdatedFullSlot(const QList<CommHistory::Group> &groups)
+{
+    Q_UNUSED(groups);
+}
+
+void EventModelPrivate::groupsDeletedSlot(const QList<int> &groupIds)
+{
+    Q_UNUSED(groupIds);
+}
+
+void EventModelPrivate::updatesBatchedSlot(const QList<CommHistory::Event> &addedEvents,
+                                           const QList<CommHistory::Event> &updatedEvents,
+                                           const QList<int> &deletedEventIds,
+                                           const QList<CommHistory::Group> &addedGroups,
+                                           const QList<int> &updatedGroupIds,
+                                           const QList<CommHistory::Group> &updatedGroups,
+                                           const QList<int> &deletedGroupIds)
+{
+    Q_UNUSED(addedGroups);
+    Q_UNUSED(updatedGroupIds);
+
+    // same order UpdatesEmitter uses for the per-type signals
+    if (!addedEvents.isEmpty())
+        eventsAddedSlot(addedEvents);
+    if (!updatedEvents.isEmpty())
+        eventsUpdatedSlot(updatedEvents);
+    if (!updatedGroups.isEmpty())
+        groupsUpdatedFullSlot(updatedGroups);
+    foreach (int id, deletedEventIds)
+        eventDeletedSlot(id);
+    if (!deletedGroupIds.isEmpty())
+        groupsDeletedSlot(deletedGroupIds);
+}
+
+void EventModelPrivate::setBatchedUpdates(bool enabled)
+{
+    if (batchedUpdates == enabled)
+        return;
+
+    batchedUpdates = enabled;
+
+    typedef bool (QDBusConnection::*ConnectFunc)(const QString &, const QString &,
+                                                 const QString &, const QString &,
+                                                 QObject *, const char *);
+    ConnectFunc legacy = enabled ? &QDBusConnection::disconnect : &QDBusConnection::connect;
+    QDBusConnection bus = QDBusConnection::sessionBus();
+
+    (bus.*legacy)(QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_ADDED_SIGNAL,
+                  this, SLOT(eventsAddedSlot(const QList<CommHistory::Event> &)));
+    (bus.*legacy)(QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_UPDATED_SIGNAL,
+                  this, SLOT(eventsUpdatedSlot(const QList<CommHistory::Event> &)));
+    (bus.*legacy)(QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENT_DELETED_SIGNAL,
+                  this, SLOT(eventDeletedSlot(int)));
+    // the receiver delivers each window as one signal
+    if (enabled) {
+        receiver = UpdatesReceiver::instance();
+        connect(receiver.data(),
+                SIGNAL(updatesBatched(const QList<CommHistory::Event> &,
+                                      const QList<CommHistory::Event> &,
+                                      const QList<int> &,
+                                      const QList<CommHistory::Group> &,
+                                      const QList<int> &,
+                                      const QList<CommHistory::Group> &,
+                                      const QList<int> &)),
+                this,
+                SLOT(updatesBatchedSlot(const QList<CommHistory::Event> &,
+                                        const QList<CommHistory::Event> &,
+                                        const QList<int> &,
+                                        const QList<CommHistory::Group> &,
+                                        const QList<int> &,
+                                        const QList<CommHistory::Group> &,
+                                        const QList<int> &)));
+    } else if (receiver) {
+        receiver->disconnect(this);
+        receiver.clear();
+    }
+}
+
 CommittingTransaction* EventModelPrivate::commitTransaction(const QList<Event> &events)
 {
     CommittingTransaction *t = tracker()->commit();
@@ -668,7 +782,16 @@ TrackerIO* EventModelPrivate::tracker()
 
 bool EventModelPrivate::setContactFromCache(CommHistory::Event &event)
 {
-    QList<Event::Contact> contacts = contactCache.value(qMakePair(event.localUid(), event.remoteUid()));
+    QPair<QString, QString> cacheKey = qMakePair(event.localUid(), event.remoteUid());
+    QList<Event::Contact> contacts = contactCache.value(cacheKey);
+
+    // contacts resolved earlier, possibly for another model
+    if (contacts.isEmpty() && contactListener) {
+        contacts = contactListener->cachedContacts(event.localUid(), event.remoteUid());
+        if (!contacts.isEmpty())
+            contactCache.insert(cacheKey, contacts);
+    }
+
     if (!contacts.isEmpty()) {
         event.setContacts(contacts);
         return true;
@@ -40,6 +40,7 @@ class ContactListener;
 class CommittingTransaction;
 class EventsQuery;
 class UpdatesEmitter;
+class UpdatesReceiver;
 
 /*!
  * \class EventModelPrivate
@@ -123,7 +124,13 @@ public:
     virtual void modifyInModel(Event &event);
     virtual void deleteFromModel(int id);
 
+    /*!
+     * Checks that the event has the fields required for adding it.
+     */
+    bool checkNewEvent(const Event &event) const;
+
     virtual bool doAddEvent(Event &event);
+    virtual bool doAddEvents(QList<Event> &events);
     virtual bool doDeleteEvent(int id, Event &event);
 
     QModelIndex findEventRecursive(int id, EventTreeItem *parent) const;
@@ -132,6 +139,13 @@ public:
 
     bool canFetchMore() const;
 
+    /*!
+     * Switch between the per-type D-Bus change signals and the windows
+     * delivered by UpdatesReceiver. Submodels listening to additional signals
+     * should reimplement this and call the base implementation.
+     */
+    virtual void setBatchedUpdates(bool enabled);
+
     /*
      * Called when contacts are somehow modified. Traverses through the
      * event list and updates event.contactId() and event.contactName()
@@ -172,6 +186,7 @@ public:
     bool threadCanFetchMore;
     bool syncOnCommit;
     bool contactChangesEnabled;
+    bool batchedUpdates;
 
     QueryRunner *queryRunner;
     QueryRunner *partQueryRunner;
@@ -184,9 +199,11 @@ public:
     QMap<QPair<QString,QString>, QList<Event::Contact> > contactCache;
 
     QThread *bgThread;
+    int queryPriority;
 
     TrackerIO *m_pTracker;
     QSharedPointer<UpdatesEmitter> emitter;
+    QSharedPointer<UpdatesReceiver> receiver;
 
 public Q_SLOTS:
     virtual void eventsReceivedSlot(int start, int end, QList<CommHistory::Event> events);
@@ -203,6 +220,18 @@ public Q_SLOTS:
 
     virtual void eventDeletedSlot(int id);
 
+    virtual void groupsUpdatedFullSlot(const QList<CommHistory::Group> &groups);
+
+    virtual void groupsDeletedSlot(const QList<int> &groupIds);
+
+    void updatesBatchedSlot(const QList<CommHistory::Event> &addedEvents,
+                            const QList<CommHistory::Event> &updatedEvents,
+                            const QList<int> &deletedEventIds,
+                            const QList<CommHistory::Group> &addedGroups,
+                            const QList<int> &updatedGroupIds,
+                            const QList<CommHistory::Group> &updatedGroups,
+                            const QList<int> &deletedGroupIds);
+
     void canFetchMoreChangedSlot(bool canFetch);
 
     void slotContactUpdated(quint32 localId,
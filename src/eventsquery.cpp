@@ -22,8 +22,39 @@
 
 #include <QDebug>
 #include <QStringList>
+#include <QHash>
+#include <QMutex>
+#include <QSparqlQuery>
 
 #include "eventsquery.h"
+#include "eventsquery_p.h"
+
+namespace {
+
+// Compiled query text is shared by all EventsQuery instances with the same
+// shape (properties, patterns and modifiers). Values that change between
+// otherwise identical queries should be passed with bindValue().
+struct CompiledQuery {
+    CompiledQuery() : extraColumns(0) {}
+
+    QString text;
+    QList<CommHistory::Event::Property> variables;
+    int extraColumns;
+};
+
+struct QueryCache {
+    QMutex mutex;
+    QHash<QString, CompiledQuery> queries;
+};
+
+Q_GLOBAL_STATIC(QueryCache, queryCache)
+
+const int MAX_CACHED_QUERIES = 64;
+
+// start of the inner select, right after the projections of the query
+const char * const INNER_SELECT = "SELECT ?message ?from ?to ";
+
+}
 
 namespace CommHistory
 {
@@ -448,6 +479,8 @@ public:
         lastAdded = part;
     }
 
+    QHash<QString, QVariant> bindings;
+
     void referenceVariable(Event::Property property)
     {
         parts[lastAdded].patterns.last() = parts[lastAdded].patterns.last().arg(eventPropertyName(property));
@@ -455,8 +488,105 @@ public:
         if (!variables.contains(property))
             variables.append(property);
     }
+
+    QString shapeKey() const
+    {
+        QStringList key;
+
+        key << QString::number(distinct);
+        foreach (Event::Property p, variables) {
+            key << QString::number(p);
+            if (parts[Modifiers].variables.contains(p))
+                key << QLatin1String("m");
+            else if (parts[Patterns].variables.contains(p))
+                key << QLatin1String("p");
+        }
+
+        for (int i = 0; i < NumberOfParts; i++) {
+            key << QLatin1String("\n");
+            key << parts[i].patterns;
+        }
+
+        return key.join(QLatin1String(" "));
+    }
+
+    CompiledQuery compile() const;
 };
 
+CompiledQuery EventsQueryPrivate::compile() const
+{
+    CompiledQuery compiled;
+    QStringList query;
+    QStringList patterns(parts[Patterns].patterns);
+
+    // generate variable names
+    QStringList projections;
+    QStringList subselectProjections;
+    foreach(Event::Property p, variables) {
+
+        if (p == Event::EventCount) { // runtime
+            continue;
+        }
+
+        if (parts[Modifiers].variables.contains(p)) {
+            // variable referenced in modifiers, use pattern instead of function
+            QString varName = eventPropertyName(p);
+            projections.append(varName);
+            subselectProjections.append(varName);
+            patterns.append(patternForProperty(p));
+        } else if (parts[Patterns].variables.contains(p)) {
+            // TODO: varable referenced in used defined pattern and should be defined there
+            QString varName = eventPropertyName(p);
+            projections.append(varName);
+            subselectProjections.append(varName);
+        } else {
+            QString func = functionForProperty(p);
+
+            if (!func.isEmpty())
+                projections.append(func);
+            else {
+                //fallback to pattern
+                QString pattern = patternForProperty(p);
+                if (!pattern.isEmpty()) {
+                    projections.append(eventPropertyName(p));
+                    subselectProjections.append(eventPropertyName(p));
+                    patterns.append(pattern);
+                } else {
+                    qDebug() << "Ignored prop" << p;
+                    continue;
+                }
+            }
+        }
+
+        compiled.variables.append(p);
+    }
+
+    projections << parts[Projections].patterns;
+
+    query << QLatin1String("SELECT");
+    if (distinct)
+        query << QLatin1String("DISTINCT");
+    query << projections.join(" ");
+    query << QLatin1String("WHERE {");
+
+    /* handle a few properties separately for query purposes -
+     */
+    query << QLatin1String(INNER_SELECT)
+          << QLatin1String("IF (nmo:isSent(?message) = true, ?to, ?from) AS ?target ")
+          << subselectProjections.join(" ")
+          << QLatin1String("WHERE {"
+                           "?message nmo:from ?from ; nmo:to ?to . ");
+
+    query << patterns;
+    query << QLatin1String("} }");
+    query << parts[Modifiers].patterns;
+
+    compiled.text = query.join(" ");
+    compiled.extraColumns = parts[Projections].patterns.size();
+
+    return compiled;
+}
+
 EventsQuery::EventsQuery(const Event::PropertySet &propertySet) :
         d(new EventsQueryPrivate(this, propertySet))
 {
@@ -511,74 +641,85 @@ QList<Event::Property> EventsQuery::eventProperties() const
     return d->variables;
 }
 
-QString EventsQuery::query() const
+EventsQuery& EventsQuery::bindValue(const QString &name, const QVariant &value)
 {
-    qDebug() << Q_FUNC_INFO;
-    QStringList query;
+    d->bindings.insert(name, value);
 
-    // generate variable names
-    QStringList projections;
-    QStringList subselectProjections;
-    foreach(Event::Property p, d->variables) {
+    return *this;
+}
 
-        if (p == Event::EventCount) { // runtime
-            d->variables.removeOne(p);
-            continue;
+QList<Event::Property> eventsQueryProperties(const QString &query,
+                                             int *extraColumns)
+{
+    QList<Event::Property> properties;
+    if (extraColumns)
+        *extraColumns = 0;
+
+    // bound values are only used in patterns and modifiers, so the
+    // projections are the same as in the compiled text
+    int end = query.indexOf(QLatin1String(INNER_SELECT));
+    QueryCache *cache = queryCache();
+    if (end < 0 || !cache)
+        return properties;
+
+    QString projections = query.left(end);
+
+    QMutexLocker locker(&cache->mutex);
+    foreach (const CompiledQuery &compiled, cache->queries) {
+        if (compiled.text.startsWith(projections)
+            && compiled.text.indexOf(QLatin1String(INNER_SELECT)) == end) {
+            properties = compiled.variables;
+            if (extraColumns)
+                *extraColumns = compiled.extraColumns;
+            break;
         }
+    }
 
-        if (d->parts[EventsQueryPrivate::Modifiers].variables.contains(p)) {
-            // variable referenced in modifiers, use pattern instead of function
-            QString varName = eventPropertyName(p);
-            projections.append(varName);
-            subselectProjections.append(varName);
-            d->parts[EventsQueryPrivate::Patterns].patterns.append(patternForProperty(p));
-        } else if (d->parts[EventsQueryPrivate::Patterns].variables.contains(p)) {
-            // TODO: varable referenced in used defined pattern and should be defined there
-            QString varName = eventPropertyName(p);
-            projections.append(varName);
-            subselectProjections.append(varName);
-            //d->parts[EventsQueryPrivate::Patterns].patterns.append(patternForProperty(p));
-        } else {
-            QString func = functionForProperty(p);
+    return properties;
+}
 
-            if (!func.isEmpty())
-                projections.append(func);
-            else {
-                //fallback to pattern
-                QString patterns = patternForProperty(p);
-                if (!patterns.isEmpty()) {
-                    projections.append(eventPropertyName(p));
-                    subselectProjections.append(eventPropertyName(p));
-                    d->parts[EventsQueryPrivate::Patterns].patterns.append(patternForProperty(p));
-                } else {
-                    qDebug() << "Ignored prop" << p;
-                    d->variables.removeOne(p);
-                }
-            }
+QString EventsQuery::query() const
+{
+    qDebug() << Q_FUNC_INFO;
+
+    QString key = d->shapeKey();
+    CompiledQuery compiled;
+    bool cached = false;
+
+    QueryCache *cache = queryCache();
+    if (cache) {
+        QMutexLocker locker(&cache->mutex);
+        QHash<QString, CompiledQuery>::const_iterator i = cache->queries.constFind(key);
+        if (i != cache->queries.constEnd()) {
+            compiled = i.value();
+            cached = true;
         }
     }
 
-    projections << d->parts[EventsQueryPrivate::Projections].patterns;
+    if (!cached) {
+        compiled = d->compile();
 
-    query << QLatin1String("SELECT");
-    if (d->distinct)
-        query << QLatin1String("DISTINCT");
-    query << projections.join(" ");
-    query << QLatin1String("WHERE {");
+        if (cache) {
+            QMutexLocker locker(&cache->mutex);
+            if (cache->queries.size() >= MAX_CACHED_QUERIES)
+                cache->queries.clear();
+            cache->queries.insert(key, compiled);
+        }
+    }
 
-    /* handle a few properties separately for query purposes -
-     */
-    query << QLatin1String("SELECT ?message ?from ?to ")
-          << QLatin1String("IF (nmo:isSent(?message) = true, ?to, ?from) AS ?target ")
-          << subselectProjections.join(" ")
-          << QLatin1String("WHERE {"
-                           "?message nmo:from ?from ; nmo:to ?to . ");
+    d->variables = compiled.variables;
 
-    query << d->parts[EventsQueryPrivate::Patterns].patterns;
-    query << QLatin1String("} }");
-    query << d->parts[EventsQueryPrivate::Modifiers].patterns;
+    if (d->bindings.isEmpty())
+        return compiled.text;
+
+    QSparqlQuery sparqlQuery(compiled.text);
+    QHashIterator<QString, QVariant> i(d->bindings);
+    while (i.hasNext()) {
+        i.next();
+        sparqlQuery.bindValue(i.key(), i.value());
+    }
 
-    return query.join(" ");
+    return sparqlQuery.preparedQueryText();
 }
 
 } // namespace
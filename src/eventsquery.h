@@ -23,6 +23,8 @@
 #ifndef EVENTSQUERY_H
 #define EVENTSQUERY_H
 
+#include <QVariant>
+
 #include "event.h"
 #include "libcommhistoryexport.h"
 
@@ -69,6 +71,18 @@ public:
      */
     EventsQuery& variable(Event::Property property);
 
+    /*!
+     * \brief bind a value to a ?:name placeholder used in patterns or modifiers
+     *
+     * Query text is compiled once per distinct set of properties, patterns
+     * and modifiers and cached, so values that change between otherwise
+     * identical queries (ids, timestamps) should be bound instead of being
+     * formatted into the patterns.
+     *
+     * \return itself
+     */
+    EventsQuery& bindValue(const QString &name, const QVariant &value);
+
     /*!
      * \brief Specify usage of DISTINCT with SELECT
      *
@@ -0,0 +1,51 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef EVENTSQUERY_P_H
+#define EVENTSQUERY_P_H
+
+#include <QList>
+#include <QString>
+
+#include "event.h"
+
+namespace CommHistory {
+
+/*!
+ * \brief event properties of a query built by EventsQuery::query() in
+ * this process
+ *
+ * Lets in-process SparqlBackend implementations of the tests return
+ * result columns in the order the query expects them.
+ *
+ * \param query final query text
+ * \param extraColumns set to the number of projections added with
+ * addProjection(), if not 0
+ *
+ * \return properties in column order, empty if the query is unknown
+ */
+QList<Event::Property> eventsQueryProperties(const QString &query,
+                                             int *extraColumns = 0);
+
+} //namespace
+
+#endif // EVENTSQUERY_P_H
@@ -28,25 +28,56 @@
 using namespace CommHistory;
 
 EventTreeItem::EventTreeItem(const Event &event, EventTreeItem *parent)
+    : eventData(event),
+      parentItem(parent),
+      rowIndex(0),
+      rowsValid(true),
+      indexedId(event.id()),
+      nestedChildren(0)
 {
-    parentItem = parent;
-    eventData = new Event( event );
 }
 
 EventTreeItem::~EventTreeItem()
 {
-    delete eventData;
     qDeleteAll(children);
 }
 
+void EventTreeItem::attach(EventTreeItem *child)
+{
+    if (!child->parentItem)
+        child->parentItem = this;
+
+    child->indexedId = child->eventData.id();
+    childIds.insert(child->indexedId, child);
+
+    if (child->childCount())
+        nestedChildren++;
+    if (children.count() == 1 && parentItem)
+        parentItem->nestedChildren++;
+}
+
+void EventTreeItem::detach(EventTreeItem *child)
+{
+    childIds.remove(child->indexedId, child);
+
+    if (child->childCount())
+        nestedChildren--;
+    if (children.isEmpty() && parentItem)
+        parentItem->nestedChildren--;
+}
+
 void EventTreeItem::appendChild(EventTreeItem *child)
 {
+    child->rowIndex = children.count();
     children.append(child);
+    attach(child);
 }
 
 void EventTreeItem::prependChild(EventTreeItem *child)
 {
     children.prepend(child);
+    rowsValid = false;
+    attach(child);
 }
 
 void EventTreeItem::moveChild( int fromRow, int toRow )
@@ -60,16 +91,23 @@ void EventTreeItem::moveChild( int fromRow, int toRow )
     }
 
     children.insert( toRow, children.takeAt( fromRow ) );
+    rowsValid = false;
 }
 
 void EventTreeItem::insertChildAt(int row, EventTreeItem *child)
 {
     children.insert(row, child);
+    rowsValid = false;
+    attach(child);
 }
 
 void EventTreeItem::removeAt(int row)
 {
-    delete children.takeAt(row);
+    EventTreeItem *child = children.takeAt(row);
+    if (row != children.count())
+        rowsValid = false;
+    detach(child);
+    delete child;
 }
 
 EventTreeItem *EventTreeItem::child(int row)
@@ -90,16 +128,18 @@ int EventTreeItem::childCount() const
 
 Event &EventTreeItem::event()
 {
-    return *eventData;
+    return eventData;
 }
 
 void EventTreeItem::setEvent(const Event &event)
 {
-    if ( eventData )
-    {
-        delete eventData;
+    eventData = event;
+
+    if (parentItem && indexedId != event.id()
+        && parentItem->childIds.remove(indexedId, this)) {
+        indexedId = event.id();
+        parentItem->childIds.insert(indexedId, this);
     }
-    eventData = new Event( event );
 }
 
 EventTreeItem *EventTreeItem::parent()
@@ -110,8 +150,52 @@ EventTreeItem *EventTreeItem::parent()
 int EventTreeItem::row() const
 {
     if (parentItem) {
-        return parentItem->children.indexOf(const_cast<EventTreeItem *>(this));
+        if (!parentItem->rowsValid)
+            parentItem->renumber();
+        return rowIndex;
     }
 
     return 0;
 }
+
+int EventTreeItem::findChild(int eventId) const
+{
+    if (!rowsValid)
+        renumber();
+
+    int found = -1;
+    QMultiHash<int, EventTreeItem *>::const_iterator i = childIds.constFind(eventId);
+    for (; i != childIds.constEnd() && i.key() == eventId; ++i) {
+        EventTreeItem *child = i.value();
+        if (child->eventData.id() != eventId) {
+            // id changed through event(), rebuild and look again
+            reindex();
+            return findChild(eventId);
+        }
+        if (found == -1 || child->rowIndex < found)
+            found = child->rowIndex;
+    }
+
+    return found;
+}
+
+bool EventTreeItem::hasNestedChildren() const
+{
+    return nestedChildren > 0;
+}
+
+void EventTreeItem::renumber() const
+{
+    for (int i = 0; i < children.count(); i++)
+        children.at(i)->rowIndex = i;
+    rowsValid = true;
+}
+
+void EventTreeItem::reindex() const
+{
+    childIds.clear();
+    foreach (EventTreeItem *child, children) {
+        child->indexedId = child->eventData.id();
+        childIds.insert(child->indexedId, child);
+    }
+}
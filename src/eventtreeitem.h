@@ -24,15 +24,19 @@
 #define COMMHISTORY_EVENTTREEITEM_H
 
 #include <QList>
+#include <QMultiHash>
 
-namespace CommHistory {
+#include "event.h"
 
-class Event;
+namespace CommHistory {
 
 /*!
  * \class EventTreeItem
  *
  * Event container for CommHistoryModels.
+ *
+ * Items index their children by event id and cache the row of each
+ * child, so row() and findChild() don't scan the child list.
  */
 class EventTreeItem
 {
@@ -53,10 +57,35 @@ public:
     EventTreeItem *parent();
     int row() const;
 
+    /*!
+     * Row of the first direct child with the given event id.
+     *
+     * \return row or -1 if not found.
+     */
+    int findChild(int eventId) const;
+
+    /*!
+     * \return true if any of the direct children has children.
+     */
+    bool hasNestedChildren() const;
+
 private:
+    void attach(EventTreeItem *child);
+    void detach(EventTreeItem *child);
+    void renumber() const;
+    void reindex() const;
+
     QList<EventTreeItem *> children;
-    Event *eventData;
+    Event eventData;
     EventTreeItem *parentItem;
+
+    // row in the parent's children, valid when the parent's rowsValid is set
+    mutable int rowIndex;
+    mutable bool rowsValid;
+    // event id -> child, the id is kept in indexedId for removal
+    mutable QMultiHash<int, EventTreeItem *> childIds;
+    mutable int indexedId;
+    int nestedChildren;
 };
 
 }
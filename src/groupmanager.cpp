@@ -32,6 +32,7 @@
 #include "groupmanager.h"
 #include "groupmanager_p.h"
 #include "updatesemitter.h"
+#include "updatesreceiver.h"
 #include "group.h"
 #include "event.h"
 #include "constants.h"
@@ -59,8 +60,10 @@ GroupManagerPrivate::GroupManagerPrivate(GroupManager *manager)
         , queryRunner(0)
         , threadCanFetchMore(false)
         , bgThread(0)
+        , queryPriority(0)
         , m_pTracker(0)
         , contactChangesEnabled(true)
+        , batchedUpdates(false)
 {
     qRegisterMetaType<QList<CommHistory::Event> >();
     qRegisterMetaType<QList<CommHistory::Group> >();
@@ -117,6 +120,7 @@ void GroupManagerPrivate::resetQueryRunner()
     deleteQueryRunner();
 
     queryRunner = new QueryRunner(tracker());
+    queryRunner->setPriority(queryPriority);
 
     connect(queryRunner,
             SIGNAL(groupsReceived(int, int, QList<CommHistory::Group>)),
@@ -191,6 +195,8 @@ void GroupManagerPrivate::modifyInModel(Group &group, bool query)
         go->copyValidProperties(group);
     }
 
+    indexGroup(go);
+
     emit q->groupUpdated(go);
     qDebug() << __PRETTY_FUNCTION__ << ": updated" << go->toString();
 }
@@ -208,6 +214,7 @@ void GroupManagerPrivate::groupsReceivedSlot(int start,
     foreach (Group g, result) {
         GroupObject *go = new GroupObject(g, q);
         groups.insert(g.id(), go);
+        indexGroup(go);
         emit q->groupAdded(go);
     }
 }
@@ -290,6 +297,7 @@ void GroupManagerPrivate::eventsAddedSlot(const QList<Event> &events)
                     }
                 }
                 go->setRemoteUids(updatedUids);
+                indexGroup(go);
             }
         }
 
@@ -312,6 +320,7 @@ void GroupManagerPrivate::eventsAddedSlot(const QList<Event> &events)
             // tpTargetId and remoteUids. Meanwhile, just use the first
             // id as target.
             go->setRemoteUids(uids);
+            indexGroup(go);
         }
 
         go->setTotalMessages(go->totalMessages() + 1);
@@ -342,6 +351,7 @@ void GroupManagerPrivate::groupsAddedSlot(const QList<CommHistory::Group> &added
                 || CommHistory::remoteAddressMatch(filterRemoteUid, group.remoteUids().first()))) {
             go = new GroupObject(group, q);
             groups.insert(group.id(), go);
+            indexGroup(go);
             emit q->groupAdded(go);
         }
 
@@ -392,6 +402,79 @@ void GroupManagerPrivate::groupsDeletedSlot(const QList<int> &groupIds)
         emit go->groupDeleted();
         go->deleteLater();
         groups.remove(id);
+        unindexGroup(go);
+    }
+}
+
+void GroupManagerPrivate::updatesBatchedSlot(const QList<CommHistory::Event> &addedEvents,
+                                             const QList<CommHistory::Event> &updatedEvents,
+                                             const QList<int> &deletedEventIds,
+                                             const QList<CommHistory::Group> &addedGroups,
+                                             const QList<int> &updatedGroupIds,
+                                             const QList<CommHistory::Group> &updatedGroups,
+                                             const QList<int> &deletedGroupIds)
+{
+    Q_UNUSED(updatedEvents);
+    Q_UNUSED(deletedEventIds);
+
+    // same order UpdatesEmitter uses for the per-type signals
+    if (!addedGroups.isEmpty())
+        groupsAddedSlot(addedGroups);
+    if (!addedEvents.isEmpty())
+        eventsAddedSlot(addedEvents);
+    if (!updatedGroups.isEmpty())
+        groupsUpdatedFullSlot(updatedGroups);
+    if (!updatedGroupIds.isEmpty())
+        groupsUpdatedSlot(updatedGroupIds);
+    if (!deletedGroupIds.isEmpty())
+        groupsDeletedSlot(deletedGroupIds);
+}
+
+void GroupManagerPrivate::setBatchedUpdates(bool enabled)
+{
+    if (batchedUpdates == enabled)
+        return;
+
+    batchedUpdates = enabled;
+
+    typedef bool (QDBusConnection::*ConnectFunc)(const QString &, const QString &,
+                                                 const QString &, const QString &,
+                                                 QObject *, const char *);
+    ConnectFunc legacy = enabled ? &QDBusConnection::disconnect : &QDBusConnection::connect;
+    QDBusConnection bus = QDBusConnection::sessionBus();
+
+    (bus.*legacy)(QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_ADDED_SIGNAL,
+                  this, SLOT(eventsAddedSlot(const QList<CommHistory::Event> &)));
+    (bus.*legacy)(QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_ADDED_SIGNAL,
+                  this, SLOT(groupsAddedSlot(const QList<CommHistory::Group> &)));
+    (bus.*legacy)(QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_UPDATED_SIGNAL,
+                  this, SLOT(groupsUpdatedSlot(const QList<int> &)));
+    (bus.*legacy)(QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_UPDATED_FULL_SIGNAL,
+                  this, SLOT(groupsUpdatedFullSlot(const QList<CommHistory::Group> &)));
+    (bus.*legacy)(QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_DELETED_SIGNAL,
+                  this, SLOT(groupsDeletedSlot(const QList<int> &)));
+    // the receiver delivers each window as one signal
+    if (enabled) {
+        receiver = UpdatesReceiver::instance();
+        connect(receiver.data(),
+                SIGNAL(updatesBatched(const QList<CommHistory::Event> &,
+                                      const QList<CommHistory::Event> &,
+                                      const QList<int> &,
+                                      const QList<CommHistory::Group> &,
+                                      const QList<int> &,
+                                      const QList<CommHistory::Group> &,
+                                      const QList<int> &)),
+                this,
+                SLOT(updatesBatchedSlot(const QList<CommHistory::Event> &,
+                                        const QList<CommHistory::Event> &,
+                                        const QList<int> &,
+                                        const QList<CommHistory::Group> &,
+                                        const QList<int> &,
+                                        const QList<CommHistory::Group> &,
+                                        const QList<int> &)));
+    } else if (receiver) {
+        receiver->disconnect(this);
+        receiver.clear();
     }
 }
 
@@ -574,9 +657,21 @@ GroupObject *GroupManager::group(int groupId) const
 
 GroupObject *GroupManager::findGroup(const QString &localUid, const QString &remoteUid) const
 {
+    typedef GroupManagerPrivate::GroupKey GroupKey;
+
+    // phone number groups match the short number of remoteUid,
+    // IM groups only the exact uid
+    QList<GroupObject*> matches =
+        d->groupIndex.values(GroupKey(localUid, QLatin1Char('p') + makeShortNumber(remoteUid)));
+    matches += d->groupIndex.values(GroupKey(localUid, QLatin1Char('i') + remoteUid));
+
+    if (matches.size() <= 1)
+        return matches.isEmpty() ? 0 : matches.first();
+
+    // several groups for the same address, return the one a scan over
+    // all groups would find first
     foreach (GroupObject *g, d->groups) {
-        if (g->localUid() == localUid && g->remoteUids().size() == 1
-                && CommHistory::remoteAddressMatch(g->remoteUids().first(), remoteUid))
+        if (matches.contains(g))
             return g;
     }
 
@@ -591,9 +686,47 @@ void GroupManagerPrivate::add(Group &group)
 
     GroupObject *go = new GroupObject(group, q);
     groups.insert(go->id(), go);
+    indexGroup(go);
     emit q->groupAdded(go);
 }
 
+void GroupManagerPrivate::indexGroup(GroupObject *go)
+{
+    unindexGroup(go);
+
+    // findGroup only matches groups with a single remote uid
+    if (go->remoteUids().size() != 1)
+        return;
+
+    // same rules as remoteAddressMatch(): phone numbers match by their
+    // short form, anything else only exactly
+    QString remoteUid = go->remoteUids().first();
+    GroupKey key(go->localUid(),
+                 normalizePhoneNumber(remoteUid).isEmpty()
+                 ? QLatin1Char('i') + remoteUid
+                 : QLatin1Char('p') + makeShortNumber(remoteUid));
+
+    groupIndex.insert(key, go);
+    groupKeys.insert(go, key);
+}
+
+void GroupManagerPrivate::unindexGroup(GroupObject *go)
+{
+    QHash<GroupObject*, GroupKey>::iterator i = groupKeys.find(go);
+    if (i != groupKeys.end()) {
+        groupIndex.remove(i.value(), go);
+        groupKeys.erase(i);
+    }
+}
+
+void GroupManagerPrivate::clearGroups()
+{
+    qDeleteAll(groups);
+    groups.clear();
+    groupIndex.clear();
+    groupKeys.clear();
+}
+
 bool GroupManager::addGroup(Group &group)
 {
     d->tracker()->transaction();
@@ -691,14 +824,12 @@ bool GroupManager::getGroups(const QString &localUid,
     if (!d->groups.isEmpty()) {
         foreach (GroupObject *go, d->groups)
             emit groupDeleted(go);
-        qDeleteAll(d->groups);
-        d->groups.clear();
+        d->clearGroups();
     }
 
     d->startContactListening();
 
-    QSparqlQuery query(TrackerIOPrivate::prepareGroupQuery(localUid, remoteUid));
-    d->executeQuery(query.preparedQueryText());
+    d->executeQuery(TrackerIOPrivate::prepareGroupQuery(localUid, remoteUid));
 
     return true;
 }
@@ -837,6 +968,18 @@ QThread* GroupManager::backgroundThread()
     return d->bgThread;
 }
 
+void GroupManager::setQueryPriority(int priority)
+{
+    d->queryPriority = priority;
+    if (d->queryRunner)
+        d->queryRunner->setPriority(priority);
+}
+
+int GroupManager::queryPriority() const
+{
+    return d->queryPriority;
+}
+
 TrackerIO& GroupManager::trackerIO()
 {
     return *d->tracker();
@@ -846,3 +989,13 @@ void GroupManager::enableContactChanges(bool enabled)
 {
     d->contactChangesEnabled = enabled;
 }
+
+void GroupManager::setBatchedUpdates(bool enabled)
+{
+    d->setBatchedUpdates(enabled);
+}
+
+bool GroupManager::batchedUpdates() const
+{
+    return d->batchedUpdates;
+}
@@ -206,6 +206,17 @@ public:
     void setBackgroundThread(QThread *thread);
     QThread* backgroundThread();
 
+    /*!
+     * Set the priority of this model's query result decoding. Result rows of
+     * all models are decoded on a shared worker pool; rows of a higher
+     * priority model are decoded first. Raise it for the model that is
+     * currently on screen. Default is 0.
+     *
+     * \param priority decoding priority
+    **/
+    void setQueryPriority(int priority);
+    int queryPriority() const;
+
     /*!
      * Return an instance of TrackerIO that can be used for low-level queries.
      * \return a TrackerIO
@@ -223,6 +234,16 @@ public:
      */
     void enableContactChanges(bool enabled);
 
+    /*!
+     * If enabled, the manager applies the changes of each coalescing
+     * window of the sending process at once, when the window ends, instead
+     * of one D-Bus change signal at a time. Disabled by default.
+     *
+     * \param enabled If true, receive changes in batches.
+     */
+    void setBatchedUpdates(bool enabled);
+    bool batchedUpdates() const;
+
     bool canFetchMore() const;
     void fetchMore();
 
@@ -26,6 +26,8 @@
 
 #include <QList>
 #include <QPair>
+#include <QHash>
+#include <QMultiHash>
 
 #include "groupmanager.h"
 #include "eventmodel.h"
@@ -38,6 +40,7 @@ class TrackerIO;
 class ContactListener;
 class CommittingTransaction;
 class UpdatesEmitter;
+class UpdatesReceiver;
 
 class GroupManagerPrivate : public QObject
 {
@@ -68,6 +71,18 @@ public:
     TrackerIO* tracker();
     void startContactListening();
 
+    /*!
+     * Lookup key of single-recipient groups: local uid and the short
+     * phone number, or the full remote uid for IM addresses.
+     */
+    typedef QPair<QString, QString> GroupKey;
+
+    void indexGroup(GroupObject *group);
+    void unindexGroup(GroupObject *group);
+    void clearGroups();
+
+    void setBatchedUpdates(bool enabled);
+
 public Q_SLOTS:
     void eventsAddedSlot(const QList<CommHistory::Event> &events);
 
@@ -78,6 +93,14 @@ public Q_SLOTS:
 
     void groupsDeletedSlot(const QList<int> &groupIds);
 
+    void updatesBatchedSlot(const QList<CommHistory::Event> &addedEvents,
+                            const QList<CommHistory::Event> &updatedEvents,
+                            const QList<int> &deletedEventIds,
+                            const QList<CommHistory::Group> &addedGroups,
+                            const QList<int> &updatedGroupIds,
+                            const QList<CommHistory::Group> &updatedGroups,
+                            const QList<int> &deletedGroupIds);
+
     void groupsReceivedSlot(int start, int end, QList<CommHistory::Group> result);
 
     void modelUpdatedSlot(bool successful);
@@ -100,6 +123,8 @@ public:
     int queryOffset;
     bool isReady;
     QHash<int,GroupObject*> groups;
+    QMultiHash<GroupKey, GroupObject*> groupIndex;
+    QHash<GroupObject*, GroupKey> groupKeys;
 
     QString filterLocalUid;
     QString filterRemoteUid;
@@ -108,12 +133,15 @@ public:
     bool threadCanFetchMore;
 
     QThread *bgThread;
+    int queryPriority;
 
     TrackerIO *m_pTracker;
 
     QSharedPointer<ContactListener> contactListener;
     bool contactChangesEnabled;
+    bool batchedUpdates;
     QSharedPointer<UpdatesEmitter> emitter;
+    QSharedPointer<UpdatesReceiver> receiver;
 };
 
 }
@@ -30,6 +30,7 @@
 #include "group.h"
 #include "groupmanager.h"
 #include "groupobject.h"
+#include "telemetry.h"
 
 using namespace CommHistory;
 
@@ -182,6 +183,9 @@ GroupModel::GroupModel(QObject *parent)
     roles[GroupObjectRole] = "group";
     roles[WeekdaySectionRole] = "weekdaySection";
     setRoleNames(roles);
+
+    if (Telemetry::isEnabled())
+        Telemetry::instance()->watchModel(this);
 }
 
 GroupModel::~GroupModel()
@@ -539,6 +543,18 @@ QThread* GroupModel::backgroundThread()
     return d->manager->backgroundThread();
 }
 
+void GroupModel::setQueryPriority(int priority)
+{
+    d->ensureManager();
+    d->manager->setQueryPriority(priority);
+}
+
+int GroupModel::queryPriority() const
+{
+    d->ensureManager();
+    return d->manager->queryPriority();
+}
+
 TrackerIO& GroupModel::trackerIO()
 {
     d->ensureManager();
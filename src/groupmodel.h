@@ -248,6 +248,17 @@ public:
     void setBackgroundThread(QThread *thread);
     QThread* backgroundThread();
 
+    /*!
+     * Set the priority of this model's query result decoding. Result rows of
+     * all models are decoded on a shared worker pool; rows of a higher
+     * priority model are decoded first. Raise it for the model that is
+     * currently on screen. Default is 0.
+     *
+     * \param priority decoding priority
+    **/
+    void setQueryPriority(int priority);
+    int queryPriority() const;
+
     /*!
      * Return an instance of TrackerIO that can be used for low-level queries.
      * \return a TrackerIO
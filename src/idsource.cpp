@@ -22,6 +22,7 @@
 
 #include <QDir>
 #include <QDebug>
+#include <QMetaObject>
 
 #include "idsource.h"
 
@@ -30,11 +31,27 @@
 
 using namespace CommHistory;
 
-static const int BASKET_SIZE = 5; //bits
-static const int BASKET_FULL = 0x1F;
+// ids reserved at once by a process
+static const int ID_BLOCK_SIZE = 32;
+// reserved ids allowed to be ahead of the ids file before saving
+// synchronously, also the amount skipped after a crash
+static const int MAX_UNSAVED_IDS = 16 * ID_BLOCK_SIZE;
 
 namespace CommHistory {
 struct IdSourceData {
+    // last reserved ids, advanced with atomic adds without the lock
+    QAtomicInt lastEventId;
+    QAtomicInt lastGroupId;
+    int users;
+    // last ids written to the ids file
+    QAtomicInt savedEventId;
+    QAtomicInt savedGroupId;
+    // bumped by setNext*Id() to invalidate the blocks of all processes
+    QAtomicInt generation;
+};
+
+// on-disk format of the ids file
+struct IdSourceFile {
     int lastEventId;
     int lastGroupId;
     int users;
@@ -44,7 +61,8 @@ struct IdSourceData {
 IdSource::IdSource(QObject *parent) :
     QObject(parent),
     m_File(QDir::homePath()
-           + QLatin1String(LAST_IDS_FILE))
+           + QLatin1String(LAST_IDS_FILE)),
+    m_SavePending(false)
 {
 }
 
@@ -60,69 +78,90 @@ IdSource::~IdSource()
     }
 }
 
-IdSourceData* IdSource::lockSharedData()
+IdSourceData* IdSource::sharedData()
 {
     Q_ASSERT(m_IdSource.isAttached());
-    m_IdSource.lock();
     return reinterpret_cast<IdSourceData*>(m_IdSource.data());
 }
 
-int IdSource::skipToNextBasket(int currentId)
+IdSourceData* IdSource::lockSharedData()
 {
-    return ((currentId >> BASKET_SIZE) + 1)<< BASKET_SIZE;
+    Q_ASSERT(m_IdSource.isAttached());
+    m_IdSource.lock();
+    return sharedData();
 }
 
-bool IdSource::newBasket(int currentId) const
+int IdSource::takeId(IdBlock &block,
+                     QAtomicInt IdSourceData::*lastId,
+                     QAtomicInt IdSourceData::*savedId)
 {
-    return !(currentId & BASKET_FULL);
-}
+    if (!openSharedMemory())
+        return 0;
 
-int IdSource::nextEventId()
-{
-    int nextId = 0;
+    IdSourceData *ids = sharedData();
+    int generation = ids->generation;
 
-    if (openSharedMemory()) {
-        IdSourceData *ids = lockSharedData();
-        nextId = ++ids->lastEventId;
-        if (newBasket(ids->lastEventId))
+    if (block.next > block.last || block.generation != generation) {
+        int first = (ids->*lastId).fetchAndAddOrdered(ID_BLOCK_SIZE) + 1;
+        block.next = first;
+        block.last = first + ID_BLOCK_SIZE - 1;
+        block.generation = generation;
+
+        if (block.last - (ids->*savedId) >= MAX_UNSAVED_IDS) {
+            // way ahead of the file, don't risk reusing ids after a crash
+            ids = lockSharedData();
             save(ids);
-        m_IdSource.unlock();
+            m_IdSource.unlock();
+        } else if (!m_SavePending) {
+            m_SavePending = true;
+            QMetaObject::invokeMethod(this, "saveReserved", Qt::QueuedConnection);
+        }
     }
 
-    return nextId;
+    return block.next++;
+}
+
+int IdSource::nextEventId()
+{
+    return takeId(m_EventBlock, &IdSourceData::lastEventId, &IdSourceData::savedEventId);
 }
 
 int IdSource::nextGroupId()
 {
-    int nextId = 0;
+    return takeId(m_GroupBlock, &IdSourceData::lastGroupId, &IdSourceData::savedGroupId);
+}
 
+void IdSource::setNextEventId(int eventId)
+{
     if (openSharedMemory()) {
         IdSourceData *ids = lockSharedData();
-        nextId = ++ids->lastGroupId;
-        if (newBasket(ids->lastGroupId))
-            save(ids);
+        ids->lastEventId.fetchAndStoreOrdered(eventId);
+        ids->generation.ref();
+        save(ids);
         m_IdSource.unlock();
     }
-
-    return nextId;
 }
 
-void IdSource::setNextEventId(int eventId)
+void IdSource::setNextGroupId(int groupId)
 {
     if (openSharedMemory()) {
         IdSourceData *ids = lockSharedData();
-        ids->lastEventId = eventId;
+        ids->lastGroupId.fetchAndStoreOrdered(groupId);
+        ids->generation.ref();
         save(ids);
         m_IdSource.unlock();
     }
 }
 
-void IdSource::setNextGroupId(int groupId)
+void IdSource::saveReserved()
 {
-    if (openSharedMemory()) {
+    m_SavePending = false;
+
+    if (m_IdSource.isAttached()) {
         IdSourceData *ids = lockSharedData();
-        ids->lastGroupId = groupId;
-        save(ids);
+        if (ids->savedEventId != ids->lastEventId
+            || ids->savedGroupId != ids->lastGroupId)
+            save(ids);
         m_IdSource.unlock();
     }
 }
@@ -145,19 +184,22 @@ bool IdSource::openSharedMemory()
                 return false;
             }
 
-            if (m_IdSource.create(sizeof(IdSource))) {
+            if (m_IdSource.create(sizeof(IdSourceData))) {
                 IdSourceData *ids = lockSharedData();
 
                 ids->lastEventId = 0;
                 ids->lastGroupId = 0;
                 ids->users = 0;
+                ids->savedEventId = 0;
+                ids->savedGroupId = 0;
+                ids->generation = 0;
 
                 load(ids);
 
                 if (ids->users != 0) {
                     qWarning() << "Skip ids after crash";
-                    ids->lastEventId = skipToNextBasket(ids->lastEventId);
-                    ids->lastGroupId = skipToNextBasket(ids->lastGroupId);
+                    ids->lastEventId.fetchAndAddOrdered(MAX_UNSAVED_IDS);
+                    ids->lastGroupId.fetchAndAddOrdered(MAX_UNSAVED_IDS);
                     ids->users = 1;
                 } else {
                     ids->users++;
@@ -183,21 +225,37 @@ bool IdSource::openSharedMemory()
 void IdSource::load(IdSourceData *data)
 {
     if (m_File.open(QIODevice::ReadOnly)) {
-        int read = m_File.read(reinterpret_cast<char*>(data),
-                               sizeof(IdSourceData));
-        if (read != sizeof(IdSourceData))
+        IdSourceFile file;
+        int read = m_File.read(reinterpret_cast<char*>(&file),
+                               sizeof(IdSourceFile));
+        if (read != sizeof(IdSourceFile)) {
             qWarning() << "Failed read from "<< m_File.fileName();
+        } else {
+            data->lastEventId = file.lastEventId;
+            data->lastGroupId = file.lastGroupId;
+            data->users = file.users;
+        }
         m_File.close();
     } // it fails for the very first time when the file does not exist
 }
 
+// Must be called with the shared memory locked.
 void IdSource::save(IdSourceData *data)
 {
+    IdSourceFile file;
+    file.lastEventId = data->lastEventId;
+    file.lastGroupId = data->lastGroupId;
+    file.users = data->users;
+
     if (m_File.open(QIODevice::WriteOnly)) {
-        int written = m_File.write(reinterpret_cast<char*>(data),
-                                   sizeof(IdSourceData));
-        if (written!= sizeof(IdSourceData))
+        int written = m_File.write(reinterpret_cast<char*>(&file),
+                                   sizeof(IdSourceFile));
+        if (written!= sizeof(IdSourceFile)) {
             qWarning() << "Failed to write to "<< m_File.fileName();
+        } else {
+            data->savedEventId = file.lastEventId;
+            data->savedGroupId = file.lastGroupId;
+        }
         m_File.close();
     } else {
         qWarning() << "Failed open " << m_File.fileName();
@@ -26,11 +26,22 @@
 #include <QObject>
 #include <QSharedMemory>
 #include <QFile>
+#include <QAtomicInt>
 
 namespace CommHistory {
 
 struct IdSourceData;
 
+/*!
+ * Allocates unique event and group ids shared by all processes using
+ * libcommhistory.
+ *
+ * Each instance reserves blocks of ids from a shared memory segment with
+ * a single atomic add and hands out ids from its local block without
+ * locking. The reserved range is written to disk asynchronously; after a
+ * crash enough ids are skipped to cover anything reserved but not yet
+ * saved. An instance must only be used from one thread.
+ */
 class IdSource : public QObject
 {
     Q_OBJECT
@@ -45,17 +56,32 @@ public:
     void setNextEventId(int eventId);
     void setNextGroupId(int groupId);
 
+private Q_SLOTS:
+    void saveReserved();
+
 private:
+    struct IdBlock {
+        IdBlock() : next(1), last(0), generation(-1) {}
+        int next;
+        int last;
+        int generation;
+    };
+
+    int takeId(IdBlock &block,
+               QAtomicInt IdSourceData::*lastId,
+               QAtomicInt IdSourceData::*savedId);
     bool openSharedMemory();
     void save(IdSourceData *data);
     void load(IdSourceData *data);
+    IdSourceData* sharedData();
     IdSourceData* lockSharedData();
-    int skipToNextBasket(int currentId);
-    bool newBasket(int currentId) const;
 
 private:
     QSharedMemory m_IdSource;
     QFile m_File;
+    IdBlock m_EventBlock;
+    IdBlock m_GroupBlock;
+    bool m_SavePending;
 };
 
 } // namespace
@@ -23,11 +23,91 @@
 #include "mmscontentdeleter.h"
 
 #include <QDebug>
-#include <QProcess>
 #include <QDir>
-#include <QFSFileEngine>
+#include <QFile>
+#include <QTimer>
 #include <QDateTime>
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#define MMS_PUBLIC_DIR "/.mms/msg/"
+#define MMS_PRIVATE_DIR "/.mms/private/msg/"
+#define DELETE_QUEUE_DIR "/.commhistoryd/"
+#define DELETE_QUEUE_FILE DELETE_QUEUE_DIR "mmsdeletequeue"
+
+namespace {
+// file system entries removed before yielding to the event loop
+static const int DELETE_BATCH_SIZE = 32;
+// pause between batches, ms
+static const int DELETE_BATCH_INTERVAL = 10;
+// minimum time between queue file writes, ms
+static const int DELETE_QUEUE_SAVE_INTERVAL = 1000;
+// content older than this is garbage in cleanMmsPlace(), seconds
+static const int GARBAGE_AGE = 24 * 60 * 60;
+
+bool isDotOrDotDot(const char *name)
+{
+    return name[0] == '.'
+        && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+// only entries directly in the MMS content directories are deleted, the
+// queue file could have been edited or written by an older version
+bool isContentPath(const QString &path)
+{
+    QStringList bases;
+    bases << QDir::homePath() + QLatin1String(MMS_PUBLIC_DIR)
+          << QDir::homePath() + QLatin1String(MMS_PRIVATE_DIR);
+
+    foreach (const QString &base, bases) {
+        if (!path.startsWith(base))
+            continue;
+
+        QString name = path.mid(base.length());
+        return !name.isEmpty()
+            && !name.contains(QLatin1Char('/'))
+            && name != QLatin1String(".")
+            && name != QLatin1String("..");
+    }
+
+    return false;
+}
+}
+
+struct MmsDeleteDir {
+    DIR *dir;
+    // name relative to the parent directory, full path for the top one
+    QByteArray name;
+};
+
+MmsContentDeleter::MmsContentDeleter(QObject *parent)
+    : QObject(parent),
+      m_pathsScanned(false),
+      m_queueLoaded(false),
+      m_queueChanged(false),
+      m_batchScheduled(false)
+{
+}
+
+MmsContentDeleter::~MmsContentDeleter()
+{
+    foreach (MmsDeleteDir *dir, m_dirs) {
+        closedir(dir->dir);
+        delete dir;
+    }
+    m_dirs.clear();
+
+    // keep the unfinished work for the next run
+    if (m_queueChanged)
+        saveQueue();
+}
+
 void MmsContentDeleter::deleteMessage(const QString &messageToken)
 {
     if (!messageToken.isEmpty())
@@ -44,48 +124,77 @@ void MmsContentDeleter::cleanMmsPlace()
 {
     qDebug() << "[MMS-DELETER] Schedule cleaning mms place";
 
-    QFileInfoList topEntryes;
-    QDir public_dir(QString("%1/.mms/msg/").arg(QDir::homePath()));
-    topEntryes << public_dir.entryInfoList(QStringList(),
-                                       QDir::Dirs | QDir::Files
-                                       | QDir::NoDotAndDotDot | QDir::Hidden
-                                       | QDir::System);
+    QMetaObject::invokeMethod(this, "doCleanMmsPlace", Qt::QueuedConnection);
+}
 
-    QDir private_dir(QString("%1/.mms/private/msg/").arg(QDir::homePath()));
-    if (private_dir.exists())
-    {
-        topEntryes << private_dir.entryInfoList(QStringList(),
-                                            QDir::Dirs | QDir::Files
-                                            | QDir::NoDotAndDotDot | QDir::Hidden
-                                            | QDir::System);
-    }
+void MmsContentDeleter::doCleanMmsPlace()
+{
+    if (!m_queueLoaded)
+        loadQueue();
 
-    QDateTime garbageTime = QDateTime::currentDateTime().addDays(-1);
-    qDebug() << "[MMS-DELETER] Garbage time is" << garbageTime;
+    scanMessageDirs(true);
+    scheduleBatch();
+}
 
-    foreach (QFileInfo fi, topEntryes)
-    {
-        qDebug() << "[MMS-DELETER]" << fi.absoluteFilePath() << "time is" << fi.created();
-        if(fi.created() <= garbageTime)
-        {
-            QMetaObject::invokeMethod(this,"doDeleteContent",
-                                       Qt::QueuedConnection,
-                                       Q_ARG(QString, fi.absoluteFilePath()));
+void MmsContentDeleter::scanMessageDirs(bool collectGarbage)
+{
+    time_t garbageTime = QDateTime::currentDateTime().toTime_t() - GARBAGE_AGE;
+
+    m_messagePaths.clear();
+
+    // private content overrides public, see resolveMessagePath()
+    QStringList bases;
+    bases << QDir::homePath() + QLatin1String(MMS_PUBLIC_DIR)
+          << QDir::homePath() + QLatin1String(MMS_PRIVATE_DIR);
+
+    foreach (const QString &base, bases) {
+        DIR *dir = opendir(QFile::encodeName(base).constData());
+        if (!dir)
+            continue;
+
+        int fd = dirfd(dir);
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+            if (isDotOrDotDot(entry->d_name))
+                continue;
+
+            struct stat st;
+            if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                continue;
+
+            QString path = base + QFile::decodeName(entry->d_name);
+
+            if (collectGarbage && st.st_ctime <= garbageTime) {
+                qDebug() << "[MMS-DELETER] Garbage" << path;
+                enqueue(path);
+            } else if (S_ISDIR(st.st_mode)) {
+                m_messagePaths.insert(QFile::decodeName(entry->d_name), path);
+            }
         }
+
+        closedir(dir);
     }
+
+    m_pathsScanned = true;
 }
 
 QString MmsContentDeleter::resolveMessagePath(const QString &messageToken)
 {
-    QString retval;
+    if (!m_pathsScanned)
+        scanMessageDirs(false);
 
-    QDir public_dir(QString("%1/.mms/msg/%2").arg(QDir::homePath()).arg(messageToken));
+    QString retval = m_messagePaths.take(messageToken);
+    if (!retval.isEmpty())
+        return retval;
+
+    // content created after the scan
+    QDir public_dir(QString("%1" MMS_PUBLIC_DIR "%2").arg(QDir::homePath()).arg(messageToken));
 
     if (public_dir.exists()) {
         retval = public_dir.path();
     }
 
-    QDir private_dir(QString("%1/.mms/private/msg/%2").arg(QDir::homePath()).arg(messageToken));
+    QDir private_dir(QString("%1" MMS_PRIVATE_DIR "%2").arg(QDir::homePath()).arg(messageToken));
 
     if (private_dir.exists()) {
         retval = private_dir.path();
@@ -103,57 +212,206 @@ void MmsContentDeleter::doMessageDelete(const QString &messageToken)
     } else {
         qDebug() << "[MMS-DELETER] Delete message folder " << messagePath   << " Thread: " << thread();
 
-        doDeleteContent(messagePath);
+        enqueue(messagePath);
     }
 }
 
-void MmsContentDeleter::doDeleteContent(const QString &path)
+void MmsContentDeleter::enqueue(const QString &path)
 {
-    qDebug() << "[MMS-DELETER] Delete content. Path" << path;
-    QFileInfo entry(path);
-    if (!entry.exists())
-    {
-        qWarning() << "[MMS-DELETER] Path" << path << " does not exists.";
-        return;
+    if (!m_queueLoaded)
+        loadQueue();
+
+    if (path != m_currentPath && !m_queue.contains(path)) {
+        m_queue.append(path);
+        m_queueChanged = true;
     }
 
-    QDir parent = entry.dir();
-    if (entry.isFile())
-    {
-        if (!parent.remove(entry.absoluteFilePath())) {
-            qCritical() << "[MMS-DELETER] Can't delete file" << entry.absoluteFilePath();
-        }
+    scheduleBatch();
+}
+
+void MmsContentDeleter::scheduleBatch()
+{
+    if (!m_batchScheduled && !m_queue.isEmpty()) {
+        m_batchScheduled = true;
+        QMetaObject::invokeMethod(this, "deleteBatch", Qt::QueuedConnection);
     }
-    else if (entry.isDir())
-    {
-        QFSFileEngine fse(path);
-        if (!fse.setPermissions( QFile::ReadOwner | QFile::ReadGroup | QFile::ReadOther |
-                                 QFile::ExeOwner  | QFile::ExeGroup  | QFile::ExeOther |
-                                 QFile::WriteOwner ) )
-        {
-            qWarning() << "[MMS-DELETER] failed to chmod dir " << path << " error:" << fse.errorString();
+}
+
+void MmsContentDeleter::deleteBatch()
+{
+    int removed = 0;
+
+    while (removed < DELETE_BATCH_SIZE) {
+        if (m_dirs.isEmpty()) {
+            if (!m_currentPath.isEmpty()) {
+                m_currentPath.clear();
+                m_queueChanged = true;
+            }
+            if (m_queue.isEmpty())
+                break;
+
+            startPath(m_queue.takeFirst());
+            removed++;
+            continue;
         }
-        QDir dir(path);
-        foreach (QFileInfo fi, dir.entryInfoList(QStringList(),
-                                                 QDir::Dirs | QDir::Files
-                                                 | QDir::NoDotAndDotDot | QDir::Hidden
-                                                 | QDir::System))
-        {
-            doDeleteContent(fi.absoluteFilePath());
+
+        MmsDeleteDir *top = m_dirs.last();
+        int fd = dirfd(top->dir);
+
+        errno = 0;
+        struct dirent *entry = readdir(top->dir);
+        if (!entry) {
+            if (errno)
+                qWarning() << "[MMS-DELETER] Failed to read dir" << top->name << strerror(errno);
+
+            // everything inside is gone, remove the directory itself
+            m_dirs.removeLast();
+            int parentFd = m_dirs.isEmpty() ? AT_FDCWD : dirfd(m_dirs.last()->dir);
+            if (unlinkat(parentFd, top->name.constData(), AT_REMOVEDIR) != 0)
+                qCritical() << "[MMS-DELETER] Can't delete dir" << top->name << strerror(errno);
+            closedir(top->dir);
+            delete top;
+            removed++;
+            continue;
         }
-        if (!parent.rmdir(entry.absoluteFilePath())) {
-            qCritical() << "[MMS-DELETER] Can't delete dir" << entry.absoluteFilePath();
+
+        if (isDotOrDotDot(entry->d_name))
+            continue;
+
+        struct stat st;
+        if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            qWarning() << "[MMS-DELETER] Can't stat" << entry->d_name << strerror(errno);
+            continue;
         }
-    }
-    else if (entry.isSymLink())
-    {
-        if (!parent.remove(entry.absoluteFilePath())) {
-            qCritical() << "[MMS-DELETER] Can't delete symlink" << entry.absoluteFilePath();
+
+        if (S_ISDIR(st.st_mode)) {
+            pushDir(fd, QByteArray(entry->d_name));
+        } else if (unlinkat(fd, entry->d_name, 0) != 0) {
+            qCritical() << "[MMS-DELETER] Can't delete file" << entry->d_name << strerror(errno);
         }
+        removed++;
     }
-    else
-    {
-        qCritical() << "Unknow fs entry" << entry.absoluteFilePath() << entry.fileName();
+
+    bool done = m_dirs.isEmpty() && m_queue.isEmpty();
+
+    // at worst some deletes are repeated or left to the next cleanup
+    // after a crash, don't rewrite the queue file for every batch
+    if (m_queueChanged
+        && (done || m_lastSave.isNull() || m_lastSave.elapsed() >= DELETE_QUEUE_SAVE_INTERVAL))
+        saveQueue();
+
+    if (!done) {
+        QTimer::singleShot(DELETE_BATCH_INTERVAL, this, SLOT(deleteBatch()));
+    } else {
+        m_batchScheduled = false;
     }
 }
 
+void MmsContentDeleter::startPath(const QString &path)
+{
+    if (!isContentPath(path)) {
+        qWarning() << "[MMS-DELETER] Not MMS content, skipping" << path;
+        return;
+    }
+
+    qDebug() << "[MMS-DELETER] Delete content. Path" << path;
+
+    QByteArray name = QFile::encodeName(path);
+    struct stat st;
+    if (lstat(name.constData(), &st) != 0) {
+        qWarning() << "[MMS-DELETER] Path" << path << " does not exists.";
+        return;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        if (pushDir(AT_FDCWD, name))
+            m_currentPath = path;
+    } else if (unlink(name.constData()) != 0) {
+        qCritical() << "[MMS-DELETER] Can't delete file" << path << strerror(errno);
+    }
+}
+
+bool MmsContentDeleter::pushDir(int parentFd, const QByteArray &name)
+{
+    // content directories may be read-only
+    if (fchmodat(parentFd, name.constData(),
+                 S_IRUSR | S_IRGRP | S_IROTH | S_IXUSR | S_IXGRP | S_IXOTH | S_IWUSR, 0) != 0) {
+        qWarning() << "[MMS-DELETER] failed to chmod dir " << name << " error:" << strerror(errno);
+    }
+
+    int fd = openat(parentFd, name.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    if (fd < 0) {
+        qCritical() << "[MMS-DELETER] Can't open dir" << name << strerror(errno);
+        return false;
+    }
+
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        qCritical() << "[MMS-DELETER] Can't open dir" << name << strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    MmsDeleteDir *entry = new MmsDeleteDir;
+    entry->dir = dir;
+    entry->name = name;
+    m_dirs.append(entry);
+
+    return true;
+}
+
+void MmsContentDeleter::loadQueue()
+{
+    m_queueLoaded = true;
+
+    QFile file(QDir::homePath() + QLatin1String(DELETE_QUEUE_FILE));
+    if (!file.open(QIODevice::ReadOnly))
+        return; // nothing left from the previous run
+
+    while (!file.atEnd()) {
+        QString path = QFile::decodeName(file.readLine().trimmed());
+        if (path.isEmpty() || m_queue.contains(path))
+            continue;
+
+        if (!isContentPath(path)) {
+            qWarning() << "[MMS-DELETER] Dropping queued path outside MMS content" << path;
+            m_queueChanged = true;
+            continue;
+        }
+
+        m_queue.append(path);
+    }
+
+    if (!m_queue.isEmpty())
+        qDebug() << "[MMS-DELETER] Resuming" << m_queue.size() << "deletes";
+}
+
+void MmsContentDeleter::saveQueue()
+{
+    m_queueChanged = false;
+    m_lastSave.start();
+
+    QFile file(QDir::homePath() + QLatin1String(DELETE_QUEUE_FILE));
+
+    if (m_currentPath.isEmpty() && m_queue.isEmpty()) {
+        if (file.exists() && !file.remove())
+            qWarning() << "[MMS-DELETER] Failed to remove" << file.fileName();
+        return;
+    }
+
+    QDir dir(QDir::homePath() + QLatin1String(DELETE_QUEUE_DIR));
+    if (!dir.exists() && !dir.mkpath(dir.path())) {
+        qWarning() << "Failed create dir" << dir.path();
+        return;
+    }
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "[MMS-DELETER] Failed open " << file.fileName();
+        return;
+    }
+
+    if (!m_currentPath.isEmpty())
+        file.write(QFile::encodeName(m_currentPath) + '\n');
+    foreach (const QString &path, m_queue)
+        file.write(QFile::encodeName(path) + '\n');
+}
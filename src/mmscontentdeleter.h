@@ -25,21 +25,62 @@
 
 #include <QObject>
 #include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QTime>
 
+struct MmsDeleteDir;
+
+/*!
+ * Deletes MMS content directories in the thread the object lives in.
+ *
+ * Paths are queued and deleted a few entries at a time, with a pause
+ * between batches, so that a mass delete doesn't block other work in
+ * the thread. The queue is saved to disk and resumed if the process
+ * exits before it is done.
+ */
 class MmsContentDeleter: public QObject
 {
     Q_OBJECT
 
+public:
+    MmsContentDeleter(QObject *parent = 0);
+    ~MmsContentDeleter();
+
 public slots:
     void deleteMessage(const QString &messageToken);
     void cleanMmsPlace();
 
 private slots:
     void doMessageDelete(const QString &messageToken);
-    void doDeleteContent(const QString &path);
+    void doCleanMmsPlace();
+    void deleteBatch();
 
 private:
     QString resolveMessagePath(const QString &messageToken);
+    void scanMessageDirs(bool collectGarbage);
+    void enqueue(const QString &path);
+    void scheduleBatch();
+    void startPath(const QString &path);
+    bool pushDir(int parentFd, const QByteArray &name);
+    void loadQueue();
+    void saveQueue();
+
+private:
+    // message token -> content directory
+    QHash<QString, QString> m_messagePaths;
+    bool m_pathsScanned;
+
+    // top level paths waiting for deletion
+    QStringList m_queue;
+    // path being deleted and its open directories, innermost last
+    QString m_currentPath;
+    QList<MmsDeleteDir*> m_dirs;
+
+    bool m_queueLoaded;
+    bool m_queueChanged;
+    QTime m_lastSave;
+    bool m_batchScheduled;
 };
 
 #endif // MESSASGE_CONTENT_DELETER_H
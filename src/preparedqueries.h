@@ -24,6 +24,9 @@
 #define COMMHISTORY_PREPAREDQUERIES_H
 
 // NOTE projections in the query should have same order as Group::Property
+// Message counters are read from the nao:Property resources maintained
+// by UPDATE_GROUP_COUNTERS_QUERY, falling back to counting the messages
+// for channels that have not been updated yet.
 #define GROUP_QUERY QLatin1String( \
 "SELECT ?channel" \
 "  nie:subject(?channel)" \
@@ -31,23 +34,41 @@
 "  nie:identifier(?channel)" \
 "  nie:title(?channel)" \
 "  ?_lastDate " \
-"  ( SELECT COUNT(?_total_messages_1)" \
-"    WHERE {" \
-"      ?_total_messages_1 nmo:communicationChannel ?channel ." \
-"      ?_total_messages_1 nmo:isDeleted false ." \
-"  })" \
-"  ( SELECT COUNT(?_total_unread_messages_1)" \
-"    WHERE {" \
-"      ?_total_unread_messages_1 nmo:communicationChannel ?channel ." \
-"      ?_total_unread_messages_1 nmo:isRead false ." \
-"      ?_total_unread_messages_1 nmo:isDeleted false ." \
-"  })" \
-"  ( SELECT COUNT(?_total_sent_messages_1)" \
-"    WHERE {" \
-"      ?_total_sent_messages_1 nmo:communicationChannel ?channel ." \
-"      ?_total_sent_messages_1 nmo:isSent true ." \
-"      ?_total_sent_messages_1 nmo:isDeleted false ." \
-"  })" \
+"  tracker:coalesce(" \
+"    ( SELECT nao:propertyValue(?_total_counter)" \
+"      WHERE {" \
+"        ?channel nao:hasProperty ?_total_counter ." \
+"        ?_total_counter nao:propertyName \"commhistory:totalMessages\" ." \
+"    })," \
+"    ( SELECT COUNT(?_total_messages_1)" \
+"      WHERE {" \
+"        ?_total_messages_1 nmo:communicationChannel ?channel ." \
+"        ?_total_messages_1 nmo:isDeleted false ." \
+"    }))" \
+"  tracker:coalesce(" \
+"    ( SELECT nao:propertyValue(?_unread_counter)" \
+"      WHERE {" \
+"        ?channel nao:hasProperty ?_unread_counter ." \
+"        ?_unread_counter nao:propertyName \"commhistory:unreadMessages\" ." \
+"    })," \
+"    ( SELECT COUNT(?_total_unread_messages_1)" \
+"      WHERE {" \
+"        ?_total_unread_messages_1 nmo:communicationChannel ?channel ." \
+"        ?_total_unread_messages_1 nmo:isRead false ." \
+"        ?_total_unread_messages_1 nmo:isDeleted false ." \
+"    }))" \
+"  tracker:coalesce(" \
+"    ( SELECT nao:propertyValue(?_sent_counter)" \
+"      WHERE {" \
+"        ?channel nao:hasProperty ?_sent_counter ." \
+"        ?_sent_counter nao:propertyName \"commhistory:sentMessages\" ." \
+"    })," \
+"    ( SELECT COUNT(?_total_sent_messages_1)" \
+"      WHERE {" \
+"        ?_total_sent_messages_1 nmo:communicationChannel ?channel ." \
+"        ?_total_sent_messages_1 nmo:isSent true ." \
+"        ?_total_sent_messages_1 nmo:isDeleted false ." \
+"    }))" \
 "  ?_lastMessage " \
 "  (SELECT GROUP_CONCAT(" \
 "    fn:concat(tracker:id(?contact), \"\\u001e\", " \
@@ -198,5 +219,62 @@
 "}" \
 )
 
+// Adds %4 (e.g. "+ 1") to one stored message counter of a channel.
+// %1 is a pattern binding the channel, %2 the channel IRI or variable
+// and %3 the counter name. Channels without stored counters are left
+// alone, see UPDATE_GROUP_COUNTERS_QUERY.
+#define ADD_TO_GROUP_COUNTER_QUERY QLatin1String( \
+"DELETE { ?_counter nao:propertyValue ?_value } " \
+"INSERT { ?_counter nao:propertyValue ?_newValue } " \
+"WHERE {" \
+"  SELECT ?_counter ?_value str(xsd:integer(?_value) %4) AS ?_newValue" \
+"  WHERE {" \
+"    %1 " \
+"    %2 nao:hasProperty ?_counter ." \
+"    ?_counter nao:propertyName \"%3\" ; nao:propertyValue ?_value ." \
+"  }" \
+"} " \
+)
+
+// Recalculates the message counters read by GROUP_QUERY.
+// %1 is a pattern selecting the channels to update (bound to ?channel),
+// empty to update all of them.
+#define UPDATE_GROUP_COUNTERS_QUERY QLatin1String( \
+"DELETE {" \
+"  ?channel nao:hasProperty ?_counter ." \
+"  ?_counter a rdfs:Resource ." \
+"} WHERE {" \
+"  ?channel a nmo:CommunicationChannel ; nao:hasProperty ?_counter ." \
+"  ?_counter nao:propertyName ?_name ." \
+"  FILTER(?_name IN (\"commhistory:totalMessages\"," \
+"                    \"commhistory:unreadMessages\"," \
+"                    \"commhistory:sentMessages\"))" \
+"  %1 " \
+"} " \
+"INSERT {" \
+"  ?channel nao:hasProperty _:total, _:unread, _:sent ." \
+"  _:total a nao:Property ; nao:propertyName \"commhistory:totalMessages\" ;" \
+"    nao:propertyValue ?_total ." \
+"  _:unread a nao:Property ; nao:propertyName \"commhistory:unreadMessages\" ;" \
+"    nao:propertyValue ?_unread ." \
+"  _:sent a nao:Property ; nao:propertyName \"commhistory:sentMessages\" ;" \
+"    nao:propertyValue ?_sent ." \
+"} WHERE {" \
+"  SELECT DISTINCT ?channel" \
+"    str(( SELECT COUNT(?_m) WHERE {" \
+"      ?_m nmo:communicationChannel ?channel ; nmo:isDeleted false ." \
+"    })) AS ?_total" \
+"    str(( SELECT COUNT(?_m) WHERE {" \
+"      ?_m nmo:communicationChannel ?channel ; nmo:isRead false ; nmo:isDeleted false ." \
+"    })) AS ?_unread" \
+"    str(( SELECT COUNT(?_m) WHERE {" \
+"      ?_m nmo:communicationChannel ?channel ; nmo:isSent true ; nmo:isDeleted false ." \
+"    })) AS ?_sent" \
+"  WHERE {" \
+"    ?channel a nmo:CommunicationChannel ." \
+"    %1 " \
+"  }" \
+"}" \
+)
 
 #endif
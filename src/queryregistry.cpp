@@ -0,0 +1,385 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtDBus/QtDBus>
+#include <QCoreApplication>
+#include <QThread>
+#include <QTime>
+#include <QDebug>
+
+#include "queryregistry.h"
+#include "queryrunner.h"
+#include "updatesemitter.h"
+#include "commonutils.h"
+#include "constants.h"
+
+// finished queries kept for later requests
+#define DEFAULT_CACHE_SIZE 16
+#define DEFAULT_MAX_AGE 10000
+// larger results are only shared while running
+#define MAX_CACHED_ROWS 2000
+
+namespace CommHistory {
+
+struct SharedQuery
+{
+    SharedQuery()
+        : handle(0), leader(0), rows(0),
+          state(QueryRegistry::Running), joinable(true) {}
+
+    int handle;
+    QString key;
+    QueryRunner *leader; // 0 after finish() or detach()
+    QList<QueryRunner*> followers;
+    QList<DecodedChunk> chunks;
+    int rows;
+    QueryRegistry::State state;
+    bool joinable; // registered by key
+    QTime finishedTime;
+};
+
+Q_GLOBAL_STATIC(QueryRegistry, queryRegistry)
+
+QueryRegistry::Statistics::Statistics()
+    : requests(0), joined(0), cacheHits(0), invalidations(0), cachedQueries(0)
+{
+}
+
+QueryRegistry::QueryRegistry()
+    : m_nextHandle(1)
+    , m_cacheSize(DEFAULT_CACHE_SIZE)
+    , m_maxAge(DEFAULT_MAX_AGE)
+{
+    moveToMainThread(this);
+
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_ADDED_SIGNAL,
+        this, SLOT(eventsAddedSlot(const QList<CommHistory::Event> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_UPDATED_SIGNAL,
+        this, SLOT(eventsUpdatedSlot(const QList<CommHistory::Event> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENT_DELETED_SIGNAL,
+        this, SLOT(eventDeletedSlot(int)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_ADDED_SIGNAL,
+        this, SLOT(groupsAddedSlot(const QList<CommHistory::Group> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_UPDATED_SIGNAL,
+        this, SLOT(groupsUpdatedSlot(const QList<int> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_UPDATED_FULL_SIGNAL,
+        this, SLOT(groupsUpdatedFullSlot(const QList<CommHistory::Group> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_DELETED_SIGNAL,
+        this, SLOT(groupsDeletedSlot(const QList<int> &)));
+}
+
+QueryRegistry::~QueryRegistry()
+{
+    qDeleteAll(m_queries);
+}
+
+QueryRegistry* QueryRegistry::instance()
+{
+    return queryRegistry();
+}
+
+void QueryRegistry::prepare()
+{
+    if (QThread::currentThread() != thread())
+        return;
+
+    if (!m_emitter) {
+        QSharedPointer<UpdatesEmitter> emitter = UpdatesEmitter::instance();
+        m_emitter = emitter.data();
+
+        connect(m_emitter, SIGNAL(eventsAdded(const QList<CommHistory::Event> &)),
+                this, SLOT(invalidate()));
+        connect(m_emitter, SIGNAL(eventsUpdated(const QList<CommHistory::Event> &)),
+                this, SLOT(invalidate()));
+        connect(m_emitter, SIGNAL(eventDeleted(int)),
+                this, SLOT(invalidate()));
+        connect(m_emitter, SIGNAL(groupsAdded(const QList<CommHistory::Group> &)),
+                this, SLOT(invalidate()));
+        connect(m_emitter, SIGNAL(groupsUpdated(const QList<int> &)),
+                this, SLOT(invalidate()));
+        connect(m_emitter, SIGNAL(groupsUpdatedFull(const QList<CommHistory::Group> &)),
+                this, SLOT(invalidate()));
+        connect(m_emitter, SIGNAL(groupsDeleted(const QList<int> &)),
+                this, SLOT(invalidate()));
+    }
+
+    // D-Bus signals are posted to receivers as events; a model reacting to
+    // one may run before ours has been delivered
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+}
+
+int QueryRegistry::attach(const QString &key, QueryRunner *runner, bool &leader)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_stats.requests++;
+
+    SharedQuery *query = m_queries.value(m_joinable.value(key));
+    if (query && query->state == Finished) {
+        if (query->finishedTime.elapsed() > m_maxAge) {
+            m_joinable.remove(key);
+            m_cached.removeOne(query->handle);
+            query->joinable = false;
+            release(query);
+            query = 0;
+        } else {
+            m_stats.cacheHits++;
+            m_cached.removeOne(query->handle);
+            m_cached.append(query->handle);
+        }
+    } else if (query) {
+        m_stats.joined++;
+    }
+
+    if (query) {
+        leader = false;
+        query->followers.append(runner);
+        if (!query->chunks.isEmpty() || query->state != Running)
+            QMetaObject::invokeMethod(runner, "sharedDataSlot", Qt::QueuedConnection);
+        return query->handle;
+    }
+
+    leader = true;
+    query = new SharedQuery;
+    query->handle = m_nextHandle++;
+    query->key = key;
+    query->leader = runner;
+    m_queries.insert(query->handle, query);
+    m_joinable.insert(key, query->handle);
+
+    return query->handle;
+}
+
+void QueryRegistry::publish(int handle, const DecodedChunk &chunk)
+{
+    QMutexLocker locker(&m_mutex);
+
+    SharedQuery *query = m_queries.value(handle);
+    if (!query || query->state != Running)
+        return;
+
+    query->chunks.append(chunk);
+    query->rows += chunk.rowCount();
+    notify(query);
+}
+
+void QueryRegistry::finish(int handle, bool successful)
+{
+    QMutexLocker locker(&m_mutex);
+
+    SharedQuery *query = m_queries.value(handle);
+    if (!query || query->state != Running)
+        return;
+
+    query->state = successful ? Finished : Failed;
+    query->leader = 0;
+    query->finishedTime.start();
+
+    if (query->joinable) {
+        if (successful && m_cacheSize > 0 && query->rows <= MAX_CACHED_ROWS) {
+            m_cached.append(handle);
+            trimCache();
+        } else {
+            m_joinable.remove(query->key);
+            query->joinable = false;
+        }
+    }
+
+    notify(query);
+    release(query);
+}
+
+QueryRegistry::State QueryRegistry::read(int handle, int from, QList<DecodedChunk> &chunks)
+{
+    QMutexLocker locker(&m_mutex);
+
+    SharedQuery *query = m_queries.value(handle);
+    if (!query)
+        return Abandoned;
+
+    chunks = query->chunks.mid(from);
+    return query->state;
+}
+
+void QueryRegistry::detach(int handle, QueryRunner *runner)
+{
+    QMutexLocker locker(&m_mutex);
+
+    SharedQuery *query = m_queries.value(handle);
+    if (!query)
+        return;
+
+    if (query->leader == runner) {
+        query->leader = 0;
+        if (query->state == Running) {
+            query->state = Abandoned;
+            if (query->joinable) {
+                m_joinable.remove(query->key);
+                query->joinable = false;
+            }
+            notify(query);
+        }
+    } else {
+        query->followers.removeOne(runner);
+    }
+
+    release(query);
+}
+
+void QueryRegistry::setCacheSize(int queries)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_cacheSize = qMax(queries, 0);
+    trimCache();
+}
+
+int QueryRegistry::cacheSize() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_cacheSize;
+}
+
+void QueryRegistry::setMaxAge(int msec)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxAge = msec;
+}
+
+int QueryRegistry::maxAge() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxAge;
+}
+
+QueryRegistry::Statistics QueryRegistry::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    Statistics stats = m_stats;
+    stats.cachedQueries = m_cached.size();
+    return stats;
+}
+
+void QueryRegistry::resetStatistics()
+{
+    QMutexLocker locker(&m_mutex);
+    m_stats = Statistics();
+}
+
+void QueryRegistry::invalidate()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_stats.invalidations++;
+
+    // running queries go on for the runners already attached to them
+    QList<int> handles = m_joinable.values();
+    m_joinable.clear();
+    m_cached.clear();
+    foreach (int handle, handles) {
+        SharedQuery *query = m_queries.value(handle);
+        if (query) {
+            query->joinable = false;
+            release(query);
+        }
+    }
+}
+
+void QueryRegistry::eventsAddedSlot(const QList<CommHistory::Event> &events)
+{
+    Q_UNUSED(events);
+    invalidate();
+}
+
+void QueryRegistry::eventsUpdatedSlot(const QList<CommHistory::Event> &events)
+{
+    Q_UNUSED(events);
+    invalidate();
+}
+
+void QueryRegistry::eventDeletedSlot(int id)
+{
+    Q_UNUSED(id);
+    invalidate();
+}
+
+void QueryRegistry::groupsAddedSlot(const QList<CommHistory::Group> &groups)
+{
+    Q_UNUSED(groups);
+    invalidate();
+}
+
+void QueryRegistry::groupsUpdatedSlot(const QList<int> &groupIds)
+{
+    Q_UNUSED(groupIds);
+    invalidate();
+}
+
+void QueryRegistry::groupsUpdatedFullSlot(const QList<CommHistory::Group> &groups)
+{
+    Q_UNUSED(groups);
+    invalidate();
+}
+
+void QueryRegistry::groupsDeletedSlot(const QList<int> &groupIds)
+{
+    Q_UNUSED(groupIds);
+    invalidate();
+}
+
+void QueryRegistry::notify(SharedQuery *query)
+{
+    // followers detach under m_mutex before they are destroyed
+    foreach (QueryRunner *runner, query->followers)
+        QMetaObject::invokeMethod(runner, "sharedDataSlot", Qt::QueuedConnection);
+}
+
+void QueryRegistry::release(SharedQuery *query)
+{
+    if (query->leader || !query->followers.isEmpty() || query->joinable)
+        return;
+
+    m_queries.remove(query->handle);
+    delete query;
+}
+
+void QueryRegistry::trimCache()
+{
+    while (m_cached.size() > m_cacheSize) {
+        SharedQuery *query = m_queries.value(m_cached.takeFirst());
+        if (query) {
+            m_joinable.remove(query->key);
+            query->joinable = false;
+            release(query);
+        }
+    }
+}
+
+}
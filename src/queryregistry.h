@@ -0,0 +1,179 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_QUERYREGISTRY_H
+#define COMMHISTORY_QUERYREGISTRY_H
+
+#include <QObject>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include <QVariantList>
+
+#include "event.h"
+#include "group.h"
+
+namespace CommHistory {
+
+class QueryRunner;
+class UpdatesEmitter;
+struct SharedQuery;
+
+/*!
+ * Decoded rows of a query, starting at row \a start.
+ */
+struct DecodedChunk {
+    DecodedChunk() : start(0) {}
+
+    int rowCount() const { return events.isEmpty() ? groups.size() : events.size(); }
+
+    int start;
+    QList<CommHistory::Event> events;
+    QList<CommHistory::Group> groups;
+    QVariantList extra;
+};
+
+/*!
+ * \class QueryRegistry
+ *
+ * Process-wide registry of model queries by query text. The first
+ * QueryRunner to run a query leads it and publishes its decoded rows here;
+ * runners requesting the same query while it is running follow the leader
+ * instead of running it again, and requests shortly after it has finished
+ * are served from a small cache.
+ *
+ * Any change notification, from the local UpdatesEmitter or from
+ * com.nokia.commhistory on D-Bus, invalidates the cache and stops new
+ * requests from joining queries started before the change.
+ */
+class QueryRegistry : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum State {
+        Running,
+        Finished,
+        Failed,
+        Abandoned // the leader stopped before all rows were read
+    };
+
+    struct Statistics {
+        Statistics();
+
+        /*! Queries passed to attach(). */
+        quint64 requests;
+        /*! Requests that followed a running query. */
+        quint64 joined;
+        /*! Requests served from the cache. */
+        quint64 cacheHits;
+        quint64 invalidations;
+        /*! Finished queries currently in the cache. */
+        int cachedQueries;
+    };
+
+    QueryRegistry();
+    ~QueryRegistry();
+
+    static QueryRegistry* instance();
+
+    /*!
+     * Prepare for a new request from the calling thread: pending change
+     * notifications are applied before the query is looked up, so a model
+     * reloading because of a notification never gets results from before
+     * it. Only has effect when called from the registry's (main) thread.
+     */
+    void prepare();
+
+    /*!
+     * Register \a runner for the query \a key. Returns a handle for the
+     * other calls, and sets \a leader if the runner has to run the query
+     * itself. Followers are notified through their sharedDataSlot().
+     */
+    int attach(const QString &key, QueryRunner *runner, bool &leader);
+
+    /*! Leader: add decoded rows and notify followers. */
+    void publish(int handle, const DecodedChunk &chunk);
+
+    /*! Leader: all rows were read. */
+    void finish(int handle, bool successful);
+
+    /*!
+     * Follower: copy chunks published after the first \a from into
+     * \a chunks. Returns the state of the query.
+     */
+    State read(int handle, int from, QList<DecodedChunk> &chunks);
+
+    /*! Leave the query; a leader leaving early abandons it. */
+    void detach(int handle, QueryRunner *runner);
+
+    /*!
+     * Maximum number of finished queries kept, 0 disables caching.
+     */
+    void setCacheSize(int queries);
+    int cacheSize() const;
+
+    /*!
+     * Age in milliseconds after which a cached result is no longer used.
+     */
+    void setMaxAge(int msec);
+    int maxAge() const;
+
+    Statistics statistics() const;
+    void resetStatistics();
+
+public Q_SLOTS:
+    /*!
+     * Drop cached results and detach running queries from their key.
+     */
+    void invalidate();
+
+private Q_SLOTS:
+    void eventsAddedSlot(const QList<CommHistory::Event> &events);
+    void eventsUpdatedSlot(const QList<CommHistory::Event> &events);
+    void eventDeletedSlot(int id);
+    void groupsAddedSlot(const QList<CommHistory::Group> &groups);
+    void groupsUpdatedSlot(const QList<int> &groupIds);
+    void groupsUpdatedFullSlot(const QList<CommHistory::Group> &groups);
+    void groupsDeletedSlot(const QList<int> &groupIds);
+
+private:
+    void notify(SharedQuery *query);
+    void release(SharedQuery *query);
+    void trimCache();
+
+    mutable QMutex m_mutex;
+    QHash<int, SharedQuery*> m_queries;  // by handle
+    QHash<QString, int> m_joinable;      // running or cached, by key
+    QList<int> m_cached;                 // least recently used first
+    int m_nextHandle;
+    int m_cacheSize;
+    int m_maxAge;
+    Statistics m_stats;
+
+    QPointer<UpdatesEmitter> m_emitter;
+};
+
+}
+
+#endif
@@ -24,13 +24,14 @@
 
 #include "queryresult.h"
 #include "contactlistener.h"
+#include "commonutils.h"
 
 #include <QSettings>
 using namespace CommHistory;
 
 // used for filling data from tracker result rows
 #define RESULT_INDEX(COL) result.result->value(result.columns[QLatin1String(COL)])
-#define RESULT_INDEX2(COL) result->value(properties.indexOf(COL))
+#define RESULT_INDEX2(COL) row.value(propertyColumns.at(COL))
 
 #define LAT(STR) QLatin1String(STR)
 
@@ -83,12 +84,56 @@ QString getAddresbookNameOrder()
 
 bool isLastNameFirst = getAddresbookNameOrder() == LAT("last-first");
 
+// check for a full entry in a comma separated rdf:type list without
+// splitting it
+bool hasType(const QString &types, const QLatin1String &type)
+{
+    int length = qstrlen(type.latin1());
+    int index = types.indexOf(type);
+    while (index != -1) {
+        int end = index + length;
+        if ((index == 0 || types.at(index - 1) == QLatin1Char(','))
+            && (end == types.length() || types.at(end) == QLatin1Char(',')))
+            return true;
+        index = types.indexOf(type, end);
+    }
+    return false;
 }
 
-void QueryResult::fillEventFromModel(Event &event)
+}
+
+QString QueryResult::decodeLocalUid(const QString &uri)
+{
+    QHash<QString, QString>::const_iterator i = localUidCache.constFind(uri);
+    if (i != localUidCache.constEnd())
+        return i.value();
+
+    QString localUid = internUid(uri.mid(TELEPATHY_URI_PREFIX_LEN));
+    localUidCache.insert(uri, localUid);
+    return localUid;
+}
+
+QString QueryResult::decodeRemoteUid(const QString &uri)
+{
+    QHash<QString, QString>::const_iterator i = remoteUidCache.constFind(uri);
+    if (i != remoteUidCache.constEnd())
+        return i.value();
+
+    QString remoteUid = internUid(parseRemoteUid(uri));
+    remoteUidCache.insert(uri, remoteUid);
+    return remoteUid;
+}
+
+void QueryResult::fillEventFromModel(const QSparqlResultRow &row, Event &event)
 {
     Event eventToFill;
 
+    if (propertyColumns.isEmpty()) {
+        propertyColumns.fill(-1, Event::NumProperties);
+        for (int i = 0; i < properties.size(); i++)
+            propertyColumns[properties.at(i)] = i;
+    }
+
     // handle properties common to all events
     foreach (Event::Property property, properties) {
         switch (property) {
@@ -96,14 +141,14 @@ void QueryResult::fillEventFromModel(Event &event)
             eventToFill.setId(Event::urlToId(RESULT_INDEX2(Event::Id).toString()));
             break;
         case Event::Type: {
-            QStringList types = RESULT_INDEX2(Event::Type).toString().split(QChar(','));
-            if (types.contains(LAT(NMO_ "MMSMessage"))) {
+            QString types = RESULT_INDEX2(Event::Type).toString();
+            if (hasType(types, LAT(NMO_ "MMSMessage"))) {
                 eventToFill.setType(Event::MMSEvent);
-            } else if (types.contains(LAT(NMO_ "SMSMessage"))) {
+            } else if (hasType(types, LAT(NMO_ "SMSMessage"))) {
                 eventToFill.setType(Event::SMSEvent);
-            } else if (types.contains(LAT(NMO_ "IMMessage"))) {
+            } else if (hasType(types, LAT(NMO_ "IMMessage"))) {
                 eventToFill.setType(Event::IMEvent);
-            } else if (types.contains(LAT(NMO_ "Call"))) {
+            } else if (hasType(types, LAT(NMO_ "Call"))) {
                 eventToFill.setType(Event::CallEvent);
             }
             break;
@@ -228,19 +273,19 @@ void QueryResult::fillEventFromModel(Event &event)
     }
 
     // local/remote id and direction are common to all events
-    if (properties.contains(Event::LocalUid)
-        || properties.contains(Event::RemoteUid)) {
+    if (propertyColumns.at(Event::LocalUid) != -1
+        || propertyColumns.at(Event::RemoteUid) != -1) {
         // local contact: <telepathy:/org/.../gabble/jabber/dut_40localhost0>
         // remote contact: <telepathy:<account>!<imid>> or <tel:+35801234567>
         QString fromId = RESULT_INDEX2(Event::LocalUid).toString();
         QString toId = RESULT_INDEX2(Event::RemoteUid).toString();
 
         if (eventToFill.direction() == Event::Outbound) {
-            eventToFill.setLocalUid(fromId.mid(TELEPATHY_URI_PREFIX_LEN));
-            eventToFill.setRemoteUid(parseRemoteUid(toId));
+            eventToFill.setLocalUid(decodeLocalUid(fromId));
+            eventToFill.setRemoteUid(decodeRemoteUid(toId));
         } else {
-            eventToFill.setLocalUid(toId.mid(TELEPATHY_URI_PREFIX_LEN));
-            eventToFill.setRemoteUid(parseRemoteUid(fromId));
+            eventToFill.setLocalUid(decodeLocalUid(toId));
+            eventToFill.setRemoteUid(decodeRemoteUid(fromId));
         }
     }
 
@@ -259,40 +304,41 @@ void QueryResult::fillEventFromModel(Event &event)
     // TODO: what to do with the contact id and nickname columns if
     // Event::ContactId and Event::ContactName are replaced with
     // Event::Contacts?
-    if (properties.contains(Event::ContactId)) {
+    if (propertyColumns.at(Event::ContactId) != -1) {
         QList<Event::Contact> contacts;
         parseContacts(RESULT_INDEX2(Event::ContactId).toString(),
                       eventToFill.localUid(), contacts);
         eventToFill.setContacts(contacts);
     }
 
-    // save data and give back as parameter
+    // save data and give back as parameter; reset before assigning
+    // to avoid detaching the shared data
+    eventToFill.resetModifiedProperties();
     event = eventToFill;
-    event.resetModifiedProperties();
 }
 
-void QueryResult::fillGroupFromModel(Group &group)
+void QueryResult::fillGroupFromModel(const QSparqlResultRow &row, Group &group)
 {
     Group groupToFill;
 
-    QStringList types = result->value(Group::LastEventType).toString().split(QChar(','));
-    if (types.contains(LAT(NMO_ "MMSMessage"))) {
+    QString types = row.value(Group::LastEventType).toString();
+    if (hasType(types, LAT(NMO_ "MMSMessage"))) {
         groupToFill.setLastEventType(Event::MMSEvent);
-    } else if (types.contains(LAT(NMO_ "SMSMessage"))) {
+    } else if (hasType(types, LAT(NMO_ "SMSMessage"))) {
         groupToFill.setLastEventType(Event::SMSEvent);
-    } else if (types.contains(LAT(NMO_ "IMMessage"))) {
+    } else if (hasType(types, LAT(NMO_ "IMMessage"))) {
         groupToFill.setLastEventType(Event::IMEvent);
     }
 
-    QString status = result->value(Group::LastEventStatus).toString();
+    QString status = row.value(Group::LastEventStatus).toString();
     if (!status.isEmpty())
         groupToFill.setLastEventStatus(nmoStatusToEventStatus(status));
 
-    groupToFill.setId(Group::urlToId(result->value(Group::Id).toString()));
+    groupToFill.setId(Group::urlToId(row.value(Group::Id).toString()));
 
-    groupToFill.setChatName(result->value(Group::ChatName).toString());
+    groupToFill.setChatName(row.value(Group::ChatName).toString());
 
-    QString identifier = result->value(Group::Type).toString();
+    QString identifier = row.value(Group::Type).toString();
     if (!identifier.isEmpty()) {
         bool ok = false;
         Group::ChatType chatType = (Group::ChatType)(identifier.toUInt(&ok));
@@ -300,23 +346,23 @@ void QueryResult::fillGroupFromModel(Group &group)
             groupToFill.setChatType(chatType);
     }
 
-    groupToFill.setRemoteUids(QStringList() << result->value(Group::RemoteUids).toString());
-    groupToFill.setLocalUid(result->value(Group::LocalUid).toString());
+    groupToFill.setRemoteUids(QStringList() << internUid(row.value(Group::RemoteUids).toString()));
+    groupToFill.setLocalUid(internUid(row.value(Group::LocalUid).toString()));
 
     QList<Event::Contact> contacts;
-    parseContacts(result->value(Group::ContactId).toString(),
+    parseContacts(row.value(Group::ContactId).toString(),
                   groupToFill.localUid(), contacts);
     groupToFill.setContacts(contacts);
 
-    groupToFill.setTotalMessages(result->value(Group::TotalMessages).toInt());
-    groupToFill.setUnreadMessages(result->value(Group::UnreadMessages).toInt());
-    groupToFill.setSentMessages(result->value(Group::SentMessages).toInt());
-    groupToFill.setEndTime(result->value(Group::EndTime).toDateTime());
-    groupToFill.setLastEventId(Event::urlToId(result->value(Group::LastEventId).toString()));
-    groupToFill.setLastVCardFileName(result->value(Group::LastVCardFileName).toString());
-    groupToFill.setLastVCardLabel(result->value(Group::LastVCardLabel).toString());
+    groupToFill.setTotalMessages(row.value(Group::TotalMessages).toInt());
+    groupToFill.setUnreadMessages(row.value(Group::UnreadMessages).toInt());
+    groupToFill.setSentMessages(row.value(Group::SentMessages).toInt());
+    groupToFill.setEndTime(row.value(Group::EndTime).toDateTime());
+    groupToFill.setLastEventId(Event::urlToId(row.value(Group::LastEventId).toString()));
+    groupToFill.setLastVCardFileName(row.value(Group::LastVCardFileName).toString());
+    groupToFill.setLastVCardLabel(row.value(Group::LastVCardLabel).toString());
 
-    QStringList text = result->value(Group::LastMessageText).toString().split("\x1e", QString::SkipEmptyParts);
+    QStringList text = row.value(Group::LastMessageText).toString().split("\x1e", QString::SkipEmptyParts);
     if (!text.isEmpty())
         groupToFill.setLastMessageText(text[0]);
 
@@ -330,65 +376,65 @@ void QueryResult::fillGroupFromModel(Group &group)
     if (groupToFill.endTime() == QDateTime::fromTime_t(0))
         groupToFill.setEndTime(QDateTime());
 
-    groupToFill.setLastModified(result->value(Group::LastModified).toDateTime());
-    groupToFill.setStartTime(result->value(Group::StartTime).toDateTime());
+    groupToFill.setLastModified(row.value(Group::LastModified).toDateTime());
+    groupToFill.setStartTime(row.value(Group::StartTime).toDateTime());
 
+    groupToFill.resetModifiedProperties();
     group = groupToFill;
-    group.resetModifiedProperties();
 }
 
-void QueryResult::fillMessagePartFromModel(MessagePart &messagePart)
+void QueryResult::fillMessagePartFromModel(const QSparqlResultRow &row, MessagePart &messagePart)
 {
     MessagePart newPart;
 
     if (!eventId) {
-        eventId = Event::urlToId(result->value(MessagePartColumnMessage).toString());
+        eventId = Event::urlToId(row.value(MessagePartColumnMessage).toString());
     }
-    newPart.setUri(result->value(MessagePartColumnMessagePart).toString());
-    newPart.setContentId(result->value(MessagePartColumnContentId).toString());
-    newPart.setPlainTextContent(result->value(MessagePartColumnText).toString());
-    newPart.setContentType(result->value(MessagePartColumnMimeType).toString());
-    newPart.setCharacterSet(result->value(MessagePartColumnCharacterSet).toString());
-    newPart.setContentSize(result->value(MessagePartColumnContentSize).toInt());
-    newPart.setContentLocation(result->value(MessagePartColumnFileName).toString());
+    newPart.setUri(row.value(MessagePartColumnMessagePart).toString());
+    newPart.setContentId(row.value(MessagePartColumnContentId).toString());
+    newPart.setPlainTextContent(row.value(MessagePartColumnText).toString());
+    newPart.setContentType(row.value(MessagePartColumnMimeType).toString());
+    newPart.setCharacterSet(row.value(MessagePartColumnCharacterSet).toString());
+    newPart.setContentSize(row.value(MessagePartColumnContentSize).toInt());
+    newPart.setContentLocation(row.value(MessagePartColumnFileName).toString());
 
     messagePart = newPart;
 }
 
-void QueryResult::fillCallGroupFromModel(Event &event)
+void QueryResult::fillCallGroupFromModel(const QSparqlResultRow &row, Event &event)
 {
     Event eventToFill;
 
     eventToFill.setType(Event::CallEvent);
-    eventToFill.setId(Event::urlToId(result->value(CallGroupColumnLastCall).toString()));
-    eventToFill.setStartTime(result->value(CallGroupColumnStartTime).toDateTime().toLocalTime());
-    eventToFill.setEndTime(result->value(CallGroupColumnEndTime).toDateTime().toLocalTime());
-    QString fromId = result->value(CallGroupColumnFrom).toString();
-    QString toId = result->value(CallGroupColumnTo).toString();
+    eventToFill.setId(Event::urlToId(row.value(CallGroupColumnLastCall).toString()));
+    eventToFill.setStartTime(row.value(CallGroupColumnStartTime).toDateTime().toLocalTime());
+    eventToFill.setEndTime(row.value(CallGroupColumnEndTime).toDateTime().toLocalTime());
+    QString fromId = row.value(CallGroupColumnFrom).toString();
+    QString toId = row.value(CallGroupColumnTo).toString();
 
-    if (result->value(CallGroupColumnIsSent).toBool()) {
+    if (row.value(CallGroupColumnIsSent).toBool()) {
         eventToFill.setDirection(Event::Outbound);
-        eventToFill.setLocalUid(fromId.mid(TELEPATHY_URI_PREFIX_LEN));
-        eventToFill.setRemoteUid(parseRemoteUid(toId));
+        eventToFill.setLocalUid(decodeLocalUid(fromId));
+        eventToFill.setRemoteUid(decodeRemoteUid(toId));
     } else {
         eventToFill.setDirection(Event::Inbound);
-        eventToFill.setLocalUid(toId.mid(TELEPATHY_URI_PREFIX_LEN));
-        eventToFill.setRemoteUid(parseRemoteUid(fromId));
+        eventToFill.setLocalUid(decodeLocalUid(toId));
+        eventToFill.setRemoteUid(decodeRemoteUid(fromId));
     }
 
-    eventToFill.setIsMissedCall(!(result->value(CallGroupColumnIsAnswered).toBool()));
-    eventToFill.setIsEmergencyCall(result->value(CallGroupColumnIsEmergency).toBool());
-    eventToFill.setIsRead(result->value(CallGroupColumnIsRead).toBool());
-    eventToFill.setLastModified(result->value(CallGroupColumnLastModified).toDateTime().toLocalTime());
+    eventToFill.setIsMissedCall(!(row.value(CallGroupColumnIsAnswered).toBool()));
+    eventToFill.setIsEmergencyCall(row.value(CallGroupColumnIsEmergency).toBool());
+    eventToFill.setIsRead(row.value(CallGroupColumnIsRead).toBool());
+    eventToFill.setLastModified(row.value(CallGroupColumnLastModified).toDateTime().toLocalTime());
 
     QList<Event::Contact> contacts;
-    parseContacts(result->value(CallGroupColumnContacts).toString(),
+    parseContacts(row.value(CallGroupColumnContacts).toString(),
                   eventToFill.localUid(), contacts);
     eventToFill.setContacts(contacts);
 
-    eventToFill.setEventCount(result->value(CallGroupColumnMissedCount).toInt());
+    eventToFill.setEventCount(row.value(CallGroupColumnMissedCount).toInt());
 
-    if (result->value(CallGroupColumnChannel).toString().endsWith("!video"))
+    if (row.value(CallGroupColumnChannel).toString().endsWith("!video"))
         eventToFill.setIsVideoCall(true);
 
     event = eventToFill;
@@ -409,8 +455,15 @@ void QueryResult::parseHeaders(const QString &result,
     }
 }
 
+void QueryResult::readContactSettings()
+{
+    QSharedPointer<ContactListener> listener = ContactListener::instance();
+    lastNameFirst = listener->isLastNameFirst();
+    preferNickname = listener->preferNickname();
+}
+
 void QueryResult::parseContacts(const QString &result, const QString &localUid,
-                                QList<Event::Contact> &contacts)
+                                QList<Event::Contact> &contacts) const
 {
     /*
      * Query result format:
@@ -481,14 +534,14 @@ void QueryResult::parseContacts(const QString &result, const QString &localUid,
 QString QueryResult::buildContactName(const QString &firstName,
                                       const QString &lastName,
                                       const QString &contactNickname,
-                                      const QString &imNickname)
+                                      const QString &imNickname) const
 {
     QString name;
 
     QString realName;
     if (!firstName.isEmpty() || !lastName.isEmpty()) {
         QString lname;
-        if (ContactListener::instance()->isLastNameFirst())  {
+        if (lastNameFirst) {
             realName = lastName;
             lname = firstName;
         } else {
@@ -503,7 +556,7 @@ QString QueryResult::buildContactName(const QString &firstName,
         }
     }
 
-    if (ContactListener::instance()->preferNickname()) {
+    if (preferNickname) {
         if (!contactNickname.isEmpty())
             name = contactNickname;
         else if (!realName.isEmpty())
@@ -24,9 +24,12 @@
 #define COMMHISTORY_QUERY_RESULT_H
 
 #include <QString>
+#include <QHash>
+#include <QVector>
 #include <QPointer>
 #include <QSparqlQuery>
 #include <QSparqlResult>
+#include <QSparqlResultRow>
 
 namespace CommHistory {
 
@@ -47,23 +50,49 @@ struct QueryResult {
     int eventId;
     QList<Event::Property> properties;
 
-    QueryResult() : eventId(0) {}
+    // result column of each Event::Property, -1 if not selected;
+    // built from properties on the first decoded row
+    QVector<int> propertyColumns;
+    // decoded and interned local/remote uids by raw column value, so
+    // repeated values are parsed once per query
+    QHash<QString, QString> localUidCache;
+    QHash<QString, QString> remoteUidCache;
 
-    void fillEventFromModel(Event &event);
-    void fillGroupFromModel(Group &group);
-    void fillMessagePartFromModel(MessagePart &part);
-    void fillCallGroupFromModel(Event &event);
+    // Telemetry query shape, -1 when telemetry is disabled
+    int telemetryShape;
+
+    // contact name settings used for Event::Contacts, see
+    // readContactSettings(); decode jobs only use these copies
+    bool lastNameFirst;
+    bool preferNickname;
+
+    QueryResult() : eventId(0), telemetryShape(-1),
+                    lastNameFirst(false), preferNickname(false) {}
+
+    /*!
+     * Copy the contact name settings from ContactListener. Called on the
+     * thread running the query, before any rows are decoded.
+     */
+    void readContactSettings();
+
+    void fillEventFromModel(const QSparqlResultRow &row, Event &event);
+    void fillGroupFromModel(const QSparqlResultRow &row, Group &group);
+    void fillMessagePartFromModel(const QSparqlResultRow &row, MessagePart &part);
+    void fillCallGroupFromModel(const QSparqlResultRow &row, Event &event);
 
     static void parseHeaders(const QString &result,
                              QHash<QString, QString> &headers);
 
-    static void parseContacts(const QString &result, const QString &localUid,
-                              QList<Event::Contact> &contacts);
+    void parseContacts(const QString &result, const QString &localUid,
+                       QList<Event::Contact> &contacts) const;
+
+    QString decodeLocalUid(const QString &uri);
+    QString decodeRemoteUid(const QString &uri);
 
-    static QString buildContactName(const QString &firstName,
-                                    const QString &lastName,
-                                    const QString &contactNickname,
-                                    const QString &imNickname);
+    QString buildContactName(const QString &firstName,
+                             const QString &lastName,
+                             const QString &contactNickname,
+                             const QString &imNickname) const;
 
     // columns for message part query
     enum {
@@ -21,6 +21,9 @@
 ******************************************************************************/
 
 #include <QMutex>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QElapsedTimer>
 #include <QDebug>
 
 #include <QSparqlResultRow>
@@ -33,9 +36,167 @@
 #include "messagepart.h"
 #include "trackerio.h"
 #include "trackerio_p.h"
+#include "sparqlbackend.h"
+#include "telemetry.h"
 
 using namespace CommHistory;
 
+// upper bound of the default number of decoding threads
+#define MAX_DEFAULT_DECODE_THREADS 4
+// maximum number of rows decoded by one job
+#define DECODE_JOB_ROWS 200
+
+namespace {
+
+// approximate size of the values read from tracker, for telemetry
+quint64 resultBytes(const QList<QSparqlResultRow> &rows)
+{
+    quint64 bytes = 0;
+    foreach (const QSparqlResultRow &row, rows) {
+        for (int i = 0; i < row.count(); i++) {
+            QVariant value = row.value(i);
+            if (value.type() == QVariant::String)
+                bytes += value.toString().size() * sizeof(QChar);
+            else
+                bytes += sizeof(qint64);
+        }
+    }
+    return bytes;
+}
+
+}
+
+namespace {
+
+class DecodePool : public QThreadPool
+{
+public:
+    DecodePool() : threadCount(qBound(2, QThread::idealThreadCount(),
+                                      MAX_DEFAULT_DECODE_THREADS))
+    {
+        setMaxThreadCount(threadCount);
+    }
+
+    // 0 when decoding on the runner threads
+    QAtomicInt threadCount;
+};
+
+Q_GLOBAL_STATIC(DecodePool, decodePoolInstance)
+
+QThreadPool* decodePool()
+{
+    DecodePool *pool = decodePoolInstance();
+    if (!pool || !int(pool->threadCount))
+        return 0;
+    return pool;
+}
+
+}
+
+namespace CommHistory {
+
+/*!
+ * Decodes a chunk of rows read by a QueryRunner. The job works on its
+ * own copy of the query's decoding state and hands the result back to the
+ * runner, which delivers the chunks in sequence order.
+ */
+class DecodeJob : public QRunnable
+{
+public:
+    DecodeJob(QueryRunner *runner, const QueryResult &query,
+              const QList<QSparqlResultRow> &rows,
+              int start, int seq, int generation)
+        : m_runner(runner)
+        , m_rows(rows)
+        , m_start(start)
+        , m_seq(seq)
+        , m_generation(generation)
+    {
+        m_decoder.queryType = query.queryType;
+        m_decoder.properties = query.properties;
+        m_decoder.propertyColumns = query.propertyColumns;
+        m_decoder.localUidCache = query.localUidCache;
+        m_decoder.remoteUidCache = query.remoteUidCache;
+        m_decoder.telemetryShape = query.telemetryShape;
+        m_decoder.lastNameFirst = query.lastNameFirst;
+        m_decoder.preferNickname = query.preferNickname;
+    }
+
+    void run()
+    {
+        DecodedChunk chunk;
+        chunk.start = m_start;
+        decode(m_decoder, m_rows, chunk);
+
+        // the runner waits for running jobs before it is destroyed
+        QMutexLocker locker(&m_runner->m_decodeMutex);
+        if (m_generation == m_runner->m_generation) {
+            m_runner->m_decoded.insert(m_seq, chunk);
+            QMetaObject::invokeMethod(m_runner, "decodedSlot", Qt::QueuedConnection);
+        }
+        if (--m_runner->m_runningJobs == 0)
+            m_runner->m_decodeDone.wakeAll();
+    }
+
+    static void decode(QueryResult &decoder,
+                       const QList<QSparqlResultRow> &rows,
+                       DecodedChunk &chunk)
+    {
+        QElapsedTimer timer;
+        if (decoder.telemetryShape >= 0)
+            timer.start();
+
+        if (decoder.queryType == EventQuery) {
+            chunk.events.reserve(rows.size());
+
+            int columns = -1;
+            foreach (const QSparqlResultRow &row, rows) {
+                Event event;
+                decoder.fillEventFromModel(row, event);
+                chunk.events.append(event);
+
+                // extra columns are the same for every row of the query
+                if (columns < 0)
+                    columns = row.count();
+                for (int i = decoder.properties.size(); i < columns; i++)
+                    chunk.extra.append(row.value(i));
+            }
+        } else if (decoder.queryType == GroupQuery) {
+            chunk.groups.reserve(rows.size());
+
+            foreach (const QSparqlResultRow &row, rows) {
+                Group group;
+                decoder.fillGroupFromModel(row, group);
+                chunk.groups.append(group);
+            }
+        } else if (decoder.queryType == GroupedCallQuery) {
+            chunk.events.reserve(rows.size());
+
+            foreach (const QSparqlResultRow &row, rows) {
+                Event event;
+                decoder.fillCallGroupFromModel(row, event);
+                chunk.events.append(event);
+            }
+        }
+
+        if (decoder.telemetryShape >= 0) {
+            qint64 usec = timer.nsecsElapsed() / 1000;
+            Telemetry::instance()->addDecode(decoder.telemetryShape, rows.size(),
+                                             resultBytes(rows), usec);
+        }
+    }
+
+private:
+    QueryRunner *m_runner;
+    QueryResult m_decoder;
+    QList<QSparqlResultRow> m_rows;
+    int m_start;
+    int m_seq;
+    int m_generation;
+};
+
+}
+
 QueryRunner::QueryRunner(TrackerIO *trackerIO, QObject *parent)
         : QObject(parent)
         , m_streamedMode(false)
@@ -44,6 +205,17 @@ QueryRunner::QueryRunner(TrackerIO *trackerIO, QObject *parent)
         , m_enableQueue(false)
         , m_canFetchMore(false)
         , m_pTracker(trackerIO)
+        , m_priority(0)
+        , m_runningJobs(0)
+        , m_generation(0)
+        , m_submitSeq(0)
+        , m_deliverSeq(0)
+        , m_finishPending(false)
+        , m_sharedHandle(0)
+        , m_leading(false)
+        , m_sharedRead(0)
+        , m_sharedRows(0)
+        , m_skipRows(0)
 {
     qDebug() << __PRETTY_FUNCTION__;
 }
@@ -53,6 +225,7 @@ QueryRunner::~QueryRunner()
     qDebug() << __PRETTY_FUNCTION__ << this << this->thread();
 
     endActiveQuery();
+    waitForDecodeJobs();
 }
 
 void QueryRunner::setStreamedMode(bool mode)
@@ -70,6 +243,33 @@ void QueryRunner::setFirstChunkSize(int size)
     m_firstChunkSize = size;
 }
 
+void QueryRunner::setPriority(int priority)
+{
+    m_priority = priority;
+}
+
+int QueryRunner::priority() const
+{
+    return m_priority;
+}
+
+void QueryRunner::setDecodeThreadCount(int count)
+{
+    DecodePool *pool = decodePoolInstance();
+    if (!pool)
+        return;
+
+    if (count > 0)
+        pool->setMaxThreadCount(count);
+    pool->threadCount = qMax(count, 0);
+}
+
+int QueryRunner::decodeThreadCount()
+{
+    DecodePool *pool = decodePoolInstance();
+    return pool ? int(pool->threadCount) : 0;
+}
+
 void QueryRunner::enableQueue(bool enable)
 {
     m_enableQueue = enable;
@@ -81,6 +281,9 @@ void QueryRunner::addQueryToQueue(QueryType type,
 {
     qDebug() << Q_FUNC_INFO << QThread::currentThread()  << this << "->";
 
+    // apply pending change notifications before the query can be shared
+    QueryRegistry::instance()->prepare();
+
     QMutexLocker locker(&m_mutex);
 
     QueryResult result;
@@ -154,7 +357,7 @@ void QueryRunner::fetchMore()
 
 void QueryRunner::startNextQueryIfReady()
 {
-    if (m_enableQueue && m_activeQuery.result)
+    if (m_enableQueue && (m_activeQuery.result || m_sharedHandle))
         return;  // ongoing query and queue mode enabled
 
     endActiveQuery();
@@ -169,33 +372,120 @@ void QueryRunner::startNextQueryIfReady()
     m_mutex.unlock();
 
     if (!m_activeQuery.query.query().isEmpty() && m_activeQuery.result.isNull()) {
-        // TODO: try to put query execution to trackerIOPrivate
-        lastReadPos = QSparql::BeforeFirstRow;
-        m_syncMode = m_streamedMode && m_pTracker->d->connection().hasFeature(QSparqlConnection::SyncExec);
-
-        if (m_syncMode) {
-            m_activeQuery.result = m_pTracker->d->connection().syncExec(m_activeQuery.query);
-            if (m_activeQuery.result->hasError())
-                finished();
-            else
-                readData();
+        // not thread-safe, so the decode jobs get a copy
+        m_activeQuery.readContactSettings();
+        if (!attachShared())
+            execActiveQuery();
+    }
+}
+
+void QueryRunner::execActiveQuery()
+{
+    // TODO: try to put query execution to trackerIOPrivate
+    lastReadPos = QSparql::BeforeFirstRow;
+    m_syncMode = m_streamedMode && m_pTracker->d->connection().hasFeature(QSparqlConnection::SyncExec);
+
+    if (Telemetry::isEnabled()) {
+        m_activeQuery.telemetryShape =
+            Telemetry::instance()->queryShape(m_activeQuery.queryType,
+                                              m_activeQuery.query.query());
+        m_queryTimer.start();
+    }
+
+    if (m_syncMode) {
+        m_activeQuery.result = m_pTracker->d->connection().syncExec(m_activeQuery.query);
+        if (m_activeQuery.result->hasError())
+            finished();
+        else
+            readData();
+    } else {
+        m_activeQuery.result = m_pTracker->d->connection().exec(m_activeQuery.query);
+
+        if (m_activeQuery.result->hasError()) {
+            finished();
         } else {
-            m_activeQuery.result = m_pTracker->d->connection().exec(m_activeQuery.query);
-
-            if (m_activeQuery.result->hasError()) {
-                finished();
-            } else {
-                connect(m_activeQuery.result.data(),
-                        SIGNAL(dataReady(int)),
-                        this, SLOT(dataReady(int)));
-                connect(m_activeQuery.result.data(),
-                        SIGNAL(finished()),
-                        this, SLOT(finished()));
-            }
+            connect(m_activeQuery.result.data(),
+                    SIGNAL(dataReady(int)),
+                    this, SLOT(dataReady(int)));
+            connect(m_activeQuery.result.data(),
+                    SIGNAL(finished()),
+                    this, SLOT(finished()));
         }
     }
 }
 
+bool QueryRunner::attachShared()
+{
+    // streamed queries are read at the pace of their own model
+    if (m_streamedMode
+        || m_skipRows
+        || (m_activeQuery.queryType != EventQuery
+            && m_activeQuery.queryType != GroupQuery
+            && m_activeQuery.queryType != GroupedCallQuery))
+        return false;
+
+    QString key = QString::number(m_activeQuery.queryType);
+    foreach (Event::Property property, m_activeQuery.properties)
+        key += QLatin1Char(',') + QString::number(property);
+    key += QLatin1Char('\n') + m_activeQuery.query.query();
+
+    m_sharedHandle = QueryRegistry::instance()->attach(key, this, m_leading);
+    m_sharedRead = 0;
+    m_sharedRows = 0;
+
+    // a leader runs the query and publishes its rows
+    return !m_leading;
+}
+
+void QueryRunner::sharedDataSlot()
+{
+    if (!m_sharedHandle || m_leading)
+        return;
+
+    QList<DecodedChunk> chunks;
+    QueryRegistry::State state = QueryRegistry::instance()->read(m_sharedHandle,
+                                                                 m_sharedRead,
+                                                                 chunks);
+    m_sharedRead += chunks.size();
+    foreach (const DecodedChunk &chunk, chunks) {
+        emitDecoded(chunk);
+        m_sharedRows += chunk.rowCount();
+    }
+
+    if (state == QueryRegistry::Abandoned) {
+        // the leader went away, read the rest ourselves
+        qDebug() << Q_FUNC_INFO << "leader abandoned shared query at" << m_sharedRows;
+        QueryRegistry::instance()->detach(m_sharedHandle, this);
+        m_sharedHandle = 0;
+        m_skipRows = m_sharedRows;
+        execActiveQuery();
+    } else if (state != QueryRegistry::Running) {
+        finishShared(state == QueryRegistry::Finished);
+    }
+}
+
+void QueryRunner::finishShared(bool successful)
+{
+    bool continueNext;
+    {
+        QMutexLocker locker(&m_mutex);
+        continueNext = m_enableQueue && !m_queries.isEmpty();
+    }
+
+    if (m_canFetchMore) {
+        m_canFetchMore = false;
+        emit canFetchMoreChanged(m_canFetchMore);
+    }
+
+    if (!continueNext)
+        emit modelUpdated(successful);
+
+    endActiveQuery();
+
+    if (continueNext)
+        nextSlot();
+}
+
 void QueryRunner::nextSlot()
 {
     qDebug() << Q_FUNC_INFO << QThread::currentThread() << this;
@@ -249,86 +539,56 @@ void QueryRunner::readData()
         start = 0;
     else
         ++start;
-    int added = 0;
 
     qDebug() << Q_FUNC_INFO << "read from:" << start;
 
     m_activeQuery.result->setPos(lastReadPos);
 
-    if (m_activeQuery.queryType == EventQuery) {
-        QList<Event> events;
-        QVariantList extra;
+    // rows expected in this round, to allocate the row list once
+    int expected = m_activeQuery.result->size() - start;
+    if (m_streamedMode) {
+        int chunk = start < m_firstChunkSize ? m_firstChunkSize - start : m_chunkSize;
+        if (chunk > 0 && (expected <= 0 || chunk < expected))
+            expected = chunk;
+    }
 
-        while (m_activeQuery.result->next()) {
-            Event event;
+    // only copy the rows here; decoding is left to the worker pool
+    QList<QSparqlResultRow> rows;
+    if (expected > 0)
+        rows.reserve(expected);
 
-            m_activeQuery.fillEventFromModel(event);
-            events.append(event);
+    while (m_activeQuery.result->next()) {
+        rows.append(m_activeQuery.result->current());
+        lastReadPos = m_activeQuery.result->pos();
+        if (!reallyFetchMore(lastReadPos))
+            break;
+    }
 
-            int max = m_activeQuery.result->current().count();
-            for(int i = m_activeQuery.properties.size(); i < max; i++) {
-                extra.append(m_activeQuery.result->value(i));
-            }
+    checkCanFetchMoreChange();
 
-            ++added;
-            lastReadPos = m_activeQuery.result->pos();
-            if (!reallyFetchMore(lastReadPos))
-                break;
-        }
-        checkCanFetchMoreChange();
-        if (added) {
-            emit eventsReceived(start, start + added - 1, events);
-            // TODO: add extra to eventsReceived on next break
-            if (!extra.isEmpty())
-                emit eventsReceivedExtra(events, extra);
-        }
-    } else if (m_activeQuery.queryType == GroupQuery) {
-        QList<Group> groups;
-
-        while (m_activeQuery.result->next()) {
-            Group group;
-            m_activeQuery.fillGroupFromModel(group);
-            groups.append(group);
-            ++added;
-            lastReadPos = m_activeQuery.result->pos();
-            if (!reallyFetchMore(lastReadPos))
-                break;
-        }
+    if (!rows.isEmpty()) {
+        if (m_activeQuery.queryType == MessagePartQuery) {
+            // parts of a single message, not worth a thread switch
+            QElapsedTimer timer;
+            if (m_activeQuery.telemetryShape >= 0)
+                timer.start();
 
-        checkCanFetchMoreChange();
-        if (added)
-            emit groupsReceived(start, start + added - 1, groups);
-    } else if (m_activeQuery.queryType == MessagePartQuery) {
-        QList<MessagePart> parts;
-        while (m_activeQuery.result->next()) {
-            MessagePart part;
-            m_activeQuery.fillMessagePartFromModel(part);
-            parts.append(part);
-            ++added;
-            lastReadPos = m_activeQuery.result->pos();
-            if (!reallyFetchMore(lastReadPos))
-                break;
-        }
+            QList<MessagePart> parts;
+            foreach (const QSparqlResultRow &row, rows) {
+                MessagePart part;
+                m_activeQuery.fillMessagePartFromModel(row, part);
+                parts.append(part);
+            }
 
-        checkCanFetchMoreChange();
-        if (added)
+            if (m_activeQuery.telemetryShape >= 0) {
+                qint64 usec = timer.nsecsElapsed() / 1000;
+                Telemetry::instance()->addDecode(m_activeQuery.telemetryShape,
+                                                 rows.size(), resultBytes(rows), usec);
+            }
             emit messagePartsReceived(m_activeQuery.eventId, parts);
-    } else if (m_activeQuery.queryType == GroupedCallQuery) {
-        QList<Event> events;
-
-        while (m_activeQuery.result->next()) {
-            Event event;
-            m_activeQuery.fillCallGroupFromModel(event);
-            events.append(event);
-            ++added;
-            lastReadPos = m_activeQuery.result->pos();
-            if (!reallyFetchMore(lastReadPos))
-                break;
+        } else {
+            submitRows(rows, start);
         }
-
-        checkCanFetchMoreChange();
-        if (added)
-            emit eventsReceived(start, start + added - 1, events);
     }
 
     // really finish current query in case more date than chunk size were read
@@ -340,6 +600,111 @@ void QueryRunner::readData()
 #endif
 }
 
+void QueryRunner::submitRows(const QList<QSparqlResultRow> &allRows, int start)
+{
+    QList<QSparqlResultRow> rows = allRows;
+    if (start < m_skipRows) {
+        // already received from an abandoned shared query
+        rows = allRows.mid(m_skipRows - start);
+        start = m_skipRows;
+        if (rows.isEmpty())
+            return;
+    }
+
+    QThreadPool *pool = decodePool();
+    if (!pool) {
+        DecodedChunk chunk;
+        chunk.start = start;
+        DecodeJob::decode(m_activeQuery, rows, chunk);
+        {
+            QMutexLocker locker(&m_decodeMutex);
+            m_decoded.insert(m_submitSeq++, chunk);
+        }
+        deliverDecoded();
+        return;
+    }
+
+    // split large reads so that a single big query uses several workers
+    for (int i = 0; i < rows.size(); i += DECODE_JOB_ROWS) {
+        int generation;
+        {
+            QMutexLocker locker(&m_decodeMutex);
+            ++m_runningJobs;
+            generation = m_generation;
+        }
+
+        pool->start(new DecodeJob(this, m_activeQuery,
+                                  rows.mid(i, DECODE_JOB_ROWS),
+                                  start + i, m_submitSeq++, generation),
+                    m_priority);
+    }
+}
+
+void QueryRunner::decodedSlot()
+{
+    deliverDecoded();
+}
+
+void QueryRunner::deliverDecoded()
+{
+    QList<DecodedChunk> ready;
+    {
+        QMutexLocker locker(&m_decodeMutex);
+        QMap<int, DecodedChunk>::iterator i = m_decoded.find(m_deliverSeq);
+        while (i != m_decoded.end() && i.key() == m_deliverSeq) {
+            ready.append(i.value());
+            i = m_decoded.erase(i);
+            ++m_deliverSeq;
+        }
+    }
+
+    if (ready.isEmpty())
+        return;
+
+    // chunks finished out of order are held back above and sent here as
+    // one contiguous range
+    DecodedChunk merged = ready.takeFirst();
+    foreach (const DecodedChunk &chunk, ready) {
+        merged.events += chunk.events;
+        merged.groups += chunk.groups;
+        merged.extra += chunk.extra;
+    }
+
+    if (m_sharedHandle)
+        QueryRegistry::instance()->publish(m_sharedHandle, merged);
+
+    emitDecoded(merged);
+
+    if (m_finishPending && m_deliverSeq == m_submitSeq) {
+        m_finishPending = false;
+        finished();
+    }
+}
+
+void QueryRunner::emitDecoded(const DecodedChunk &chunk)
+{
+    if (m_activeQuery.queryType == GroupQuery) {
+        if (!chunk.groups.isEmpty())
+            emit groupsReceived(chunk.start,
+                                chunk.start + chunk.groups.size() - 1,
+                                chunk.groups);
+    } else if (!chunk.events.isEmpty()) {
+        emit eventsReceived(chunk.start,
+                            chunk.start + chunk.events.size() - 1,
+                            chunk.events);
+        // TODO: add extra to eventsReceived on next break
+        if (!chunk.extra.isEmpty())
+            emit eventsReceivedExtra(chunk.events, chunk.extra);
+    }
+}
+
+void QueryRunner::waitForDecodeJobs()
+{
+    QMutexLocker locker(&m_decodeMutex);
+    while (m_runningJobs > 0)
+        m_decodeDone.wait(&m_decodeMutex);
+}
+
 void QueryRunner::checkCanFetchMoreChange()
 {
     bool newFetchMore = !(m_activeQuery.result->isFinished()
@@ -357,6 +722,11 @@ void QueryRunner::finished()
     bool continueNext = false;
 
     if (m_activeQuery.queryType == GenericQuery) {
+        if (m_activeQuery.telemetryShape >= 0)
+            Telemetry::instance()->addQuery(m_activeQuery.telemetryShape,
+                                            m_queryTimer.nsecsElapsed() / 1000,
+                                            !m_activeQuery.result
+                                            || m_activeQuery.result->hasError());
         emit resultsReceived(m_activeQuery.result);
         continueNext = m_enableQueue && !m_queries.isEmpty();
     } else {
@@ -368,6 +738,21 @@ void QueryRunner::finished()
             return;
 
         bool abort = m_activeQuery.result->hasError();
+
+        // finish after the last decoded rows have been delivered
+        if (!abort && m_deliverSeq != m_submitSeq) {
+            m_finishPending = true;
+            return;
+        }
+
+        if (m_activeQuery.telemetryShape >= 0)
+            Telemetry::instance()->addQuery(m_activeQuery.telemetryShape,
+                                            m_queryTimer.nsecsElapsed() / 1000,
+                                            abort);
+
+        if (m_sharedHandle)
+            QueryRegistry::instance()->finish(m_sharedHandle, !abort);
+
         if (abort) {
             qCritical() << m_activeQuery.result->lastError().message();
         } else {
@@ -400,4 +785,22 @@ void QueryRunner::endActiveQuery()
         m_activeQuery.result = 0;
     }
     m_activeQuery.query.setQuery(QString());
+    m_activeQuery.telemetryShape = -1;
+
+    if (m_sharedHandle) {
+        QueryRegistry::instance()->detach(m_sharedHandle, this);
+        m_sharedHandle = 0;
+    }
+    m_leading = false;
+    m_skipRows = 0;
+
+    // drop rows of the old query still being decoded
+    {
+        QMutexLocker locker(&m_decodeMutex);
+        ++m_generation;
+        m_decoded.clear();
+    }
+    m_submitSeq = 0;
+    m_deliverSeq = 0;
+    m_finishPending = false;
 }
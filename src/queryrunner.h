@@ -24,19 +24,35 @@
 #define COMMHISTORY_QUERYTHREAD_H
 
 #include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMap>
 
 #include "event.h"
 #include "group.h"
 #include "queryresult.h"
+#include "queryregistry.h"
 
 namespace CommHistory {
 
 class TrackerIO;
+class DecodeJob;
 
 /*!
  * \class QueryRunner
  *
  * Helper thread for async tracker queries.
+ *
+ * Result rows are read on the runner's thread, but event and group rows
+ * are decoded on a process-wide worker pool shared by all runners, so
+ * several models loading at the same time decode in parallel. Decoded
+ * chunks are delivered in row order regardless of which worker finishes
+ * first.
+ *
+ * Non-streamed model queries are shared through QueryRegistry: a runner
+ * asking for a query that another runner is already running receives that
+ * runner's rows instead of running it again.
  */
 class QueryRunner: public QObject
 {
@@ -52,6 +68,23 @@ public:
 
     void setFirstChunkSize(int size);
 
+    /*!
+     * Set the decoding priority of this runner's queries. Pending decode
+     * jobs of a higher priority runner are started first; a model that is
+     * currently visible should use a higher priority than background
+     * models. Default is 0.
+     */
+    void setPriority(int priority);
+    int priority() const;
+
+    /*!
+     * Set the number of worker threads used for decoding query results in
+     * this process. 0 disables the pool and decodes rows on the runner's
+     * own thread.
+     */
+    static void setDecodeThreadCount(int count);
+    static int decodeThreadCount();
+
     // If false (default), runQuery() cancels any ongoing queries before
     // starting a new one.
 
@@ -92,6 +125,8 @@ private Q_SLOTS:
     void finished();
     void nextSlot();
     void fetchMoreSlot();
+    void decodedSlot();
+    void sharedDataSlot();
 
 private:
     void checkCanFetchMoreChange();
@@ -99,6 +134,13 @@ private:
     bool reallyFetchMore(int pos);
     void readData();
     void endActiveQuery();
+    void execActiveQuery();
+    bool attachShared();
+    void finishShared(bool successful);
+    void emitDecoded(const DecodedChunk &chunk);
+    void submitRows(const QList<QSparqlResultRow> &rows, int start);
+    void deliverDecoded();
+    void waitForDecodeJobs();
 
 private:
     bool m_streamedMode;
@@ -117,6 +159,31 @@ private:
 
     bool m_syncMode;
 
+    QAtomicInt m_priority; // set from the model thread
+
+    // time since exec of the active query, when telemetry is enabled
+    QElapsedTimer m_queryTimer;
+
+    // decoding state, see DecodeJob
+    QMutex m_decodeMutex; // protects the members below
+    QWaitCondition m_decodeDone;
+    int m_runningJobs;
+    int m_generation;
+    QMap<int, DecodedChunk> m_decoded;
+    // sequence numbers of the active query, only used on the runner's thread
+    int m_submitSeq;
+    int m_deliverSeq;
+    bool m_finishPending;
+
+    // sharing through QueryRegistry, 0 when the query is not shared
+    int m_sharedHandle;
+    bool m_leading;
+    int m_sharedRead;  // chunks received as a follower
+    int m_sharedRows;  // rows emitted as a follower
+    int m_skipRows;    // rows already emitted before running unshared
+
+    friend class DecodeJob;
+
 #ifdef DEBUG
     QTime m_timer;
 #endif
@@ -0,0 +1,897 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtDBus/QtDBus>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QScopedPointer>
+#include <QSparqlResult>
+#include <QSparqlResultRow>
+#include <QSparqlError>
+#include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QDebug>
+
+#include <algorithm>
+#include <math.h>
+
+#include "searchindex.h"
+#include "trackerio.h"
+#include "trackerio_p.h"
+#include "sparqlbackend.h"
+#include "eventsquery.h"
+#include "queryresult.h"
+#include "messagepart.h"
+#include "commonutils.h"
+#include "constants.h"
+
+// longer words are cut, nobody types them in full
+#define MAX_TOKEN_LENGTH 32
+// a shorter last word is matched as a whole word, a single letter
+// prefix would expand to a good part of the vocabulary
+#define MIN_PREFIX_LENGTH 2
+
+namespace CommHistory {
+
+struct Posting
+{
+    int eventId;
+    quint16 count; // occurrences of the token in the message
+};
+
+// text properties of a message, see IndexedMessage::textProperties
+enum TextProperty {
+    FreeTextProperty = 1,
+    SubjectProperty = 2,
+    PartsProperty = 4,
+    AllTextProperties = FreeTextProperty | SubjectProperty | PartsProperty
+};
+
+struct IndexedMessage
+{
+    IndexedMessage()
+        : groupId(-1), time(0), type(Event::UnknownType), textProperties(0) {}
+
+    int groupId;
+    uint time;
+    QString remoteUid;
+    Event::EventType type;
+    // the text is not kept: an update carrying only some text properties
+    // reads the others back from tracker if they were not empty
+    quint8 textProperties;
+    // unique tokens of the message, sharing the keys of postings
+    QVector<QString> tokens;
+};
+
+struct SearchIndexData
+{
+    // postings of every token, sorted by event id
+    QMap<QString, QVector<Posting> > postings;
+    QHash<int, IndexedMessage> messages;
+
+    void index(const Event &event);
+    void update(const Event &event);
+    void insert(int eventId, const IndexedMessage &message, const QString &text);
+    void remove(int eventId);
+    void removeIf(const QSet<int> &values, bool byGroup);
+};
+
+namespace {
+
+Q_GLOBAL_STATIC(SearchIndex, searchIndex)
+
+QAtomicInt indexCreated(0);
+
+// posting list of one token and its inverse document frequency
+struct TokenList
+{
+    const QVector<Posting> *postings;
+    float idf;
+};
+
+// a search word, with its prefix expansions
+struct Term
+{
+    QList<TokenList> tokens;
+    int postings;
+
+    bool operator<(const Term &other) const { return postings < other.postings; }
+};
+
+bool postingLessThan(const Posting &posting, int eventId)
+{
+    return posting.eventId < eventId;
+}
+
+bool matchLessThan(const SearchIndex::Match &a, const SearchIndex::Match &b)
+{
+    // best first, then newest first
+    if (a.score != b.score)
+        return a.score > b.score;
+    if (a.time != b.time)
+        return a.time > b.time;
+    return a.eventId > b.eventId;
+}
+
+bool isIndexedType(Event::EventType type)
+{
+    return type == Event::SMSEvent
+        || type == Event::MMSEvent
+        || type == Event::IMEvent;
+}
+
+void appendText(QString &text, const QString &part)
+{
+    if (part.isEmpty())
+        return;
+    if (!text.isEmpty())
+        text += QLatin1Char(' ');
+    text += part;
+}
+
+// text properties carried by event
+int textProperties(const Event &event)
+{
+    const Event::PropertySet valid = event.validProperties();
+    int result = 0;
+    if (valid.contains(Event::FreeText))
+        result |= FreeTextProperty;
+    if (valid.contains(Event::Subject))
+        result |= SubjectProperty;
+    if (valid.contains(Event::MessageParts))
+        result |= PartsProperty;
+    return result;
+}
+
+QString partsText(const Event &event)
+{
+    QString text;
+    foreach (const MessagePart &part, event.messageParts()) {
+        if (part.contentType().startsWith(QLatin1String("text/plain")))
+            appendText(text, part.plainTextContent());
+    }
+    return text;
+}
+
+// indexed text of the properties event carries; nonEmpty is set to the
+// properties that had text
+QString messageText(const Event &event, quint8 *nonEmpty)
+{
+    const int carried = textProperties(event);
+    QString text;
+    *nonEmpty = 0;
+
+    if ((carried & FreeTextProperty) && !event.freeText().isEmpty()) {
+        appendText(text, event.freeText());
+        *nonEmpty |= FreeTextProperty;
+    }
+    if ((carried & SubjectProperty) && !event.subject().isEmpty()) {
+        appendText(text, event.subject());
+        *nonEmpty |= SubjectProperty;
+    }
+    if (carried & PartsProperty) {
+        QString parts = partsText(event);
+        if (!parts.isEmpty()) {
+            appendText(text, parts);
+            *nonEmpty |= PartsProperty;
+        }
+    }
+
+    return text;
+}
+
+void applyMetadata(IndexedMessage &message, const Event &event)
+{
+    const Event::PropertySet valid = event.validProperties();
+    if (valid.contains(Event::Type))
+        message.type = event.type();
+    if (valid.contains(Event::GroupId))
+        message.groupId = event.groupId();
+    if (valid.contains(Event::StartTime))
+        message.time = event.startTime().toTime_t();
+    if (valid.contains(Event::RemoteUid))
+        message.remoteUid = internUid(event.remoteUid());
+}
+
+QSparqlResult* runQuery(SparqlBackend &connection, const QString &query)
+{
+    QSparqlQuery sparqlQuery(query);
+    QSparqlResult *result;
+    if (connection.hasFeature(QSparqlConnection::SyncExec)) {
+        result = connection.syncExec(sparqlQuery);
+    } else {
+        result = connection.exec(sparqlQuery);
+        result->waitForFinished();
+    }
+
+    if (result->hasError()) {
+        qCritical() << Q_FUNC_INFO << result->lastError().message();
+        delete result;
+        return 0;
+    }
+
+    return result;
+}
+
+// text/plain parts of MMS messages matching filter, by message id
+bool readPartTexts(SparqlBackend &connection, const QString &filter,
+                   QHash<int, QString> &texts)
+{
+    QScopedPointer<QSparqlResult> result(runQuery(connection, QString(QLatin1String(
+        "SELECT ?message nie:plainTextContent(?part) WHERE { "
+        "?message nmo:mmsHasContent [nie:hasPart ?part] . "
+        "?part nie:mimeType ?type "
+        "FILTER(fn:starts-with(?type, \"text/plain\")%1) }")).arg(filter)));
+    if (!result)
+        return false;
+
+    while (result->next()) {
+        QSparqlResultRow row = result->current();
+        int eventId = Event::urlToId(row.value(0).toString());
+        appendText(texts[eventId], row.value(1).toString());
+    }
+
+    return true;
+}
+
+}
+
+class SearchIndexLoader : public QRunnable
+{
+public:
+    SearchIndexLoader(SearchIndex *index) : m_index(index) {}
+
+    void run() {
+        m_index->load();
+    }
+
+private:
+    SearchIndex *m_index;
+};
+
+void SearchIndexData::index(const Event &event)
+{
+    if (event.id() < 0)
+        return;
+
+    if (!isIndexedType(event.type()) || event.isDeleted()) {
+        remove(event.id());
+        return;
+    }
+
+    IndexedMessage message;
+    applyMetadata(message, event);
+    QString text = messageText(event, &message.textProperties);
+    insert(event.id(), message, text);
+}
+
+void SearchIndexData::update(const Event &event)
+{
+    if (event.id() < 0)
+        return;
+
+    const Event::PropertySet valid = event.validProperties();
+    if ((valid.contains(Event::IsDeleted) && event.isDeleted())
+        || (valid.contains(Event::Type) && !isIndexedType(event.type()))) {
+        remove(event.id());
+        return;
+    }
+
+    QHash<int, IndexedMessage>::iterator it = messages.find(event.id());
+
+    // SearchIndex::updateEvents() added the text properties the update
+    // lacks, the tokens are rebuilt from the event alone
+    if (textProperties(event)) {
+        IndexedMessage message;
+        if (it != messages.end())
+            message = it.value();
+        applyMetadata(message, event);
+        QString text = messageText(event, &message.textProperties);
+        if (isIndexedType(message.type))
+            insert(event.id(), message, text);
+    } else if (it != messages.end()) {
+        applyMetadata(it.value(), event);
+    }
+}
+
+void SearchIndexData::insert(int eventId, const IndexedMessage &message,
+                             const QString &text)
+{
+    remove(eventId);
+
+    QStringList tokens = SearchIndex::tokenize(text);
+    if (tokens.isEmpty())
+        return;
+    qSort(tokens);
+
+    IndexedMessage &indexed = messages[eventId];
+    indexed = message;
+    indexed.tokens.clear();
+
+    int i = 0;
+    while (i < tokens.size()) {
+        int next = i + 1;
+        while (next < tokens.size() && tokens.at(next) == tokens.at(i))
+            next++;
+
+        Posting posting;
+        posting.eventId = eventId;
+        posting.count = qMin(next - i, 0xffff);
+
+        QMap<QString, QVector<Posting> >::iterator token = postings.find(tokens.at(i));
+        if (token == postings.end())
+            token = postings.insert(tokens.at(i), QVector<Posting>());
+
+        QVector<Posting> &list = token.value();
+        // ids are mostly handed out in order, so this is usually an append
+        if (list.isEmpty() || list.last().eventId < eventId) {
+            list.append(posting);
+        } else {
+            QVector<Posting>::iterator pos = std::lower_bound(list.begin(), list.end(),
+                                                              eventId, postingLessThan);
+            list.insert(pos, posting);
+        }
+
+        indexed.tokens.append(token.key());
+        i = next;
+    }
+}
+
+void SearchIndexData::remove(int eventId)
+{
+    QHash<int, IndexedMessage>::iterator it = messages.find(eventId);
+    if (it == messages.end())
+        return;
+
+    foreach (const QString &tokenText, it.value().tokens) {
+        QMap<QString, QVector<Posting> >::iterator token = postings.find(tokenText);
+        if (token == postings.end())
+            continue;
+
+        QVector<Posting> &list = token.value();
+        QVector<Posting>::iterator pos = std::lower_bound(list.begin(), list.end(),
+                                                          eventId, postingLessThan);
+        if (pos != list.end() && pos->eventId == eventId)
+            list.erase(pos);
+        if (list.isEmpty())
+            postings.erase(token);
+    }
+
+    messages.erase(it);
+}
+
+void SearchIndexData::removeIf(const QSet<int> &values, bool byGroup)
+{
+    QList<int> removed;
+    QHash<int, IndexedMessage>::const_iterator it;
+    for (it = messages.constBegin(); it != messages.constEnd(); ++it) {
+        if (values.contains(byGroup ? it.value().groupId : (int)it.value().type))
+            removed.append(it.key());
+    }
+
+    foreach (int eventId, removed)
+        remove(eventId);
+}
+
+SearchIndex::SearchIndex()
+    : m_data(new SearchIndexData)
+    , m_loaded(false)
+    , m_loading(false)
+{
+    moveToMainThread(this);
+
+    qRegisterMetaType<QList<CommHistory::Event> >();
+    qRegisterMetaType<QList<int> >();
+
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_ADDED_SIGNAL,
+        this, SLOT(addEvents(const QList<CommHistory::Event> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_UPDATED_SIGNAL,
+        this, SLOT(updateEvents(const QList<CommHistory::Event> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENT_DELETED_SIGNAL,
+        this, SLOT(removeEvent(int)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_DELETED_SIGNAL,
+        this, SLOT(removeGroups(const QList<int> &)));
+
+    indexCreated.fetchAndStoreOrdered(1);
+}
+
+SearchIndex::~SearchIndex()
+{
+    indexCreated.fetchAndStoreOrdered(0);
+    delete m_data;
+}
+
+SearchIndex* SearchIndex::instance()
+{
+    return searchIndex();
+}
+
+bool SearchIndex::exists()
+{
+    return indexCreated.fetchAndAddOrdered(0) != 0;
+}
+
+bool SearchIndex::isLoaded() const
+{
+    QReadLocker locker(&m_lock);
+    return m_loaded;
+}
+
+bool SearchIndex::isLoading() const
+{
+    QReadLocker locker(&m_lock);
+    return m_loading;
+}
+
+bool SearchIndex::load()
+{
+    {
+        QWriteLocker locker(&m_lock);
+        while (m_loading)
+            m_loadDone.wait(&m_lock);
+        if (m_loaded)
+            return true;
+        m_loading = true;
+    }
+
+    // read without holding the lock, searches keep using the old data
+    SearchIndexData *data = new SearchIndexData;
+    bool ok = read(data);
+
+    {
+        QWriteLocker locker(&m_lock);
+        m_loading = false;
+        if (ok) {
+            qSwap(m_data, data);
+            m_loaded = true;
+            foreach (const Change &pending, m_pending) {
+                apply(pending);
+                if (!m_loaded) // cleared meanwhile
+                    break;
+            }
+        }
+        m_pending.clear();
+        delete data;
+        m_loadDone.wakeAll();
+    }
+
+    qDebug() << Q_FUNC_INFO << "messages:" << messageCount() << "tokens:" << tokenCount();
+    emit loaded(ok);
+
+    return ok;
+}
+
+void SearchIndex::loadInBackground()
+{
+    {
+        QReadLocker locker(&m_lock);
+        if (m_loading)
+            return;
+
+        if (m_loaded) {
+            QMetaObject::invokeMethod(this, "loaded", Qt::QueuedConnection,
+                                      Q_ARG(bool, true));
+            return;
+        }
+    }
+
+    QThreadPool::globalInstance()->start(new SearchIndexLoader(this));
+}
+
+bool SearchIndex::read(SearchIndexData *data)
+{
+    SparqlBackend &connection = TrackerIO::instance()->d->connection();
+
+    QHash<int, QString> partTexts;
+    if (!readPartTexts(connection, QString(), partTexts))
+        return false;
+
+    Event::PropertySet properties;
+    properties << Event::Id << Event::Type << Event::StartTime
+               << Event::RemoteUid << Event::GroupId
+               << Event::FreeText << Event::Subject;
+
+    EventsQuery query(properties);
+    query.addPattern(QLatin1String("{ %1 rdf:type nmo:SMSMessage } "
+                                   "UNION { %1 rdf:type nmo:MMSMessage } "
+                                   "UNION { %1 rdf:type nmo:IMMessage } "
+                                   "%1 nmo:isDeleted \"false\" ."))
+            .variable(Event::Id);
+
+    QScopedPointer<QSparqlResult> result(runQuery(connection, query.query()));
+    if (!result)
+        return false;
+
+    QueryResult decoder;
+    decoder.queryType = EventQuery;
+    decoder.properties = query.eventProperties();
+
+    while (result->next()) {
+        Event event;
+        decoder.fillEventFromModel(result->current(), event);
+        if (event.id() < 0 || !isIndexedType(event.type()))
+            continue;
+
+        IndexedMessage message;
+        applyMetadata(message, event);
+        QString text = messageText(event, &message.textProperties);
+        QString parts = partTexts.value(event.id());
+        if (!parts.isEmpty()) {
+            appendText(text, parts);
+            message.textProperties |= PartsProperty;
+        }
+
+        data->insert(event.id(), message, text);
+    }
+
+    return true;
+}
+
+QList<SearchIndex::Match> SearchIndex::search(const QString &text,
+                                              int groupId,
+                                              const QStringList &remoteUids,
+                                              int offset,
+                                              int limit,
+                                              int *totalMatches) const
+{
+    QList<Match> matches;
+    if (totalMatches)
+        *totalMatches = 0;
+
+    QStringList words = tokenize(text);
+    if (words.isEmpty())
+        return matches;
+
+    // a word is complete once something other than a letter follows it
+    const QChar last = text.at(text.size() - 1);
+    const bool prefixSearch = (last.isLetterOrNumber() || last.isMark())
+        && words.last().size() >= MIN_PREFIX_LENGTH;
+    const QString prefix = prefixSearch ? words.takeLast() : QString();
+    words.removeDuplicates();
+    words.removeAll(prefix);
+
+    QReadLocker locker(&m_lock);
+
+    const float messages = m_data->messages.size();
+    QList<Term> terms;
+
+    foreach (const QString &word, words) {
+        QMap<QString, QVector<Posting> >::const_iterator it = m_data->postings.constFind(word);
+        if (it == m_data->postings.constEnd())
+            return matches;
+
+        Term term;
+        TokenList tokens = { &it.value(), (float)log(1 + messages / it.value().size()) };
+        term.tokens.append(tokens);
+        term.postings = it.value().size();
+        terms.append(term);
+    }
+
+    if (!prefix.isEmpty()) {
+        Term term;
+        term.postings = 0;
+        QMap<QString, QVector<Posting> >::const_iterator it = m_data->postings.lowerBound(prefix);
+        while (it != m_data->postings.constEnd() && it.key().startsWith(prefix)) {
+            TokenList tokens = { &it.value(), (float)log(1 + messages / it.value().size()) };
+            term.tokens.append(tokens);
+            term.postings += it.value().size();
+            ++it;
+        }
+
+        if (term.tokens.isEmpty())
+            return matches;
+        terms.append(term);
+    }
+
+    // intersect starting from the rarest term; a message scores the sum
+    // over terms of its best matching token's tf-idf
+    qSort(terms);
+
+    QHash<int, float> scores;
+    for (int i = 0; i < terms.size(); i++) {
+        const Term &term = terms.at(i);
+        QHash<int, float> termScores;
+        termScores.reserve(i == 0 ? term.postings : scores.size());
+
+        foreach (const TokenList &tokens, term.tokens) {
+            foreach (const Posting &posting, *tokens.postings) {
+                if (i > 0 && !scores.contains(posting.eventId))
+                    continue;
+
+                float score = posting.count * tokens.idf;
+                QHash<int, float>::iterator best = termScores.find(posting.eventId);
+                if (best == termScores.end())
+                    termScores.insert(posting.eventId, score);
+                else if (best.value() < score)
+                    best.value() = score;
+            }
+        }
+
+        if (i > 0) {
+            QHash<int, float>::iterator it;
+            for (it = termScores.begin(); it != termScores.end(); ++it)
+                it.value() += scores.value(it.key());
+        }
+
+        scores = termScores;
+        if (scores.isEmpty())
+            return matches;
+    }
+
+    // numbers are matched by their last digits, cache per remote uid
+    QHash<QString, bool> uidMatches;
+
+    QHash<int, float>::const_iterator it;
+    for (it = scores.constBegin(); it != scores.constEnd(); ++it) {
+        const IndexedMessage &message = m_data->messages.constFind(it.key()).value();
+        if (groupId != -1 && message.groupId != groupId)
+            continue;
+
+        if (!remoteUids.isEmpty()) {
+            QHash<QString, bool>::const_iterator cached = uidMatches.constFind(message.remoteUid);
+            if (cached == uidMatches.constEnd()) {
+                bool found = false;
+                foreach (const QString &uid, remoteUids) {
+                    if (remoteAddressMatch(message.remoteUid, uid)) {
+                        found = true;
+                        break;
+                    }
+                }
+                cached = uidMatches.insert(message.remoteUid, found);
+            }
+            if (!cached.value())
+                continue;
+        }
+
+        Match match;
+        match.eventId = it.key();
+        match.groupId = message.groupId;
+        match.time = message.time;
+        match.score = it.value();
+        matches.append(match);
+    }
+
+    locker.unlock();
+
+    if (totalMatches)
+        *totalMatches = matches.size();
+
+    if (offset >= matches.size())
+        return QList<Match>();
+
+    int end = limit > 0 ? qMin(offset + limit, matches.size()) : matches.size();
+    std::partial_sort(matches.begin(), matches.begin() + end, matches.end(), matchLessThan);
+
+    return matches.mid(offset, end - offset);
+}
+
+QStringList SearchIndex::tokenize(const QString &text)
+{
+    QStringList tokens;
+    QString token;
+
+    const QChar *c = text.unicode();
+    const QChar *end = c + text.size();
+    for (; c != end; ++c) {
+        if (c->isLetterOrNumber()) {
+            if (token.size() >= MAX_TOKEN_LENGTH)
+                continue;
+
+            QChar folded = c->toLower();
+            // drop diacritics: "é" becomes "e"
+            if (folded.decompositionTag() == QChar::Canonical)
+                folded = folded.decomposition().at(0);
+            token.append(folded);
+        } else if (c->isMark()) {
+            // combining diacritic of decomposed text, part of the word
+            continue;
+        } else if (!token.isEmpty()) {
+            tokens.append(token);
+            token.clear();
+        }
+    }
+
+    if (!token.isEmpty())
+        tokens.append(token);
+
+    return tokens;
+}
+
+int SearchIndex::messageCount() const
+{
+    QReadLocker locker(&m_lock);
+    return m_data->messages.size();
+}
+
+int SearchIndex::tokenCount() const
+{
+    QReadLocker locker(&m_lock);
+    return m_data->postings.size();
+}
+
+void SearchIndex::addEvents(const QList<CommHistory::Event> &events)
+{
+    change(Added, events);
+}
+
+void SearchIndex::updateEvents(const QList<CommHistory::Event> &events)
+{
+    change(Updated, withStoredText(events));
+}
+
+QList<Event> SearchIndex::withStoredText(const QList<Event> &events) const
+{
+    // text properties to read per event id
+    QHash<int, int> missing;
+    {
+        QReadLocker locker(&m_lock);
+        if (!m_loaded && !m_loading)
+            return events;
+
+        foreach (const Event &event, events) {
+            int carried = textProperties(event);
+            if (!carried || carried == AllTextProperties || event.id() < 0)
+                continue;
+
+            // while loading the message may not be known yet
+            int needed = AllTextProperties;
+            if (m_loaded) {
+                QHash<int, IndexedMessage>::const_iterator it =
+                    m_data->messages.constFind(event.id());
+                needed = it != m_data->messages.constEnd() ? it.value().textProperties : 0;
+            }
+
+            if (needed & ~carried)
+                missing.insert(event.id(), needed & ~carried);
+        }
+    }
+
+    if (missing.isEmpty())
+        return events;
+
+    bool needParts = false;
+    QStringList urls;
+    QHash<int, int>::const_iterator it;
+    for (it = missing.constBegin(); it != missing.constEnd(); ++it) {
+        needParts |= (it.value() & PartsProperty) != 0;
+        urls << QString(QLatin1String("<%1>")).arg(Event::idToUrl(it.key()).toString());
+    }
+    const QString idList = urls.join(QLatin1String(","));
+
+    SparqlBackend &connection = TrackerIO::instance()->d->connection();
+
+    QHash<int, QString> partTexts;
+    if (needParts)
+        readPartTexts(connection, QString(QLatin1String(" && ?message IN (%1)")).arg(idList),
+                      partTexts);
+
+    Event::PropertySet properties;
+    properties << Event::Id << Event::FreeText << Event::Subject;
+    EventsQuery query(properties);
+    query.addPattern(QString(QLatin1String("FILTER(%2 IN (%1))")).arg(idList))
+            .variable(Event::Id);
+
+    QHash<int, Event> stored;
+    QScopedPointer<QSparqlResult> result(runQuery(connection, query.query()));
+    if (result) {
+        QueryResult decoder;
+        decoder.queryType = EventQuery;
+        decoder.properties = query.eventProperties();
+        while (result->next()) {
+            Event event;
+            decoder.fillEventFromModel(result->current(), event);
+            stored.insert(event.id(), event);
+        }
+    }
+
+    QList<Event> completed;
+    foreach (Event event, events) {
+        int lacking = missing.value(event.id());
+        if (lacking & FreeTextProperty)
+            event.setFreeText(stored.value(event.id()).freeText());
+        if (lacking & SubjectProperty)
+            event.setSubject(stored.value(event.id()).subject());
+        if (lacking & PartsProperty) {
+            MessagePart part;
+            part.setContentType(QLatin1String("text/plain"));
+            part.setPlainTextContent(partTexts.value(event.id()));
+            event.setMessageParts(QList<MessagePart>() << part);
+        }
+        completed.append(event);
+    }
+
+    return completed;
+}
+
+void SearchIndex::removeEvent(int eventId)
+{
+    change(Removed, QList<Event>(), QList<int>() << eventId);
+}
+
+void SearchIndex::removeGroups(const QList<int> &groupIds)
+{
+    change(GroupsRemoved, QList<Event>(), groupIds);
+}
+
+void SearchIndex::removeEventsOfType(int type)
+{
+    change(TypeRemoved, QList<Event>(), QList<int>() << type);
+}
+
+void SearchIndex::clear()
+{
+    change(Cleared, QList<Event>());
+}
+
+void SearchIndex::change(ChangeType type,
+                         const QList<CommHistory::Event> &events,
+                         const QList<int> &ids)
+{
+    Change change;
+    change.type = type;
+    change.events = events;
+    change.ids = ids;
+
+    QWriteLocker locker(&m_lock);
+    if (m_loaded)
+        apply(change);
+    else if (m_loading)
+        m_pending.append(change);
+    // otherwise the change is read by the next load()
+}
+
+void SearchIndex::apply(const Change &change)
+{
+    switch (change.type) {
+    case Added:
+        foreach (const Event &event, change.events)
+            m_data->index(event);
+        break;
+    case Updated:
+        foreach (const Event &event, change.events)
+            m_data->update(event);
+        break;
+    case Removed:
+        foreach (int eventId, change.ids)
+            m_data->remove(eventId);
+        break;
+    case GroupsRemoved:
+        m_data->removeIf(change.ids.toSet(), true);
+        break;
+    case TypeRemoved:
+        m_data->removeIf(change.ids.toSet(), false);
+        break;
+    case Cleared:
+        delete m_data;
+        m_data = new SearchIndexData;
+        m_loaded = false;
+        break;
+    }
+}
+
+} // namespace CommHistory
@@ -0,0 +1,181 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_SEARCHINDEX_H
+#define COMMHISTORY_SEARCHINDEX_H
+
+#include <QObject>
+#include <QReadWriteLock>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QList>
+
+#include "event.h"
+
+namespace CommHistory {
+
+struct SearchIndexData;
+
+/*!
+ * \class SearchIndex
+ *
+ * Process-wide in-memory token index over message text: the free text
+ * of SMS and IM messages, and the subject and text/plain parts of MMS
+ * messages. Calls are not indexed.
+ *
+ * The index is read from tracker by load() or loadInBackground() and
+ * then kept up to date incrementally: TrackerIO hands it the events it
+ * adds, modifies and deletes once their transaction has been committed,
+ * and the eventsAdded, eventsUpdated, eventDeleted and groupsDeleted
+ * notifications of com.nokia.commhistory on D-Bus bring in the changes
+ * of other processes. Until instance() has been called nothing is
+ * collected.
+ *
+ * Tokens are lower-cased letter and digit runs with diacritics removed.
+ * All words of a search must match, the last one as a prefix so that
+ * partial words can be searched while typing. A last word of a single
+ * letter is only matched as a whole word.
+ */
+class SearchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Match {
+        Match() : eventId(-1), groupId(-1), time(0), score(0) {}
+
+        int eventId;
+        int groupId;
+        /*! Start time of the event, as time_t. */
+        uint time;
+        /*! tf-idf of the matched tokens, higher is better. */
+        float score;
+    };
+
+    SearchIndex();
+    ~SearchIndex();
+
+    static SearchIndex* instance();
+
+    /*!
+     * True if instance() has been called, i.e. changes are collected.
+     */
+    static bool exists();
+
+    bool isLoaded() const;
+    bool isLoading() const;
+
+    /*!
+     * Read all messages from tracker, blocking the calling thread.
+     * Changes reported while loading are applied once it is done. Does
+     * nothing if the index is already loaded.
+     */
+    bool load();
+
+    /*!
+     * Run load() on a worker thread and emit loaded() when done.
+     */
+    void loadInBackground();
+
+    /*!
+     * Search for messages containing all words of \a text, best match
+     * first; matches with the same score are ordered by time, newest
+     * first.
+     *
+     * \param text Words to look for, the last one is matched as a prefix.
+     * \param groupId Only return messages of this group, -1 for all.
+     * \param remoteUids Only return messages with one of these remote
+     * uids (phone numbers are compared by their last digits), empty for
+     * all.
+     * \param offset Number of best matches to skip.
+     * \param limit Maximum number of matches returned, 0 for all.
+     * \param totalMatches Set to the number of matches before paging.
+     */
+    QList<Match> search(const QString &text,
+                        int groupId = -1,
+                        const QStringList &remoteUids = QStringList(),
+                        int offset = 0,
+                        int limit = 0,
+                        int *totalMatches = 0) const;
+
+    /*!
+     * Split text into index tokens.
+     */
+    static QStringList tokenize(const QString &text);
+
+    int messageCount() const;
+    int tokenCount() const;
+
+public Q_SLOTS:
+    /*!
+     * Add or replace the messages in the index. Other event types and
+     * deleted messages are ignored.
+     */
+    void addEvents(const QList<CommHistory::Event> &events);
+
+    /*!
+     * Apply modified properties. Free text, subject and message parts
+     * are indexed separately; only the ones given are replaced, the
+     * others are read from tracker if the message had text in them.
+     */
+    void updateEvents(const QList<CommHistory::Event> &events);
+
+    void removeEvent(int eventId);
+    void removeGroups(const QList<int> &groupIds);
+    void removeEventsOfType(int type);
+
+    /*!
+     * Forget all messages; the index has to be loaded again.
+     */
+    void clear();
+
+Q_SIGNALS:
+    void loaded(bool successful);
+
+private:
+    enum ChangeType { Added, Updated, Removed, GroupsRemoved, TypeRemoved, Cleared };
+    struct Change {
+        ChangeType type;
+        QList<CommHistory::Event> events;
+        QList<int> ids;
+    };
+
+    bool read(SearchIndexData *data);
+    QList<CommHistory::Event> withStoredText(const QList<CommHistory::Event> &events) const;
+    void change(ChangeType type,
+                const QList<CommHistory::Event> &events,
+                const QList<int> &ids = QList<int>());
+    void apply(const Change &change);
+
+    mutable QReadWriteLock m_lock;
+    QWaitCondition m_loadDone;
+    SearchIndexData *m_data;
+    bool m_loaded;
+    bool m_loading;
+
+    // changes received while loading, replayed after it
+    QList<Change> m_pending;
+};
+
+}
+
+#endif
@@ -0,0 +1,257 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QDebug>
+
+#include "eventmodel_p.h"
+#include "eventsquery.h"
+#include "eventtreeitem.h"
+#include "searchindex.h"
+
+#include "searchmodel.h"
+
+#define DEFAULT_PAGE_SIZE 50
+
+namespace CommHistory {
+
+using namespace CommHistory;
+
+class SearchModelPrivate : public EventModelPrivate {
+public:
+    Q_DECLARE_PUBLIC(SearchModel);
+
+    SearchModelPrivate(EventModel *model)
+        : EventModelPrivate(model)
+        , groupFilter(-1)
+        , pageSize(DEFAULT_PAGE_SIZE)
+        , fetched(0)
+        , totalMatches(0)
+        , waitingForIndex(false) {
+    }
+
+    bool fillModel(int start, int end, QList<CommHistory::Event> events) {
+        Q_UNUSED(start);
+        Q_UNUSED(end);
+        Q_Q(SearchModel);
+
+        // the query returns the page in any order, keep rows by rank
+        foreach (const Event &event, events) {
+            int rank = ranks.value(event.id(), -1);
+            if (rank < 0)
+                continue;
+
+            int first = 0;
+            int count = eventRootItem->childCount();
+            while (count > 0) {
+                int step = count / 2;
+                if (ranks.value(eventRootItem->eventAt(first + step).id()) < rank) {
+                    first += step + 1;
+                    count -= step + 1;
+                } else {
+                    count = step;
+                }
+            }
+
+            q->beginInsertRows(QModelIndex(), first, first);
+            eventRootItem->insertChildAt(first, new EventTreeItem(event, eventRootItem));
+            q->endInsertRows();
+        }
+
+        return false;
+    }
+
+    void reset() {
+        clearEvents();
+        ranks.clear();
+        fetched = 0;
+        totalMatches = 0;
+        waitingForIndex = false;
+    }
+
+    bool fetchPage() {
+        QList<SearchIndex::Match> matches =
+            SearchIndex::instance()->search(text, groupFilter, contactFilter,
+                                            fetched, pageSize, &totalMatches);
+        qDebug() << Q_FUNC_INFO << text << fetched << matches.size() << "of" << totalMatches;
+
+        if (matches.isEmpty()) {
+            if (queryMode == EventModel::SyncQuery)
+                modelUpdatedSlot(true);
+            else
+                QMetaObject::invokeMethod(this, "modelUpdatedSlot", Qt::QueuedConnection,
+                                          Q_ARG(bool, true));
+            return true;
+        }
+
+        QStringList urls;
+        foreach (const SearchIndex::Match &match, matches) {
+            ranks.insert(match.eventId, fetched++);
+            urls << QString(QLatin1String("<%1>")).arg(Event::idToUrl(match.eventId).toString());
+        }
+
+        EventsQuery query(propertyMask);
+        query.addPattern(QString(QLatin1String("FILTER(%2 IN (%1))"))
+                         .arg(urls.join(QLatin1String(","))))
+                .variable(Event::Id);
+
+        // the page is selected by the ids
+        int limit = queryLimit;
+        int offset = queryOffset;
+        queryLimit = 0;
+        queryOffset = 0;
+        bool result = executeQuery(query);
+        queryLimit = limit;
+        queryOffset = offset;
+
+        return result;
+    }
+
+    int groupFilter;
+    QStringList contactFilter;
+    int pageSize;
+
+    QString text;
+    // position of the fetched matches in the ranking, by event id
+    QHash<int, int> ranks;
+    int fetched;
+    int totalMatches;
+    bool waitingForIndex;
+};
+
+SearchModel::SearchModel(QObject *parent)
+    : EventModel(*new SearchModelPrivate(this), parent)
+{
+    connect(SearchIndex::instance(), SIGNAL(loaded(bool)),
+            this, SLOT(indexLoadedSlot(bool)));
+}
+
+SearchModel::~SearchModel()
+{
+}
+
+void SearchModel::setGroupFilter(int groupId)
+{
+    Q_D(SearchModel);
+    d->groupFilter = groupId;
+}
+
+int SearchModel::groupFilter() const
+{
+    Q_D(const SearchModel);
+    return d->groupFilter;
+}
+
+void SearchModel::setContactFilter(const QStringList &remoteUids)
+{
+    Q_D(SearchModel);
+    d->contactFilter = remoteUids;
+}
+
+QStringList SearchModel::contactFilter() const
+{
+    Q_D(const SearchModel);
+    return d->contactFilter;
+}
+
+void SearchModel::setPageSize(int pageSize)
+{
+    Q_D(SearchModel);
+    d->pageSize = pageSize > 0 ? pageSize : DEFAULT_PAGE_SIZE;
+}
+
+int SearchModel::pageSize() const
+{
+    Q_D(const SearchModel);
+    return d->pageSize;
+}
+
+bool SearchModel::search(const QString &text)
+{
+    Q_D(SearchModel);
+
+    beginResetModel();
+    d->reset();
+    endResetModel();
+
+    d->text = text;
+
+    SearchIndex *index = SearchIndex::instance();
+    if (!index->isLoaded()) {
+        if (d->queryMode != EventModel::SyncQuery) {
+            d->waitingForIndex = true;
+            index->loadInBackground();
+            return true;
+        }
+
+        if (!index->load())
+            return false;
+    }
+
+    return d->fetchPage();
+}
+
+bool SearchModel::fetchNextPage()
+{
+    Q_D(SearchModel);
+
+    if (d->waitingForIndex || !hasMorePages())
+        return false;
+
+    return d->fetchPage();
+}
+
+QString SearchModel::searchText() const
+{
+    Q_D(const SearchModel);
+    return d->text;
+}
+
+int SearchModel::totalMatches() const
+{
+    Q_D(const SearchModel);
+    return d->totalMatches;
+}
+
+bool SearchModel::hasMorePages() const
+{
+    Q_D(const SearchModel);
+    return d->fetched < d->totalMatches;
+}
+
+void SearchModel::indexLoadedSlot(bool successful)
+{
+    Q_D(SearchModel);
+
+    if (!d->waitingForIndex)
+        return;
+    d->waitingForIndex = false;
+
+    if (!successful) {
+        qWarning() << Q_FUNC_INFO << "Error reading search index";
+        emit modelReady(false);
+        return;
+    }
+
+    d->fetchPage();
+}
+
+} // namespace CommHistory
@@ -0,0 +1,126 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_SEARCHMODEL_H
+#define COMMHISTORY_SEARCHMODEL_H
+
+#include <QStringList>
+
+#include "eventmodel.h"
+#include "libcommhistoryexport.h"
+
+namespace CommHistory {
+
+class SearchModelPrivate;
+
+/*!
+ * \class SearchModel
+ *
+ * Model for full-text search of SMS, MMS and IM messages. Messages
+ * containing all words of the search text are listed best match first,
+ * one page at a time. The last word is matched as a prefix, so search()
+ * can be called on every key press.
+ *
+ * The first search reads the message text index of the process (see
+ * SearchIndex) in the background, unless the query mode is SyncQuery.
+ * Later searches only fetch the events of the matched page.
+ */
+class LIBCOMMHISTORY_EXPORT SearchModel : public EventModel
+{
+    Q_OBJECT
+
+public:
+    /*!
+     * Model constructor.
+     *
+     * \param parent Parent object.
+     */
+    SearchModel(QObject *parent = 0);
+
+    /*!
+     * Destructor.
+     */
+    ~SearchModel();
+
+    /*!
+     * Only search messages of this group, -1 (default) for all. Applied
+     * by the next search().
+     */
+    void setGroupFilter(int groupId);
+    int groupFilter() const;
+
+    /*!
+     * Only search messages exchanged with one of these remote uids, empty
+     * (default) for all. Phone numbers are compared by their last digits.
+     * Applied by the next search().
+     */
+    void setContactFilter(const QStringList &remoteUids);
+    QStringList contactFilter() const;
+
+    /*!
+     * Number of matches fetched by search() and fetchNextPage(), 50 by
+     * default.
+     */
+    void setPageSize(int pageSize);
+    int pageSize() const;
+
+    /*!
+     * Reset model and fetch the best matches for text.
+     *
+     * \param text Search text, the last word is matched as a prefix.
+     * \return true if successful, otherwise false
+     */
+    bool search(const QString &text);
+
+    /*!
+     * Append the next page of matches of the current search.
+     *
+     * \return true if successful, otherwise false
+     */
+    bool fetchNextPage();
+
+    /*!
+     * Text of the current search.
+     */
+    QString searchText() const;
+
+    /*!
+     * Number of matches of the current search, including those not
+     * fetched yet.
+     */
+    int totalMatches() const;
+
+    /*!
+     * True if fetchNextPage() would add more matches.
+     */
+    bool hasMorePages() const;
+
+private Q_SLOTS:
+    void indexLoadedSlot(bool successful);
+
+private:
+    Q_DECLARE_PRIVATE(SearchModel);
+};
+
+}
+
+#endif
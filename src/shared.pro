@@ -64,9 +64,11 @@ QT_LIKE_HEADERS += headers/CallEvent \
                    headers/UnreadEventsModel \
                    headers/ClassZeroSMSModel \
                    headers/SingleEventModel \
+                   headers/SearchModel \
                    headers/Events \
                    headers/Models \
-                   headers/TrackerIO
+                   headers/TrackerIO \
+                   headers/Telemetry
 
 include(sources.pri)
 
@@ -29,12 +29,20 @@ HEADERS += trackerio.h \
            idsource.h \
            trackerio_p.h \
            queryresult.h \
+           queryregistry.h \
+           sparqlbackend.h \
            singleeventmodel.h \
+           searchmodel.h \
+           searchindex.h \
            committingtransaction.h \
            committingtransaction_p.h \
            eventsquery.h \
+           eventsquery_p.h \
            preparedqueries.h \
            updatesemitter.h \
+           updatesreceiver.h \
+           telemetry.h \
+           telemetry_p.h \
            constants.h \
            groupobject.h \
            groupmanager.h \
@@ -66,11 +74,17 @@ SOURCES += trackerio.cpp \
            contactlistener.cpp \
            idsource.cpp \
            queryresult.cpp \
+           queryregistry.cpp \
+           sparqlbackend.cpp \
            singleeventmodel.cpp \
+           searchmodel.cpp \
+           searchindex.cpp \
            committingtransaction.cpp \
            eventsquery.cpp \
            updatequery.cpp \
            updatesemitter.cpp \
+           updatesreceiver.cpp \
+           telemetry.cpp \
            groupmanager.cpp \
            groupobject.cpp \
            contactgroupmodel.cpp \
@@ -0,0 +1,93 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_SPARQLBACKEND_H
+#define COMMHISTORY_SPARQLBACKEND_H
+
+#include <QSparqlConnection>
+#include <QSparqlConnectionOptions>
+#include <QSparqlQuery>
+#include <QSparqlResult>
+
+#include "libcommhistoryexport.h"
+
+namespace CommHistory {
+
+/*!
+ * \class SparqlBackend
+ *
+ * Executes the SPARQL queries of TrackerIO, QueryRunner and
+ * CommittingTransaction. By default every thread gets its own
+ * TrackerSparqlBackend; tests and benchmarks can replace it for the whole
+ * process with setDefault().
+ */
+class LIBCOMMHISTORY_EXPORT SparqlBackend
+{
+public:
+    virtual ~SparqlBackend();
+
+    /*!
+     * Start executing query. The caller owns the returned result.
+     */
+    virtual QSparqlResult* exec(const QSparqlQuery &query) = 0;
+
+    /*!
+     * Execute query, the result is iterated on as rows are read.
+     * Only called if hasFeature(QSparqlConnection::SyncExec).
+     */
+    virtual QSparqlResult* syncExec(const QSparqlQuery &query) = 0;
+
+    virtual bool hasFeature(QSparqlConnection::Feature feature) const = 0;
+
+    /*!
+     * Use backend in every thread instead of connecting to tracker. The
+     * backend must be thread-safe and outlive all models and TrackerIO
+     * users; set it before the first query. 0 restores the tracker
+     * connections.
+     */
+    static void setDefault(SparqlBackend *backend);
+    static SparqlBackend* defaultBackend();
+};
+
+/*!
+ * \class TrackerSparqlBackend
+ *
+ * SparqlBackend on a QSparqlConnection, not thread-safe.
+ */
+class LIBCOMMHISTORY_EXPORT TrackerSparqlBackend : public SparqlBackend
+{
+public:
+    TrackerSparqlBackend(const QString &driver,
+                         const QSparqlConnectionOptions &options);
+    ~TrackerSparqlBackend();
+
+    QSparqlResult* exec(const QSparqlQuery &query);
+    QSparqlResult* syncExec(const QSparqlQuery &query);
+    bool hasFeature(QSparqlConnection::Feature feature) const;
+
+private:
+    QSparqlConnection m_connection;
+};
+
+}
+
+#endif
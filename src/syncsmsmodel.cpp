@@ -118,11 +118,9 @@ void SyncSMSModelPrivate::checkTokens(CommittingTransaction *transaction,
     }
 
     // no duplicate message tokens found, go ahead and add events
-    for (int i = 0; i < events.count(); i++) {
-        if (!doAddEvent(events[i])) {
-            transaction->abort();
-            return;
-        }
+    if (!doAddEvents(events)) {
+        transaction->abort();
+        return;
     }
 
     foreach (Event event, events) {
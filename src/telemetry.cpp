@@ -0,0 +1,563 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QAbstractItemModel>
+#include <QThread>
+#include <QRegExp>
+#include <QTextStream>
+#include <QDebug>
+#include <cstdlib>
+
+#include "telemetry.h"
+#include "telemetry_p.h"
+#include "trackerio.h"
+#include "queryregistry.h"
+#include "updatesemitter.h"
+#include "queryresult.h"
+#include "commonutils.h"
+#include "constants.h"
+
+// distinct shapes are few; anything beyond this is counted as one
+#define MAX_QUERY_SHAPES 128
+// raw query texts remembered for skipping normalization
+#define MAX_QUERY_TEXTS 512
+
+namespace CommHistory {
+
+namespace {
+
+// -1 until read from the environment
+QAtomicInt telemetryEnabled(-1);
+
+const char *queryTypeName(int type)
+{
+    switch (type) {
+    case EventQuery:       return "events";
+    case GroupQuery:       return "groups";
+    case MessagePartQuery: return "messageparts";
+    case GroupedCallQuery: return "callgroups";
+    default:               return "generic";
+    }
+}
+
+QString normalizeQuery(const QString &query)
+{
+    QString shape(query);
+    shape.replace(QRegExp(QLatin1String("\"(?:[^\"\\\\]|\\\\.)*\"")), QLatin1String("?"));
+    shape.replace(QRegExp(QLatin1String("<[^<>\\s]*>")), QLatin1String("<?>"));
+    shape.replace(QRegExp(QLatin1String("\\b\\d+\\b")), QLatin1String("?"));
+    return shape.simplified();
+}
+
+QString msec(qint64 usec)
+{
+    return QString::number(usec / 1000.0, 'f', 1);
+}
+
+QVariantMap histogramMap(const Telemetry::Histogram &histogram)
+{
+    QVariantMap map;
+    map.insert(QLatin1String("count"), histogram.count);
+    map.insert(QLatin1String("mean"), histogram.mean());
+    map.insert(QLatin1String("p50"), histogram.percentile(50));
+    map.insert(QLatin1String("p90"), histogram.percentile(90));
+    map.insert(QLatin1String("p99"), histogram.percentile(99));
+    map.insert(QLatin1String("max"), histogram.max);
+    return map;
+}
+
+void writeHistogram(QTextStream &out, const Telemetry::Histogram &histogram)
+{
+    out << "mean " << msec(histogram.mean())
+        << " p50 " << msec(histogram.percentile(50))
+        << " p90 " << msec(histogram.percentile(90))
+        << " p99 " << msec(histogram.percentile(99))
+        << " max " << msec(histogram.max) << " ms";
+}
+
+}
+
+Q_GLOBAL_STATIC(Telemetry, telemetryInstance)
+
+Telemetry::Histogram::Histogram()
+    : count(0), total(0), max(0)
+{
+    for (int i = 0; i < Buckets; i++)
+        buckets[i] = 0;
+}
+
+void Telemetry::Histogram::add(qint64 usec)
+{
+    if (usec < 0)
+        usec = 0;
+
+    int bucket = 0;
+    for (qint64 v = usec; v > 1 && bucket < Buckets - 1; v >>= 1)
+        bucket++;
+
+    buckets[bucket]++;
+    count++;
+    total += usec;
+    if (usec > max)
+        max = usec;
+}
+
+qint64 Telemetry::Histogram::percentile(int p) const
+{
+    if (!count)
+        return 0;
+
+    quint64 target = (count * p + 99) / 100;
+    quint64 seen = 0;
+    for (int i = 0; i < Buckets - 1; i++) {
+        seen += buckets[i];
+        if (seen >= qMax(target, quint64(1)))
+            return qMin(qint64(1) << (i + 1), max);
+    }
+
+    return max;
+}
+
+TelemetryPrivate::TelemetryPrivate(Telemetry *parent)
+    : q(parent)
+    , exported(false)
+{
+    // model signals are counted directly in the emitting thread
+    moveToMainThread(this);
+}
+
+bool TelemetryPrivate::exportObject()
+{
+    QMutexLocker locker(&mutex);
+    if (exported)
+        return true;
+
+    if (!findChild<TelemetryAdaptor*>())
+        new TelemetryAdaptor(this);
+    if (!QDBusConnection::sessionBus().registerObject(COMM_HISTORY_TELEMETRY_PATH, this)) {
+        qWarning() << Q_FUNC_INFO << "Object registration failed:"
+                   << QDBusConnection::sessionBus().lastError();
+        return false;
+    }
+
+    exported = true;
+    return true;
+}
+
+Telemetry::ModelStatistics& TelemetryPrivate::modelStatistics(QObject *model)
+{
+    QString name(QLatin1String(model->metaObject()->className()));
+    Telemetry::ModelStatistics &stats = models[name];
+    if (stats.model.isEmpty())
+        stats.model = name;
+    return stats;
+}
+
+void TelemetryPrivate::rowsInsertedSlot(const QModelIndex &parent, int start, int end)
+{
+    Q_UNUSED(parent);
+    QMutexLocker locker(&mutex);
+    modelStatistics(sender()).rowsInserted += end - start + 1;
+}
+
+void TelemetryPrivate::rowsRemovedSlot(const QModelIndex &parent, int start, int end)
+{
+    Q_UNUSED(parent);
+    QMutexLocker locker(&mutex);
+    modelStatistics(sender()).rowsRemoved += end - start + 1;
+}
+
+void TelemetryPrivate::dataChangedSlot(const QModelIndex &topLeft,
+                                       const QModelIndex &bottomRight)
+{
+    Q_UNUSED(topLeft);
+    Q_UNUSED(bottomRight);
+    QMutexLocker locker(&mutex);
+    modelStatistics(sender()).dataChanged++;
+}
+
+void TelemetryPrivate::modelResetSlot()
+{
+    QMutexLocker locker(&mutex);
+    modelStatistics(sender()).resets++;
+}
+
+TelemetryAdaptor::TelemetryAdaptor(TelemetryPrivate *parent)
+    : QDBusAbstractAdaptor(parent)
+{
+}
+
+QString TelemetryAdaptor::report(bool verbose)
+{
+    return Telemetry::instance()->report(verbose);
+}
+
+QVariantMap TelemetryAdaptor::statistics()
+{
+    return Telemetry::instance()->toVariantMap();
+}
+
+void TelemetryAdaptor::reset()
+{
+    Telemetry::instance()->reset();
+}
+
+bool TelemetryAdaptor::isEnabled()
+{
+    return Telemetry::isEnabled();
+}
+
+void TelemetryAdaptor::setEnabled(bool enabled)
+{
+    Telemetry::setEnabled(enabled);
+}
+
+Telemetry::Telemetry()
+    : d(new TelemetryPrivate(this))
+{
+}
+
+Telemetry::~Telemetry()
+{
+    delete d;
+}
+
+Telemetry* Telemetry::instance()
+{
+    return telemetryInstance();
+}
+
+bool Telemetry::isEnabled()
+{
+    int enabled = telemetryEnabled;
+    if (enabled >= 0)
+        return enabled;
+
+    QByteArray value(getenv("COMMHISTORY_TELEMETRY"));
+    enabled = !value.isEmpty() && value != "0";
+    if (telemetryEnabled.testAndSetOrdered(-1, enabled)
+        && value == "dbus")
+        instance()->exportOnDBus();
+
+    return telemetryEnabled;
+}
+
+void Telemetry::setEnabled(bool enabled)
+{
+    telemetryEnabled = enabled ? 1 : 0;
+}
+
+QList<Telemetry::QueryStatistics> Telemetry::queryStatistics() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->queries;
+}
+
+Telemetry::TransactionStatistics Telemetry::transactionStatistics() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->transactions;
+}
+
+QList<Telemetry::ModelStatistics> Telemetry::modelStatistics() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->models.values();
+}
+
+void Telemetry::reset()
+{
+    {
+        QMutexLocker locker(&d->mutex);
+        // keep the shapes, ids may still be held by running queries
+        for (int i = 0; i < d->queries.size(); i++) {
+            QueryStatistics &stats = d->queries[i];
+            QueryStatistics cleared;
+            cleared.id = stats.id;
+            cleared.type = stats.type;
+            cleared.shape = stats.shape;
+            stats = cleared;
+        }
+        d->transactions = TransactionStatistics();
+        d->models.clear();
+    }
+
+    QSharedPointer<UpdatesEmitter> emitter = UpdatesEmitter::existingInstance();
+    if (emitter)
+        emitter->resetStatistics();
+    TrackerIO::instance()->resetCommitStatistics();
+    QueryRegistry::instance()->resetStatistics();
+}
+
+QString Telemetry::report(bool verbose) const
+{
+    QList<QueryStatistics> queries = queryStatistics();
+    TransactionStatistics transactions = transactionStatistics();
+    QList<ModelStatistics> models = modelStatistics();
+
+    QString result;
+    QTextStream out(&result);
+
+    if (!isEnabled())
+        out << "telemetry disabled, set COMMHISTORY_TELEMETRY=1\n";
+
+    out << "queries:\n";
+    foreach (const QueryStatistics &stats, queries) {
+        if (!stats.queries && !stats.decode.count)
+            continue;
+
+        out << "  #" << stats.id << " " << stats.type
+            << ": " << stats.queries << " runs";
+        if (stats.failures)
+            out << " (" << stats.failures << " failed)";
+        out << ", " << stats.rows << " rows, " << stats.bytes / 1024 << " kB\n"
+            << "    round trip ";
+        writeHistogram(out, stats.roundTrip);
+        out << "\n    decode ";
+        writeHistogram(out, stats.decode);
+        out << " (" << stats.decode.count << " chunks)\n";
+        if (verbose)
+            out << "    " << stats.shape << "\n";
+    }
+
+    out << "transactions: " << transactions.commits << " commits";
+    if (transactions.failures)
+        out << " (" << transactions.failures << " failed)";
+    out << ", " << transactions.queries << " updates\n  commit ";
+    writeHistogram(out, transactions.commit);
+    out << "\n";
+
+    out << "models:\n";
+    foreach (const ModelStatistics &stats, models) {
+        out << "  " << stats.model << ": "
+            << stats.rowsInserted << " rows inserted, "
+            << stats.rowsRemoved << " removed, "
+            << stats.dataChanged << " dataChanged, "
+            << stats.resets << " resets\n";
+    }
+
+    TrackerIO::CommitStatistics commits = TrackerIO::instance()->commitStatistics();
+    out << "commit queue: " << commits.transactions << " queued, "
+        << commits.updates << " updates, " << commits.merged << " merged (ratio "
+        << QString::number(commits.mergeRatio(), 'f', 2) << "), depth "
+        << commits.queueDepth << "/" << commits.maxQueueDepth << ", wait max "
+        << commits.maxWait << " ms\n";
+
+    QSharedPointer<UpdatesEmitter> emitter = UpdatesEmitter::existingInstance();
+    if (emitter) {
+        UpdatesEmitter::Statistics updates = emitter->statistics();
+        out << "update signals: " << updates.queued << " queued, "
+            << updates.merged << " merged, " << updates.batches << " batches, depth "
+            << updates.queueDepth << "/" << updates.maxQueueDepth << ", latency max "
+            << updates.maxLatency << " ms\n";
+    }
+
+    QueryRegistry::Statistics shared = QueryRegistry::instance()->statistics();
+    out << "shared queries: " << shared.requests << " requests, "
+        << shared.joined << " joined, " << shared.cacheHits << " cache hits, "
+        << shared.invalidations << " invalidations, "
+        << shared.cachedQueries << " cached\n";
+
+    out.flush();
+    return result;
+}
+
+QVariantMap Telemetry::toVariantMap() const
+{
+    QVariantMap map;
+    map.insert(QLatin1String("enabled"), isEnabled());
+
+    QVariantList queries;
+    foreach (const QueryStatistics &stats, queryStatistics()) {
+        QVariantMap query;
+        query.insert(QLatin1String("id"), stats.id);
+        query.insert(QLatin1String("type"), stats.type);
+        query.insert(QLatin1String("shape"), stats.shape);
+        query.insert(QLatin1String("queries"), stats.queries);
+        query.insert(QLatin1String("failures"), stats.failures);
+        query.insert(QLatin1String("rows"), stats.rows);
+        query.insert(QLatin1String("bytes"), stats.bytes);
+        query.insert(QLatin1String("roundTrip"), histogramMap(stats.roundTrip));
+        query.insert(QLatin1String("decode"), histogramMap(stats.decode));
+        queries << query;
+    }
+    map.insert(QLatin1String("queries"), queries);
+
+    TransactionStatistics transactions = transactionStatistics();
+    QVariantMap transaction;
+    transaction.insert(QLatin1String("commits"), transactions.commits);
+    transaction.insert(QLatin1String("failures"), transactions.failures);
+    transaction.insert(QLatin1String("queries"), transactions.queries);
+    transaction.insert(QLatin1String("commit"), histogramMap(transactions.commit));
+    map.insert(QLatin1String("transactions"), transaction);
+
+    QVariantList models;
+    foreach (const ModelStatistics &stats, modelStatistics()) {
+        QVariantMap model;
+        model.insert(QLatin1String("model"), stats.model);
+        model.insert(QLatin1String("rowsInserted"), stats.rowsInserted);
+        model.insert(QLatin1String("rowsRemoved"), stats.rowsRemoved);
+        model.insert(QLatin1String("dataChanged"), stats.dataChanged);
+        model.insert(QLatin1String("resets"), stats.resets);
+        models << model;
+    }
+    map.insert(QLatin1String("models"), models);
+
+    TrackerIO::CommitStatistics commits = TrackerIO::instance()->commitStatistics();
+    QVariantMap commitQueue;
+    commitQueue.insert(QLatin1String("transactions"), commits.transactions);
+    commitQueue.insert(QLatin1String("updates"), commits.updates);
+    commitQueue.insert(QLatin1String("merged"), commits.merged);
+    commitQueue.insert(QLatin1String("maxQueueDepth"), commits.maxQueueDepth);
+    commitQueue.insert(QLatin1String("maxWait"), commits.maxWait);
+    map.insert(QLatin1String("commitQueue"), commitQueue);
+
+    QSharedPointer<UpdatesEmitter> emitter = UpdatesEmitter::existingInstance();
+    if (emitter) {
+        UpdatesEmitter::Statistics updates = emitter->statistics();
+        QVariantMap emitted;
+        emitted.insert(QLatin1String("queued"), updates.queued);
+        emitted.insert(QLatin1String("merged"), updates.merged);
+        emitted.insert(QLatin1String("batches"), updates.batches);
+        emitted.insert(QLatin1String("maxQueueDepth"), updates.maxQueueDepth);
+        emitted.insert(QLatin1String("maxLatency"), updates.maxLatency);
+        map.insert(QLatin1String("updateSignals"), emitted);
+    }
+
+    QueryRegistry::Statistics shared = QueryRegistry::instance()->statistics();
+    QVariantMap registry;
+    registry.insert(QLatin1String("requests"), shared.requests);
+    registry.insert(QLatin1String("joined"), shared.joined);
+    registry.insert(QLatin1String("cacheHits"), shared.cacheHits);
+    registry.insert(QLatin1String("invalidations"), shared.invalidations);
+    registry.insert(QLatin1String("cachedQueries"), shared.cachedQueries);
+    map.insert(QLatin1String("sharedQueries"), registry);
+
+    return map;
+}
+
+bool Telemetry::exportOnDBus()
+{
+    // the adaptor is a child of d and the object is registered from its
+    // thread; isEnabled() may first be called on a query or decode thread
+    if (QThread::currentThread() != d->thread())
+        return QMetaObject::invokeMethod(d, "exportObject", Qt::QueuedConnection);
+
+    return d->exportObject();
+}
+
+void Telemetry::watchModel(QAbstractItemModel *model)
+{
+    if (!model)
+        return;
+
+    QObject::connect(model, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
+                     d, SLOT(rowsInsertedSlot(const QModelIndex &, int, int)),
+                     Qt::DirectConnection);
+    QObject::connect(model, SIGNAL(rowsRemoved(const QModelIndex &, int, int)),
+                     d, SLOT(rowsRemovedSlot(const QModelIndex &, int, int)),
+                     Qt::DirectConnection);
+    QObject::connect(model, SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &)),
+                     d, SLOT(dataChangedSlot(const QModelIndex &, const QModelIndex &)),
+                     Qt::DirectConnection);
+    QObject::connect(model, SIGNAL(modelReset()),
+                     d, SLOT(modelResetSlot()),
+                     Qt::DirectConnection);
+}
+
+int Telemetry::queryShape(int queryType, const QString &query)
+{
+    if (!isEnabled())
+        return -1;
+
+    QString key(QString::number(queryType) + QLatin1Char('\n') + query);
+
+    QMutexLocker locker(&d->mutex);
+    QHash<QString, int>::const_iterator i = d->queryIds.constFind(key);
+    if (i != d->queryIds.constEnd())
+        return i.value();
+
+    QString shape(normalizeQuery(query));
+    QString shapeKey(QString::number(queryType) + QLatin1Char('\n') + shape);
+    if (!d->shapeIds.contains(shapeKey) && d->queries.size() >= MAX_QUERY_SHAPES) {
+        shape = QLatin1String("(other)");
+        shapeKey = QString::number(queryType) + QLatin1Char('\n') + shape;
+    }
+
+    int id = d->shapeIds.value(shapeKey, -1);
+    if (id < 0) {
+        QueryStatistics stats;
+        id = d->queries.size();
+        stats.id = id + 1;
+        stats.type = QLatin1String(queryTypeName(queryType));
+        stats.shape = shape;
+        d->queries.append(stats);
+        d->shapeIds.insert(shapeKey, id);
+    }
+
+    // literal-heavy queries (by contact, by group) vary endlessly
+    if (d->queryIds.size() >= MAX_QUERY_TEXTS)
+        d->queryIds.clear();
+    d->queryIds.insert(key, id);
+
+    return id;
+}
+
+void Telemetry::addQuery(int shape, qint64 usec, bool failed)
+{
+    QMutexLocker locker(&d->mutex);
+    if (shape < 0 || shape >= d->queries.size())
+        return;
+
+    QueryStatistics &stats = d->queries[shape];
+    stats.queries++;
+    if (failed)
+        stats.failures++;
+    stats.roundTrip.add(usec);
+}
+
+void Telemetry::addDecode(int shape, int rows, quint64 bytes, qint64 usec)
+{
+    QMutexLocker locker(&d->mutex);
+    if (shape < 0 || shape >= d->queries.size())
+        return;
+
+    QueryStatistics &stats = d->queries[shape];
+    stats.rows += rows;
+    stats.bytes += bytes;
+    stats.decode.add(usec);
+}
+
+void Telemetry::addTransaction(int queries, qint64 usec, bool failed)
+{
+    if (!isEnabled())
+        return;
+
+    QMutexLocker locker(&d->mutex);
+    d->transactions.commits++;
+    if (failed)
+        d->transactions.failures++;
+    d->transactions.queries += queries;
+    d->transactions.commit.add(usec);
+}
+
+}
@@ -0,0 +1,179 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_TELEMETRY_H
+#define COMMHISTORY_TELEMETRY_H
+
+#include <QString>
+#include <QList>
+#include <QVariantMap>
+
+#include "libcommhistoryexport.h"
+
+class QAbstractItemModel;
+
+namespace CommHistory {
+
+class TelemetryPrivate;
+
+/*!
+ * \class Telemetry
+ *
+ * Runtime cost counters of libcommhistory in this process: model queries
+ * by query shape (tracker round trip, decoding time, rows and bytes),
+ * committed transactions and model row updates. The report also includes
+ * the UpdatesEmitter, commit queue and QueryRegistry statistics.
+ *
+ * Collection is off by default. Enable it with setEnabled() or by setting
+ * COMMHISTORY_TELEMETRY in the environment to 1, or to "dbus" to also
+ * export the com.nokia.commhistory.Telemetry interface (see
+ * exportOnDBus()), which commhistory-tool stats reads.
+ */
+class LIBCOMMHISTORY_EXPORT Telemetry
+{
+public:
+    /*!
+     * Latency distribution. Bucket i counts samples in
+     * [2^i, 2^(i+1)) microseconds, bucket 0 also shorter ones and the last
+     * bucket all longer ones.
+     */
+    struct LIBCOMMHISTORY_EXPORT Histogram {
+        enum { Buckets = 24 };
+
+        Histogram();
+
+        void add(qint64 usec);
+        /*! Upper bound in microseconds of the bucket holding percentile p (0-100). */
+        qint64 percentile(int p) const;
+        qint64 mean() const { return count ? total / count : 0; }
+
+        quint64 count;
+        qint64 total;
+        qint64 max;
+        quint64 buckets[Buckets];
+    };
+
+    struct QueryStatistics {
+        QueryStatistics() : id(0), queries(0), failures(0), rows(0), bytes(0) {}
+
+        int id;
+        /*! "events", "groups", "callgroups", "messageparts" or "generic". */
+        QString type;
+        /*! Query text with literals, IRIs and numbers replaced by '?'. */
+        QString shape;
+        quint64 queries;
+        quint64 failures;
+        quint64 rows;
+        /*! Approximate size of the result values. */
+        quint64 bytes;
+        /*! From exec to the last row read. */
+        Histogram roundTrip;
+        /*! Per decoded chunk of rows. */
+        Histogram decode;
+    };
+
+    struct TransactionStatistics {
+        TransactionStatistics() : commits(0), failures(0), queries(0) {}
+
+        quint64 commits;
+        quint64 failures;
+        quint64 queries;
+        /*! From the start of the first update to finished(). */
+        Histogram commit;
+    };
+
+    struct ModelStatistics {
+        ModelStatistics() : rowsInserted(0), rowsRemoved(0), dataChanged(0), resets(0) {}
+
+        /*! Class name of the model. */
+        QString model;
+        quint64 rowsInserted;
+        quint64 rowsRemoved;
+        quint64 dataChanged;
+        quint64 resets;
+    };
+
+    /*!
+     * Use instance() instead.
+     */
+    Telemetry();
+    ~Telemetry();
+
+    static Telemetry* instance();
+
+    static bool isEnabled();
+    static void setEnabled(bool enabled);
+
+    QList<QueryStatistics> queryStatistics() const;
+    TransactionStatistics transactionStatistics() const;
+    QList<ModelStatistics> modelStatistics() const;
+
+    /*!
+     * Clear the counters, including those of UpdatesEmitter, TrackerIO and
+     * QueryRegistry.
+     */
+    void reset();
+
+    /*!
+     * Plain text summary of all counters. Query shapes are listed by id,
+     * with their text if verbose is set.
+     */
+    QString report(bool verbose = false) const;
+
+    /*!
+     * All counters as nested maps and lists, suitable for D-Bus.
+     */
+    QVariantMap toVariantMap() const;
+
+    /*!
+     * Export com.nokia.commhistory.Telemetry at /CommHistoryTelemetry on
+     * the session bus. Returns false if the object could not be
+     * registered. Called from another thread than the main thread, the
+     * export is queued to the main thread and true is returned.
+     */
+    bool exportOnDBus();
+
+    /*!
+     * Count the rows inserted, removed and changed by model. Done by the
+     * libcommhistory models when telemetry is enabled.
+     */
+    void watchModel(QAbstractItemModel *model);
+
+    /*!
+     * Recording, used by QueryRunner and CommittingTransaction. shape ids
+     * are returned by queryShape() and are -1 if telemetry is disabled.
+     */
+    int queryShape(int queryType, const QString &query);
+    void addQuery(int shape, qint64 usec, bool failed);
+    void addDecode(int shape, int rows, quint64 bytes, qint64 usec);
+    void addTransaction(int queries, qint64 usec, bool failed);
+
+private:
+    Q_DISABLE_COPY(Telemetry)
+
+    friend class TelemetryPrivate;
+    TelemetryPrivate * const d;
+};
+
+}
+
+#endif
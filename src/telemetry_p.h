@@ -0,0 +1,90 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_TELEMETRY_P_H
+#define COMMHISTORY_TELEMETRY_P_H
+
+#include <QObject>
+#include <QMutex>
+#include <QHash>
+#include <QModelIndex>
+#include <QtDBus/QtDBus>
+
+#include "telemetry.h"
+
+namespace CommHistory {
+
+class TelemetryPrivate : public QObject
+{
+    Q_OBJECT
+
+public:
+    TelemetryPrivate(Telemetry *parent);
+
+    Telemetry::ModelStatistics& modelStatistics(QObject *model);
+
+    Telemetry *q;
+
+    mutable QMutex mutex; // protects the members below
+    QList<Telemetry::QueryStatistics> queries;   // by shape id
+    QHash<QString, int> shapeIds;                // by type and shape
+    QHash<QString, int> queryIds;                // by type and raw query text
+    Telemetry::TransactionStatistics transactions;
+    QHash<QString, Telemetry::ModelStatistics> models;
+    bool exported;
+
+public Q_SLOTS:
+    void rowsInsertedSlot(const QModelIndex &parent, int start, int end);
+    void rowsRemovedSlot(const QModelIndex &parent, int start, int end);
+    void dataChangedSlot(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void modelResetSlot();
+
+    /*!
+     * Register the object and its adaptor, see Telemetry::exportOnDBus().
+     * Has to run in the thread of this object.
+     */
+    bool exportObject();
+};
+
+/*!
+ * com.nokia.commhistory.Telemetry, see Telemetry::exportOnDBus().
+ */
+class TelemetryAdaptor : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+
+    Q_CLASSINFO("D-Bus Interface", "com.nokia.commhistory.Telemetry")
+
+public:
+    TelemetryAdaptor(TelemetryPrivate *parent);
+
+public Q_SLOTS:
+    QString report(bool verbose);
+    QVariantMap statistics();
+    void reset();
+    bool isEnabled();
+    void setEnabled(bool enabled);
+};
+
+}
+
+#endif
@@ -29,6 +29,7 @@
 #include <QDBusMessage>
 #include <QDBusConnection>
 #include <QDBusPendingCall>
+#include <QMutex>
 
 #include <qtcontacts-tracker/phoneutils.h>
 
@@ -45,6 +46,9 @@
 #include "preparedqueries.h"
 
 #include "trackerio_p.h"
+#include "queryregistry.h"
+#include "searchindex.h"
+#include "sparqlbackend.h"
 #include "trackerio.h"
 
 using namespace CommHistory;
@@ -55,6 +59,8 @@ using namespace CommHistory;
 #define QSPARQL_DATA_READY_INTERVAL 25
 
 #define MAX_VARIABLES_IN_QUERY 100
+#define MAX_EVENTS_IN_UPDATE 50
+#define MAX_MERGED_TRANSACTIONS 20
 
 #define NMO_ "http://www.semanticdesktop.org/ontologies/2007/03/22/nmo#"
 
@@ -161,29 +167,69 @@ QString TrackerIOPrivate::prepareGroupQuery(const QString &localUid,
                                             const QString &remoteUid,
                                             int groupId)
 {
-    QString queryFormat(GROUP_QUERY);
-    QStringList constraints;
+    enum {
+        FilterHiddenNumber = 1 << 0,
+        FilterIMAddress    = 1 << 1,
+        FilterPhoneNumber  = 1 << 2,
+        FilterLocalUid     = 1 << 3,
+        FilterGroupId      = 1 << 4
+    };
+
+    QString number;
+    int shape = 0;
     if (!remoteUid.isNull() && remoteUid.isEmpty()) {
         // special case for hidden phone numbers
-        constraints << QString(LAT("OPTIONAL { ?channel nmo:hasParticipant [ nco:hasContactMedium ?m ] . } "
-                                   "FILTER(!BOUND(?m))"));
+        shape |= FilterHiddenNumber;
     } else if (!remoteUid.isEmpty()) {
-        QString number = normalizePhoneNumber(remoteUid);
-        if (number.isEmpty()) {
-            constraints << QString(LAT("?channel nmo:hasParticipant [nco:hasIMAddress [nco:imID %1]] ."))
-                          .arg(escapeForQSparql(remoteUid));
-        } else {
-            constraints << QString(LAT("?channel nmo:hasParticipant [nco:hasPhoneNumber [maemo:localPhoneNumber \"%1\"]] ."))
-                          .arg(number.right(CommHistory::phoneNumberMatchLength()));
-        }
-    }
-    if (!localUid.isEmpty()) {
-        constraints << QString(LAT("FILTER(nie:subject(?channel) = %1) ")).arg(escapeForQSparql(localUid));
+        number = normalizePhoneNumber(remoteUid);
+        shape |= number.isEmpty() ? FilterIMAddress : FilterPhoneNumber;
     }
+    if (!localUid.isEmpty())
+        shape |= FilterLocalUid;
     if (groupId != -1)
-        constraints << QString(LAT("FILTER(?channel = <%1>) ")).arg(Group::idToUrl(groupId).toString());
+        shape |= FilterGroupId;
+
+    // GROUP_QUERY is big, build the text only once per filter combination
+    static QMutex mutex;
+    static QHash<int, QString> queries;
+
+    QString queryText;
+    {
+        QMutexLocker locker(&mutex);
+        queryText = queries.value(shape);
+        if (queryText.isEmpty()) {
+            QStringList constraints;
+            if (shape & FilterHiddenNumber)
+                constraints << LAT("OPTIONAL { ?channel nmo:hasParticipant [ nco:hasContactMedium ?m ] . } "
+                                   "FILTER(!BOUND(?m))");
+            if (shape & FilterIMAddress)
+                constraints << LAT("?channel nmo:hasParticipant [nco:hasIMAddress [nco:imID ?:remoteUid]] .");
+            if (shape & FilterPhoneNumber)
+                constraints << LAT("?channel nmo:hasParticipant [nco:hasPhoneNumber [maemo:localPhoneNumber ?:remoteUid]] .");
+            if (shape & FilterLocalUid)
+                constraints << LAT("FILTER(nie:subject(?channel) = ?:localUid) ");
+            if (shape & FilterGroupId)
+                constraints << LAT("FILTER(?channel = ?:channel) ");
+
+            queryText = QString(GROUP_QUERY).arg(constraints.join(LAT(" ")));
+            queries.insert(shape, queryText);
+        }
+    }
+
+    if (!shape)
+        return queryText;
 
-    return queryFormat.arg(constraints.join(LAT(" ")));
+    QSparqlQuery query(queryText);
+    if (shape & FilterIMAddress)
+        query.bindValue(LAT("remoteUid"), remoteUid);
+    if (shape & FilterPhoneNumber)
+        query.bindValue(LAT("remoteUid"), number.right(CommHistory::phoneNumberMatchLength()));
+    if (shape & FilterLocalUid)
+        query.bindValue(LAT("localUid"), localUid);
+    if (shape & FilterGroupId)
+        query.bindValue(LAT("channel"), Group::idToUrl(groupId));
+
+    return query.preparedQueryText();
 }
 
 QString TrackerIOPrivate::prepareGroupedCallQuery(const QStringList &channels)
@@ -204,6 +250,102 @@ QString TrackerIOPrivate::prepareGroupedCallQuery(const QStringList &channels)
     return query;
 }
 
+QString TrackerIOPrivate::prepareGroupCountersQuery(const QString &channelPattern)
+{
+    return QString(UPDATE_GROUP_COUNTERS_QUERY).arg(channelPattern);
+}
+
+void TrackerIOPrivate::GroupCounts::add(const Event &event)
+{
+    // same conditions as the COUNT subqueries of UPDATE_GROUP_COUNTERS_QUERY
+    if (event.isDeleted())
+        return;
+
+    total++;
+    if (!event.isRead())
+        unread++;
+    if (event.direction() == Event::Outbound)
+        sent++;
+}
+
+QString TrackerIOPrivate::prepareAddedCountersQuery(const QMap<int, GroupCounts> &counts)
+{
+    QString query;
+    QStringList channels;
+
+    QMap<int, GroupCounts>::const_iterator i;
+    for (i = counts.constBegin(); i != counts.constEnd(); ++i) {
+        QString channel = QString(LAT("<%1>")).arg(Group::idToUrl(i.key()).toString());
+        channels << channel;
+
+        const int deltas[] = { i.value().total, i.value().unread, i.value().sent };
+        const char *names[] = { "commhistory:totalMessages",
+                                "commhistory:unreadMessages",
+                                "commhistory:sentMessages" };
+        for (int c = 0; c < 3; c++) {
+            if (deltas[c])
+                query += QString(ADD_TO_GROUP_COUNTER_QUERY)
+                         .arg(QString(), channel, LAT(names[c]),
+                              LAT("+ ") + QString::number(deltas[c]));
+        }
+    }
+
+    if (channels.isEmpty())
+        return query;
+
+    // new channels and those of databases written before the counters
+    // existed are counted once, after the messages have been added
+    query += prepareGroupCountersQuery(
+        QString(LAT("FILTER(?channel IN (%1)) "
+                    "OPTIONAL { ?channel nao:hasProperty ?_existing . "
+                    "?_existing nao:propertyName \"commhistory:totalMessages\" } "
+                    "FILTER(!BOUND(?_existing))"))
+        .arg(channels.join(LAT(","))));
+
+    return query;
+}
+
+QString TrackerIOPrivate::prepareMessageCountersQuery(const QUrl &message,
+                                                      int delta,
+                                                      int counters)
+{
+    QString query;
+    QString sign = delta > 0 ? LAT("+ 1") : LAT("- 1");
+    QString messagePattern = QString(LAT("<%1> nmo:communicationChannel ?_channel ; "))
+                             .arg(message.toString());
+
+    if (counters & TotalCounter)
+        query += QString(ADD_TO_GROUP_COUNTER_QUERY)
+                 .arg(messagePattern + LAT("nmo:isDeleted false ."),
+                      LAT("?_channel"), LAT("commhistory:totalMessages"), sign);
+    if (counters & UnreadCounter)
+        query += QString(ADD_TO_GROUP_COUNTER_QUERY)
+                 .arg(messagePattern + LAT("nmo:isRead false ; nmo:isDeleted false ."),
+                      LAT("?_channel"), LAT("commhistory:unreadMessages"), sign);
+    if (counters & SentCounter)
+        query += QString(ADD_TO_GROUP_COUNTER_QUERY)
+                 .arg(messagePattern + LAT("nmo:isSent true ; nmo:isDeleted false ."),
+                      LAT("?_channel"), LAT("commhistory:sentMessages"), sign);
+
+    // a message moved to a channel without counters has it counted
+    if (delta > 0)
+        query += prepareGroupCountersQuery(
+            QString(LAT("<%1> nmo:communicationChannel ?channel . "
+                        "OPTIONAL { ?channel nao:hasProperty ?_existing . "
+                        "?_existing nao:propertyName \"commhistory:totalMessages\" } "
+                        "FILTER(!BOUND(?_existing))"))
+            .arg(message.toString()));
+
+    return query;
+}
+
+bool TrackerIOPrivate::hasGroupCounters(const Event &event)
+{
+    return event.type() == Event::IMEvent
+        || event.type() == Event::SMSEvent
+        || event.type() == Event::MMSEvent;
+}
+
 QUrl TrackerIOPrivate::uriForIMAddress(const QString &account, const QString &remoteUid)
 {
     return QUrl(QString(LAT("telepathy:")) + account + QLatin1Char('!') + remoteUid);
@@ -1078,10 +1220,11 @@ bool TrackerIOPrivate::markGroupAsRead(const QString &channelIRI)
             "WHERE {?msg rdf:type nmo:Message; nmo:communicationChannel ?:channel;"
                    "nmo:isRead ?r; nie:contentLastModified ?d}"
             "INSERT {?msg nmo:isRead ?:read; nie:contentLastModified ?:date}"
-            "WHERE {?msg rdf:type nmo:Message; nmo:communicationChannel ?:channel}"),
+            "WHERE {?msg rdf:type nmo:Message; nmo:communicationChannel ?:channel}")
+                       + prepareGroupCountersQuery(LAT("FILTER(?channel = ?:channel)")),
                        QSparqlQuery::InsertStatement);
 
-    query.bindValue(LAT("channel"), channelIRI);
+    query.bindValue(LAT("channel"), QUrl(channelIRI));
     query.bindValue(LAT("read"), true);
     //Need to update the contentModifiedTime as well so that NOS gets update with the updated time
     query.bindValue(LAT("date"), QDateTime::currentDateTime());
@@ -1142,24 +1285,22 @@ void TrackerIO::recreateIds()
     qDebug() << Q_FUNC_INFO << "max event id =" << maxMessageId << ", group id =" << maxGroupId;
 }
 
-bool TrackerIO::addEvent(Event &event)
+bool TrackerIOPrivate::addEvent(UpdateQuery &query, Event &event)
 {
-    UpdateQuery query;
-
     // TODO: maybe check uri prefix for localUid?
     if (event.type() == Event::IMEvent
         || event.type() == Event::SMSEvent
         || event.type() == Event::MMSEvent) {
         if (event.type() == Event::IMEvent) {
-            d->addIMEvent(query, event);
+            addIMEvent(query, event);
         } else {
             if (event.parentId() < 0) {
-                d->calculateParentId(event);
+                calculateParentId(event);
             }
-            d->addSMSEvent(query, event);
+            addSMSEvent(query, event);
 
             //setting the time at which the folder was last updated
-            d->setFolderLastModifiedTime(query, event.parentId(), QDateTime::currentDateTime());
+            setFolderLastModifiedTime(query, event.parentId(), QDateTime::currentDateTime());
         }
 
         // specify not-inherited classes only when adding events, not during modifications
@@ -1169,10 +1310,10 @@ bool TrackerIO::addEvent(Event &event)
                            LAT("nie:DataObject"));
 
         if (!event.isDraft()) {
-            d->setChannel(query, event, event.groupId());
+            setChannel(query, event, event.groupId());
         }
     } else if (event.type() == Event::CallEvent) {
-        d->addCallEvent(query, event);
+        addCallEvent(query, event);
     } else if (event.type() != Event::StatusMessageEvent) {
         qWarning() << "event type not implemented";
         return false;
@@ -1184,8 +1325,92 @@ bool TrackerIO::addEvent(Event &event)
                     "nie:contentLastModified",
                     event.lastModified());
 
-    return d->handleQuery(QSparqlQuery(query.query(),
-                                       QSparqlQuery::InsertStatement));
+    return true;
+}
+
+bool TrackerIO::addEvent(Event &event)
+{
+    UpdateQuery query;
+
+    if (!d->addEvent(query, event))
+        return false;
+
+    if (d->hasGroupCounters(event) && event.groupId() != -1) {
+        QMap<int, TrackerIOPrivate::GroupCounts> counts;
+        counts[event.groupId()].add(event);
+        query.appendInsertion(d->prepareAddedCountersQuery(counts));
+    }
+
+    if (!d->handleQuery(QSparqlQuery(query.query(),
+                                     QSparqlQuery::InsertStatement)))
+        return false;
+
+    d->updateSearchIndex(d->m_pTransaction, "addEvents",
+                         Q_ARG(QList<CommHistory::Event>, QList<Event>() << event));
+    return true;
+}
+
+bool TrackerIO::addEvents(QList<Event> &events)
+{
+    qDebug() << Q_FUNC_INFO << events.count();
+
+    bool success = true;
+    QStringList batch;
+    QMap<int, TrackerIOPrivate::GroupCounts> batchCounts;
+    QList<Event> batchEvents;
+    // the same events in the list, to reset their ids if the batch fails
+    QList<Event *> batchTargets;
+
+    // Each event gets its own set of statements (blank nodes for message
+    // parts, headers and vcards are scoped per statement), but all of
+    // them are sent to tracker in one update. The contact cache makes
+    // sure the nco:IMAddress/nco:PhoneNumber ensure blocks are written
+    // only once per batch.
+    QMutableListIterator<Event> i(events);
+    while (i.hasNext()) {
+        Event &event = i.next();
+
+        UpdateQuery query;
+        if (d->addEvent(query, event)) {
+            batch << query.query();
+            batchEvents << event;
+            batchTargets << &event;
+            if (d->hasGroupCounters(event) && event.groupId() != -1)
+                batchCounts[event.groupId()].add(event);
+        } else {
+            qWarning() << Q_FUNC_INFO << "skipping event" << event.toString();
+            event.setId(-1);
+            success = false;
+        }
+
+        if (batch.size() >= MAX_EVENTS_IN_UPDATE
+            || (!i.hasNext() && !batch.isEmpty())) {
+            // counters are updated once per group and batch
+            if (!batchCounts.isEmpty())
+                batch << d->prepareAddedCountersQuery(batchCounts);
+
+            if (d->handleQuery(QSparqlQuery(batch.join(LAT(" ")),
+                                            QSparqlQuery::InsertStatement))) {
+                d->updateSearchIndex(d->m_pTransaction, "addEvents",
+                                     Q_ARG(QList<CommHistory::Event>, batchEvents));
+            } else {
+                qWarning() << Q_FUNC_INFO << "failed to add" << batchTargets.size() << "events";
+                foreach (Event *failed, batchTargets)
+                    failed->setId(-1);
+                success = false;
+            }
+
+            batch.clear();
+            batchCounts.clear();
+            batchEvents.clear();
+            batchTargets.clear();
+            // the next batch has to repeat its ensure blocks in case
+            // this one fails
+            d->m_contactCache.clear();
+        }
+    }
+
+    return success;
 }
 
 bool TrackerIO::addGroup(Group &group)
@@ -1265,6 +1490,7 @@ bool TrackerIOPrivate::querySingleEvent(EventsQuery &query, Event &event)
 
     result.result = events.data();
     result.properties = query.eventProperties();
+    result.readContactSettings();
 
     if (!events->first()) {
         qWarning() << "Event not found";
@@ -1273,7 +1499,7 @@ bool TrackerIOPrivate::querySingleEvent(EventsQuery &query, Event &event)
 
     QSparqlResultRow row = events->current();
 
-    result.fillEventFromModel(event);
+    result.fillEventFromModel(row, event);
 
     if (event.type() == Event::MMSEvent) {
         QString partQuery = TrackerIOPrivate::prepareMessagePartQuery(event.url().toString());
@@ -1285,11 +1511,10 @@ bool TrackerIOPrivate::querySingleEvent(EventsQuery &query, Event &event)
             result.result = parts.data();
 
             parts->first();
-            QSparqlResultRow partRow = parts->current();
 
             do {
                 MessagePart part;
-                result.fillMessagePartFromModel(part);
+                result.fillMessagePartFromModel(parts->current(), part);
                 event.addMessagePart(part);
             } while (parts->next());
         }
@@ -1304,9 +1529,9 @@ bool TrackerIO::getEvent(int id, Event &event)
     qDebug() << Q_FUNC_INFO << id;
     EventsQuery query(Event::allProperties());
 
-    query.addPattern(QString(LAT("FILTER(%2 = <%1>)"))
-                     .arg(Event::idToUrl(id).toString()))
+    query.addPattern(LAT("FILTER(%1 = ?:event)"))
                     .variable(Event::Id);
+    query.bindValue(LAT("event"), Event::idToUrl(id));
 
     return d->querySingleEvent(query, event);
 }
@@ -1315,9 +1540,9 @@ bool TrackerIO::getEventByMessageToken(const QString& token, Event &event)
 {
     EventsQuery query(Event::allProperties());
 
-    query.addPattern(QString(LAT("%2 nmo:messageId \"%1\" ."))
-                     .arg(token))
+    query.addPattern(LAT("%1 nmo:messageId ?:token ."))
                     .variable(Event::Id);
+    query.bindValue(LAT("token"), token);
 
     return d->querySingleEvent(query, event);
 }
@@ -1326,11 +1551,11 @@ bool TrackerIO::getEventByMessageToken(const QString &token, int groupId, Event
 {
     EventsQuery query(Event::allProperties());
 
-    query.addPattern(QString(LAT("%3 nmo:messageId \"%1\";"
-                                           "nmo:communicationChannel <%2> ."))
-                     .arg(token)
-                     .arg(Group::idToUrl(groupId).toString()))
+    query.addPattern(LAT("%1 nmo:messageId ?:token;"
+                         "nmo:communicationChannel ?:channel ."))
                     .variable(Event::Id);
+    query.bindValue(LAT("token"), token);
+    query.bindValue(LAT("channel"), Group::idToUrl(groupId));
 
     return d->querySingleEvent(query, event);
 }
@@ -1339,12 +1564,12 @@ bool TrackerIO::getEventByMmsId(const QString& mmsId, int groupId, Event &event)
 {
     EventsQuery query(Event::allProperties());
 
-    query.addPattern(QString(LAT("%3 nmo:mmsId \"%1\";"
-                                           "nmo:isSent \"true\";"
-                                           "nmo:communicationChannel <%2> ."))
-                     .arg(mmsId)
-                     .arg(Group::idToUrl(groupId).toString()))
+    query.addPattern(LAT("%1 nmo:mmsId ?:mmsId;"
+                         "nmo:isSent \"true\";"
+                         "nmo:communicationChannel ?:channel ."))
                     .variable(Event::Id);
+    query.bindValue(LAT("mmsId"), mmsId);
+    query.bindValue(LAT("channel"), Group::idToUrl(groupId));
 
     return d->querySingleEvent(query, event);
 }
@@ -1361,7 +1586,20 @@ bool TrackerIO::modifyEvent(Event &event)
 
     event.setLastModified(QDateTime::currentDateTime()); // always update modified times in case of modifyEvent
                                                          // irrespective whether client sets or not
-                                                         // allow uid changes for drafts
+
+    // take the message out of its channel's counters before the change
+    // and add it back afterwards; both read the stored state
+    const Event::PropertySet modified = event.modifiedProperties();
+    bool updateCounters = d->hasGroupCounters(event)
+        && (modified.contains(Event::IsRead)
+            || modified.contains(Event::IsDeleted)
+            || modified.contains(Event::Direction)
+            || modified.contains(Event::IsDraft)
+            || modified.contains(Event::GroupId));
+    if (updateCounters)
+        query.deletion(d->prepareMessageCountersQuery(event.url(), -1));
+
+    // allow uid changes for drafts
     if (event.isDraft()
         && (event.validProperties().contains(Event::LocalUid)
             || event.validProperties().contains(Event::RemoteUid))) {
@@ -1411,9 +1649,17 @@ bool TrackerIO::modifyEvent(Event &event)
 
     d->writeCommonProperties(query, event, true);
 
-    return d->handleQuery(QSparqlQuery(query.query(), QSparqlQuery::InsertStatement),
-                          d, "updateGroupTimestamps",
-                          QVariant::fromValue(event));
+    if (updateCounters)
+        query.appendInsertion(d->prepareMessageCountersQuery(event.url(), 1));
+
+    if (!d->handleQuery(QSparqlQuery(query.query(), QSparqlQuery::InsertStatement),
+                        d, "updateGroupTimestamps",
+                        QVariant::fromValue(event)))
+        return false;
+
+    d->updateSearchIndex(d->m_pTransaction, "updateEvents",
+                         Q_ARG(QList<CommHistory::Event>, QList<Event>() << event));
+    return true;
 }
 
 bool TrackerIO::modifyGroup(Group &group)
@@ -1454,6 +1700,10 @@ bool TrackerIO::moveEvent(Event &event, int groupId)
 {
     UpdateQuery query;
 
+    bool updateCounters = d->hasGroupCounters(event);
+    if (updateCounters)
+        query.deletion(d->prepareMessageCountersQuery(event.url(), -1));
+
     d->setChannel(query, event, groupId, true); // true means modify
 
     if (event.direction() == Event::Inbound) {
@@ -1462,8 +1712,20 @@ bool TrackerIO::moveEvent(Event &event, int groupId)
                             NormalizeFlagKeepDialString);
     }
 
-    return d->handleQuery(QSparqlQuery(query.query(),
-                                       QSparqlQuery::InsertStatement));
+    if (updateCounters)
+        query.appendInsertion(d->prepareMessageCountersQuery(event.url(), 1));
+
+    if (!d->handleQuery(QSparqlQuery(query.query(),
+                                     QSparqlQuery::InsertStatement)))
+        return false;
+
+    Event moved;
+    moved.setId(event.id());
+    moved.setType(event.type());
+    moved.setGroupId(groupId);
+    d->updateSearchIndex(d->m_pTransaction, "updateEvents",
+                         Q_ARG(QList<CommHistory::Event>, QList<Event>() << moved));
+    return true;
 }
 
 bool TrackerIO::deleteEvent(Event &event, QThread *backgroundThread)
@@ -1509,15 +1771,22 @@ bool TrackerIO::deleteEvent(Event &event, QThread *backgroundThread)
         break;
     }
 
+    if (d->hasGroupCounters(event))
+        query = d->prepareMessageCountersQuery(event.url(), -1) + query;
+
     QSparqlQuery deleteQuery(query, QSparqlQuery::DeleteStatement);
     deleteQuery.bindValue(LAT("uri"), event.url());
 
     if (event.type() == Event::CallEvent)
         deleteQuery.bindValue(LAT("graph"), COMMHISTORY_GRAPH_CALL_CHANNEL);
 
-    return d->handleQuery(deleteQuery, d,
-                          "updateGroupTimestamps",
-                          QVariant::fromValue(event));
+    if (!d->handleQuery(deleteQuery, d,
+                        "updateGroupTimestamps",
+                        QVariant::fromValue(event)))
+        return false;
+
+    d->updateSearchIndex(d->m_pTransaction, "removeEvent", Q_ARG(int, event.id()));
+    return true;
 }
 
 bool TrackerIO::getGroup(int id, Group &group)
@@ -1541,7 +1810,8 @@ bool TrackerIO::getGroup(int id, Group &group)
     QSparqlResultRow row = groups->current();
 
     result.result = groups.data();
-    result.fillGroupFromModel(groupToFill);
+    result.readContactSettings();
+    result.fillGroupFromModel(row, groupToFill);
     group = groupToFill;
 
     return true;
@@ -1631,6 +1901,12 @@ bool TrackerIOPrivate::doDeleteGroups(CommittingTransaction *transaction,
                         .arg(groups.join(LAT(","))));
     }
 
+    update.deletion(QString(LAT("DELETE {?counter rdf:type rdfs:Resource}"
+                                "WHERE {?channel rdf:type nmo:CommunicationChannel; "
+                                "nao:hasProperty ?counter "
+                                "FILTER(?channel IN (%1))}"))
+                    .arg(groups.join(LAT(","))));
+
     update.deletion(QString(LAT("DELETE {?channel rdf:type rdfs:Resource}"
                                 "WHERE {?channel rdf:type nmo:CommunicationChannel "
                                 "FILTER(?channel IN (%1))}"))
@@ -1649,10 +1925,14 @@ bool TrackerIOPrivate::doDeleteGroups(CommittingTransaction *transaction,
 
     if (transaction) {
         transaction->addQuery(query);
-        return true;
+    } else if (!handleQuery(query)) {
+        return false;
     }
 
-    return handleQuery(query);
+    if (deleteMessages)
+        updateSearchIndex(transaction, "removeGroups", Q_ARG(QList<int>, groupIds));
+
+    return true;
 }
 
 void TrackerIOPrivate::mmsTokensReady(CommittingTransaction *transaction,
@@ -1729,6 +2009,14 @@ bool TrackerIO::totalEventsInGroup(int groupId, int &totalEvents)
     return false;
 }
 
+bool TrackerIO::recalculateGroupCounters()
+{
+    qDebug() << Q_FUNC_INFO;
+
+    return d->handleQuery(QSparqlQuery(d->prepareGroupCountersQuery(),
+                                       QSparqlQuery::InsertStatement));
+}
+
 bool TrackerIO::markAsReadGroup(int groupId)
 {
     return d->markGroupAsRead(Group::idToUrl(groupId).toString());
@@ -1748,6 +2036,10 @@ bool TrackerIO::markAsReadAll(Event::EventType eventType)
                   "INSERT {?e nmo:isRead true; nie:contentLastModified ?:date}"
                   "WHERE {?e rdf:type ?:eventType}");
 
+    if (eventType != Event::CallEvent)
+        query += d->prepareGroupCountersQuery(
+            LAT("?_e nmo:communicationChannel ?channel; rdf:type ?:eventType ."));
+
     QUrl eventTypeUrl;
 
     switch(eventType) {
@@ -1800,7 +2092,11 @@ CommittingTransaction* TrackerIO::commit(bool isBlocking)
             if (d->syncOnCommit)
                 connect(d->m_pTransaction, SIGNAL(finished()),
                         d, SLOT(syncTracker()));
+            d->m_pTransaction->d->queuedTime.start();
             d->m_pendingTransactions.enqueue(d->m_pTransaction);
+            d->m_commitStats.transactions++;
+            d->m_commitStats.maxQueueDepth = qMax(d->m_commitStats.maxQueueDepth,
+                                                  d->m_pendingTransactions.size());
             d->runNextTransaction();
             // if m_pTransaction is not in pending transactions,
             // it's failed right away
@@ -1823,6 +2119,13 @@ void TrackerIOPrivate::runNextTransaction()
 {
     qDebug() << Q_FUNC_INFO;
 
+    // transactions merged into the previous update finish together with it
+    while (!m_pendingTransactions.isEmpty()
+           && m_pendingTransactions.head()->isFinished()) {
+        // allow other finished() slots to be invoked
+        m_pendingTransactions.dequeue()->deleteLater();
+    }
+
     if (m_pendingTransactions.isEmpty())
         return;
 
@@ -1830,18 +2133,12 @@ void TrackerIOPrivate::runNextTransaction()
 
     Q_ASSERT(t);
 
-    if (t->isFinished()) {
-        t->deleteLater(); // allow other finished() slots to be invoked
-        m_pendingTransactions.dequeue();
-        t = 0;
+    if (!t->isRunning()) {
+        mergePendingTransactions();
 
-        if (!m_pendingTransactions.isEmpty())
-            t = m_pendingTransactions.head();
-    }
-
-    if (t && !t->isRunning()) {
         if (!t->run(connection())) {
             qWarning() << Q_FUNC_INFO << "abort transaction" << t;
+            t->d->splitMerged();
             emit t->finished();
             m_pendingTransactions.dequeue();
             delete t;
@@ -1855,6 +2152,44 @@ void TrackerIOPrivate::runNextTransaction()
     }
 }
 
+void TrackerIOPrivate::mergePendingTransactions()
+{
+    CommittingTransaction *t = m_pendingTransactions.head();
+    QList<CommittingTransaction *> merged;
+
+    if (t->d->isMergeable()) {
+        for (int i = 1; i < m_pendingTransactions.size()
+                 && merged.size() < MAX_MERGED_TRANSACTIONS; i++) {
+            CommittingTransaction *next = m_pendingTransactions.at(i);
+            if (!next->d->isMergeable())
+                break;
+            merged.append(next);
+        }
+        t->d->merge(merged);
+    }
+
+    merged.prepend(t);
+    foreach (CommittingTransaction *m, merged) {
+        int wait = m->d->queuedTime.elapsed();
+        m_commitStats.totalWait += wait;
+        m_commitStats.maxWait = qMax(m_commitStats.maxWait, wait);
+    }
+    m_commitStats.updates++;
+    m_commitStats.merged += merged.size() - 1;
+}
+
+TrackerIO::CommitStatistics TrackerIO::commitStatistics() const
+{
+    CommitStatistics stats = d->m_commitStats;
+    stats.queueDepth = d->m_pendingTransactions.size();
+    return stats;
+}
+
+void TrackerIO::resetCommitStatistics()
+{
+    d->m_commitStats = CommitStatistics();
+}
+
 void TrackerIO::rollback()
 {
     d->m_contactCache.clear();
@@ -1875,6 +2210,10 @@ bool TrackerIO::deleteAllEvents(Event::EventType eventType)
     QString query("DELETE {?e a rdfs:Resource}"
                   "WHERE {?e rdf:type ?:eventType}");
 
+    // the deleted events can't be matched anymore, recount every channel
+    if (eventType != Event::CallEvent)
+        query += d->prepareGroupCountersQuery();
+
     QUrl eventTypeUrl;
 
     switch(eventType) {
@@ -1910,7 +2249,11 @@ bool TrackerIO::deleteAllEvents(Event::EventType eventType)
     if (eventType == Event::CallEvent)
         deleteQuery.bindValue(LAT("graph"), COMMHISTORY_GRAPH_CALL_CHANNEL);
 
-    return d->handleQuery(deleteQuery);
+    if (!d->handleQuery(deleteQuery))
+        return false;
+
+    d->updateSearchIndex(d->m_pTransaction, "removeEventsOfType", Q_ARG(int, eventType));
+    return true;
 }
 
 void TrackerIOPrivate::calculateParentId(Event& event)
@@ -1959,6 +2302,9 @@ bool TrackerIO::markAsRead(const QList<int> &eventIds)
 {
     UpdateQuery query;
     foreach (int id, eventIds) {
+        // only unread messages match, before they are marked
+        query.deletion(d->prepareMessageCountersQuery(Event::idToUrl(id), -1,
+                                                      TrackerIOPrivate::UnreadCounter));
         query.insertion(Event::idToUrl(id),
                         "nmo:isRead",
                         true,
@@ -2107,12 +2453,28 @@ void TrackerIOPrivate::deleteMmsContent(CommittingTransaction *transaction,
     }
 }
 
-QSparqlConnection& TrackerIOPrivate::connection()
+void TrackerIOPrivate::updateSearchIndex(CommittingTransaction *transaction,
+                                         const char *method,
+                                         QGenericArgument arg)
+{
+    if (!SearchIndex::exists())
+        return;
+
+    if (transaction)
+        transaction->addSignal(false, SearchIndex::instance(), method, arg);
+    else
+        QMetaObject::invokeMethod(SearchIndex::instance(), method, arg);
+}
+
+SparqlBackend& TrackerIOPrivate::connection()
 {
+    if (SparqlBackend *backend = SparqlBackend::defaultBackend())
+        return *backend;
+
     if (!m_pConnection.hasLocalData()) {
         QSparqlConnectionOptions ops;
         ops.setDataReadyInterval(QSPARQL_DATA_READY_INTERVAL);
-        m_pConnection.setLocalData(new QSparqlConnection(QSPARQL_DRIVER, ops));
+        m_pConnection.setLocalData(new TrackerSparqlBackend(QSPARQL_DRIVER, ops));
     }
 
     return *m_pConnection.localData();
@@ -2143,6 +2505,8 @@ bool TrackerIOPrivate::addToTransactionOrRunQuery(CommittingTransaction *transac
     } else {
         QSparqlResult *sResult = connection().exec(query);
         result = runBlockedQuery(sResult);
+        if (query.type() != QSparqlQuery::SelectStatement)
+            QueryRegistry::instance()->invalidate();
         if (callback) {
             // note: this can go recursive
             QMetaObject::invokeMethod(caller, callback,
@@ -67,6 +67,21 @@ public:
      */
     bool addEvent(Event &event);
 
+    /*!
+     * Add several new events into the database. Events are written in
+     * batches, one tracker update per batch, and contact and address
+     * resources shared by the events are inserted only once per batch.
+     * The id fields of successfully prepared events are updated.
+     *
+     * Events that cannot be stored (e.g. unsupported type) are skipped
+     * and their id is reset to -1. Note that a tracker error fails the
+     * whole batch the event belongs to.
+     *
+     * \param events New events.
+     * \return true if all events were added, false if any of them failed
+     */
+    bool addEvents(QList<Event> &events);
+
     /*!
      * Add a new group into the database. The id field of the group is
      * updated if successfully added.
@@ -245,6 +260,16 @@ public:
      */
     bool deleteAllEvents(Event::EventType eventType);
 
+    /*!
+     * Recalculate the stored total, unread and sent message counters of
+     * all groups. The counters are kept up to date by the event and group
+     * operations of this class; this is only needed to repair them, e.g.
+     * after the database was modified by other means.
+     *
+     * \return true if successful, otherwise false
+     */
+    bool recalculateGroupCounters();
+
     /*!
      * Initate a new tracker transaction.
      *
@@ -266,6 +291,36 @@ public:
      */
     void rollback();
 
+    /*!
+     * Counters of the asynchronous commit queue. Queued transactions
+     * that consist only of updates without callbacks are merged into
+     * one tracker update; each still emits its own signals.
+     */
+    struct CommitStatistics {
+        CommitStatistics()
+            : transactions(0), updates(0), merged(0), queueDepth(0),
+              maxQueueDepth(0), totalWait(0), maxWait(0) {}
+
+        /*! Transactions queued by commit(). */
+        quint64 transactions;
+        /*! Tracker updates started for them. */
+        quint64 updates;
+        /*! Transactions that ran as part of another's update. */
+        quint64 merged;
+        int queueDepth;
+        int maxQueueDepth;
+        /*! Time in ms from commit() to the start of the update. */
+        qint64 totalWait;
+        int maxWait;
+
+        double mergeRatio() const {
+            return updates ? double(updates + merged) / updates : 1.0;
+        }
+    };
+
+    CommitStatistics commitStatistics() const;
+    void resetCommitStatistics();
+
     /*!
      * Do NOT call this unless you know what you are doing.
      */
@@ -279,6 +334,7 @@ public:
 private:
     friend class TrackerIOPrivate;
     friend class QueryRunner;
+    friend class SearchIndex;
     TrackerIOPrivate * const d;
 };
 
@@ -26,6 +26,7 @@
 #include <QObject>
 #include <QUrl>
 #include <QHash>
+#include <QMap>
 #include <QSet>
 #include <QThreadStorage>
 #include <QSparqlQuery>
@@ -39,7 +40,6 @@
 #include "commonutils.h"
 
 class MmsContentDeleter;
-class QSparqlConnection;
 class QSparqlResult;
 
 namespace CommHistory {
@@ -49,6 +49,7 @@ class UpdateQuery;
 class TrackerIO;
 class CommittingTransaction;
 class EventsQuery;
+class SparqlBackend;
 
 /**
  * \class TrackerIOPrivate
@@ -94,6 +95,54 @@ public:
      */
     static QString prepareGroupedCallQuery(const QStringList &channels = QStringList());
 
+    /*!
+     * Create update recalculating the message counters of channels
+     * matching the SPARQL pattern (empty for all channels).
+     */
+    static QString prepareGroupCountersQuery(const QString &channelPattern = QString());
+
+    enum GroupCounter {
+        TotalCounter = 0x1,
+        UnreadCounter = 0x2,
+        SentCounter = 0x4,
+        AllCounters = TotalCounter | UnreadCounter | SentCounter
+    };
+
+    /*!
+     * Messages added to one group, for its counters.
+     */
+    struct GroupCounts {
+        GroupCounts() : total(0), unread(0), sent(0) {}
+        void add(const Event &event);
+
+        int total;
+        int unread;
+        int sent;
+    };
+
+    /*!
+     * Create update adding the counts of new messages to the stored
+     * counters of their groups. Groups without stored counters yet are
+     * counted instead.
+     */
+    static QString prepareAddedCountersQuery(const QMap<int, GroupCounts> &counts);
+
+    /*!
+     * Create update adding delta (1 or -1) to the counters of the channel
+     * of message that its current state is counted in. Used before (-1)
+     * and after (+1) the statements changing the message, so that only
+     * the difference is applied.
+     */
+    static QString prepareMessageCountersQuery(const QUrl &message,
+                                               int delta,
+                                               int counters = AllCounters);
+
+    /*!
+     * True if the event is counted in the counters of its channel. As in
+     * GROUP_QUERY, drafts are counted.
+     */
+    static bool hasGroupCounters(const Event &event);
+
     /*!
      * Return IMContact node as blank anonymous SPARQL string
      * that corresponds to account/target (or
@@ -176,6 +225,14 @@ public:
      */
     void setChannel(UpdateQuery &query, Event &event, int channelId, bool modify = false);
 
+    /*!
+     * Adds the statements for inserting a new event to the query.
+     * Used by addEvent() and addEvents().
+     *
+     * \return false if the event type is not supported
+     */
+    bool addEvent(UpdateQuery &query, Event &event);
+
     /* Used by addEvent(). */
     void addIMEvent(UpdateQuery &query, Event &event);
     void addSMSEvent(UpdateQuery &query, Event &event); // also handles MMS
@@ -193,7 +250,7 @@ public:
     MmsContentDeleter& getMmsDeleter(QThread *backgroundThread);
     bool isLastMmsEvent(const QString& messageToken);
 
-    QSparqlConnection& connection();
+    SparqlBackend& connection();
     bool checkPendingResult(QSparqlResult *result, bool destroyOnFinished = true);
     // wrapper around addToTransactionOrRunQuery with m_pTransaction
     bool handleQuery(const QSparqlQuery &query,
@@ -217,6 +274,22 @@ public:
 
     bool markGroupAsRead(const QString &channelIRI);
 
+    /*!
+     * Invoke method of SearchIndex with arg once transaction has been
+     * committed, or right away without a transaction. Nothing is done if
+     * the index is not used in this process.
+     */
+    void updateSearchIndex(CommittingTransaction *transaction,
+                           const char *method,
+                           QGenericArgument arg);
+
+    /*!
+     * Merge the queued transactions following the head of
+     * m_pendingTransactions into it when possible, and account wait
+     * times before it's started.
+     */
+    void mergePendingTransactions();
+
 public Q_SLOTS:
     void runNextTransaction();
     /*!
@@ -243,9 +316,10 @@ public Q_SLOTS:
                           QVariant arg);
 
 public:
-    QThreadStorage<QSparqlConnection*> m_pConnection;
+    QThreadStorage<SparqlBackend*> m_pConnection;
     CommittingTransaction *m_pTransaction;
     QQueue<CommittingTransaction*> m_pendingTransactions;
+    TrackerIO::CommitStatistics m_commitStats;
 
     // Temporary contact cache, valid during a transaction
     QHash<QUrl, QString> m_contactCache;
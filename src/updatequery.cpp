@@ -21,7 +21,6 @@
 ******************************************************************************/
 
 #include <QStringBuilder>
-#include <QSparqlBinding>
 
 #include "updatequery.h"
 
@@ -36,60 +35,119 @@ QString encloseUrl(const QUrl &url)
         || urlString.startsWith(LAT("?")))
         return urlString;
 
-    return QString(LAT("<%1>")).arg(urlString);
+    return LAT("<") % urlString % LAT(">");
 }
 
-void copyReverse(const QStringList &src, QStringList &target, const QString &delim = QString())
+// same escapes as QSparqlBinding::toString(), without the round-trip
+void appendLiteral(QString &buffer, const QString &value)
 {
-    QStringListIterator i(src);
-    i.toBack();
-    while(i.hasPrevious()) {
-        if (!delim.isEmpty() && i.hasNext())
-            target << delim;
-        target << i.previous();
+    buffer += QLatin1Char('"');
+
+    const QChar *c = value.constData();
+    const QChar *end = c + value.size();
+    for (; c != end; ++c) {
+        switch (c->unicode()) {
+        case '\\': buffer += LAT("\\\\"); break;
+        case '"': buffer += LAT("\\\""); break;
+        case '\'': buffer += LAT("\\'"); break;
+        case '\n': buffer += LAT("\\n"); break;
+        case '\r': buffer += LAT("\\r"); break;
+        case '\t': buffer += LAT("\\t"); break;
+        case '\b': buffer += LAT("\\b"); break;
+        case '\f': buffer += LAT("\\f"); break;
+        default: buffer += *c;
+        }
     }
+
+    buffer += QLatin1Char('"');
 }
 
 }
 
 namespace CommHistory {
 
-UpdateQuery::UpdateQuery() : nextVar(0)
+UpdateQuery::UpdateQuery()
+    : nextVar(0)
+    , maxSize(DefaultSizeLimit)
+    , blankNodes(false)
 {
 }
 
+void UpdateQuery::setSizeLimit(int chars)
+{
+    maxSize = chars;
+}
+
+int UpdateQuery::sizeLimit() const
+{
+    return maxSize;
+}
 
 void UpdateQuery::deletion(const QUrl &subject,
                            const char *predicate,
                            const QString &object)
 {
     QString obj = object.isEmpty() ? nextVariable() : object;
+    QString s = encloseUrl(subject);
 
-    deletions << LAT("DELETE {")
-            << encloseUrl(subject)
-            << LAT(predicate) << obj
-            << LAT("} WHERE {")
-            << encloseUrl(subject) << LAT(predicate) << obj
-            << LAT("}");
+    deletions += LAT("DELETE { ") % s % LAT(" ") % LAT(predicate) % LAT(" ") % obj
+        % LAT(" } WHERE { ") % s % LAT(" ") % LAT(predicate) % LAT(" ") % obj
+        % LAT(" } ");
 }
 
 void UpdateQuery::resourceDeletion(const QUrl &subject,
                                    const char *predicate)
 {
     QString r = nextVariable();
-    deletions << LAT("DELETE {")
-            << encloseUrl(subject)
-            << LAT(predicate) << r << LAT(".")
-            << r << LAT("rdf:type rdfs:Resource .")
-            << LAT("} WHERE {")
-            << encloseUrl(subject) << LAT(predicate) << r
-            << LAT("} ");
+    QString s = encloseUrl(subject);
+
+    deletions += LAT("DELETE { ") % s % LAT(" ") % LAT(predicate) % LAT(" ") % r
+        % LAT(" . ") % r % LAT(" rdf:type rdfs:Resource . } WHERE { ")
+        % s % LAT(" ") % LAT(predicate) % LAT(" ") % r % LAT(" } ");
 }
 
 void UpdateQuery::deletion(const QString &query) {
-    deletions << query;
+    deletions += query;
+    deletions += QLatin1Char(' ');
 }
 
+void UpdateQuery::closeSubject()
+{
+    if (!currentSubject.isEmpty()) {
+        insertions += LAT(" . ");
+        currentSubject.clear();
+    }
+}
+
+void UpdateQuery::checkBlankNodes(const QString &text)
+{
+    if (!blankNodes && text.contains(LAT("_:")))
+        blankNodes = true;
+}
+
+void UpdateQuery::beginTriple(const QUrl &subject)
+{
+    QString s = encloseUrl(subject);
+    if (s == currentSubject) {
+        insertions += LAT("; ");
+        return;
+    }
+
+    closeSubject();
+    checkBlankNodes(s);
+
+    if (!blankNodes && maxSize > 0
+        && rawInsertions.size() + insertions.size() >= maxSize) {
+        splitInsertions += LAT("INSERT OR REPLACE { ") % rawInsertions
+            % insertions % LAT("} ");
+        rawInsertions.clear();
+        insertions.clear();
+    }
+
+    insertions += s;
+    insertions += QLatin1Char(' ');
+    currentSubject = s;
+}
 
 void UpdateQuery::insertionRaw(const QUrl &subject,
                                const char *predicate,
@@ -97,102 +155,111 @@ void UpdateQuery::insertionRaw(const QUrl &subject,
                                bool modify) {
     Q_UNUSED(modify); // was in use with separate deletes
 
-    insertions.insertMulti(subject, LAT(predicate) % LAT(" ") % object);
+    checkBlankNodes(object);
+    beginTriple(subject);
+    insertions += LAT(predicate);
+    insertions += QLatin1Char(' ');
+    insertions += object;
 }
 
 void UpdateQuery::insertion(const QUrl &subject,
                             const char *predicate,
                             const QString &object,
                             bool modify) {
-    QSparqlBinding objectBinding;
-    objectBinding.setValue(object);
-    insertionRaw(subject, predicate, objectBinding.toString(), modify);
+    Q_UNUSED(modify);
+
+    beginTriple(subject);
+    insertions += LAT(predicate);
+    insertions += QLatin1Char(' ');
+    appendLiteral(insertions, object);
 }
 
 void UpdateQuery::insertion(const QUrl &subject,
                             const char *predicate,
                             const QDateTime &object,
                             bool modify) {
-    insertionRaw(subject,
-                 predicate,
-                 LAT("\"") % object.toUTC().toString(Qt::ISODate) % LAT("\"^^xsd:dateTime"),
-                 modify);
+    Q_UNUSED(modify);
+
+    beginTriple(subject);
+    insertions += LAT(predicate) % LAT(" \"")
+        % object.toUTC().toString(Qt::ISODate) % LAT("\"^^xsd:dateTime");
 }
 
 void UpdateQuery::insertion(const QUrl &subject,
                             const char *predicate,
                             bool object,
                             bool modify) {
-    insertionRaw(subject,
-                 predicate,
-                 object ? LAT("true") : LAT("false"),
-                 modify);
+    Q_UNUSED(modify);
+
+    beginTriple(subject);
+    insertions += LAT(predicate) % (object ? LAT(" true") : LAT(" false"));
 }
 
 void UpdateQuery::insertion(const QUrl &subject,
                             const char *predicate,
                             int object,
                             bool modify) {
-    insertionRaw(subject,
-                 predicate,
-                 LAT("\"") % QString::number(object) % LAT("\"^^xsd:int"),
-                 modify);
-}
+    Q_UNUSED(modify);
 
+    beginTriple(subject);
+    insertions += LAT(predicate) % LAT(" \"") % QString::number(object)
+        % LAT("\"^^xsd:int");
+}
 
 void UpdateQuery::insertion(const QUrl &subject,
                             const char *predicate,
                             const QUrl &object,
                             bool modify) {
-    insertionRaw(subject,
-                 predicate,
-                 encloseUrl(object),
-                 modify);
+    Q_UNUSED(modify);
+
+    QString o = encloseUrl(object);
+    checkBlankNodes(o);
+    beginTriple(subject);
+    insertions += LAT(predicate) % LAT(" ") % o;
 }
 
 void UpdateQuery::insertion(const QString &statement)
 {
-    insertions.insertMulti(QUrl(), statement);
+    // raw statements (resource types) go before the triples of their
+    // INSERT OR REPLACE, as they did before splitting
+    checkBlankNodes(statement);
+    rawInsertions += statement;
+    rawInsertions += QLatin1Char(' ');
 }
 
 void UpdateQuery::insertionSilent(const QString &statement)
 {
-    silents << statement;
+    silents += statement;
+    silents += QLatin1Char(' ');
 }
 
 void UpdateQuery::appendInsertion(const QString &statement)
 {
-    postInsertions << statement;
+    postInsertions += statement;
+    postInsertions += QLatin1Char(' ');
 }
 
 QString UpdateQuery::query()
 {
-    QStringList query;
-    query << deletions;
-
-    if (!silents.isEmpty())
-        query << LAT("INSERT SILENT {")
-              << silents
-              << LAT("}");
+    closeSubject();
 
-    if (!insertions.isEmpty()) {
-        query << LAT("INSERT OR REPLACE {");
-        copyReverse(insertions.values(QUrl()), query);
+    QString query;
+    query.reserve(deletions.size() + silents.size() + splitInsertions.size()
+                  + rawInsertions.size() + insertions.size()
+                  + postInsertions.size() + 64);
+    query += deletions;
 
-        foreach (QUrl subject, insertions.uniqueKeys()) {
-            if (subject.isEmpty())
-                continue;
+    if (!silents.isEmpty())
+        query += LAT("INSERT SILENT { ") % silents % LAT("} ");
 
-            query << encloseUrl(subject);
-            copyReverse(insertions.values(subject), query, LAT("; "));
-            query << LAT(" .");
-        }
-        query << LAT("}");
-    }
+    query += splitInsertions;
+    if (!rawInsertions.isEmpty() || !insertions.isEmpty())
+        query += LAT("INSERT OR REPLACE { ") % rawInsertions % insertions
+            % LAT("} ");
 
-    query << postInsertions;
+    query += postInsertions;
 
-    return query.join(LAT(" "));
+    return query;
 }
 
 QString UpdateQuery::nextVariable()
@@ -201,4 +268,3 @@ QString UpdateQuery::nextVariable()
 }
 
 } //namespace
-
@@ -29,10 +29,28 @@
 
 namespace CommHistory {
 
+/*!
+ * Builds a SPARQL update in place: every call appends escaped text to
+ * the buffer of its section, and consecutive triples with the same
+ * subject are written as one "<subject> p1 o1; p2 o2 ." block. A
+ * subject that comes back after another one gets a second block in the
+ * same statement. Raw insertion(QString) statements are written first
+ * in the INSERT OR REPLACE that is open when they are added.
+ * Once the INSERT OR REPLACE block grows past sizeLimit() characters it
+ * is closed at the next subject boundary and a new one is started, so
+ * oversized transactions become several statements. Updates using
+ * blank nodes are never split, because labels are scoped to one
+ * statement.
+ */
 class UpdateQuery {
 public:
+    enum { DefaultSizeLimit = 256 * 1024 };
+
     UpdateQuery();
 
+    void setSizeLimit(int chars);
+    int sizeLimit() const;
+
     void deletion(const QUrl &subject,
                   const char *predicate,
                   const QString &object = QString());
@@ -83,13 +101,23 @@ public:
 
 private:
     QString nextVariable();
+    void beginTriple(const QUrl &subject);
+    void closeSubject();
+    void checkBlankNodes(const QString &text);
 
 private:
     int nextVar;
-    QStringList deletions;
-    QMultiMap<QUrl, QString> insertions;
-    QStringList postInsertions;
-    QStringList silents;
+    int maxSize;
+    bool blankNodes;
+    QString deletions;
+    QString silents;
+    // finished INSERT OR REPLACE statements
+    QString splitInsertions;
+    // body of the open one: raw statements, then triples
+    QString rawInsertions;
+    QString insertions;
+    QString currentSubject;
+    QString postInsertions;
 };
 
 } // namespace
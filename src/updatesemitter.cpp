@@ -21,6 +21,8 @@
 ******************************************************************************/
 
 #include <QtDBus/QtDBus>
+#include <QTimer>
+#include <QTime>
 
 #include "adaptor.h"
 
@@ -31,9 +33,116 @@ namespace CommHistory {
 
 QWeakPointer<UpdatesEmitter> UpdatesEmitter::m_Instance;
 
+class UpdatesEmitterPrivate
+{
+public:
+    UpdatesEmitterPrivate()
+        : adaptor(0)
+        , interval(0)
+    {
+    }
+
+    int queueDepth() const
+    {
+        return addedEvents.size() + updatedEvents.size() + deletedEvents.size()
+            + addedGroups.size() + updatedGroups.size() + fullGroups.size()
+            + deletedGroups.size();
+    }
+
+    bool isEmpty() const
+    {
+        return queueDepth() == 0;
+    }
+
+    void clear()
+    {
+        addedEventIds.clear();
+        addedEvents.clear();
+        updatedEventIds.clear();
+        updatedEvents.clear();
+        deletedEvents.clear();
+        addedGroupIds.clear();
+        addedGroups.clear();
+        updatedGroups.clear();
+        fullGroupIds.clear();
+        fullGroups.clear();
+        deletedGroups.clear();
+    }
+
+    template<class T>
+    static QList<T> take(const QList<int> &ids, QHash<int, T> &items)
+    {
+        // ids may contain stale or repeated entries, the hash decides
+        QList<T> result;
+        foreach (int id, ids) {
+            typename QHash<int, T>::iterator i = items.find(id);
+            if (i != items.end()) {
+                result.append(i.value());
+                items.erase(i);
+            }
+        }
+        return result;
+    }
+
+    Adaptor *adaptor;
+    QTimer timer;
+    int interval;
+    QTime firstQueued;
+    UpdatesEmitter::Statistics stats;
+
+    // arrival order + latest merged value per id
+    QList<int> addedEventIds;
+    QHash<int, Event> addedEvents;
+    QList<int> updatedEventIds;
+    QHash<int, Event> updatedEvents;
+    QList<int> deletedEvents;
+
+    QList<int> addedGroupIds;
+    QHash<int, Group> addedGroups;
+    QList<int> updatedGroups;
+    QList<int> fullGroupIds;
+    QHash<int, Group> fullGroups;
+    QList<int> deletedGroups;
+};
+
+UpdatesEmitter::Statistics::Statistics()
+    : queued(0)
+    , merged(0)
+    , batches(0)
+    , queueDepth(0)
+    , maxQueueDepth(0)
+    , lastLatency(0)
+    , maxLatency(0)
+{
+}
+
 UpdatesEmitter::UpdatesEmitter()
+    : d(new UpdatesEmitterPrivate)
 {
-    new Adaptor(this);
+    qRegisterMetaType<QList<CommHistory::Event> >();
+    qRegisterMetaType<QList<CommHistory::Group> >();
+    qRegisterMetaType<QList<int> >();
+
+    d->adaptor = new Adaptor(this);
+    d->timer.setSingleShot(true);
+    d->timer.setInterval(d->interval);
+    connect(&d->timer, SIGNAL(timeout()), this, SLOT(flush()));
+
+    connect(this, SIGNAL(eventsAdded(const QList<CommHistory::Event>&)),
+            this, SLOT(queueEventsAdded(const QList<CommHistory::Event>&)));
+    connect(this, SIGNAL(eventsUpdated(const QList<CommHistory::Event>&)),
+            this, SLOT(queueEventsUpdated(const QList<CommHistory::Event>&)));
+    connect(this, SIGNAL(eventDeleted(int)),
+            this, SLOT(queueEventDeleted(int)));
+    connect(this, SIGNAL(groupsAdded(const QList<CommHistory::Group>&)),
+            this, SLOT(queueGroupsAdded(const QList<CommHistory::Group>&)));
+    connect(this, SIGNAL(groupsUpdated(const QList<int>&)),
+            this, SLOT(queueGroupsUpdated(const QList<int>&)));
+    connect(this, SIGNAL(groupsUpdatedFull(const QList<CommHistory::Group>&)),
+            this, SLOT(queueGroupsUpdatedFull(const QList<CommHistory::Group>&)));
+    connect(this, SIGNAL(groupsDeleted(const QList<int>&)),
+            this, SLOT(queueGroupsDeleted(const QList<int>&)));
+
     if (!QDBusConnection::sessionBus().registerObject(COMM_HISTORY_OBJECT_PATH,
                                                       this)) {
         qWarning() << Q_FUNC_INFO << ": error registering object";
@@ -42,7 +151,228 @@ UpdatesEmitter::UpdatesEmitter()
 
 UpdatesEmitter::~UpdatesEmitter()
 {
+    // don't lose notifications of a process exiting right after a commit
+    flush();
     QDBusConnection::sessionBus().unregisterObject(COMM_HISTORY_OBJECT_PATH);
+    delete d;
+}
+
+void UpdatesEmitter::setCoalescingInterval(int msec)
+{
+    if (msec < 0)
+        flush();
+
+    d->interval = msec;
+    d->timer.setInterval(qMax(msec, 0));
+}
+
+int UpdatesEmitter::coalescingInterval() const
+{
+    return d->interval;
+}
+
+UpdatesEmitter::Statistics UpdatesEmitter::statistics() const
+{
+    Statistics result = d->stats;
+    result.queueDepth = d->queueDepth();
+    return result;
+}
+
+void UpdatesEmitter::resetStatistics()
+{
+    d->stats = Statistics();
+}
+
+void UpdatesEmitter::flush()
+{
+    d->timer.stop();
+    if (d->isEmpty())
+        return;
+
+    int latency = d->firstQueued.elapsed();
+    d->stats.lastLatency = latency;
+    d->stats.maxLatency = qMax(d->stats.maxLatency, latency);
+    d->stats.batches++;
+
+    QList<Group> addedGroups = UpdatesEmitterPrivate::take(d->addedGroupIds, d->addedGroups);
+    QList<Event> addedEvents = UpdatesEmitterPrivate::take(d->addedEventIds, d->addedEvents);
+    QList<Event> updatedEvents = UpdatesEmitterPrivate::take(d->updatedEventIds, d->updatedEvents);
+    QList<Group> fullGroups = UpdatesEmitterPrivate::take(d->fullGroupIds, d->fullGroups);
+    QList<int> updatedGroups = d->updatedGroups;
+    QList<int> deletedEvents = d->deletedEvents;
+    QList<int> deletedGroups = d->deletedGroups;
+    d->clear();
+
+    // the whole window in one message for batched clients, then the
+    // per-type signals for the others
+    emit d->adaptor->updatesBatched(addedEvents, updatedEvents, deletedEvents,
+                                    addedGroups, updatedGroups, fullGroups,
+                                    deletedGroups);
+
+    if (!addedGroups.isEmpty())
+        emit d->adaptor->groupsAdded(addedGroups);
+    if (!addedEvents.isEmpty())
+        emit d->adaptor->eventsAdded(addedEvents);
+    if (!updatedEvents.isEmpty())
+        emit d->adaptor->eventsUpdated(updatedEvents);
+    if (!fullGroups.isEmpty())
+        emit d->adaptor->groupsUpdatedFull(fullGroups);
+    if (!updatedGroups.isEmpty())
+        emit d->adaptor->groupsUpdated(updatedGroups);
+    foreach (int id, deletedEvents)
+        emit d->adaptor->eventDeleted(id);
+    if (!deletedGroups.isEmpty())
+        emit d->adaptor->groupsDeleted(deletedGroups);
+}
+
+void UpdatesEmitter::startQueueing(int count)
+{
+    d->stats.queued += count;
+
+    if (d->isEmpty())
+        d->firstQueued.start();
+    if (d->interval >= 0 && !d->timer.isActive())
+        d->timer.start();
+}
+
+void UpdatesEmitter::endQueueing()
+{
+    d->stats.maxQueueDepth = qMax(d->stats.maxQueueDepth, d->queueDepth());
+
+    // without coalescing every notification is a window of its own
+    if (d->interval < 0)
+        flush();
+}
+
+void UpdatesEmitter::queueEventsAdded(const QList<CommHistory::Event> &events)
+{
+    startQueueing(events.size());
+
+    foreach (const Event &event, events) {
+        if (d->addedEvents.contains(event.id()))
+            d->stats.merged++;
+        else
+            d->addedEventIds.append(event.id());
+        d->addedEvents.insert(event.id(), event);
+    }
+
+    endQueueing();
+}
+
+void UpdatesEmitter::queueEventsUpdated(const QList<CommHistory::Event> &events)
+{
+    startQueueing(events.size());
+
+    foreach (const Event &event, events) {
+        QHash<int, Event>::iterator i = d->addedEvents.find(event.id());
+        if (i != d->addedEvents.end()) {
+            i.value().copyValidProperties(event);
+            d->stats.merged++;
+            continue;
+        }
+
+        i = d->updatedEvents.find(event.id());
+        if (i != d->updatedEvents.end()) {
+            i.value().copyValidProperties(event);
+            d->stats.merged++;
+        } else {
+            d->updatedEventIds.append(event.id());
+            d->updatedEvents.insert(event.id(), event);
+        }
+    }
+
+    endQueueing();
+}
+
+void UpdatesEmitter::queueEventDeleted(int id)
+{
+    startQueueing(1);
+
+    if (d->updatedEvents.remove(id))
+        d->stats.merged++;
+    if (d->addedEvents.remove(id)) {
+        // added and deleted within the window, nobody needs to know
+        d->stats.merged += 2;
+    } else if (!d->deletedEvents.contains(id)) {
+        d->deletedEvents.append(id);
+    } else {
+        d->stats.merged++;
+    }
+
+    endQueueing();
+}
+
+void UpdatesEmitter::queueGroupsAdded(const QList<CommHistory::Group> &groups)
+{
+    startQueueing(groups.size());
+
+    foreach (const Group &group, groups) {
+        if (d->addedGroups.contains(group.id()))
+            d->stats.merged++;
+        else
+            d->addedGroupIds.append(group.id());
+        d->addedGroups.insert(group.id(), group);
+    }
+
+    endQueueing();
+}
+
+void UpdatesEmitter::queueGroupsUpdated(const QList<int> &groupIds)
+{
+    startQueueing(groupIds.size());
+
+    foreach (int id, groupIds) {
+        if (d->updatedGroups.contains(id))
+            d->stats.merged++;
+        else
+            d->updatedGroups.append(id);
+    }
+
+    endQueueing();
+}
+
+void UpdatesEmitter::queueGroupsUpdatedFull(const QList<CommHistory::Group> &groups)
+{
+    startQueueing(groups.size());
+
+    foreach (const Group &group, groups) {
+        QHash<int, Group>::iterator i = d->addedGroups.find(group.id());
+        if (i != d->addedGroups.end()) {
+            i.value().copyValidProperties(group);
+            d->stats.merged++;
+            continue;
+        }
+
+        i = d->fullGroups.find(group.id());
+        if (i != d->fullGroups.end()) {
+            i.value().copyValidProperties(group);
+            d->stats.merged++;
+        } else {
+            d->fullGroupIds.append(group.id());
+            d->fullGroups.insert(group.id(), group);
+        }
+    }
+
+    endQueueing();
+}
+
+void UpdatesEmitter::queueGroupsDeleted(const QList<int> &groupIds)
+{
+    startQueueing(groupIds.size());
+
+    foreach (int id, groupIds) {
+        d->fullGroups.remove(id);
+        d->updatedGroups.removeAll(id);
+        if (d->addedGroups.remove(id)) {
+            d->stats.merged += 2;
+        } else if (!d->deletedGroups.contains(id)) {
+            d->deletedGroups.append(id);
+        } else {
+            d->stats.merged++;
+        }
+    }
+
+    endQueueing();
 }
 
 QSharedPointer<UpdatesEmitter> UpdatesEmitter::instance()
@@ -58,4 +388,9 @@ QSharedPointer<UpdatesEmitter> UpdatesEmitter::instance()
     return result;
 }
 
+QSharedPointer<UpdatesEmitter> UpdatesEmitter::existingInstance()
+{
+    return m_Instance.toStrongRef();
+}
+
 }
@@ -32,13 +32,69 @@
 
 namespace CommHistory {
 
+class UpdatesEmitterPrivate;
+
+/*!
+ * \class UpdatesEmitter
+ *
+ * Relays change notifications of the local process to the
+ * com.nokia.commhistory D-Bus interface. Notifications emitted within the
+ * coalescing window are merged (an event updated twice is sent once, an
+ * event added and deleted in the same window is not sent at all). Each
+ * window is sent as one updatesBatched() D-Bus signal for clients using
+ * batched updates (see UpdatesReceiver), and as the per-type signals,
+ * one eventDeleted() per id, for the others.
+ */
 class UpdatesEmitter : public QObject
 {
     Q_OBJECT
 public:
+    /*!
+     * Coalescing counters, see statistics().
+     */
+    struct Statistics {
+        Statistics();
+
+        /*! Notifications passed to the emitter. */
+        quint64 queued;
+        /*! Notifications merged into an already queued one or cancelled. */
+        quint64 merged;
+        /*! Flushed coalescing windows. */
+        quint64 batches;
+        /*! Entries currently waiting for the next flush. */
+        int queueDepth;
+        int maxQueueDepth;
+        /*! Time in ms between the first queued notification and its flush. */
+        int lastLatency;
+        int maxLatency;
+    };
+
     static QSharedPointer<UpdatesEmitter> instance();
+
+    /*!
+     * The emitter if there is one, without creating it.
+     */
+    static QSharedPointer<UpdatesEmitter> existingInstance();
     ~UpdatesEmitter();
 
+    /*!
+     * Set the coalescing window in milliseconds. 0 (the default) merges
+     * everything emitted during the same event loop iteration; a negative
+     * value disables coalescing and relays each notification immediately
+     * as a window of its own.
+     */
+    void setCoalescingInterval(int msec);
+    int coalescingInterval() const;
+
+    Statistics statistics() const;
+    void resetStatistics();
+
+public Q_SLOTS:
+    /*!
+     * Send queued notifications now.
+     */
+    void flush();
+
 Q_SIGNALS:
 #ifndef Q_MOC_RUN
 public:
@@ -51,10 +107,24 @@ public:
     void groupsUpdatedFull(const QList<CommHistory::Group> &groups);
     void groupsDeleted(const QList<int> &groupIds);
 
+private Q_SLOTS:
+    void queueEventsAdded(const QList<CommHistory::Event> &events);
+    void queueEventsUpdated(const QList<CommHistory::Event> &events);
+    void queueEventDeleted(int id);
+    void queueGroupsAdded(const QList<CommHistory::Group> &groups);
+    void queueGroupsUpdated(const QList<int> &groupIds);
+    void queueGroupsUpdatedFull(const QList<CommHistory::Group> &groups);
+    void queueGroupsDeleted(const QList<int> &groupIds);
+
 private:
     UpdatesEmitter();
 
+    void startQueueing(int count);
+    void endQueueing();
+
     static QWeakPointer<UpdatesEmitter> m_Instance;
+
+    UpdatesEmitterPrivate * const d;
 };
 
 }
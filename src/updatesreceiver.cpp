@@ -0,0 +1,66 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtDBus/QtDBus>
+
+#include "updatesreceiver.h"
+#include "constants.h"
+
+namespace CommHistory {
+
+QWeakPointer<UpdatesReceiver> UpdatesReceiver::m_Instance;
+
+UpdatesReceiver::UpdatesReceiver()
+{
+    qRegisterMetaType<QList<CommHistory::Event> >();
+    qRegisterMetaType<QList<CommHistory::Group> >();
+    qRegisterMetaType<QList<int> >();
+
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, UPDATES_BATCHED_SIGNAL,
+        this, SIGNAL(updatesBatched(const QList<CommHistory::Event> &,
+                                    const QList<CommHistory::Event> &,
+                                    const QList<int> &,
+                                    const QList<CommHistory::Group> &,
+                                    const QList<int> &,
+                                    const QList<CommHistory::Group> &,
+                                    const QList<int> &)));
+}
+
+UpdatesReceiver::~UpdatesReceiver()
+{
+}
+
+QSharedPointer<UpdatesReceiver> UpdatesReceiver::instance()
+{
+    QSharedPointer<UpdatesReceiver> result;
+    if (!m_Instance) {
+        result = QSharedPointer<UpdatesReceiver>(new UpdatesReceiver());
+        m_Instance = result.toWeakRef();
+    } else {
+        result = m_Instance.toStrongRef();
+    }
+
+    return result;
+}
+
+}
@@ -0,0 +1,68 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef UPDATESRECEIVER_H
+#define UPDATESRECEIVER_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QWeakPointer>
+
+#include "event.h"
+#include "group.h"
+
+namespace CommHistory {
+
+/*!
+ * \class UpdatesReceiver
+ *
+ * Receives the updatesBatched() D-Bus signal of the com.nokia.commhistory
+ * interface, one per coalescing window of a sending UpdatesEmitter.
+ * Shared by the models and managers of the process that use batched
+ * updates, so the per-type signals are not delivered to the process
+ * for them.
+ */
+class UpdatesReceiver : public QObject
+{
+    Q_OBJECT
+public:
+    static QSharedPointer<UpdatesReceiver> instance();
+    ~UpdatesReceiver();
+
+Q_SIGNALS:
+    void updatesBatched(const QList<CommHistory::Event> &addedEvents,
+                        const QList<CommHistory::Event> &updatedEvents,
+                        const QList<int> &deletedEventIds,
+                        const QList<CommHistory::Group> &addedGroups,
+                        const QList<int> &updatedGroupIds,
+                        const QList<CommHistory::Group> &updatedGroups,
+                        const QList<int> &deletedGroupIds);
+
+private:
+    UpdatesReceiver();
+
+    static QWeakPointer<UpdatesReceiver> m_Instance;
+};
+
+}
+
+#endif // UPDATESRECEIVER_H
@@ -25,6 +25,11 @@
 #include <malloc.h>
 #include "eventmodel.h"
 #include "callmodel.h"
+#include "conversationmodel.h"
+#include "queryregistry.h"
+#include "sparqlbackend.h"
+#include "memorysparqlbackend.h"
+#include "commonutils.h"
 #include "common.h"
 
 #include "mem_eventmodel.h"
@@ -218,6 +223,129 @@ void MemEventModelTest::callSetFilter()
     MALLINFO_DUMP("don");
 }
 
+void MemEventModelTest::internedUids()
+{
+    const int numEvents = 10000;
+    const int contacts = 10;
+
+    // fill a model through QueryRunner and QueryResult, then compare
+    // with what separate copies of the decoded uids would take
+    MemorySparqlBackend backend;
+    backend.addTable(QLatin1String("?message nmo:from ?from"),
+                     MemorySparqlBackend::MessageEvents, numEvents, contacts);
+    SparqlBackend::setDefault(&backend);
+    int cacheSize = QueryRegistry::instance()->cacheSize();
+    QueryRegistry::instance()->setCacheSize(0);
+
+    MALLINFO_DUMP("before decode");
+
+    ConversationModel *model = new ConversationModel();
+    model->setQueryMode(EventModel::AsyncQuery);
+    QSignalSpy modelReady(model, SIGNAL(modelReady(bool)));
+    QVERIFY(model->getEvents(1));
+    QVERIFY(waitSignal(modelReady, WAIT_TIMEOUT));
+    QCOMPARE(model->rowCount(), numEvents);
+
+    MALLINFO_DUMP("model decoded");
+
+    // every row with the same uid points to the same data
+    QHash<QString, const QChar*> shared;
+    for (int row = 0; row < model->rowCount(); row++) {
+        Event e = model->event(model->index(row, 0));
+        foreach (const QString &uid, QStringList() << e.localUid() << e.remoteUid()) {
+            if (!shared.contains(uid))
+                shared.insert(uid, uid.constData());
+            QCOMPARE(uid.constData(), shared.value(uid));
+        }
+    }
+    QCOMPARE(shared.size(), contacts + 1);
+
+    QList<QString> copies;
+    copies.reserve(2 * numEvents);
+    struct mallinfo before = mallinfo();
+    for (int row = 0; row < model->rowCount(); row++) {
+        Event e = model->event(model->index(row, 0));
+        copies << QString(e.localUid().unicode(), e.localUid().size())
+               << QString(e.remoteUid().unicode(), e.remoteUid().size());
+    }
+    struct mallinfo after = mallinfo();
+    int copied = after.uordblks - before.uordblks;
+    qDebug() << "MALLINFO uids saved by interning" << numEvents << "events"
+             << copied << "bytes";
+
+    QVERIFY(copied > 0);
+
+    delete model;
+    SparqlBackend::setDefault(0);
+    QueryRegistry::instance()->setCacheSize(cacheSize);
+}
+
+void MemEventModelTest::callEventFootprint()
+{
+    const int numEvents = 30000;
+
+    MemorySparqlBackend backend;
+    backend.addTable(QLatin1String("?message a nmo:Call"),
+                     MemorySparqlBackend::CallEvents, numEvents, 100);
+    SparqlBackend::setDefault(&backend);
+    int cacheSize = QueryRegistry::instance()->cacheSize();
+    QueryRegistry::instance()->setCacheSize(0);
+
+    struct mallinfo before = mallinfo();
+
+    CallModel *model = new CallModel();
+    model->setQueryMode(EventModel::AsyncQuery);
+    model->setFilter(CallModel::SortByTime);
+    QSignalSpy modelReady(model, SIGNAL(modelReady(bool)));
+    QVERIFY(model->getEvents());
+    QVERIFY(waitSignal(modelReady, WAIT_TIMEOUT));
+    int rows = model->rowCount();
+    QVERIFY(rows > 0);
+
+    struct mallinfo loaded = mallinfo();
+    qDebug() << "MALLINFO call model" << rows << "calls"
+             << (loaded.uordblks - before.uordblks) / rows << "bytes per call";
+
+    // detach a copy of every call, once keeping the core block only and
+    // once with an allocated (empty) extension block, as every event
+    // had before the split
+    int used[2];
+    for (int extended = 0; extended < 2; extended++) {
+        QList<Event> copies;
+        copies.reserve(rows);
+        for (int row = 0; row < rows; row++)
+            copies.append(model->event(model->index(row, 0)));
+
+        struct mallinfo start = mallinfo();
+        for (int i = 0; i < copies.size(); i++) {
+            Event &e = copies[i];
+            QVERIFY(e.subject().isEmpty() && e.encoding().isEmpty());
+            if (extended) {
+                // setting a value allocates the block, clearing keeps it
+                e.setEncoding(QLatin1String("x"));
+                e.setEncoding(QString());
+            } else {
+                e.setIsRead(!e.isRead());
+            }
+        }
+        struct mallinfo end = mallinfo();
+        used[extended] = end.uordblks - start.uordblks;
+
+        qDebug() << (extended ? "MALLINFO detached calls with extension block"
+                              : "MALLINFO detached calls without extension block")
+                 << used[extended] / rows << "bytes per call";
+    }
+
+    qDebug() << "MALLINFO empty extension block per call event"
+             << (used[1] - used[0]) / rows << "bytes";
+
+    QVERIFY(used[0] < used[1]);
+
+    delete model;
+    SparqlBackend::setDefault(0);
+    QueryRegistry::instance()->setCacheSize(cacheSize);
+}
+
 void MemEventModelTest::cleanupTestCase()
 {
     MALLINFO_DUMP("CLEANUP");
@@ -38,6 +38,8 @@ private slots:
     void deleteEvent();
 
     void callSetFilter();
+    void internedUids();
+    void callEventFootprint();
 
     void cleanupTestCase();
 };
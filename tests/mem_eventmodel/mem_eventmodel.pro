@@ -29,5 +29,7 @@ DESTDIR = ../bin
 QT -= gui
 MOBILITY += contacts
 CONFIG  += qtestlib qdbus mobility
-SOURCES += mem_eventmodel.cpp
-HEADERS += mem_eventmodel.h
+SOURCES += mem_eventmodel.cpp \
+           ../memorysparqlbackend.cpp
+HEADERS += mem_eventmodel.h \
+           ../memorysparqlbackend.h
@@ -0,0 +1,460 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QTimer>
+#include <QDebug>
+#include <QRegExp>
+#include <QSparqlBinding>
+
+#include "memorysparqlbackend.h"
+#include "eventsquery.h"
+#include "eventsquery_p.h"
+#include "queryresult.h"
+#include "group.h"
+
+using namespace CommHistory;
+
+#define NMO_ "http://www.semanticdesktop.org/ontologies/2007/03/22/nmo#"
+
+namespace {
+
+const int DEFAULT_INTERVAL = 25;
+
+const QLatin1String LOCAL_UID("/org/freedesktop/Telepathy/Account/ring/tel/ring");
+const QLatin1String CALL_TYPE(NMO_ "Call");
+const QLatin1String SMS_TYPE(NMO_ "Message," NMO_ "SMSMessage");
+
+QString remoteUid(int contact)
+{
+    return QString(QLatin1String("+358400%1")).arg(contact, 6, 10, QLatin1Char('0'));
+}
+
+QVariant eventValue(const MemorySparqlBackend::Table &table,
+                    int index,
+                    Event::Property property)
+{
+    // newest first, every second event outbound, every third inbound
+    // call missed
+    int contact = index % table.contacts;
+    bool outbound = index % 2;
+    QDateTime time = table.newest.addSecs(-60 * index);
+    QString local = QLatin1String("telepathy:") + LOCAL_UID;
+
+    switch (property) {
+    case Event::Id:
+        return Event::idToUrl(index + 1).toString();
+    case Event::Type:
+        return QString(table.type == MemorySparqlBackend::CallEvents ? CALL_TYPE : SMS_TYPE);
+    case Event::Direction:
+        return outbound;
+    case Event::StartTime:
+    case Event::EndTime:
+    case Event::LastModified:
+        return time;
+    case Event::IsRead:
+        return index % 5 != 0;
+    case Event::IsMissedCall:
+        // the column is nmo:isAnswered
+        return outbound || index % 3 != 0;
+    case Event::LocalUid:
+        return outbound ? local : remoteUid(contact);
+    case Event::RemoteUid:
+        return outbound ? remoteUid(contact) : local;
+    case Event::FreeText:
+        if (table.type == MemorySparqlBackend::MessageEvents)
+            return QString(QLatin1String("Message %1")).arg(index);
+        break;
+    case Event::GroupId:
+        if (table.type == MemorySparqlBackend::MessageEvents)
+            return Group::idToUrl(table.groupId).toString();
+        break;
+    default:
+        break;
+    }
+
+    return QVariant();
+}
+
+QVariant groupValue(const MemorySparqlBackend::Table &table,
+                    int index,
+                    int column)
+{
+    QDateTime time = table.newest.addSecs(-60 * index);
+
+    switch (column) {
+    case Group::Id:
+        return Group::idToUrl(index + 1).toString();
+    case Group::LocalUid:
+        return QString(LOCAL_UID);
+    case Group::RemoteUids:
+        return remoteUid(index % table.contacts);
+    case Group::Type:
+        return QString(QLatin1String("0"));
+    case Group::EndTime:
+    case Group::LastModified:
+    case Group::StartTime:
+        return time;
+    case Group::TotalMessages:
+        return index % 10 + 1;
+    case Group::UnreadMessages:
+        return index % 3;
+    case Group::SentMessages:
+        return index % 10 / 2;
+    case Group::LastEventId:
+        return Event::idToUrl(index + 1).toString();
+    case Group::LastMessageText:
+        return QString(QLatin1String("Message %1")).arg(index);
+    case Group::LastEventType:
+        return QString(SMS_TYPE);
+    default:
+        break;
+    }
+
+    return QVariant();
+}
+
+QVariant callGroupValue(const MemorySparqlBackend::Table &table,
+                        int index,
+                        int column)
+{
+    bool outbound = index % 2;
+    QString local = QLatin1String("telepathy:") + LOCAL_UID;
+    QString remote = remoteUid(index % table.contacts);
+    QDateTime time = table.newest.addSecs(-60 * index);
+
+    switch (column) {
+    case QueryResult::CallGroupColumnChannel:
+        return local + QLatin1Char('!') + remote;
+    case QueryResult::CallGroupColumnLastCall:
+        return Event::idToUrl(index + 1).toString();
+    case QueryResult::CallGroupColumnStartTime:
+    case QueryResult::CallGroupColumnEndTime:
+    case QueryResult::CallGroupColumnLastModified:
+        return time;
+    case QueryResult::CallGroupColumnFrom:
+        return outbound ? local : remote;
+    case QueryResult::CallGroupColumnTo:
+        return outbound ? remote : local;
+    case QueryResult::CallGroupColumnIsSent:
+        return outbound;
+    case QueryResult::CallGroupColumnIsAnswered:
+        return outbound || index % 3 != 0;
+    case QueryResult::CallGroupColumnIsEmergency:
+        return false;
+    case QueryResult::CallGroupColumnIsRead:
+        return index % 5 != 0;
+    case QueryResult::CallGroupColumnMissedCount:
+        return outbound ? 0 : index % 3;
+    default:
+        break;
+    }
+
+    return QVariant();
+}
+
+// value of the last LIMIT or OFFSET of the outermost select, -1 if none
+int trailingModifier(const QString &query, const QString &modifier)
+{
+    QString tail = query.mid(query.lastIndexOf(QLatin1Char('}')) + 1);
+    QRegExp rx(modifier + QLatin1String("\\s+(\\d+)"), Qt::CaseInsensitive);
+    if (rx.lastIndexIn(tail) == -1)
+        return -1;
+    return rx.cap(1).toInt();
+}
+
+}
+
+MemorySparqlBackend::MemorySparqlBackend()
+    : m_interval(DEFAULT_INTERVAL)
+    , m_updates(0)
+{
+}
+
+MemorySparqlBackend::~MemorySparqlBackend()
+{
+}
+
+void MemorySparqlBackend::addTable(const QString &marker,
+                                   TableType type,
+                                   int rows,
+                                   int contacts)
+{
+    QMutexLocker locker(&m_mutex);
+
+    Table table;
+    table.marker = marker;
+    table.type = type;
+    table.rows = rows;
+    table.contacts = qMax(contacts, 1);
+    table.newest = QDateTime::currentDateTime().toUTC();
+    m_tables.append(table);
+}
+
+void MemorySparqlBackend::clear()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_tables.clear();
+    m_updates = 0;
+}
+
+void MemorySparqlBackend::setDataReadyInterval(int rows)
+{
+    QMutexLocker locker(&m_mutex);
+    m_interval = qMax(rows, 1);
+}
+
+int MemorySparqlBackend::updateCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_updates;
+}
+
+QSparqlResult* MemorySparqlBackend::exec(const QSparqlQuery &query)
+{
+    return execQuery(query, false);
+}
+
+QSparqlResult* MemorySparqlBackend::syncExec(const QSparqlQuery &query)
+{
+    return execQuery(query, true);
+}
+
+bool MemorySparqlBackend::hasFeature(QSparqlConnection::Feature feature) const
+{
+    switch (feature) {
+    case QSparqlConnection::QuerySize:
+    case QSparqlConnection::AsyncExec:
+    case QSparqlConnection::SyncExec:
+        return true;
+    default:
+        return false;
+    }
+}
+
+QSparqlResult* MemorySparqlBackend::execQuery(const QSparqlQuery &query, bool sync)
+{
+    QString text = query.preparedQueryText();
+    Table table;
+    int interval;
+    bool found = false;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        interval = m_interval;
+        if (query.type() != QSparqlQuery::SelectStatement) {
+            m_updates++;
+        } else {
+            foreach (const Table &t, m_tables) {
+                if (text.contains(t.marker)) {
+                    table = t;
+                    found = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (!found)
+        return new MemoryResult(table, 0, 0, QList<Event::Property>(), 0, interval, sync);
+
+    QList<Event::Property> properties;
+    int extraColumns = 0;
+    if (table.type == CallEvents || table.type == MessageEvents) {
+        properties = eventsQueryProperties(text, &extraColumns);
+        if (properties.isEmpty())
+            qWarning() << Q_FUNC_INFO << "events query not built by EventsQuery";
+    }
+
+    int offset = qMax(trailingModifier(text, QLatin1String("OFFSET")), 0);
+    int limit = trailingModifier(text, QLatin1String("LIMIT"));
+    int count = qMax(table.rows - offset, 0);
+    if (limit >= 0)
+        count = qMin(count, limit);
+
+    return new MemoryResult(table, offset, count, properties, extraColumns,
+                            interval, sync);
+}
+
+QSparqlResultRow MemorySparqlBackend::row(const Table &table,
+                                          int index,
+                                          const QList<Event::Property> &properties,
+                                          int extraColumns)
+{
+    QSparqlResultRow row;
+
+    switch (table.type) {
+    case CallEvents:
+    case MessageEvents:
+        foreach (Event::Property property, properties)
+            row.append(QSparqlBinding(QString(), eventValue(table, index, property)));
+        // only tracker:id() projections are added by the models
+        for (int i = 0; i < extraColumns; i++)
+            row.append(QSparqlBinding(QString(), index + 1));
+        break;
+    case Groups:
+        for (int column = 0; column < Group::NumProperties; column++)
+            row.append(QSparqlBinding(QString(), groupValue(table, index, column)));
+        break;
+    case CallGroups:
+        for (int column = 0; column <= QueryResult::CallGroupColumnMissedCount; column++)
+            row.append(QSparqlBinding(QString(), callGroupValue(table, index, column)));
+        break;
+    }
+
+    return row;
+}
+
+MemoryResult::MemoryResult(const MemorySparqlBackend::Table &table,
+                           int first,
+                           int count,
+                           const QList<Event::Property> &properties,
+                           int extraColumns,
+                           int interval,
+                           bool sync)
+    : m_table(table)
+    , m_properties(properties)
+    , m_extraColumns(extraColumns)
+    , m_first(first)
+    , m_count(count)
+    , m_available(0)
+    , m_interval(interval)
+    , m_sync(sync)
+    , m_finished(false)
+    , m_rowPos(-1)
+{
+    if (m_sync) {
+        m_available = m_count;
+        m_finished = true;
+    } else {
+        QTimer::singleShot(0, this, SLOT(deliver()));
+    }
+}
+
+void MemoryResult::deliver()
+{
+    if (m_finished)
+        return;
+
+    if (m_available < m_count) {
+        m_available = qMin(m_available + m_interval, m_count);
+        emit dataReady(m_available);
+    }
+
+    if (m_available == m_count) {
+        m_finished = true;
+        emit finished();
+    } else {
+        QTimer::singleShot(0, this, SLOT(deliver()));
+    }
+}
+
+bool MemoryResult::next()
+{
+    if (pos() == QSparql::AfterLastRow)
+        return false;
+
+    int next = pos() == QSparql::BeforeFirstRow ? 0 : pos() + 1;
+    if (next >= m_available) {
+        if (m_finished)
+            updatePos(QSparql::AfterLastRow);
+        return false;
+    }
+
+    updatePos(next);
+    return true;
+}
+
+bool MemoryResult::setPos(int pos)
+{
+    if (pos == QSparql::BeforeFirstRow || pos == QSparql::AfterLastRow
+        || (pos >= 0 && pos < m_available)) {
+        updatePos(pos);
+        return true;
+    }
+
+    return false;
+}
+
+bool MemoryResult::first()
+{
+    return setPos(0);
+}
+
+QSparqlResultRow MemoryResult::current() const
+{
+    int index = pos();
+    if (index < 0 || index >= m_available)
+        return QSparqlResultRow();
+
+    if (m_rowPos != index) {
+        m_row = MemorySparqlBackend::row(m_table, m_first + index,
+                                         m_properties, m_extraColumns);
+        m_rowPos = index;
+    }
+
+    return m_row;
+}
+
+QSparqlBinding MemoryResult::binding(int i) const
+{
+    return current().binding(i);
+}
+
+QVariant MemoryResult::value(int i) const
+{
+    return current().value(i);
+}
+
+int MemoryResult::size() const
+{
+    return m_available;
+}
+
+bool MemoryResult::isFinished() const
+{
+    return m_finished;
+}
+
+void MemoryResult::waitForFinished()
+{
+    if (m_finished)
+        return;
+
+    m_available = m_count;
+    m_finished = true;
+    emit dataReady(m_available);
+    emit finished();
+}
+
+bool MemoryResult::hasFeature(QSparqlResult::Feature feature) const
+{
+    switch (feature) {
+    case QSparqlResult::QuerySize:
+        return true;
+    case QSparqlResult::Sync:
+        return m_sync;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,141 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef MEMORYSPARQLBACKEND_H
+#define MEMORYSPARQLBACKEND_H
+
+#include <QDateTime>
+#include <QMutex>
+#include <QSparqlResultRow>
+
+#include "sparqlbackend.h"
+#include "event.h"
+
+/*!
+ * In-process stand-in for tracker. Selects are answered from generated
+ * tables: the first table whose marker is contained in the query text
+ * serves it, honouring a trailing LIMIT/OFFSET. Rows are built on demand
+ * in the column layout libcommhistory expects for the table type, so even
+ * a million-row table costs no memory until it is read. Updates succeed
+ * without effect and unknown selects return no rows.
+ */
+class MemorySparqlBackend : public CommHistory::SparqlBackend
+{
+public:
+    enum TableType {
+        CallEvents,     // events query on nmo:Call
+        MessageEvents,  // events query on SMS in one group
+        CallGroups,     // grouped call query, one row per contact
+        Groups          // group query, one row per contact
+    };
+
+    struct Table {
+        Table() : type(CallEvents), rows(0), contacts(1), groupId(1) {}
+
+        QString marker;
+        TableType type;
+        int rows;
+        int contacts;
+        int groupId;
+        QDateTime newest;
+    };
+
+    MemorySparqlBackend();
+    ~MemorySparqlBackend();
+
+    void addTable(const QString &marker, TableType type, int rows, int contacts = 1);
+    void clear();
+
+    /*!
+     * Rows between dataReady() signals of asynchronous results, like
+     * QSparqlConnectionOptions::setDataReadyInterval().
+     */
+    void setDataReadyInterval(int rows);
+
+    /*! Number of update queries executed. */
+    int updateCount() const;
+
+    QSparqlResult* exec(const QSparqlQuery &query);
+    QSparqlResult* syncExec(const QSparqlQuery &query);
+    bool hasFeature(QSparqlConnection::Feature feature) const;
+
+    static QSparqlResultRow row(const Table &table,
+                                int index,
+                                const QList<CommHistory::Event::Property> &properties,
+                                int extraColumns);
+
+private:
+    QSparqlResult* execQuery(const QSparqlQuery &query, bool sync);
+
+    mutable QMutex m_mutex;
+    QList<Table> m_tables;
+    int m_interval;
+    int m_updates;
+};
+
+/*!
+ * Result of MemorySparqlBackend, rows [first, first + count) of a table.
+ */
+class MemoryResult : public QSparqlResult
+{
+    Q_OBJECT
+
+public:
+    MemoryResult(const MemorySparqlBackend::Table &table,
+                 int first,
+                 int count,
+                 const QList<CommHistory::Event::Property> &properties,
+                 int extraColumns,
+                 int interval,
+                 bool sync);
+
+    bool next();
+    bool setPos(int pos);
+    bool first();
+    QSparqlResultRow current() const;
+    QSparqlBinding binding(int i) const;
+    QVariant value(int i) const;
+    int size() const;
+    bool isFinished() const;
+    void waitForFinished();
+    bool hasFeature(QSparqlResult::Feature feature) const;
+
+private Q_SLOTS:
+    void deliver();
+
+private:
+    MemorySparqlBackend::Table m_table;
+    QList<CommHistory::Event::Property> m_properties;
+    int m_extraColumns;
+    int m_first;
+    int m_count;
+    int m_available;
+    int m_interval;
+    bool m_sync;
+    bool m_finished;
+
+    // row at m_rowPos, built when first read
+    mutable int m_rowPos;
+    mutable QSparqlResultRow m_row;
+};
+
+#endif
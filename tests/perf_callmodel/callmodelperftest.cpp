@@ -22,14 +22,15 @@
 
 #include <QtTest/QtTest>
 #include <QDateTime>
-#include <QDBusConnection>
-#include <cstdlib>
 #include "callmodelperftest.h"
-#include "common.h"
+#include "memorysparqlbackend.h"
+#include "perfstats.h"
+#include "queryregistry.h"
 
 using namespace CommHistory;
 
-const int TIMEOUT = 5000;
+// large tables take minutes to load in tree mode
+const int TIMEOUT = 600000;
 
 void CallModelPerfTest::initTestCase()
 {
@@ -39,196 +40,76 @@ void CallModelPerfTest::initTestCase()
         logFile = 0;
     }
 
-    qsrand( QDateTime::currentDateTime().toTime_t() );
-}
-
-void CallModelPerfTest::init()
-{
-    deleteAll();
-    QTest::qWait(TIMEOUT);
-    waitForIdle();
+    // run the models on generated tables instead of tracker, and measure
+    // every iteration rather than the shared result cache
+    backend = new MemorySparqlBackend;
+    SparqlBackend::setDefault(backend);
+    QueryRegistry::instance()->setCacheSize(0);
 }
 
 void CallModelPerfTest::getEvents_data()
 {
-    QTest::addColumn<int>("events");
+    QTest::addColumn<int>("rows");
     QTest::addColumn<int>("contacts");
-
-    QTest::newRow("10 events, 3 contacts") << 10 << 3;
-    QTest::newRow("10 events, 300 contacts") << 10 << 300;
-    QTest::newRow("100 events, 3 contacts") << 100 << 3;
-    QTest::newRow("100 events, 300 contacts") << 100 << 300;
-    QTest::newRow("1000 events, 3 contacts") << 1000 << 3;
-    QTest::newRow("1000 events, 300 contacts") << 1000 << 300;
+    QTest::addColumn<int>("sorting");
+
+    QTest::newRow("1k calls, 300 contacts") << 1000 << 300 << (int)CallModel::SortByTime;
+    QTest::newRow("10k calls, 300 contacts") << 10000 << 300 << (int)CallModel::SortByTime;
+    QTest::newRow("100k calls, 3000 contacts") << 100000 << 3000 << (int)CallModel::SortByTime;
+    QTest::newRow("1M calls, 3000 contacts") << 1000000 << 3000 << (int)CallModel::SortByTime;
+    QTest::newRow("1k call groups") << 1000 << 1000 << (int)CallModel::SortByContact;
+    QTest::newRow("10k call groups") << 10000 << 10000 << (int)CallModel::SortByContact;
+    QTest::newRow("100k call groups") << 100000 << 100000 << (int)CallModel::SortByContact;
+    QTest::newRow("1M call groups") << 1000000 << 1000000 << (int)CallModel::SortByContact;
 }
 
 void CallModelPerfTest::getEvents()
 {
-    QFETCH(int, events);
+    QFETCH(int, rows);
     QFETCH(int, contacts);
+    QFETCH(int, sorting);
 
-    QDateTime startTime = QDateTime::currentDateTime();
-
-    int commitBatchSize = 75;
-    #ifdef PERF_BATCH_SIZE
-    commitBatchSize = PERF_BATCH_SIZE;
-    #endif
-
-
-    EventModel addModel;
-    QDateTime when = QDateTime::currentDateTime();
-    QList<QString> remoteUids;
-
-    qDebug() << __FUNCTION__ << "- Creating" << contacts << "new contacts";
+    backend->clear();
+    if (sorting == CallModel::SortByContact)
+        backend->addTable(QLatin1String("?lastCall"),
+                          MemorySparqlBackend::CallGroups, rows, contacts);
+    else
+        backend->addTable(QLatin1String("?message a nmo:Call"),
+                          MemorySparqlBackend::CallEvents, rows, contacts);
 
-    int ci = 0;
-    while(ci < contacts) {
-        ci++;
-        QString phoneNumber = QString().setNum(qrand() % 10000000);
-        remoteUids << phoneNumber;
-        addTestContact(QString("Test Contact %1").arg(ci), phoneNumber);
+    int iterations = perfIterations(rows);
+    QList<PerfSample> samples;
 
-        if(ci % commitBatchSize == 0 && ci < contacts) {
-            qDebug() << __FUNCTION__ << "- adding" << commitBatchSize
-                << "contacts (" << ci << "/" << contacts << ")";
-            waitForIdle(5000);
-        }
-    }
-    qDebug() << __FUNCTION__ << "- adding rest of the contacts ("
-        << ci << "/" << contacts << ")";
-
-    waitForIdle(5000);
-    QTest::qWait(TIMEOUT);
-
-    qDebug() << __FUNCTION__ << "- Creating" << events << "new events";
-
-    QList<Event> eventList;
-
-    int ei = 0;
-    while(ei < events) {
-        ei++;
-
-        Event::EventDirection direction;
-        bool isMissed = false;
-
-        if(qrand() % 2 > 0) {
-            direction = Event::Inbound;
-            isMissed = (qrand() % 2 > 0);
-        } else {
-            direction = Event::Outbound;
-        }
-
-        Event e;
-        e.setType(Event::CallEvent);
-        e.setDirection(direction);
-        e.setGroupId(-1);
-        e.setStartTime(when.addSecs(ei));
-        e.setEndTime(when.addSecs(ei));
-        e.setLocalUid(ACCOUNT1);
-        e.setRemoteUid(remoteUids.at(qrand() % contacts));
-        e.setFreeText("");
-        e.setIsDraft(false);
-        e.setIsMissedCall(isMissed);
-
-        eventList << e;
-
-        if(ei % commitBatchSize == 0 && ei != events) {
-            qDebug() << __FUNCTION__ << "- adding" << commitBatchSize
-                << "events (" << ei << "/" << events << ")";
-            QVERIFY(addModel.addEvents(eventList, false));
-            eventList.clear();
-            waitForIdle();
-        }
-    }
-
-    QVERIFY(addModel.addEvents(eventList, false));
-    qDebug() << __FUNCTION__ << "- adding rest of the events ("
-        << ei << "/" << events << ")";
-    eventList.clear();
-    waitForIdle();
-
-    int iterations = 10;
-    int sum = 0;
-    QList<int> times;
-
-    #ifdef PERF_ITERATIONS
-    iterations = PERF_ITERATIONS;
-    #endif
-
-    char *iterVar = getenv("PERF_ITERATIONS");
-    if (iterVar) {
-        int iters = QString::fromAscii(iterVar).toInt();
-        if (iters > 0) {
-            iterations = iters;
-        }
-    }
-
-    QTest::qWait(TIMEOUT);
-
-    qDebug() << __FUNCTION__ << "- Fetching events." << iterations << "iterations";
+    qDebug() << __FUNCTION__ << "- Fetching" << rows << "rows."
+             << iterations << "iterations";
     for(int i = 0; i < iterations; i++) {
-
         CallModel fetchModel;
-        bool result = false;
+        fetchModel.setQueryMode(EventModel::AsyncQuery);
+        fetchModel.setFilter((CallModel::Sorting)sorting);
+        ModelProbe probe(&fetchModel);
+
+        AllocationCounter allocations;
+        probe.start();
+        QVERIFY(fetchModel.getEvents());
+        QVERIFY(probe.wait(TIMEOUT));
+
+        PerfSample sample;
+        sample.elapsed = probe.ready();
+        sample.firstChunk = probe.firstChunk();
+        sample.allocations = allocations.count();
+        samples << sample;
+        qDebug("Time elapsed: %d ms", sample.elapsed);
 
-        fetchModel.setQueryMode(EventModel::SyncQuery);
-        fetchModel.setFilter(CallModel::SortByContact);
-
-        QTime time;
-        time.start();
-        result = fetchModel.getEvents();
-        int elapsed = time.elapsed();
-        times << elapsed;
-        sum += elapsed;
-        qDebug("Time elapsed: %d ms", elapsed);
-
-        QVERIFY(result);
         QVERIFY(fetchModel.rowCount() > 0);
-
-        waitForIdle();
-    }
-
-    if(logFile) {
-        QTextStream out(logFile);
-
-        out << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss") << ": "
-            << metaObject()->className() << "::" << QTest::currentTestFunction() << "("
-            << QTest::currentDataTag() << ", " << iterations << " iterations)"
-            << "\n";
-
-        for (int i = 0; i < times.size(); i++) {
-            out << times.at(i) << " ";
-        }
-        out << "\n";
-    }
-
-    qSort(times);
-    float median = 0.0;
-    if(iterations % 2 > 0) {
-        median = times[(int)(iterations / 2)];
-    } else {
-        median = (times[iterations / 2] + times[iterations / 2 - 1]) / 2.0f;
     }
 
-    float mean = sum / (float)iterations;
-    int testSecs = startTime.secsTo(QDateTime::currentDateTime());
-
-    qDebug("##### Mean: %.1f; Median: %.1f; Test time: %dsec", mean, median, testSecs);
-
-    if(logFile) {
-        QTextStream out(logFile);
-        out << "Median average: " << (int)median << " ms. Test time: ";
-        if (testSecs > 3600) { out << (testSecs / 3600) << "h "; }
-        if (testSecs > 60) { out << ((testSecs % 3600) / 60) << "m "; }
-        out << ((testSecs % 3600) % 60) << "s\n";
-    }
+    reportSamples(logFile, metaObject()->className(), rows, samples);
 }
 
 void CallModelPerfTest::cleanupTestCase()
 {
-    deleteAll();
-    QTest::qWait(TIMEOUT);
-    waitForIdle();
+    SparqlBackend::setDefault(0);
+    delete backend;
 
     if(logFile) {
         logFile->close();
@@ -29,7 +29,7 @@
 
 using namespace CommHistory;
 
-class TestCallPerfItem;
+class MemorySparqlBackend;
 
 class CallModelPerfTest : public QObject
 {
@@ -37,13 +37,13 @@ class CallModelPerfTest : public QObject
 
 private slots:
     void initTestCase();
-    void init();
     void getEvents_data();
     void getEvents();
     void cleanupTestCase();
 
 private:
     QFile *logFile;
+    MemorySparqlBackend *backend;
 };
 
 #endif
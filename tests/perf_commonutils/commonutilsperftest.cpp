@@ -0,0 +1,167 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QRegExp>
+#include "commonutils.h"
+#include "commonutilsperftest.h"
+
+using namespace CommHistory;
+
+namespace {
+
+const int NUMBER_COUNT = 1000000;
+
+// the regexp based implementation normalizePhoneNumber() replaced,
+// used to check that the output is identical
+QString referenceNormalize(const QString &number, PhoneNumberNormalizeFlags flags)
+{
+    QString result(number);
+
+    QRegExp sipRegExp("^sips?:(.*)@");
+    if (sipRegExp.indexIn(number) != -1)
+        result = sipRegExp.cap(1);
+
+    if (flags & NormalizeFlagRemovePunctuation) {
+        result.remove(QRegExp("[()\\-\\. ]"));
+        if (result.indexOf(QRegExp("[^\\d#\\*\\+XxWwPp]")) != -1)
+            return QString();
+    } else {
+        if (result.indexOf(QRegExp("[^()\\-\\. \\d#\\*\\+XxWwPp]")) != -1)
+            return QString();
+    }
+
+    if (!(flags & NormalizeFlagKeepDialString))
+        result.replace(QRegExp("[XxWwPp].*"), "");
+
+    if ((result.indexOf(QLatin1String("*31#")) != -1 ||
+         result.indexOf(QLatin1String("#31#")) != -1) &&
+         result.indexOf('+') != -1) {
+        return QString();
+    }
+
+    return result;
+}
+
+QString randomDigits(int count)
+{
+    QString digits;
+    for (int i = 0; i < count; i++)
+        digits.append(QChar('0' + qrand() % 10));
+    return digits;
+}
+
+// mix of the address formats seen in the call log and messaging
+QString randomNumber()
+{
+    switch (qrand() % 10) {
+    case 0:
+        return QString("+358 %1 %2 %3").arg(randomDigits(2), randomDigits(3), randomDigits(4));
+    case 1:
+        return QString("0%1-%2").arg(randomDigits(2), randomDigits(7));
+    case 2:
+        return QString("(0%1) %2.%3").arg(randomDigits(2), randomDigits(3), randomDigits(4));
+    case 3:
+        return QString("+1%1p%2").arg(randomDigits(10), randomDigits(4));
+    case 4:
+        return QString("sip:+358%1@sip.example.com").arg(randomDigits(9));
+    case 5:
+        return QString("user%1@jabber.example.com").arg(randomDigits(3));
+    case 6:
+        return QString("*31#%1").arg(randomDigits(10));
+    case 7:
+        return QString("#31#+358%1").arg(randomDigits(9));
+    default:
+        return QString("+358%1").arg(randomDigits(9));
+    }
+}
+
+}
+
+void CommonUtilsPerfTest::initTestCase()
+{
+    qsrand(1234);
+
+    numbers.reserve(NUMBER_COUNT);
+    for (int i = 0; i < NUMBER_COUNT; i++)
+        numbers << randomNumber();
+}
+
+void CommonUtilsPerfTest::normalizePhoneNumber_data()
+{
+    QTest::addColumn<int>("flags");
+
+    QTest::newRow("none") << (int)NormalizeFlagNone;
+    QTest::newRow("remove punctuation") << (int)NormalizeFlagRemovePunctuation;
+    QTest::newRow("keep dial string") << (int)NormalizeFlagKeepDialString;
+    QTest::newRow("remove punctuation, keep dial string")
+        << (int)(NormalizeFlagRemovePunctuation | NormalizeFlagKeepDialString);
+}
+
+void CommonUtilsPerfTest::normalizePhoneNumber()
+{
+    QFETCH(int, flags);
+    PhoneNumberNormalizeFlags normalizeFlags(flags);
+
+    QStringList normalized;
+    normalized.reserve(numbers.size());
+
+    QTime time;
+    time.start();
+    foreach (const QString &number, numbers)
+        normalized << CommHistory::normalizePhoneNumber(number, normalizeFlags);
+    int elapsed = time.elapsed();
+
+    QStringList reference;
+    reference.reserve(numbers.size());
+
+    time.start();
+    foreach (const QString &number, numbers)
+        reference << referenceNormalize(number, normalizeFlags);
+    int referenceElapsed = time.elapsed();
+
+    qDebug("##### %d numbers: %d ms, regexp reference %d ms",
+           numbers.size(), elapsed, referenceElapsed);
+
+    for (int i = 0; i < numbers.size(); i++) {
+        if (normalized.at(i) != reference.at(i))
+            qWarning() << numbers.at(i) << normalized.at(i) << reference.at(i);
+        QCOMPARE(normalized.at(i), reference.at(i));
+    }
+}
+
+void CommonUtilsPerfTest::makeShortNumber()
+{
+    QTime time;
+    time.start();
+    int matched = 0;
+    for (int i = 1; i < numbers.size(); i++) {
+        if (CommHistory::makeShortNumber(numbers.at(i), NormalizeFlagKeepDialString)
+            == CommHistory::makeShortNumber(numbers.at(i - 1), NormalizeFlagKeepDialString))
+            matched++;
+    }
+
+    qDebug("##### %d short number comparisons: %d ms (%d matched)",
+           numbers.size() - 1, time.elapsed(), matched);
+}
+
+QTEST_MAIN(CommonUtilsPerfTest)
@@ -22,17 +22,16 @@
 
 #include <QtTest/QtTest>
 #include <QDateTime>
-#include <QDBusConnection>
-#include <cstdlib>
 #include "conversationmodelperftest.h"
-#include "common.h"
-#include "conversationmodel.h"
+#include "memorysparqlbackend.h"
+#include "perfstats.h"
+#include "queryregistry.h"
 
 using namespace CommHistory;
 
-Group group1, group2;
-
-const int TIMEOUT = 5000;
+const int TIMEOUT = 600000;
+// generated messages are all in the first group
+const int GROUP_ID = 1;
 
 void ConversationModelPerfTest::initTestCase()
 {
@@ -42,35 +41,28 @@ void ConversationModelPerfTest::initTestCase()
         logFile = 0;
     }
 
-    qsrand( QDateTime::currentDateTime().toTime_t() );
-}
+    qRegisterMetaType<QModelIndex>("QModelIndex");
 
-void ConversationModelPerfTest::init()
-{
-    deleteAll();
-    QTest::qWait(TIMEOUT);
-    waitForIdle();
+    backend = new MemorySparqlBackend;
+    SparqlBackend::setDefault(backend);
+    QueryRegistry::instance()->setCacheSize(0);
 }
 
 void ConversationModelPerfTest::getEvents_data()
 {
-    // Number of messages created
+    // Number of messages in the conversation
     QTest::addColumn<int>("messages");
-
-    // Number of contacts created
+    // Number of contacts the messages are from
     QTest::addColumn<int>("contacts");
-
-    // Number of messages to fetch from db. Negative value fetches all messages
+    // Number of messages to fetch first. Negative value fetches all messages
     QTest::addColumn<int>("limit");
 
-    QTest::newRow("10 messages, 3 contacts") << 10 << 3 << -1;
-    QTest::newRow("10 messages, 300 contacts") << 10 << 300 << -1;
-    QTest::newRow("100 messages, 3 contacts") << 100 << 3 << -1;
-    QTest::newRow("100 messages, 300 contacts") << 100 << 300 << -1;
-    QTest::newRow("1000 messages, 3 contacts") << 1000 << 3 << -1;
-    QTest::newRow("1000 messages, 300 contacts") << 1000 << 300 << -1;
-    QTest::newRow("1000 messages, 3 contacts, limit 25") << 1000 << 3 << 25;
-    QTest::newRow("1000 messages, 300 contacts, limit 25") << 1000 << 300 << 25;
+    QTest::newRow("1k messages") << 1000 << 3 << -1;
+    QTest::newRow("10k messages") << 10000 << 3 << -1;
+    QTest::newRow("100k messages") << 100000 << 300 << -1;
+    QTest::newRow("1M messages") << 1000000 << 300 << -1;
+    QTest::newRow("1k messages, limit 25") << 1000 << 3 << 25;
+    QTest::newRow("1M messages, limit 25") << 1000000 << 300 << 25;
 }
 
 void ConversationModelPerfTest::getEvents()
@@ -79,177 +71,50 @@ void ConversationModelPerfTest::getEvents()
     QFETCH(int, contacts);
     QFETCH(int, limit);
 
-    qRegisterMetaType<QModelIndex>("QModelIndex");
-
-    QDateTime startTime = QDateTime::currentDateTime();
-
-    addTestGroups( group1, group2 );
-
-    int commitBatchSize = 75;
-    #ifdef PERF_BATCH_SIZE
-    commitBatchSize = PERF_BATCH_SIZE;
-    #endif
-
-    EventModel addModel;
-    QDateTime when = QDateTime::currentDateTime();
-    QList<QString> remoteUids;
-
-    qDebug() << __FUNCTION__ << "- Creating" << contacts << "new contacts";
-
-    int ci = 0;
-    while(ci < contacts) {
-        ci++;
-        QString phoneNumber = QString().setNum(qrand() % 10000000);
-        remoteUids << phoneNumber;
-        addTestContact(QString("Test Contact %1").arg(ci), phoneNumber);
-
-        if(ci % commitBatchSize == 0 && ci < contacts) {
-            qDebug() << __FUNCTION__ << "- adding" << commitBatchSize
-                << "contacts (" << ci << "/" << contacts << ")";
-            waitForIdle(5000);
-        }
-    }
-    qDebug() << __FUNCTION__ << "- adding rest of the contacts ("
-        << ci << "/" << contacts << ")";
-    waitForIdle(5000);
-    QTest::qWait(TIMEOUT);
-
-    qDebug() << __FUNCTION__ << "- Creating" << messages << "new messages";
-
-    QList<Event> eventList;
-
-    int ei = 0;
-    while(ei < messages) {
-        ei++;
-
-        Event::EventDirection direction;
-        direction = qrand() % 2 > 0 ? Event::Inbound : Event::Outbound;
-
-        Event e;
-        e.setType(Event::SMSEvent);
-        e.setDirection(direction);
-        e.setGroupId(group1.id());
-        e.setStartTime(when.addSecs(ei));
-        e.setEndTime(when.addSecs(ei));
-        e.setLocalUid(ACCOUNT1);
-        e.setRemoteUid(remoteUids.at(0));
-        e.setFreeText(randomMessage(qrand() % 49 + 1)); // Max 50 words / message
-        e.setIsDraft(false);
-        e.setIsMissedCall(false);
-
-        eventList << e;
-
-        if(ei % commitBatchSize == 0 && ei != messages) {
-            qDebug() << __FUNCTION__ << "- adding" << commitBatchSize
-                << "messages (" << ei << "/" << messages << ")";
-            QVERIFY(addModel.addEvents(eventList, false));
-            eventList.clear();
-            waitForIdle();
-        }
-    }
+    backend->clear();
+    backend->addTable(QLatin1String("?message nmo:from ?from"),
+                      MemorySparqlBackend::MessageEvents, messages, contacts);
 
-    QVERIFY(addModel.addEvents(eventList, false));
-    qDebug() << __FUNCTION__ << "- adding rest of the messages ("
-        << ei << "/" << messages << ")";
-    eventList.clear();
-    waitForIdle();
+    // a limited fetch only reads the first chunk
+    int rows = limit < 0 ? messages : limit;
+    int iterations = perfIterations(rows);
+    QList<PerfSample> samples;
 
-    int iterations = 10;
-    int sum = 0;
-    QList<int> times;
-
-    #ifdef PERF_ITERATIONS
-    iterations = PERF_ITERATIONS;
-    #endif
-
-    char *iterVar = getenv("PERF_ITERATIONS");
-    if (iterVar) {
-        int iters = QString::fromAscii(iterVar).toInt();
-        if (iters > 0) {
-            iterations = iters;
-        }
-    }
-
-    QTest::qWait(TIMEOUT);
-
-    qDebug() << __FUNCTION__ << "- Fetching messages." << iterations << "iterations";
+    qDebug() << __FUNCTION__ << "- Fetching" << rows << "of" << messages
+             << "messages." << iterations << "iterations";
     for(int i = 0; i < iterations; i++) {
-
         ConversationModel fetchModel;
-        bool result = false;
-
-        QSignalSpy rowsInserted(&fetchModel, SIGNAL(rowsInserted(const QModelIndex &, int, int)));
-
         if (limit < 0) {
-            fetchModel.setQueryMode(EventModel::SyncQuery);
+            fetchModel.setQueryMode(EventModel::AsyncQuery);
         } else {
             fetchModel.setQueryMode(EventModel::StreamedAsyncQuery);
             fetchModel.setFirstChunkSize(limit);
             fetchModel.setChunkSize(limit);
         }
+        ModelProbe probe(&fetchModel);
 
-        QTime time;
-        time.start();
-        result = fetchModel.getEvents(group1.id());
+        AllocationCounter allocations;
+        probe.start();
+        QVERIFY(fetchModel.getEvents(GROUP_ID));
+        QVERIFY(probe.wait(TIMEOUT));
 
-        if(limit >= 0) {
-            while (time.elapsed() < 10000 && rowsInserted.isEmpty())
-            QCoreApplication::processEvents();
-        }
-
-        int elapsed = time.elapsed();
-        times << elapsed;
-        sum += elapsed;
-        qDebug("Time elapsed: %d ms", elapsed);
+        PerfSample sample;
+        sample.elapsed = probe.ready();
+        sample.firstChunk = probe.firstChunk();
+        sample.allocations = allocations.count();
+        samples << sample;
+        qDebug("Time elapsed: %d ms", sample.elapsed);
 
-        QVERIFY(result);
         QVERIFY(fetchModel.rowCount() > 0);
-
-        // With 1000 messages deleting model right away results in segfault
-        waitForIdle();
     }
 
-    if(logFile) {
-        QTextStream out(logFile);
-
-        out << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss") << ": "
-            << metaObject()->className() << "::" << QTest::currentTestFunction() << "("
-            << QTest::currentDataTag() << ", " << iterations << " iterations)"
-            << "\n";
-
-        for (int i = 0; i < times.size(); i++) {
-            out << times.at(i) << " ";
-        }
-        out << "\n";
-    }
-
-    qSort(times);
-    float median = 0.0;
-    if(iterations % 2 > 0) {
-        median = times[(int)(iterations / 2)];
-    } else {
-        median = (times[iterations / 2] + times[iterations / 2 - 1]) / 2.0f;
-    }
-
-    float mean = sum / (float)iterations;
-    int testSecs = startTime.secsTo(QDateTime::currentDateTime());
-
-    qDebug("##### Mean: %.1f; Median: %.1f; Test time: %dsec", mean, median, testSecs);
-
-    if(logFile) {
-        QTextStream out(logFile);
-        out << "Median average: " << (int)median << " ms. Test time: ";
-        if (testSecs > 3600) { out << (testSecs / 3600) << "h "; }
-        if (testSecs > 60) { out << ((testSecs % 3600) / 60) << "m "; }
-        out << ((testSecs % 3600) % 60) << "s\n";
-    }
+    reportSamples(logFile, metaObject()->className(), rows, samples);
 }
 
 void ConversationModelPerfTest::cleanupTestCase()
 {
-    deleteAll();
-    QTest::qWait(TIMEOUT);
-    waitForIdle();
+    SparqlBackend::setDefault(0);
+    delete backend;
 
     if(logFile) {
         logFile->close();
@@ -29,19 +29,21 @@
 
 using namespace CommHistory;
 
+class MemorySparqlBackend;
+
 class ConversationModelPerfTest : public QObject
 {
     Q_OBJECT
 
 private slots:
     void initTestCase();
-    void init();
     void getEvents_data();
     void getEvents();
     void cleanupTestCase();
 
 private:
     QFile *logFile;
+    MemorySparqlBackend *backend;
 };
 
 #endif
@@ -22,15 +22,32 @@
 
 #include <QtTest/QtTest>
 #include <QDateTime>
-#include <QDBusConnection>
 #include <QModelIndex>
-#include <cstdlib>
 #include "groupmodelperftest.h"
+#include "contactgroupmodel.h"
+#include "groupmanager.h"
+#include "groupobject.h"
+#include "memorysparqlbackend.h"
+#include "perfstats.h"
+#include "queryregistry.h"
 #include "common.h"
 
 using namespace CommHistory;
 
-const int TIMEOUT = 5000;
+const int TIMEOUT = 600000;
+
+namespace {
+
+// Feeds in-memory groups to ContactGroupModel without touching tracker.
+class FakeGroupManager : public GroupManager
+{
+public:
+    void emitAdded(GroupObject *group) { emit groupAdded(group); }
+    void emitUpdated(GroupObject *group) { emit groupUpdated(group); }
+    void emitDeleted(GroupObject *group) { emit groupDeleted(group); }
+};
+
+}
 
 void GroupModelPerfTest::initTestCase()
 {
@@ -40,186 +57,136 @@ void GroupModelPerfTest::initTestCase()
         logFile = 0;
     }
 
-    qsrand( QDateTime::currentDateTime().toTime_t() );
-}
-
-void GroupModelPerfTest::init()
-{
-    deleteAll();
-    QTest::qWait(TIMEOUT);
-    waitForIdle();
+    backend = new MemorySparqlBackend;
+    SparqlBackend::setDefault(backend);
+    QueryRegistry::instance()->setCacheSize(0);
 }
 
 void GroupModelPerfTest::getGroups_data()
 {
     QTest::addColumn<int>("groups");
-    QTest::addColumn<int>("messages");
 
-    QTest::newRow("10 groups, 1 message each") << 10 << 1;
-    QTest::newRow("10 groups, 10 messages each") << 10 << 10;
-    QTest::newRow("100 groups, 1 message each") << 100 << 1;
-    QTest::newRow("100 groups, 10 messages each") << 100 << 10;
+    QTest::newRow("1k groups") << 1000;
+    QTest::newRow("10k groups") << 10000;
+    QTest::newRow("100k groups") << 100000;
+    QTest::newRow("1M groups") << 1000000;
 }
 
 void GroupModelPerfTest::getGroups()
 {
-    qDebug() << __FUNCTION__;
-
-    QDateTime startTime = QDateTime::currentDateTime();
-
     QFETCH(int, groups);
-    QFETCH(int, messages);
 
-    int commitBatchSize = 75;
-    #ifdef PERF_BATCH_SIZE
-    commitBatchSize = PERF_BATCH_SIZE;
-    #endif
+    backend->clear();
+    backend->addTable(QLatin1String("commhistory:totalMessages"),
+                      MemorySparqlBackend::Groups, groups, groups);
 
-    GroupModel addModel;
-    QDateTime when = QDateTime::currentDateTime();
-    QList<Group> groupList;
+    int iterations = perfIterations(groups);
+    QList<PerfSample> samples;
 
-    qDebug() << __FUNCTION__ << "- Creating" << groups << "new contacts and groups";
+    qDebug() << __FUNCTION__ << "- Fetching" << groups << "groups."
+             << iterations << "iterations";
+    for(int i = 0; i < iterations; i++) {
+        GroupModel fetchModel;
+        fetchModel.setQueryMode(EventModel::AsyncQuery);
+        ModelProbe probe(&fetchModel);
 
-    int gi = 0;
-    while(gi < groups) {
-        gi++;
+        AllocationCounter allocations;
+        probe.start();
+        QVERIFY(fetchModel.getGroups());
+        QVERIFY(probe.wait(TIMEOUT));
 
-        QString phoneNumber = QString().setNum(qrand() % 10000000);
-        addTestContact(QString("Test Contact %1").arg(gi), phoneNumber);
+        PerfSample sample;
+        sample.elapsed = probe.ready();
+        sample.firstChunk = probe.firstChunk();
+        sample.allocations = allocations.count();
+        samples << sample;
+        qDebug("Time elapsed: %d ms", sample.elapsed);
 
-        Group grp;
-        grp.setLocalUid(ACCOUNT1);
-        QStringList uids;
-        uids << phoneNumber;
-        grp.setRemoteUids(uids);
+        QCOMPARE(fetchModel.rowCount(), groups);
+    }
 
-        QVERIFY(addModel.addGroup(grp));
-        groupList << grp;
+    reportSamples(logFile, metaObject()->className(), groups, samples);
+}
 
-        if(gi % commitBatchSize == 0 && gi < groups) {
-            qDebug() << __FUNCTION__ << "- adding" << commitBatchSize
-                << "groups (" << gi << "/" << groups << ")";
-            waitForIdle(5000);
-        }
-    }
-    qDebug() << __FUNCTION__ << "- adding rest of the groups ("
-             << gi << "/" << groups << ")";
-    waitForIdle(5000);
-    QTest::qWait(TIMEOUT);
-
-    qDebug() << __FUNCTION__ << "- Creating" << messages << "messages to each group";
-
-    EventModel eventModel;
-
-    gi = 0;
-    foreach (Group grp, groupList) {
-        gi++;
-        QList<Event> eventList;
-
-        for(int i = 0; i < messages; i++) {
-
-            Event e;
-            e.setType(Event::SMSEvent);
-            e.setDirection(qrand() % 2 ? Event::Inbound : Event::Outbound);
-            e.setGroupId(grp.id());
-            e.setStartTime(when.addSecs(i));
-            e.setEndTime(when.addSecs(i));
-            e.setLocalUid(ACCOUNT1);
-            e.setRemoteUid(grp.remoteUids().at(0));
-            e.setFreeText(randomMessage(qrand() % 49 + 1));  // Max 50 words / message
-            e.setIsDraft(false);
-            e.setIsMissedCall(false);
-
-            eventList << e;
-        }
-
-        QVERIFY(eventModel.addEvents(eventList, false));
-        qDebug() << __FUNCTION__ << "- adding" << messages << "messages ("
-                 << gi << "/" << groups << ")";
-        eventList.clear();
-        waitForIdle();
-    }
+void GroupModelPerfTest::contactGroups_data()
+{
+    QTest::addColumn<int>("groups");
 
-    int iterations = 10;
-    int sum = 0;
-    QList<int> times;
+    QTest::newRow("1000 groups") << 1000;
+    QTest::newRow("2000 groups") << 2000;
+    QTest::newRow("5000 groups") << 5000;
+}
 
-    #ifdef PERF_ITERATIONS
-    iterations = PERF_ITERATIONS;
-    #endif
+void GroupModelPerfTest::contactGroups()
+{
+    QFETCH(int, groups);
 
-    char *iterVar = getenv("PERF_ITERATIONS");
-    if (iterVar) {
-        int iters = QString::fromAscii(iterVar).toInt();
-        if (iters > 0) {
-            iterations = iters;
-        }
-    }
+    FakeGroupManager manager;
+    ContactGroupModel model;
+    model.setManager(&manager);
 
-    QTest::qWait(TIMEOUT);
+    // every contact has two conversations (e.g. SMS and IM), every
+    // fifth conversation is with two contacts
+    QDateTime when = QDateTime::currentDateTime();
+    QList<GroupObject*> objects;
+    for (int i = 0; i < groups; i++) {
+        Group group;
+        group.setId(i + 1);
+        group.setLocalUid(i % 2 ? ACCOUNT1 : RING_ACCOUNT);
+        group.setRemoteUids(QStringList() << QString::number(i / 2));
+        group.setEndTime(when.addSecs(i));
+        group.setTotalMessages(1);
+
+        QList<Event::Contact> contacts;
+        contacts << Event::Contact(i / 2 + 1, QString("Contact %1").arg(i / 2));
+        if (i % 5 == 4)
+            contacts << Event::Contact(i / 2 + 2, QString("Contact %1").arg(i / 2 + 1));
+        group.setContacts(contacts);
+
+        objects << new GroupObject(group, &manager);
+    }
 
-    qDebug() << __FUNCTION__ << "- Fetching groups." << iterations << "iterations";
-    for(int i = 0; i < iterations; i++) {
+    QTime time;
+    time.start();
+    foreach (GroupObject *object, objects)
+        manager.emitAdded(object);
+    int addTime = time.elapsed();
 
-        GroupModel fetchModel;
-        bool result = false;
+    int expectedRows = model.rowCount();
+    QVERIFY(expectedRows > 0);
+    QVERIFY(expectedRows < groups);
 
-        fetchModel.setQueryMode(EventModel::SyncQuery);
+    time.start();
+    foreach (GroupObject *object, objects)
+        manager.emitUpdated(object);
+    int updateTime = time.elapsed();
+    QCOMPARE(model.rowCount(), expectedRows);
 
-        QTime time;
-        time.start();
-        result = fetchModel.getGroups();
-        int elapsed = time.elapsed();
-        times << elapsed;
-        sum += elapsed;
-        qDebug("Time elapsed: %d ms", elapsed);
+    time.start();
+    foreach (GroupObject *object, objects)
+        manager.emitDeleted(object);
+    int deleteTime = time.elapsed();
+    QCOMPARE(model.rowCount(), 0);
 
-        QVERIFY(result);
-        QCOMPARE(fetchModel.rowCount(), groups);
-    }
+    qDebug("##### %d groups: add %d ms, update %d ms, delete %d ms",
+           groups, addTime, updateTime, deleteTime);
 
     if(logFile) {
         QTextStream out(logFile);
-
         out << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss") << ": "
             << metaObject()->className() << "::" << QTest::currentTestFunction() << "("
-            << QTest::currentDataTag() << ", " << iterations << " iterations)"
-            << "\n";
-
-        for (int i = 0; i < times.size(); i++) {
-            out << times.at(i) << " ";
-        }
-        out << "\n";
+            << QTest::currentDataTag() << ")\n"
+            << "add " << addTime << " ms, update " << updateTime
+            << " ms, delete " << deleteTime << " ms\n";
     }
 
-    qSort(times);
-    float median = 0.0;
-    if(iterations % 2 > 0) {
-        median = times[(int)(iterations / 2)];
-    } else {
-        median = (times[iterations / 2] + times[iterations / 2 - 1]) / 2.0f;
-    }
-
-    float mean = sum / (float)iterations;
-    int testSecs = startTime.secsTo(QDateTime::currentDateTime());
-
-    qDebug("##### Mean: %.1f; Median: %.1f; Test time: %dsec", mean, median, testSecs);
-
-    if(logFile) {
-        QTextStream out(logFile);
-        out << "Median average: " << (int)median << " ms. Test time: ";
-        if (testSecs > 3600) { out << (testSecs / 3600) << "h "; }
-        if (testSecs > 60) { out << ((testSecs % 3600) / 60) << "m "; }
-        out << ((testSecs % 3600) % 60) << "s\n";
-    }
+    qDeleteAll(objects);
 }
 
 void GroupModelPerfTest::cleanupTestCase()
 {
-    deleteAll();
-    QTest::qWait(TIMEOUT);
-    waitForIdle();
+    SparqlBackend::setDefault(0);
+    delete backend;
 
     if(logFile) {
         logFile->close();
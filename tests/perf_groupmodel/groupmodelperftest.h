@@ -30,6 +30,7 @@
 using namespace CommHistory;
 
 class QModelIndex;
+class MemorySparqlBackend;
 
 class GroupModelPerfTest : public QObject
 {
@@ -37,13 +38,15 @@ class GroupModelPerfTest : public QObject
 
 private slots:
     void initTestCase();
-    void init();
     void getGroups_data();
     void getGroups();
+    void contactGroups_data();
+    void contactGroups();
     void cleanupTestCase();
 
 private:
     QFile *logFile;
+    MemorySparqlBackend *backend;
 };
 
 #endif
@@ -0,0 +1,258 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <math.h>
+#include <stdlib.h>
+
+#include "searchindexperftest.h"
+#include "searchindex.h"
+#include "sparqlbackend.h"
+#include "memorysparqlbackend.h"
+#include "messagepart.h"
+#include "event.h"
+
+using namespace CommHistory;
+
+namespace {
+
+const int MESSAGE_COUNT = 200000;
+const int GROUP_COUNT = 1000;
+const int WORD_COUNT = 20000;
+// searches per measurement, the median is reported
+const int SEARCH_ROUNDS = 50;
+// search-as-you-type over 200k messages answers in tens of milliseconds
+const int MAX_SEARCH_USEC = 50000;
+
+QString randomWord()
+{
+    QString word;
+    int length = 3 + qrand() % 8;
+    for (int i = 0; i < length; i++)
+        word.append(QChar('a' + qrand() % 26));
+    return word;
+}
+
+// Zipf-like: the first words of the vocabulary are by far the most
+// common, as in real messages
+const QString& pickWord(const QStringList &words)
+{
+    double r = (double)qrand() / RAND_MAX;
+    return words.at(qMin((int)(pow(r, 4) * words.size()), words.size() - 1));
+}
+
+QString remoteUid(int group)
+{
+    return QString("+35850%1").arg(group, 7, 10, QChar('0'));
+}
+
+Event randomMessage(int id, const QStringList &words)
+{
+    QString text;
+    int length = 3 + qrand() % 20;
+    for (int i = 0; i < length; i++) {
+        if (i)
+            text.append(' ');
+        text.append(pickWord(words));
+    }
+
+    Event event;
+    event.setId(id);
+    event.setGroupId(id % GROUP_COUNT + 1);
+    event.setRemoteUid(remoteUid(event.groupId()));
+    event.setStartTime(QDateTime::fromTime_t(1300000000 + id * 60));
+
+    // every tenth message is an MMS with a subject and a text part
+    if (id % 10 == 0) {
+        MessagePart part;
+        part.setContentType("text/plain");
+        part.setPlainTextContent(text);
+        event.setType(Event::MMSEvent);
+        event.setSubject(pickWord(words));
+        event.setMessageParts(QList<MessagePart>() << part);
+    } else {
+        event.setType(id % 3 ? Event::SMSEvent : Event::IMEvent);
+        event.setFreeText(text);
+    }
+
+    return event;
+}
+
+int median(QList<qint64> &values)
+{
+    qSort(values);
+    return values.at(values.size() / 2);
+}
+
+}
+
+void SearchIndexPerfTest::initTestCase()
+{
+    logFile = new QFile("libcommhistory-performance-test.log");
+    if(!logFile->open(QIODevice::Append)) {
+        qDebug() << "!!!! Failed to open log file !!!!";
+        logFile = 0;
+    }
+
+    qsrand(1234);
+    for (int i = 0; i < WORD_COUNT; i++)
+        words << randomWord();
+
+    // no tables: loading reads an empty store, the messages are added
+    // below the way TrackerIO hands over committed events
+    backend = new MemorySparqlBackend;
+    SparqlBackend::setDefault(backend);
+
+    index = new SearchIndex;
+    QVERIFY(index->load());
+
+    QElapsedTimer timer;
+    timer.start();
+    QList<Event> batch;
+    for (int id = 1; id <= MESSAGE_COUNT; id++) {
+        batch << randomMessage(id, words);
+        if (batch.size() == 1000) {
+            index->addEvents(batch);
+            batch.clear();
+        }
+    }
+    index->addEvents(batch);
+    qint64 elapsed = timer.elapsed();
+
+    QCOMPARE(index->messageCount(), MESSAGE_COUNT);
+
+    qDebug("##### indexed %d messages, %d tokens: %lld ms",
+           index->messageCount(), index->tokenCount(), elapsed);
+
+    if (logFile) {
+        QTextStream out(logFile);
+        out << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss") << ": "
+            << metaObject()->className() << "::" << QTest::currentTestFunction() << "\n"
+            << "indexed " << index->messageCount() << " messages, "
+            << index->tokenCount() << " tokens: " << elapsed << " ms\n";
+    }
+}
+
+void SearchIndexPerfTest::search_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("groupId");
+    QTest::addColumn<QStringList>("remoteUids");
+    QTest::addColumn<int>("limit");
+
+    // words[0] is in about a third of the messages, words[2000] in a few
+    // hundred and the last ones in almost none
+    QTest::newRow("common word") << words.at(0) + ' ' << -1 << QStringList() << 0;
+    QTest::newRow("common word, first page") << words.at(0) + ' ' << -1 << QStringList() << 50;
+    QTest::newRow("medium word") << words.at(2000) + ' ' << -1 << QStringList() << 50;
+    QTest::newRow("rare word") << words.last() + ' ' << -1 << QStringList() << 50;
+    QTest::newRow("two common words")
+        << words.at(0) + ' ' + words.at(1) + ' ' << -1 << QStringList() << 50;
+    QTest::newRow("common and rare word")
+        << words.at(0) + ' ' + words.at(WORD_COUNT / 2) + ' ' << -1 << QStringList() << 50;
+    QTest::newRow("two letter prefix") << words.at(5).left(2) << -1 << QStringList() << 50;
+    QTest::newRow("three letter prefix") << words.at(5).left(3) << -1 << QStringList() << 50;
+    QTest::newRow("word and prefix")
+        << words.at(0) + ' ' + words.at(5).left(3) << -1 << QStringList() << 50;
+    QTest::newRow("common word in group") << words.at(0) + ' ' << 7 << QStringList() << 50;
+    QTest::newRow("common word with contact")
+        << words.at(0) + ' ' << -1 << (QStringList() << remoteUid(7)) << 50;
+}
+
+void SearchIndexPerfTest::search()
+{
+    QFETCH(QString, text);
+    QFETCH(int, groupId);
+    QFETCH(QStringList, remoteUids);
+    QFETCH(int, limit);
+
+    QList<qint64> times;
+    int total = 0;
+    int returned = 0;
+    for (int i = 0; i < SEARCH_ROUNDS; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        QList<SearchIndex::Match> matches =
+            index->search(text, groupId, remoteUids, 0, limit, &total);
+        times << timer.nsecsElapsed() / 1000;
+        returned = matches.size();
+    }
+
+    int usec = median(times);
+    qDebug("##### %d messages, %d matches (%d returned): median %d us",
+           index->messageCount(), total, returned, usec);
+
+    if (logFile) {
+        QTextStream out(logFile);
+        out << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss") << ": "
+            << metaObject()->className() << "::" << QTest::currentTestFunction() << "("
+            << QTest::currentDataTag() << ", " << SEARCH_ROUNDS << " iterations)\n"
+            << "Median: " << usec << " us, " << total << " matches\n";
+    }
+
+    QVERIFY2(usec < MAX_SEARCH_USEC,
+             qPrintable(QString("median %1 us, limit %2 us").arg(usec).arg(MAX_SEARCH_USEC)));
+}
+
+void SearchIndexPerfTest::update()
+{
+    // incremental upkeep: replace the text of existing messages
+    QList<Event> updates;
+    for (int i = 0; i < 1000; i++) {
+        Event event;
+        event.setId(1 + qrand() % MESSAGE_COUNT);
+        event.setFreeText(pickWord(words) + ' ' + pickWord(words));
+        updates << event;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    index->updateEvents(updates);
+    qint64 elapsed = timer.nsecsElapsed() / 1000;
+
+    QCOMPARE(index->messageCount(), MESSAGE_COUNT);
+    qDebug("##### %d updates: %lld us", updates.size(), elapsed);
+
+    if (logFile) {
+        QTextStream out(logFile);
+        out << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss") << ": "
+            << metaObject()->className() << "::" << QTest::currentTestFunction() << "\n"
+            << updates.size() << " updates: " << elapsed << " us\n";
+    }
+}
+
+void SearchIndexPerfTest::cleanupTestCase()
+{
+    delete index;
+    index = 0;
+    SparqlBackend::setDefault(0);
+    delete backend;
+
+    if(logFile) {
+        logFile->close();
+        delete logFile;
+        logFile = 0;
+    }
+}
+
+QTEST_MAIN(SearchIndexPerfTest)
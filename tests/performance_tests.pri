@@ -28,8 +28,12 @@ DEPENDPATH  += $${INCLUDEPATH}
 
 CONFIG += qtsparql qtcontacts_extensions_tracker
 
-SOURCES += ../common.cpp
-HEADERS += ../common.h
+SOURCES += ../common.cpp \
+           ../memorysparqlbackend.cpp \
+           ../perfstats.cpp
+HEADERS += ../common.h \
+           ../memorysparqlbackend.h \
+           ../perfstats.h
 
 DEFINES += PERF_ITERATIONS=10
 DEFINES += PERF_BATCH_SIZE=25
@@ -25,7 +25,9 @@
 TEMPLATE = subdirs
 SUBDIRS = perf_callmodel \
 		  perf_conversationmodel \
-		  perf_groupmodel
+		  perf_groupmodel \
+		  perf_commonutils \
+		  perf_searchindex
 CONFIG += ordered
 
 # make sure the destination path exists
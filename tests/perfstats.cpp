@@ -0,0 +1,208 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QAbstractItemModel>
+#include <QEventLoop>
+#include <QTextStream>
+#include <cstdlib>
+
+#include "perfstats.h"
+
+namespace {
+volatile quint64 allocations = 0;
+
+// the rows/s figures must not be read as tracker query cost
+const char BACKEND_NOTE[] =
+    "MemorySparqlBackend: SPARQL is not interpreted (filters and ordering "
+    "are ignored), rows/s covers decoding and model updates only";
+}
+
+// count every heap allocation of the process, the libc implementation
+// does the work
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    __sync_fetch_and_add(&allocations, 1);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    __sync_fetch_and_add(&allocations, 1);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __sync_fetch_and_add(&allocations, 1);
+    return __libc_realloc(ptr, size);
+}
+
+}
+
+AllocationCounter::AllocationCounter()
+    : m_start(total())
+{
+}
+
+void AllocationCounter::restart()
+{
+    m_start = total();
+}
+
+quint64 AllocationCounter::count() const
+{
+    return total() - m_start;
+}
+
+quint64 AllocationCounter::total()
+{
+    return __sync_fetch_and_add(&allocations, 0);
+}
+
+ModelProbe::ModelProbe(QAbstractItemModel *model)
+    : m_firstChunk(-1)
+    , m_ready(-1)
+{
+    connect(model, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
+            this, SLOT(rowsInsertedSlot()));
+    connect(model, SIGNAL(modelReady(bool)),
+            this, SLOT(modelReadySlot()));
+}
+
+void ModelProbe::start()
+{
+    m_firstChunk = -1;
+    m_ready = -1;
+    m_time.start();
+}
+
+bool ModelProbe::wait(int timeout)
+{
+    QTime waited;
+    waited.start();
+    while (m_ready < 0 && waited.elapsed() < timeout)
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+
+    return m_ready >= 0;
+}
+
+int ModelProbe::firstChunk() const
+{
+    return m_firstChunk;
+}
+
+int ModelProbe::ready() const
+{
+    return m_ready;
+}
+
+void ModelProbe::rowsInsertedSlot()
+{
+    if (m_firstChunk < 0)
+        m_firstChunk = m_time.elapsed();
+}
+
+void ModelProbe::modelReadySlot()
+{
+    if (m_ready < 0)
+        m_ready = m_time.elapsed();
+}
+
+int perfIterations(int rows)
+{
+    int iterations = 10;
+
+    #ifdef PERF_ITERATIONS
+    iterations = PERF_ITERATIONS;
+    #endif
+
+    char *iterVar = getenv("PERF_ITERATIONS");
+    if (iterVar) {
+        int iters = QString::fromAscii(iterVar).toInt();
+        if (iters > 0) {
+            iterations = iters;
+        }
+    }
+
+    // keep runs with large tables to a few minutes
+    if (rows > 10000)
+        iterations = qMax(1, iterations * 10000 / rows);
+
+    return iterations;
+}
+
+void reportSamples(QFile *logFile,
+                   const char *className,
+                   int rows,
+                   const QList<PerfSample> &samples)
+{
+    if (samples.isEmpty())
+        return;
+
+    QList<int> times;
+    QList<int> firstChunks;
+    QList<quint64> allocs;
+    foreach (const PerfSample &sample, samples) {
+        times << sample.elapsed;
+        firstChunks << sample.firstChunk;
+        allocs << sample.allocations;
+    }
+
+    qSort(times);
+    qSort(firstChunks);
+    qSort(allocs);
+
+    int median = times.at(times.size() / 2);
+    int firstChunk = firstChunks.at(firstChunks.size() / 2);
+    double rowsPerSec = rows * 1000.0 / qMax(median, 1);
+    double allocsPerRow = (double)allocs.at(allocs.size() / 2) / qMax(rows, 1);
+
+    qDebug("##### %d rows: median %d ms, %.0f rows/s, first chunk %d ms, "
+           "%.1f allocations/event",
+           rows, median, rowsPerSec, firstChunk, allocsPerRow);
+    qDebug("##### %s", BACKEND_NOTE);
+
+    if(logFile) {
+        QTextStream out(logFile);
+
+        out << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss") << ": "
+            << className << "::" << QTest::currentTestFunction() << "("
+            << QTest::currentDataTag() << ", " << samples.size() << " iterations)"
+            << "\n";
+
+        foreach (const PerfSample &sample, samples)
+            out << sample.elapsed << " ";
+        out << "\n";
+
+        out << "Median: " << median << " ms, " << (qint64)rowsPerSec << " rows/s, "
+            << "first chunk " << firstChunk << " ms, "
+            << QString::number(allocsPerRow, 'f', 1) << " allocations/event\n"
+            << BACKEND_NOTE << "\n";
+    }
+}
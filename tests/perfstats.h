@@ -0,0 +1,110 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** Contact: Reto Zingg <reto.zingg@nokia.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef PERFSTATS_H
+#define PERFSTATS_H
+
+#include <QObject>
+#include <QTime>
+#include <QList>
+
+class QAbstractItemModel;
+class QFile;
+
+/*!
+ * Heap allocations made by all threads of the process since construction
+ * or restart(). malloc(), calloc() and realloc() are counted.
+ */
+class AllocationCounter
+{
+public:
+    AllocationCounter();
+
+    void restart();
+    quint64 count() const;
+
+    static quint64 total();
+
+private:
+    quint64 m_start;
+};
+
+/*!
+ * Times a model load: the first rowsInserted() and modelReady().
+ */
+class ModelProbe : public QObject
+{
+    Q_OBJECT
+
+public:
+    ModelProbe(QAbstractItemModel *model);
+
+    void start();
+
+    /*!
+     * Process events until modelReady() or timeout ms. Returns true if the
+     * model became ready.
+     */
+    bool wait(int timeout);
+
+    /*! ms from start() to the first inserted rows, -1 if none yet. */
+    int firstChunk() const;
+    /*! ms from start() to modelReady(), -1 if not ready yet. */
+    int ready() const;
+
+private Q_SLOTS:
+    void rowsInsertedSlot();
+    void modelReadySlot();
+
+private:
+    QTime m_time;
+    int m_firstChunk;
+    int m_ready;
+};
+
+struct PerfSample {
+    PerfSample() : elapsed(0), firstChunk(-1), allocations(0) {}
+
+    int elapsed;
+    int firstChunk;
+    quint64 allocations;
+};
+
+/*!
+ * Iterations to run for rows: PERF_ITERATIONS (from the environment or
+ * the build), fewer for large tables.
+ */
+int perfIterations(int rows);
+
+/*!
+ * Write the samples of the current test row to qDebug and logFile:
+ * times, median rows/s, median time to first chunk and allocations per
+ * row. The rows are served by MemorySparqlBackend, which does not
+ * interpret SPARQL, so the output says that rows/s leaves out the cost
+ * of the query itself.
+ */
+void reportSamples(QFile *logFile,
+                   const char *className,
+                   int rows,
+                   const QList<PerfSample> &samples);
+
+#endif
@@ -31,13 +31,16 @@ SUBDIRS = model_example \
           ut_conversationmodel \
           ut_draftmodel \
           ut_groupmodel \
+          ut_groupmanager \
           ut_outboxmodel \
           ut_smsinboxmodel \
           ut_syncmodel \
           ut_unreadeventsmodel \
           ut_classzerosmsmodel \
           ut_singleeventmodel \
-          ut_eventsquery
+          ut_searchmodel \
+          ut_eventsquery \
+          ut_updatequery
 CONFIG += ordered
 
 # make sure the destination path exists
@@ -36,6 +36,12 @@
 #include "event.h"
 #include "common.h"
 #include "trackerio.h"
+#include "updatesemitter.h"
+#include "updatesreceiver.h"
+#include "committingtransaction.h"
+#include "queryregistry.h"
+#include "telemetry.h"
+#include "constants.h"
 
 #include "modelwatcher.h"
 
@@ -45,6 +51,9 @@ QEventLoop loop;
 
 int groupUpdated = 0;
 int groupDeleted = 0;
+int batchCount = 0;
+QList<Event> batchAdded, batchUpdated;
+QList<int> batchDeleted;
 
 ModelWatcher watcher;
 
@@ -62,6 +71,25 @@ void EventModelTest::groupsDeletedSlot(const QList<int> &groupIds)
         groupDeleted = groupIds.first();
 }
 
+void EventModelTest::updatesBatchedSlot(const QList<CommHistory::Event> &addedEvents,
+                                        const QList<CommHistory::Event> &updatedEvents,
+                                        const QList<int> &deletedEventIds,
+                                        const QList<CommHistory::Group> &addedGroups,
+                                        const QList<int> &updatedGroupIds,
+                                        const QList<CommHistory::Group> &updatedGroups,
+                                        const QList<int> &deletedGroupIds)
+{
+    Q_UNUSED(addedGroups);
+    Q_UNUSED(updatedGroupIds);
+    Q_UNUSED(updatedGroups);
+    Q_UNUSED(deletedGroupIds);
+
+    batchCount++;
+    batchAdded = addedEvents;
+    batchUpdated = updatedEvents;
+    batchDeleted = deletedEventIds;
+}
+
 void EventModelTest::initTestCase()
 {
     deleteAll();
@@ -237,6 +265,8 @@ void EventModelTest::testAddEvents()
     QCOMPARE(watcher.committedCount(), 2);
     QVERIFY(compareEvents(watcher.lastAdded()[0], e1));
     QVERIFY(compareEvents(watcher.lastAdded()[1], e2));
+    QVERIFY(events[0].id() != -1);
+    QVERIFY(events[1].id() != -1);
 
     e3.setGroupId(group1.id());
     e3.setType(Event::IMEvent);
@@ -256,6 +286,53 @@ void EventModelTest::testAddEvents()
     QVERIFY(compareEvents(watcher.lastAdded()[0], e3));
 }
 
+void EventModelTest::testAddEventsBatch()
+{
+    EventModel model;
+    watcher.setModel(&model);
+
+    // more than one tracker update worth of events, with repeating
+    // and unique remote uids
+    QList<Event> events;
+    for (int i = 0; i < 60; i++) {
+        Event e;
+        e.setGroupId(group1.id());
+        e.setType(Event::SMSEvent);
+        e.setDirection(i % 2 ? Event::Inbound : Event::Outbound);
+        e.setStartTime(QDateTime::fromString("2010-01-09T13:37:00Z", Qt::ISODate).addSecs(i));
+        e.setEndTime(e.startTime());
+        e.setLocalUid(RING_ACCOUNT);
+        e.setRemoteUid(i % 3 ? QString("+3581234567") : QString("+35850%1").arg(i));
+        e.setFreeText(QString("addEventsBatch %1").arg(i));
+        events << e;
+    }
+
+    QVERIFY(model.addEvents(events));
+    watcher.waitForSignals(60, 60);
+    QCOMPARE(watcher.committedCount(), 60);
+
+    foreach (Event e, events) {
+        QVERIFY(e.id() != -1);
+        Event event;
+        QVERIFY(model.trackerIO().getEvent(e.id(), event));
+        QVERIFY(compareEvents(event, e));
+    }
+
+    // unsupported events are reported, the rest are added
+    QList<Event> mixed;
+    mixed << events.first() << Event() << events.last();
+    mixed[0].setId(-1);
+    mixed[2].setId(-1);
+    QVERIFY(!model.trackerIO().addEvents(mixed));
+    QVERIFY(mixed[0].id() != -1);
+    QCOMPARE(mixed[1].id(), -1);
+    QVERIFY(mixed[2].id() != -1);
+
+    Event event;
+    QVERIFY(model.trackerIO().getEvent(mixed[2].id(), event));
+    QVERIFY(compareEvents(event, mixed[2]));
+}
+
 void EventModelTest::testModifyEvent()
 {
     EventModel model;
@@ -1909,6 +1986,388 @@ void EventModelTest::testAddNonDigitRemoteId()
     QVERIFY(compareEvents(event, tevent));
 }
 
+void EventModelTest::testBatchedUpdates()
+{
+    QSharedPointer<UpdatesEmitter> emitter = UpdatesEmitter::instance();
+    emitter->setCoalescingInterval(100);
+    emitter->resetStatistics();
+
+    // the window is sent as one signal
+    QSharedPointer<UpdatesReceiver> receiver = UpdatesReceiver::instance();
+    QVERIFY(connect(receiver.data(),
+                    SIGNAL(updatesBatched(const QList<CommHistory::Event> &,
+                                          const QList<CommHistory::Event> &,
+                                          const QList<int> &,
+                                          const QList<CommHistory::Group> &,
+                                          const QList<int> &,
+                                          const QList<CommHistory::Group> &,
+                                          const QList<int> &)),
+                    this,
+                    SLOT(updatesBatchedSlot(const QList<CommHistory::Event> &,
+                                            const QList<CommHistory::Event> &,
+                                            const QList<int> &,
+                                            const QList<CommHistory::Group> &,
+                                            const QList<int> &,
+                                            const QList<CommHistory::Group> &,
+                                            const QList<int> &))));
+    batchCount = 0;
+
+    EventModel model;
+    model.setBatchedUpdates(true);
+    QVERIFY(model.batchedUpdates());
+
+    Event added;
+    added.setId(900001);
+    added.setType(Event::IMEvent);
+    added.setFreeText("batched add");
+
+    Event read;
+    read.setId(900002);
+    read.setIsRead(true);
+    Event text;
+    text.setId(900002);
+    text.setFreeText("batched update");
+
+    Event removed;
+    removed.setId(900003);
+    removed.setType(Event::SMSEvent);
+
+    // add + update merge, double update merges, add + delete cancels out
+    emit emitter->eventsAdded(QList<Event>() << added << removed);
+    emit emitter->eventsUpdated(QList<Event>() << read);
+    emit emitter->eventsUpdated(QList<Event>() << text);
+    emit emitter->eventsUpdated(QList<Event>() << read);
+    text.setId(added.id());
+    emit emitter->eventsUpdated(QList<Event>() << text);
+    emit emitter->eventDeleted(removed.id());
+    // deletions of a window travel together too
+    emit emitter->eventDeleted(900010);
+    emit emitter->eventDeleted(900011);
+    emit emitter->eventDeleted(900010);
+
+    QCOMPARE(emitter->statistics().queueDepth, 4);
+    QCOMPARE(emitter->statistics().queued, quint64(10));
+    QCOMPARE(emitter->statistics().merged, quint64(6));
+
+    QTime timer;
+    timer.start();
+    while (!batchCount && timer.elapsed() < WAIT_SIGNAL_TIMEOUT)
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+
+    QCOMPARE(batchCount, 1);
+    QCOMPARE(emitter->statistics().batches, quint64(1));
+    QCOMPARE(emitter->statistics().queueDepth, 0);
+
+    QCOMPARE(batchAdded.size(), 1);
+    QCOMPARE(batchAdded.first().id(), added.id());
+    QCOMPARE(batchAdded.first().freeText(), QString("batched update"));
+    QCOMPARE(batchUpdated.size(), 1);
+    QCOMPARE(batchUpdated.first().id(), 900002);
+    QVERIFY(batchUpdated.first().isRead());
+    QCOMPARE(batchUpdated.first().freeText(), QString("batched update"));
+    QCOMPARE(batchDeleted, QList<int>() << 900010 << 900011);
+
+    // without coalescing each notification is a window of its own
+    emitter->setCoalescingInterval(-1);
+    batchCount = 0;
+    emit emitter->eventDeleted(900012);
+    QCOMPARE(emitter->statistics().batches, quint64(2));
+    QCOMPARE(emitter->statistics().queueDepth, 0);
+
+    timer.start();
+    while (!batchCount && timer.elapsed() < WAIT_SIGNAL_TIMEOUT)
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+    QCOMPARE(batchCount, 1);
+    QVERIFY(batchAdded.isEmpty());
+    QCOMPARE(batchDeleted, QList<int>() << 900012);
+
+    emitter->setCoalescingInterval(0);
+    receiver->disconnect(this);
+}
+
+void EventModelTest::testCompactSerialization()
+{
+    Event full;
+    full.setId(1234);
+    full.setType(Event::MMSEvent);
+    full.setDirection(Event::Inbound);
+    full.setStartTime(QDateTime::fromString("2011-05-06T12:00:00Z", Qt::ISODate));
+    full.setEndTime(QDateTime::fromString("2011-05-06T12:00:01Z", Qt::ISODate));
+    full.setLocalUid("/org/freedesktop/Telepathy/Account/ring/tel/ring");
+    full.setRemoteUid("+358501234567");
+    full.setFreeText("compact");
+    full.setSubject("subject");
+    full.setCcList(QStringList() << "cc1" << "cc2");
+    full.setFromVCard("card.vcf", "Card");
+    MessagePart part;
+    part.setContentId("text_slide1");
+    part.setContentType("text/plain");
+    part.setPlainTextContent("hello");
+    full.setMessageParts(QList<MessagePart>() << part);
+
+    QByteArray fullData;
+    {
+        QDataStream out(&fullData, QIODevice::WriteOnly);
+        out << full;
+    }
+    Event fullCopy;
+    {
+        QDataStream in(fullData);
+        in >> fullCopy;
+    }
+    QVERIFY(compareEvents(fullCopy, full));
+    QCOMPARE(fullCopy.validProperties(), full.validProperties());
+    QCOMPARE(fullCopy.fromVCardLabel(), QString("Card"));
+    QCOMPARE(fullCopy.messageParts().size(), 1);
+    QCOMPARE(fullCopy.messageParts().first().plainTextContent(), QString("hello"));
+    QVERIFY(fullCopy.modifiedProperties().isEmpty());
+
+    // status update: only id and isRead travel
+    Event status;
+    status.setId(full.id());
+    status.setIsRead(true);
+
+    QByteArray statusData;
+    {
+        QDataStream out(&statusData, QIODevice::WriteOnly);
+        out << status;
+    }
+    QVERIFY(statusData.size() < fullData.size() / 4);
+
+    Event partial;
+    {
+        QDataStream in(statusData);
+        in >> partial;
+    }
+    QCOMPARE(partial.id(), full.id());
+    QVERIFY(partial.isRead());
+    QCOMPARE(partial.validProperties(),
+             Event::PropertySet() << Event::Id << Event::IsRead);
+
+    // merging keeps the cached fields
+    fullCopy.copyValidProperties(partial);
+    QVERIFY(fullCopy.isRead());
+    QCOMPARE(fullCopy.freeText(), full.freeText());
+    QCOMPARE(fullCopy.ccList(), full.ccList());
+}
+
+void EventModelTest::testMergedCommits()
+{
+    EventModel model;
+    watcher.setModel(&model);
+    TrackerIO &tracker = model.trackerIO();
+
+    QList<int> ids;
+    for (int i = 0; i < 4; i++) {
+        ids << addTestEvent(model, Event::IMEvent, Event::Inbound, ACCOUNT1,
+                            group1.id(), QString("merge %1").arg(i));
+        watcher.waitForSignals();
+    }
+
+    tracker.resetCommitStatistics();
+
+    // the first commit starts right away, the rest queue up behind it
+    // and have no callbacks, so they run as one update
+    QList<QSignalSpy *> spies;
+    foreach (int id, ids) {
+        tracker.transaction();
+        QVERIFY(tracker.markAsRead(QList<int>() << id));
+        CommittingTransaction *t = tracker.commit();
+        QVERIFY(t);
+        spies << new QSignalSpy(t, SIGNAL(finished()));
+    }
+
+    foreach (QSignalSpy *spy, spies) {
+        if (spy->isEmpty())
+            QVERIFY(waitSignal(*spy));
+        QCOMPARE(spy->count(), 1);
+    }
+    qDeleteAll(spies);
+
+    TrackerIO::CommitStatistics stats = tracker.commitStatistics();
+    QCOMPARE(stats.transactions, quint64(ids.size()));
+    QCOMPARE(stats.updates + stats.merged, quint64(ids.size()));
+    QVERIFY(stats.merged > 0);
+    QVERIFY(stats.mergeRatio() > 1.0);
+    QVERIFY(stats.maxQueueDepth > 1);
+    QCOMPARE(stats.queueDepth, 0);
+
+    foreach (int id, ids) {
+        Event event;
+        QVERIFY(tracker.getEvent(id, event));
+        QVERIFY(event.isRead());
+    }
+}
+
+void EventModelTest::testParallelDecoding()
+{
+    ConversationModel model;
+    model.enableContactChanges(false);
+    model.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(model.getEvents(group1.id()));
+    QVERIFY(model.rowCount() > 0);
+
+    // two models decoding on the shared pool at the same time, one of
+    // them preferred; both must get the rows in query order
+    QThread modelThread;
+    modelThread.start();
+
+    ConversationModel background;
+    background.enableContactChanges(false);
+    background.setBackgroundThread(&modelThread);
+    background.setQueryMode(EventModel::AsyncQuery);
+
+    ConversationModel visible;
+    visible.enableContactChanges(false);
+    visible.setQueryMode(EventModel::AsyncQuery);
+    visible.setQueryPriority(1);
+    QCOMPARE(visible.queryPriority(), 1);
+
+    QSignalSpy backgroundReady(&background, SIGNAL(modelReady(bool)));
+    QSignalSpy visibleReady(&visible, SIGNAL(modelReady(bool)));
+    QVERIFY(background.getEvents(group1.id()));
+    QVERIFY(visible.getEvents(group1.id()));
+
+    QVERIFY(waitSignal(visibleReady));
+    QVERIFY(visibleReady.first().at(0).toBool());
+    if (backgroundReady.isEmpty())
+        QVERIFY(waitSignal(backgroundReady));
+    QVERIFY(backgroundReady.first().at(0).toBool());
+
+    QCOMPARE(visible.rowCount(), model.rowCount());
+    QCOMPARE(background.rowCount(), model.rowCount());
+    for (int i = 0; i < model.rowCount(); i++) {
+        Event event = model.index(i, 0).data(Qt::UserRole).value<Event>();
+        Event visibleEvent = visible.index(i, 0).data(Qt::UserRole).value<Event>();
+        Event backgroundEvent = background.index(i, 0).data(Qt::UserRole).value<Event>();
+        QVERIFY(compareEvents(event, visibleEvent));
+        QVERIFY(compareEvents(event, backgroundEvent));
+    }
+
+    modelThread.quit();
+    modelThread.wait(3000);
+}
+
+void EventModelTest::testSharedQueries()
+{
+    QueryRegistry *registry = QueryRegistry::instance();
+    registry->invalidate();
+    registry->resetStatistics();
+
+    // identical queries issued together run once
+    QList<ConversationModel *> models;
+    QList<QSignalSpy *> spies;
+    for (int i = 0; i < 3; i++) {
+        ConversationModel *model = new ConversationModel;
+        model->enableContactChanges(false);
+        model->setQueryMode(EventModel::AsyncQuery);
+        spies << new QSignalSpy(model, SIGNAL(modelReady(bool)));
+        QVERIFY(model->getEvents(group1.id()));
+        models << model;
+    }
+
+    foreach (QSignalSpy *spy, spies) {
+        if (spy->isEmpty())
+            QVERIFY(waitSignal(*spy));
+        QVERIFY(spy->first().at(0).toBool());
+    }
+    qDeleteAll(spies);
+    spies.clear();
+
+    QueryRegistry::Statistics stats = registry->statistics();
+    QCOMPARE(stats.requests, quint64(3));
+    QCOMPARE(stats.joined + stats.cacheHits, quint64(2));
+    QCOMPARE(stats.cachedQueries, 1);
+
+    ConversationModel *first = models.first();
+    QVERIFY(first->rowCount() > 0);
+    foreach (ConversationModel *model, models) {
+        QCOMPARE(model->rowCount(), first->rowCount());
+        for (int i = 0; i < first->rowCount(); i++) {
+            Event e1 = first->index(i, 0).data(Qt::UserRole).value<Event>();
+            Event e2 = model->index(i, 0).data(Qt::UserRole).value<Event>();
+            QVERIFY(compareEvents(e1, e2));
+        }
+    }
+
+    // a later request is served from the cache
+    ConversationModel cached;
+    cached.enableContactChanges(false);
+    cached.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(cached.getEvents(group1.id()));
+    QCOMPARE(cached.rowCount(), first->rowCount());
+    QCOMPARE(registry->statistics().cacheHits, stats.cacheHits + 1);
+
+    // a change drops the cache and the new event shows up
+    watcher.setModel(first);
+    addTestEvent(*first, Event::IMEvent, Event::Inbound, ACCOUNT1,
+                 group1.id(), "shared query");
+    watcher.waitForSignals();
+    QVERIFY(registry->statistics().invalidations > stats.invalidations);
+    QCOMPARE(registry->statistics().cachedQueries, 0);
+
+    ConversationModel fresh;
+    fresh.enableContactChanges(false);
+    fresh.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(fresh.getEvents(group1.id()));
+    QCOMPARE(fresh.rowCount(), cached.rowCount() + 1);
+
+    qDeleteAll(models);
+}
+
+void EventModelTest::testTelemetry()
+{
+    Telemetry *telemetry = Telemetry::instance();
+    Telemetry::setEnabled(true);
+    telemetry->reset();
+    QueryRegistry::instance()->invalidate();
+
+    ConversationModel model;
+    model.enableContactChanges(false);
+    model.setQueryMode(EventModel::AsyncQuery);
+    QSignalSpy ready(&model, SIGNAL(modelReady(bool)));
+    QVERIFY(model.getEvents(group1.id()));
+    QVERIFY(waitSignal(ready));
+    QVERIFY(model.rowCount() > 0);
+
+    quint64 runs = 0;
+    quint64 rows = 0;
+    foreach (const Telemetry::QueryStatistics &stats, telemetry->queryStatistics()) {
+        if (stats.type == QLatin1String("events")) {
+            runs += stats.queries;
+            rows += stats.rows;
+        }
+    }
+    QVERIFY(runs > 0);
+    QVERIFY(rows >= quint64(model.rowCount()));
+
+    watcher.setModel(&model);
+    addTestEvent(model, Event::IMEvent, Event::Inbound, ACCOUNT1,
+                 group1.id(), "telemetry");
+    watcher.waitForSignals();
+
+    Telemetry::TransactionStatistics transactions = telemetry->transactionStatistics();
+    QVERIFY(transactions.commits > 0);
+    QVERIFY(transactions.queries >= transactions.commits);
+    QCOMPARE(transactions.commit.count, transactions.commits);
+
+    bool found = false;
+    foreach (const Telemetry::ModelStatistics &stats, telemetry->modelStatistics()) {
+        if (stats.model == QLatin1String("CommHistory::ConversationModel")) {
+            found = true;
+            QVERIFY(stats.rowsInserted >= quint64(model.rowCount()));
+        }
+    }
+    QVERIFY(found);
+    QVERIFY(telemetry->report().contains(QLatin1String("transactions:")));
+
+    telemetry->reset();
+    QCOMPARE(telemetry->transactionStatistics().commits, quint64(0));
+    QVERIFY(telemetry->modelStatistics().isEmpty());
+
+    Telemetry::setEnabled(false);
+}
+
 void EventModelTest::cleanupTestCase()
 {
     deleteAll();
@@ -34,6 +34,7 @@ private slots:
     void initTestCase();
     void testAddEvent();
     void testAddEvents();
+    void testAddEventsBatch();
     void testModifyEvent();
     void testDeleteEvent();
     void testDeleteEventVCard_data();
@@ -59,10 +60,23 @@ private slots:
     void testContactMatching();
     void testAddNonDigitRemoteId_data();
     void testAddNonDigitRemoteId();
+    void testBatchedUpdates();
+    void testCompactSerialization();
+    void testMergedCommits();
+    void testParallelDecoding();
+    void testSharedQueries();
+    void testTelemetry();
     void cleanupTestCase();
 
     void groupsUpdatedSlot(const QList<int> &groupIds);
     void groupsDeletedSlot(const QList<int> &groupIds);
+    void updatesBatchedSlot(const QList<CommHistory::Event> &addedEvents,
+                            const QList<CommHistory::Event> &updatedEvents,
+                            const QList<int> &deletedEventIds,
+                            const QList<CommHistory::Group> &addedGroups,
+                            const QList<int> &updatedGroupIds,
+                            const QList<CommHistory::Group> &updatedGroups,
+                            const QList<int> &deletedGroupIds);
 };
 
 #endif
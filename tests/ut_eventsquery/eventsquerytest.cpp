@@ -155,4 +155,35 @@ void EventsQueryTest::contact()
     QVERIFY(!result->hasError());
 }
 
+void EventsQueryTest::bindings()
+{
+    Event::PropertySet props;
+    props << Event::StartTime;
+
+    EventsQuery q1(props);
+    q1.addPattern("%1 nmo:messageId ?:token .").variable(Event::Id);
+    q1.bindValue("token", QString("first"));
+
+    EventsQuery q2(props);
+    q2.addPattern("%1 nmo:messageId ?:token .").variable(Event::Id);
+    q2.bindValue("token", QString("second \"quoted\""));
+
+    QString query1 = q1.query();
+    QString query2 = q2.query();
+    qDebug() << query1 << query2;
+
+    QVERIFY(!query1.contains("?:token"));
+    QVERIFY(query1.contains("\"first\""));
+    QVERIFY(query2.contains("\"second \\\"quoted\\\"\""));
+    QCOMPARE(q1.eventProperties(), q2.eventProperties());
+
+    // same shape, only the bound values differ
+    QCOMPARE(QString(query1).replace("\"first\"", "X"),
+             QString(query2).replace("\"second \\\"quoted\\\"\"", "X"));
+
+    QScopedPointer<QSparqlResult> result(conn->exec(QSparqlQuery(query2)));
+    result->waitForFinished();
+    QVERIFY(!result->hasError());
+}
+
 QTEST_MAIN(EventsQueryTest)
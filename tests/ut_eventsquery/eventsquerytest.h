@@ -20,6 +20,7 @@ private slots:
     void tofrom();
     void distinct();
     void contact();
+    void bindings();
 
 private:
     QSparqlConnection *conn;
@@ -0,0 +1,65 @@
+#include <QtTest/QtTest>
+
+#include "groupmanagertest.h"
+#include "groupmanager.h"
+#include "groupobject.h"
+#include "eventmodel.h"
+#include "event.h"
+#include "common.h"
+
+using namespace CommHistory;
+
+namespace {
+
+const QString ringAccount("/org/freedesktop/Telepathy/Account/ring/tel/ring");
+
+}
+
+void GroupManagerTest::initTestCase()
+{
+    deleteAll();
+}
+
+void GroupManagerTest::findGroup()
+{
+    Group group;
+    addTestGroup(group, ringAccount, "0401234567");
+
+    GroupManager manager;
+    manager.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(manager.getGroups());
+
+    GroupObject *go = manager.group(group.id());
+    QVERIFY(go);
+    QCOMPARE(manager.findGroup(ringAccount, "0401234567"), go);
+    QVERIFY(!manager.findGroup(ringAccount, "+358409876543"));
+
+    QSignalSpy groupUpdated(&manager, SIGNAL(groupUpdated(GroupObject*)));
+    EventModel model;
+
+    // the same number in international format replaces the uid
+    QVERIFY(addTestEvent(model, Event::SMSEvent, Event::Inbound, ringAccount,
+                         group.id(), "rewrite", false, false,
+                         QDateTime::currentDateTime(), "+358401234567") != -1);
+    QVERIFY(waitSignal(groupUpdated));
+    QCOMPARE(go->remoteUids(), QStringList() << "+358401234567");
+    QCOMPARE(manager.findGroup(ringAccount, "+358401234567"), go);
+    QCOMPARE(manager.findGroup(ringAccount, "0401234567"), go);
+
+    // a second number makes it a group findGroup() does not match
+    groupUpdated.clear();
+    QVERIFY(addTestEvent(model, Event::SMSEvent, Event::Inbound, ringAccount,
+                         group.id(), "append", false, false,
+                         QDateTime::currentDateTime(), "+358409876543") != -1);
+    QVERIFY(waitSignal(groupUpdated));
+    QCOMPARE(go->remoteUids().size(), 2);
+    QVERIFY(!manager.findGroup(ringAccount, "+358401234567"));
+    QVERIFY(!manager.findGroup(ringAccount, "+358409876543"));
+}
+
+void GroupManagerTest::cleanupTestCase()
+{
+    deleteAll();
+}
+
+QTEST_MAIN(GroupManagerTest)
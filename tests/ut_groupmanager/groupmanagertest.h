@@ -0,0 +1,16 @@
+#ifndef GROUPMANAGERTEST_H
+#define GROUPMANAGERTEST_H
+
+#include <QObject>
+
+class GroupManagerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void findGroup();
+    void cleanupTestCase();
+};
+
+#endif
@@ -955,6 +955,95 @@ void GroupModelTest::markGroupAsRead()
     QCOMPARE(testGroup.unreadMessages(),0);
 }
 
+void GroupModelTest::groupCounters()
+{
+    EventModel eventModel;
+    GroupModel groupModel;
+    groupModel.enableContactChanges(false);
+    Group group;
+    addTestGroup(group, ACCOUNT2, QString("counters@localhost"));
+
+    QSignalSpy eventsCommitted(&eventModel, SIGNAL(eventsCommitted(const QList<CommHistory::Event>&, bool)));
+    int eventId1 = addTestEvent(eventModel, Event::IMEvent, Event::Inbound, ACCOUNT2, group.id(), "Counters test 1");
+    QVERIFY(waitSignal(eventsCommitted));
+    eventsCommitted.clear();
+    addTestEvent(eventModel, Event::IMEvent, Event::Inbound, ACCOUNT2, group.id(), "Counters test 2");
+    QVERIFY(waitSignal(eventsCommitted));
+    eventsCommitted.clear();
+    int eventId3 = addTestEvent(eventModel, Event::IMEvent, Event::Inbound, ACCOUNT2, group.id(), "Counters test 3");
+    QVERIFY(waitSignal(eventsCommitted));
+    eventsCommitted.clear();
+
+    Group testGroup;
+    QVERIFY(groupModel.trackerIO().getGroup(group.id(), testGroup));
+    QCOMPARE(testGroup.totalMessages(), 3);
+    QCOMPARE(testGroup.unreadMessages(), 3);
+
+    Event event;
+    QVERIFY(groupModel.trackerIO().getEvent(eventId1, event));
+    event.setIsRead(true);
+    QVERIFY(eventModel.modifyEvent(event));
+    QVERIFY(waitSignal(eventsCommitted));
+    eventsCommitted.clear();
+
+    QVERIFY(groupModel.trackerIO().getGroup(group.id(), testGroup));
+    QCOMPARE(testGroup.totalMessages(), 3);
+    QCOMPARE(testGroup.unreadMessages(), 2);
+
+    QVERIFY(groupModel.trackerIO().getEvent(eventId3, event));
+    QVERIFY(eventModel.deleteEvent(event));
+    QVERIFY(waitSignal(eventsCommitted));
+    eventsCommitted.clear();
+
+    QVERIFY(groupModel.trackerIO().getGroup(group.id(), testGroup));
+    QCOMPARE(testGroup.totalMessages(), 2);
+    QCOMPARE(testGroup.unreadMessages(), 1);
+
+    // drafts are counted, as in the group query
+    int draftId = addTestEvent(eventModel, Event::IMEvent, Event::Outbound, ACCOUNT2,
+                               group.id(), "Counters draft", true);
+    QVERIFY(waitSignal(eventsCommitted));
+    eventsCommitted.clear();
+
+    QVERIFY(groupModel.trackerIO().getGroup(group.id(), testGroup));
+    QCOMPARE(testGroup.totalMessages(), 3);
+
+    QVERIFY(groupModel.trackerIO().getEvent(draftId, event));
+    event.setIsDraft(false);
+    event.setIsRead(true);
+    QVERIFY(eventModel.modifyEvent(event));
+    QVERIFY(waitSignal(eventsCommitted));
+    eventsCommitted.clear();
+
+    QVERIFY(groupModel.trackerIO().getGroup(group.id(), testGroup));
+    QCOMPARE(testGroup.totalMessages(), 3);
+    QCOMPARE(testGroup.unreadMessages(), 1);
+
+    // moving a message updates both channels
+    Group otherGroup;
+    addTestGroup(otherGroup, ACCOUNT2, QString("counters2@localhost"));
+    QVERIFY(groupModel.trackerIO().getEvent(draftId, event));
+    QVERIFY(groupModel.trackerIO().moveEvent(event, otherGroup.id()));
+
+    QVERIFY(groupModel.trackerIO().getGroup(group.id(), testGroup));
+    QCOMPARE(testGroup.totalMessages(), 2);
+    QVERIFY(groupModel.trackerIO().getGroup(otherGroup.id(), testGroup));
+    QCOMPARE(testGroup.totalMessages(), 1);
+
+    QVERIFY(groupModel.trackerIO().getGroup(group.id(), testGroup));
+    QCOMPARE(testGroup.totalMessages(), 2);
+    QCOMPARE(testGroup.unreadMessages(), 1);
+
+    // repair pass gives the same result
+    groupModel.trackerIO().transaction();
+    QVERIFY(groupModel.trackerIO().recalculateGroupCounters());
+    groupModel.trackerIO().commit(true);
+
+    QVERIFY(groupModel.trackerIO().getGroup(group.id(), testGroup));
+    QCOMPARE(testGroup.totalMessages(), 2);
+    QCOMPARE(testGroup.unreadMessages(), 1);
+}
+
 void GroupModelTest::resolveContact()
 {
     GroupModel groupModel;
@@ -56,6 +56,7 @@ private slots:
     void streamingQuery();
     void deleteMmsContent();
     void markGroupAsRead();
+    void groupCounters();
     void resolveContact();
     void queryContacts();
     void changeRemoteUid();
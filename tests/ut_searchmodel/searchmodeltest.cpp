@@ -0,0 +1,267 @@
+#include <QtTest/QtTest>
+
+#include "searchmodeltest.h"
+#include "searchmodel.h"
+#include "searchindex.h"
+#include "eventmodel.h"
+#include "event.h"
+#include "messagepart.h"
+#include "common.h"
+#include "trackerio.h"
+
+#include "modelwatcher.h"
+
+using namespace CommHistory;
+
+namespace {
+
+const QString account("/org/freedesktop/Telepathy/Account/gabble/jabber/dut_40localhost0");
+
+Group group1, group2;
+QEventLoop loop;
+
+ModelWatcher watcher;
+
+int addMessage(EventModel &model, const QString &text,
+               int groupId = group1.id(),
+               const QString &remoteUid = QString("td@localhost"),
+               const QDateTime &when = QDateTime::currentDateTime())
+{
+    int id = addTestEvent(model, Event::IMEvent, Event::Inbound, account,
+                          groupId, text, false, false, when, remoteUid);
+    watcher.waitForSignals();
+    // the index is updated when the transaction finishes
+    QTest::qWait(100);
+    return id;
+}
+
+QList<int> matchIds(const QList<SearchIndex::Match> &matches)
+{
+    QList<int> ids;
+    foreach (const SearchIndex::Match &match, matches)
+        ids << match.eventId;
+    return ids;
+}
+
+}
+
+void SearchModelTest::initTestCase()
+{
+    deleteAll();
+
+    watcher.setLoop(&loop);
+
+    addTestGroups(group1, group2);
+
+    QVERIFY(SearchIndex::instance()->load());
+    QCOMPARE(SearchIndex::instance()->messageCount(), 0);
+}
+
+void SearchModelTest::tokenize_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<QStringList>("tokens");
+
+    QTest::newRow("empty") << QString() << QStringList();
+    QTest::newRow("punctuation") << QString("Hello, World!")
+                                 << (QStringList() << "hello" << "world");
+    QTest::newRow("digits") << QString("a1b2 3.14")
+                            << (QStringList() << "a1b2" << "3" << "14");
+    QTest::newRow("diacritics") << QString::fromUtf8("Ärger über Café")
+                                << (QStringList() << "arger" << "uber" << "cafe");
+    QTest::newRow("decomposed") << QString::fromUtf8("Cafe\xcc\x81 bar")
+                                << (QStringList() << "cafe" << "bar");
+    QTest::newRow("long") << QString(40, QChar('x'))
+                          << (QStringList() << QString(32, QChar('x')));
+}
+
+void SearchModelTest::tokenize()
+{
+    QFETCH(QString, text);
+    QFETCH(QStringList, tokens);
+
+    QCOMPARE(SearchIndex::tokenize(text), tokens);
+}
+
+void SearchModelTest::ranking()
+{
+    EventModel model;
+    watcher.setModel(&model);
+
+    QDateTime now = QDateTime::currentDateTime();
+    int once = addMessage(model, "apple pie", group1.id(), "td@localhost", now.addSecs(-10));
+    int twice = addMessage(model, "apple and apple juice", group1.id(), "td@localhost", now.addSecs(-20));
+    int newer = addMessage(model, "Apple pie", group1.id(), "td@localhost", now);
+    QVERIFY(once != -1 && twice != -1 && newer != -1);
+
+    SearchIndex *index = SearchIndex::instance();
+    int total = 0;
+    QList<SearchIndex::Match> matches = index->search("apple ", -1, QStringList(), 0, 0, &total);
+    QCOMPARE(total, 3);
+    QCOMPARE(matchIds(matches), QList<int>() << twice << newer << once);
+
+    // all words have to match
+    matches = index->search("apple juice ", -1, QStringList(), 0, 0, &total);
+    QCOMPARE(total, 1);
+    QCOMPARE(matchIds(matches), QList<int>() << twice);
+
+    matches = index->search("apple banana ");
+    QVERIFY(matches.isEmpty());
+}
+
+void SearchModelTest::prefix()
+{
+    SearchIndex *index = SearchIndex::instance();
+
+    // the last word is a prefix while it is being typed
+    QCOMPARE(index->search("app").size(), 3);
+    QCOMPARE(index->search("apple ju").size(), 1);
+    QCOMPARE(index->search("app ").size(), 0);
+    QCOMPARE(index->search("ju apple").size(), 0);
+    QCOMPARE(index->search(QString::fromUtf8("APPLÉ")).size(), 3);
+
+    // a single letter is a whole word, not the start of every word
+    int total = -1;
+    QVERIFY(index->search("a", -1, QStringList(), 0, 0, &total).isEmpty());
+    QCOMPARE(total, 0);
+    QCOMPARE(index->search("ap").size(), 3);
+}
+
+void SearchModelTest::filters()
+{
+    EventModel model;
+    watcher.setModel(&model);
+
+    int other = addMessage(model, "apple tree", group2.id(), "td2@localhost");
+    QVERIFY(other != -1);
+
+    SearchIndex *index = SearchIndex::instance();
+    QCOMPARE(index->search("apple").size(), 4);
+
+    QList<SearchIndex::Match> matches = index->search("apple", group2.id());
+    QCOMPARE(matchIds(matches), QList<int>() << other);
+    QCOMPARE(matches.first().groupId, group2.id());
+
+    matches = index->search("apple", -1, QStringList() << "td2@localhost");
+    QCOMPARE(matchIds(matches), QList<int>() << other);
+
+    matches = index->search("apple", group1.id(), QStringList() << "td2@localhost");
+    QVERIFY(matches.isEmpty());
+}
+
+void SearchModelTest::updates()
+{
+    EventModel model;
+    watcher.setModel(&model);
+
+    int id = addMessage(model, "orange");
+    QVERIFY(id != -1);
+
+    SearchIndex *index = SearchIndex::instance();
+    QCOMPARE(matchIds(index->search("orange")), QList<int>() << id);
+
+    Event event;
+    QVERIFY(model.trackerIO().getEvent(id, event));
+    event.setFreeText("lemon");
+    QVERIFY(model.modifyEvent(event));
+    watcher.waitForSignals();
+    QTest::qWait(100);
+
+    QVERIFY(index->search("orange").isEmpty());
+    QCOMPARE(matchIds(index->search("lemon")), QList<int>() << id);
+
+    QVERIFY(model.deleteEvent(event));
+    watcher.waitForSignals();
+    QTest::qWait(100);
+
+    QVERIFY(index->search("lemon").isEmpty());
+
+    // an update only replaces the text properties it carries, the
+    // others are read back from tracker
+    MessagePart part;
+    part.setContentId("text_slide1");
+    part.setContentType("text/plain;charset=utf-8");
+    part.setPlainTextContent("kiwi");
+    Event mms;
+    mms.setType(Event::MMSEvent);
+    mms.setDirection(Event::Inbound);
+    mms.setGroupId(group1.id());
+    mms.setStartTime(QDateTime::currentDateTime());
+    mms.setEndTime(QDateTime::currentDateTime());
+    mms.setLocalUid(RING_ACCOUNT);
+    mms.setRemoteUid("+358501234567");
+    mms.setMessageToken("searchmodeltest-mms");
+    mms.setSubject("melon");
+    mms.setMessageParts(QList<MessagePart>() << part);
+    QVERIFY(model.addEvent(mms));
+    watcher.waitForSignals();
+    QTest::qWait(100);
+    QCOMPARE(matchIds(index->search("kiwi melon")), QList<int>() << mms.id());
+
+    Event subject;
+    subject.setId(mms.id());
+    subject.setSubject("grape");
+    index->updateEvents(QList<Event>() << subject);
+    QVERIFY(index->search("melon").isEmpty());
+    QCOMPARE(matchIds(index->search("kiwi grape")), QList<int>() << mms.id());
+
+    QVERIFY(model.deleteEvent(mms));
+    watcher.waitForSignals();
+    QTest::qWait(100);
+    QVERIFY(index->search("kiwi").isEmpty());
+}
+
+void SearchModelTest::searchModel()
+{
+    SearchModel model;
+    watcher.setModel(&model);
+
+    QVERIFY(model.search("apple ju"));
+    QVERIFY(watcher.waitForModelReady());
+    QCOMPARE(model.rowCount(), 1);
+    QCOMPARE(model.totalMatches(), 1);
+    QCOMPARE(model.event(model.index(0, 0)).freeText(), QString("apple and apple juice"));
+
+    model.setGroupFilter(group2.id());
+    QVERIFY(model.search("apple"));
+    QVERIFY(watcher.waitForModelReady());
+    QCOMPARE(model.rowCount(), 1);
+    QCOMPARE(model.event(model.index(0, 0)).groupId(), group2.id());
+
+    model.setGroupFilter(-1);
+    QVERIFY(model.search("nothing"));
+    QVERIFY(watcher.waitForModelReady());
+    QCOMPARE(model.rowCount(), 0);
+    QVERIFY(!model.hasMorePages());
+}
+
+void SearchModelTest::paging()
+{
+    SearchModel model;
+    watcher.setModel(&model);
+    model.setPageSize(3);
+
+    QVERIFY(model.search("apple"));
+    QVERIFY(watcher.waitForModelReady());
+    QCOMPARE(model.totalMatches(), 4);
+    QCOMPARE(model.rowCount(), 3);
+    QVERIFY(model.hasMorePages());
+
+    QList<int> expected = matchIds(SearchIndex::instance()->search("apple"));
+    QVERIFY(model.fetchNextPage());
+    QVERIFY(watcher.waitForModelReady());
+    QCOMPARE(model.rowCount(), 4);
+    QVERIFY(!model.hasMorePages());
+    QVERIFY(!model.fetchNextPage());
+
+    // rows are in rank order, whatever order tracker returned them in
+    for (int row = 0; row < model.rowCount(); row++)
+        QCOMPARE(model.event(model.index(row, 0)).id(), expected.at(row));
+}
+
+void SearchModelTest::cleanupTestCase()
+{
+    deleteAll();
+}
+
+QTEST_MAIN(SearchModelTest)
@@ -0,0 +1,23 @@
+#ifndef SEARCHMODELTEST_H
+#define SEARCHMODELTEST_H
+
+#include <QObject>
+
+class SearchModelTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void tokenize_data();
+    void tokenize();
+    void ranking();
+    void prefix();
+    void filters();
+    void updates();
+    void searchModel();
+    void paging();
+    void cleanupTestCase();
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include <QtTest/QtTest>
+#include <QSparqlBinding>
+
+#include "updatequerytest.h"
+#include "updatequery.h"
+
+using namespace CommHistory;
+
+namespace {
+
+const QUrl subjectA("urn:a");
+const QUrl subjectB("urn:b");
+const QUrl subjectC("urn:c");
+
+}
+
+void UpdateQueryTest::escaping_data()
+{
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("plain") << QString("hello");
+    QTest::newRow("backslash") << QString("a\\b\\");
+    QTest::newRow("quotes") << QString("say \"hi\" 'there'");
+    QTest::newRow("newline") << QString("one\ntwo");
+    QTest::newRow("carriage return") << QString("one\r\ntwo");
+    QTest::newRow("tab") << QString("a\tb");
+    QTest::newRow("non-ascii") << QString::fromUtf8("Ärger über € \xe2\x80\x8f");
+    QTest::newRow("empty") << QString("");
+}
+
+void UpdateQueryTest::escaping()
+{
+    QFETCH(QString, text);
+
+    QSparqlBinding binding;
+    binding.setValue(text);
+
+    UpdateQuery query;
+    query.insertion(subjectA, "nie:title", text);
+    QCOMPARE(query.query(),
+             QString("INSERT OR REPLACE { <urn:a> nie:title %1 . } ")
+             .arg(binding.toString()));
+}
+
+void UpdateQueryTest::mergeSubjects()
+{
+    UpdateQuery query;
+    query.deletion(subjectA, "nmo:isRead");
+    query.insertion(subjectA, "nie:title", QString("1"));
+    query.insertion(subjectA, "nmo:isRead", true);
+    query.insertion(subjectB, "nie:title", QString("2"));
+    query.insertion(subjectA, "nmo:isDraft", false);
+    query.appendInsertion("INSERT { <urn:c> a nmo:Message }");
+
+    QCOMPARE(query.query(),
+             QString("DELETE { <urn:a> nmo:isRead ?_0 } WHERE { <urn:a> nmo:isRead ?_0 } "
+                     "INSERT OR REPLACE { "
+                     "<urn:a> nie:title \"1\"; nmo:isRead true . "
+                     "<urn:b> nie:title \"2\" . "
+                     "<urn:a> nmo:isDraft false . } "
+                     "INSERT { <urn:c> a nmo:Message } "));
+}
+
+void UpdateQueryTest::splitAtSubjects()
+{
+    UpdateQuery query;
+    query.setSizeLimit(10);
+    QCOMPARE(query.sizeLimit(), 10);
+
+    // the limit is passed within the first subject, which stays whole
+    query.insertion(subjectA, "nie:title", QString("1"));
+    query.insertion(subjectA, "nie:comment", QString("2"));
+    query.insertion(subjectB, "nie:title", QString("3"));
+    query.insertion(subjectC, "nie:title", QString("4"));
+
+    QCOMPARE(query.query(),
+             QString("INSERT OR REPLACE { <urn:a> nie:title \"1\"; nie:comment \"2\" . } "
+                     "INSERT OR REPLACE { <urn:b> nie:title \"3\" . } "
+                     "INSERT OR REPLACE { <urn:c> nie:title \"4\" . } "));
+
+    UpdateQuery unlimited;
+    unlimited.setSizeLimit(0);
+    unlimited.insertion(subjectA, "nie:title", QString("1"));
+    unlimited.insertion(subjectB, "nie:title", QString("2"));
+    QCOMPARE(unlimited.query().count("INSERT OR REPLACE"), 1);
+}
+
+void UpdateQueryTest::noSplitWithBlankNodes()
+{
+    // blank node labels are scoped to one statement
+    UpdateQuery object;
+    object.setSizeLimit(10);
+    object.insertion(subjectA, "nie:title", QString("1"));
+    object.insertion(subjectB, "nmo:hasPart", QUrl("_:part"));
+    object.insertion(QUrl("_:part"), "nie:title", QString("2"));
+    object.insertion(subjectC, "nie:title", QString("3"));
+
+    QCOMPARE(object.query(),
+             QString("INSERT OR REPLACE { <urn:a> nie:title \"1\" . "
+                     "<urn:b> nmo:hasPart _:part . "
+                     "_:part nie:title \"2\" . "
+                     "<urn:c> nie:title \"3\" . } "));
+
+    UpdateQuery subject;
+    subject.setSizeLimit(10);
+    subject.insertion(QUrl("_:part"), "nie:title", QString("1"));
+    subject.insertion(subjectA, "nmo:hasPart", QUrl("_:part"));
+    subject.insertion(subjectB, "nie:title", QString("2"));
+    QCOMPARE(subject.query().count("INSERT OR REPLACE"), 1);
+
+    UpdateQuery raw;
+    raw.setSizeLimit(10);
+    raw.insertion("_:part a nmo:Attachment .");
+    raw.insertion(subjectA, "nmo:hasPart", QUrl("_:part"));
+    raw.insertion(subjectB, "nie:title", QString("2"));
+    QCOMPARE(raw.query().count("INSERT OR REPLACE"), 1);
+}
+
+void UpdateQueryTest::rawStatementsFirst()
+{
+    const QString channel("GRAPH <urn:g> { <urn:b> a nmo:CommunicationChannel }");
+
+    UpdateQuery query;
+    query.insertion(subjectA, "nie:title", QString("1"));
+    query.insertion(channel);
+    query.insertion(subjectB, "nie:title", QString("2"));
+
+    QCOMPARE(query.query(),
+             QString("INSERT OR REPLACE { %1 "
+                     "<urn:a> nie:title \"1\" . "
+                     "<urn:b> nie:title \"2\" . } ").arg(channel));
+
+    // after a split, first in the statement that was open
+    UpdateQuery split;
+    split.setSizeLimit(10);
+    split.insertion(subjectA, "nie:title", QString("1"));
+    split.insertion(subjectB, "nie:title", QString("2"));
+    split.insertion(channel);
+    split.insertion(subjectB, "nie:comment", QString("3"));
+    split.insertion(subjectC, "nie:title", QString("4"));
+
+    QCOMPARE(split.query(),
+             QString("INSERT OR REPLACE { <urn:a> nie:title \"1\" . } "
+                     "INSERT OR REPLACE { %1 <urn:b> nie:title \"2\"; nie:comment \"3\" . } "
+                     "INSERT OR REPLACE { <urn:c> nie:title \"4\" . } ").arg(channel));
+}
+
+QTEST_MAIN(UpdateQueryTest)
@@ -0,0 +1,19 @@
+#ifndef UPDATEQUERYTEST_H
+#define UPDATEQUERYTEST_H
+
+#include <QObject>
+
+class UpdateQueryTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void escaping_data();
+    void escaping();
+    void mergeSubjects();
+    void splitAtSubjects();
+    void noSplitWithBlankNodes();
+    void rawStatementsFirst();
+};
+
+#endif
@@ -48,6 +48,10 @@ public:
                 this, SLOT(groupsCommittedSlot(QList<int>,bool)));
     };
 
+    // for transactions committed through TrackerIO, which call
+    // eventsCommittedSlot() directly (see CommittingTransaction::addSignal())
+    Catcher() : count(0) {};
+
     void waitCommit(int numEvents = 1) {
         count = 0;
         stop = false;
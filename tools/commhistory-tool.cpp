@@ -21,9 +21,11 @@
 ******************************************************************************/
 
 #include <iostream>
+#include <cmath>
 #include <QtCore>
 #include <QDebug>
 #include <QUuid>
+#include <QtDBus/QtDBus>
 
 #include "../src/groupmodel.h"
 #include "../src/conversationmodel.h"
@@ -33,6 +35,8 @@
 #include "../src/callevent.h"
 #include "../src/group.h"
 #include "../src/trackerio.h"
+#include "../src/committingtransaction.h"
+#include "../src/constants.h"
 
 #include <QSparqlConnection>
 #include <QSparqlResult>
@@ -90,6 +94,12 @@ const int numMmsSubjects = 10;
 #define MMS_ACCOUNT  TELEPATHY_ACCOUNT_PREFIX + TELEPATHY_MMS_ACCOUNT_POSTFIX
 #define RING_ACCOUNT TELEPATHY_ACCOUNT_PREFIX + TELEPATHY_RING_ACCOUNT_POSTFIX
 
+#define TELEMETRY_INTERFACE QLatin1String("com.nokia.commhistory.Telemetry")
+// per process, the bus is asked about every client
+#define TELEMETRY_TIMEOUT   2000
+
+#define GENERATED_IM_ACCOUNT TELEPATHY_ACCOUNT_PREFIX + QLatin1String("gabble/jabber/generated0")
+
 QStringList optionsWithArguments;
 
 QVariantMap parseOptions(QStringList &arguments)
@@ -141,13 +151,19 @@ void printUsage()
     std::cout << "                 deletegroup group-id"                                                                                                   << std::endl;
     std::cout << "                 deleteall"                                                                                                              << std::endl;
     std::cout << "                 markallcallsread"                                                                                                       << std::endl;
+    std::cout << "                 recountgroups"                                                                                                          << std::endl;
     std::cout << "                 export [-group group-id] [-calls] [-groups] filename"
                                     << std::endl;
     std::cout << "                 import filename"
                                     << std::endl;
+    std::cout << "                 generate [-n number-of-events] [-seed seed] [-contacts number-of-contacts] [-years years] [-batch events-per-transaction]" << std::endl;
+    std::cout << "                 stats [-v] [-reset] [service]"                                                                                          << std::endl;
     std::cout << "When adding new events, the default count is 1."                                                                                         << std::endl;
     std::cout << "When adding new events, the given local-ui is ignored, if -sms or -mms specified."                                                       << std::endl;
     std::cout << "New events are of IM type and have random contents."                                                                                     << std::endl;
+    std::cout << "generate adds calls and SMS, MMS and IM conversations with contacts picked"                                                              << std::endl;
+    std::cout << "by a Zipf distribution. The same seed gives the same data (default 1)."                                                                  << std::endl;
+    std::cout << "stats reads processes running with COMMHISTORY_TELEMETRY=dbus."                                                                          << std::endl;
 }
 
 int doAdd(const QStringList &arguments, const QVariantMap &options)
@@ -891,6 +907,24 @@ int doMarkAllCallsRead(const QStringList &arguments, const QVariantMap &options)
     return 0;
 }
 
+int doRecountGroups(const QStringList &arguments, const QVariantMap &options)
+{
+    Q_UNUSED(arguments);
+    Q_UNUSED(options);
+
+    TrackerIO *tracker = TrackerIO::instance();
+    tracker->transaction();
+    if (!tracker->recalculateGroupCounters()) {
+        tracker->rollback();
+        qCritical() << "Error recalculating group counters.";
+        return -1;
+    }
+
+    tracker->commit(true);
+
+    return 0;
+}
+
 bool exportGroup(QDataStream &out, const Group &group)
 {
     ConversationModel model;
@@ -1071,12 +1105,312 @@ int doImport(const QStringList &arguments, const QVariantMap &options)
     return 0;
 }
 
+// xorshift; unlike qrand() the sequence of a seed is the same everywhere
+class Random
+{
+public:
+    Random(quint32 seed) : m_state(seed ? seed : 1) {}
+
+    quint32 next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    int below(int n) { return next() % n; }
+    bool chance(int percent) { return below(100) < percent; }
+    double uniform() { return next() / 4294967296.0; }
+    // exponentially distributed with the given mean
+    double exponential(double mean) { return -mean * log(1.0 - uniform()); }
+
+private:
+    quint32 m_state;
+};
+
+// contacts in order of popularity, weight of the k:th is 1/k
+class ZipfContacts
+{
+public:
+    ZipfContacts(int count) {
+        double total = 0;
+        m_cumulative.reserve(count);
+        for (int k = 1; k <= count; k++) {
+            total += 1.0 / k;
+            m_cumulative.append(total);
+        }
+    }
+
+    int pick(Random &random) const {
+        double u = random.uniform() * m_cumulative.last();
+        return qLowerBound(m_cumulative.begin(), m_cumulative.end(), u)
+            - m_cumulative.begin();
+    }
+
+    static QString phoneNumber(int contact) {
+        return QString("+35840%1").arg(1000000 + contact);
+    }
+
+    static QString imAddress(int contact) {
+        return QString("contact%1@example.com").arg(contact);
+    }
+
+private:
+    QVector<double> m_cumulative;
+};
+
+bool commitGenerated(TrackerIO *tracker, const QList<Event> &events)
+{
+    CommittingTransaction *t = tracker->commit();
+    if (!t)
+        return false;
+
+    Catcher c;
+    t->addSignal(false, &c, "eventsCommittedSlot",
+                 Q_ARG(QList<CommHistory::Event>, events), Q_ARG(bool, true));
+    t->addSignal(true, &c, "eventsCommittedSlot",
+                 Q_ARG(QList<CommHistory::Event>, events), Q_ARG(bool, false));
+    c.waitCommit(events.count());
+
+    return c.ok;
+}
+
+int doGenerate(const QStringList &arguments, const QVariantMap &options)
+{
+    Q_UNUSED(arguments);
+
+    int count = options.value("-n", 10000).toInt();
+    int numContacts = options.value("-contacts", 500).toInt();
+    int years = options.value("-years", 3).toInt();
+    int batchSize = options.value("-batch", 1000).toInt();
+    quint32 seed = options.value("-seed", 1).toUInt();
+    if (count <= 0 || numContacts <= 0 || years <= 0 || batchSize <= 0) {
+        qCritical() << "Invalid option value";
+        return -1;
+    }
+
+    qRegisterMetaType<QList<CommHistory::Event> >();
+
+    Random random(seed);
+    ZipfContacts contacts(numContacts);
+    TrackerIO *tracker = TrackerIO::instance();
+
+    // everything ends before now, the oldest conversations start years ago
+    QDateTime now = QDateTime::currentDateTime();
+    uint newest = now.toTime_t();
+    uint span = uint(years) * 365 * 24 * 3600;
+
+    QHash<QString, int> groups; // by local uid and remote uid
+    int generated = 0;
+    int calls = 0, sms = 0, mms = 0, im = 0;
+
+    QTime total;
+    total.start();
+    QTime batchTime;
+    batchTime.start();
+
+    QList<Event> batch;
+    tracker->transaction();
+
+    while (generated < count) {
+        int contact = contacts.pick(random);
+        int kind = random.below(100);
+
+        // calls 35%, SMS 45%, MMS 5%, IM 15%
+        Event::EventType type = Event::CallEvent;
+        QString localUid = RING_ACCOUNT;
+        QString remoteUid = ZipfContacts::phoneNumber(contact);
+        if (kind >= 35 && kind < 80) {
+            type = Event::SMSEvent;
+        } else if (kind >= 80 && kind < 85) {
+            type = Event::MMSEvent;
+            localUid = MMS_ACCOUNT;
+        } else if (kind >= 85) {
+            type = Event::IMEvent;
+            localUid = GENERATED_IM_ACCOUNT;
+            remoteUid = ZipfContacts::imAddress(contact);
+        }
+
+        // conversations are a few messages on average, with a long tail;
+        // calls mostly come alone
+        int length = 1;
+        int more = type == Event::CallEvent ? 30 : 85;
+        while (length < 200 && random.chance(more))
+            length++;
+        length = qMin(length, count - generated);
+
+        int groupId = -1;
+        if (type != Event::CallEvent) {
+            QString key = localUid + QLatin1Char('\n') + remoteUid;
+            groupId = groups.value(key, -1);
+            if (groupId < 0) {
+                Group group;
+                group.setLocalUid(localUid);
+                group.setRemoteUids(QStringList() << remoteUid);
+                if (!tracker->addGroup(group)) {
+                    qCritical() << "Error adding group";
+                    tracker->rollback();
+                    return -1;
+                }
+                groupId = group.id();
+                groups.insert(key, groupId);
+            }
+        }
+
+        uint time = newest - uint(random.uniform() * span);
+        for (int i = 0; i < length; i++) {
+            Event e;
+            e.setType(type);
+            e.setLocalUid(localUid);
+            e.setRemoteUid(remoteUid);
+            e.setGroupId(groupId);
+            e.setDirection(random.chance(50) ? Event::Inbound : Event::Outbound);
+
+            QDateTime startTime = QDateTime::fromTime_t(time);
+            e.setStartTime(startTime);
+            e.setEndTime(startTime);
+
+            if (type == Event::CallEvent) {
+                bool missed = e.direction() == Event::Inbound && random.chance(20);
+                e.setIsMissedCall(missed);
+                if (!missed)
+                    e.setEndTime(startTime.addSecs(int(random.exponential(120))));
+                e.setIsRead(!missed || time < newest - 24 * 3600);
+                calls++;
+            } else {
+                QString text = textContent[random.below(numTextContents)];
+                for (int j = random.below(3); j > 0; j--) {
+                    text += QLatin1Char(' ');
+                    text += QLatin1String(textContent[random.below(numTextContents)]);
+                }
+
+                if (type == Event::MMSEvent) {
+                    e.setSubject(mmsSubject[random.below(numMmsSubjects)]);
+                    MessagePart part;
+                    part.setContentId("text_slide1");
+                    part.setContentType("text/plain");
+                    part.setPlainTextContent(text);
+                    e.setMessageParts(QList<MessagePart>() << part);
+                    mms++;
+                } else {
+                    e.setFreeText(text);
+                    if (type == Event::SMSEvent)
+                        sms++;
+                    else
+                        im++;
+                }
+
+                if (type != Event::IMEvent)
+                    e.setMessageToken(QString("generated-%1-%2").arg(seed).arg(generated + i));
+                if (e.direction() == Event::Outbound)
+                    e.setStatus(Event::SentStatus);
+                e.setIsRead(e.direction() == Event::Outbound
+                            || time < newest - 24 * 3600 || random.chance(50));
+            }
+
+            batch.append(e);
+            time = qMin(newest, time + 1 + uint(random.exponential(180)));
+        }
+        generated += length;
+
+        if (batch.size() >= batchSize || generated >= count) {
+            if (!tracker->addEvents(batch)) {
+                qCritical() << "Error adding events";
+                tracker->rollback();
+                return -1;
+            }
+            if (!commitGenerated(tracker, batch)) {
+                qCritical() << "Error committing events";
+                return -1;
+            }
+
+            int elapsed = qMax(batchTime.restart(), 1);
+            std::cout << generated << "/" << count << " events, "
+                      << batch.size() * 1000 / elapsed << " events/s" << std::endl;
+
+            batch.clear();
+            if (generated < count)
+                tracker->transaction();
+        }
+    }
+
+    int elapsed = qMax(total.elapsed(), 1);
+    std::cout << "Generated " << generated << " events (" << calls << " calls, "
+              << sms << " SMS, " << mms << " MMS, " << im << " IM) in "
+              << groups.size() << " conversations with seed " << seed << ", "
+              << elapsed / 1000.0 << " s, "
+              << qint64(generated) * 1000 / elapsed << " events/s" << std::endl;
+
+    return 0;
+}
+
+int doStats(const QStringList &arguments, const QVariantMap &options)
+{
+    bool verbose = options.contains("-v");
+    bool reset = options.contains("-reset");
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    if (!bus.isConnected()) {
+        qCritical() << "Error connecting to session bus:" << bus.lastError();
+        return -1;
+    }
+
+    QStringList services;
+    if (arguments.count() > 2) {
+        services << arguments.at(2);
+    } else {
+        // every process exports the object under its unique name only
+        foreach (const QString &name, bus.interface()->registeredServiceNames().value()) {
+            if (name.startsWith(QLatin1Char(':')))
+                services << name;
+        }
+    }
+
+    int found = 0;
+    foreach (const QString &service, services) {
+        QDBusMessage call = QDBusMessage::createMethodCall(service,
+                                                          COMM_HISTORY_TELEMETRY_PATH,
+                                                          TELEMETRY_INTERFACE,
+                                                          QLatin1String("report"));
+        call << verbose;
+        QDBusMessage reply = bus.call(call, QDBus::Block, TELEMETRY_TIMEOUT);
+        if (reply.type() != QDBusMessage::ReplyMessage || reply.arguments().isEmpty()) {
+            if (arguments.count() > 2)
+                qCritical() << "Error reading statistics:" << reply.errorMessage();
+            continue;
+        }
+
+        found++;
+        std::cout << "== " << qPrintable(service)
+                  << " (pid " << bus.interface()->servicePid(service).value() << ")"
+                  << std::endl;
+        std::cout << qPrintable(reply.arguments().first().toString()) << std::endl;
+
+        if (reset) {
+            bus.call(QDBusMessage::createMethodCall(service,
+                                                    COMM_HISTORY_TELEMETRY_PATH,
+                                                    TELEMETRY_INTERFACE,
+                                                    QLatin1String("reset")),
+                     QDBus::Block, TELEMETRY_TIMEOUT);
+        }
+    }
+
+    if (!found) {
+        std::cout << "No process exports statistics, "
+                  << "run it with COMMHISTORY_TELEMETRY=dbus." << std::endl;
+        return arguments.count() > 2 ? -1 : 0;
+    }
+
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     try {
         QCoreApplication app(argc, argv);
 
-        optionsWithArguments << "-group" << "-startTime" << "-endTime" << "-n" << "-text";
+        optionsWithArguments << "-group" << "-startTime" << "-endTime" << "-n" << "-text"
+                             << "-seed" << "-contacts" << "-years" << "-batch";
 
         QStringList args = app.arguments();
         QVariantMap options = parseOptions(args);
@@ -1127,10 +1461,16 @@ int main(int argc, char **argv)
             return doDeleteAll(args, options);
         } else if (args.at(1) == "markallcallsread") {
             return doMarkAllCallsRead(args, options);
+        } else if (args.at(1) == "recountgroups") {
+            return doRecountGroups(args, options);
         } else if (args.at(1) == "export" && args.count() > 2) {
             return doExport(args, options);
         } else if (args.at(1) == "import") {
             return doImport(args, options);
+        } else if (args.at(1) == "generate") {
+            return doGenerate(args, options);
+        } else if (args.at(1) == "stats") {
+            return doStats(args, options);
         } else {
             printUsage();
         }